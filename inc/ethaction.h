@@ -0,0 +1,42 @@
+/*
+ * Coda delle azioni di un'interfaccia: conta solo l'ultimo stato
+ * richiesto. Una nuova richiesta rende obsoleta quella in corso, che se
+ * ne accorge ai punti di controllo (ethActionSuperseded, ethActionWait)
+ * e si interrompe; il lavoro riparte poi per lo stato piu` recente.
+ */
+#ifndef __ETHACTION_INCLUDED__
+#define __ETHACTION_INCLUDED__
+
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct s_action_queue;
+typedef void (*t_action_cb)(struct s_action_queue *q, int target, void *data);
+
+typedef struct s_action_queue {
+    t_evloop *loop;
+    int target;                 /* ultimo stato richiesto */
+    unsigned int gen;           /* incrementato a ogni richiesta */
+    unsigned int runGen;        /* richiesta servita dall'azione in corso */
+    int busy;                   /* azione in esecuzione */
+    int timerId;                /* avvio differito, 0 se non programmato */
+    int superseded;             /* azioni interrotte (statistica) */
+    t_action_cb run;
+    void *cbData;
+} t_action_queue;
+
+extern void ethActionInit(t_action_queue *q, t_evloop *loop, t_action_cb run,
+                          void *data);
+extern void ethActionSubmit(t_action_queue *q, int target);
+extern int ethActionSuperseded(const t_action_queue *q);
+extern int ethActionWait(t_action_queue *q, long ms);
+extern void ethActionCancel(t_action_queue *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,15 +6,10 @@
 
 #include "etherrors.h"
 
-#define ETHAPI_DEBUG
-
-#ifdef __arm__
-	/*
-	 * Su PC posso avere o non avere la simulazione ethernet. Su embedded
-	 * non ce l'ho __MAI__.
-	 */
-#undef  ETHAPI_DEBUG
-#endif
+/*
+ * La simulazione ethernet e` un backend scelto a runtime (ethbackend.h);
+ * compilando con -DETHAPI_DEBUG diventa quello di default.
+ */
 
 #ifdef __cplusplus
 extern "C" {
@@ -77,6 +72,7 @@ extern int ethGetLinkStatus(t_network_conf *conf);
 extern int ethConnect(t_network_conf *conf);
 extern int ethNTPConnect(t_network_conf *conf);
 extern int ethPingServer(const char *server);
+extern int ethGetDefaultGateway(t_network_conf *conf);
 extern int etherror;
 
 #ifdef __cplusplus
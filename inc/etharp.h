@@ -0,0 +1,48 @@
+/*
+ * Primitive ARP su packet socket (AF_PACKET) per la verifica rapida
+ * della raggiungibilita` del gateway a livello 2.
+ */
+#ifndef __ETHARP_INCLUDED__
+#define __ETHARP_INCLUDED__
+
+#include <netinet/in.h>
+#include "ethapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHARP_HWADDR_LEN     6
+#define ETHARP_RETRANS_MSECS  50  /* ritrasmissione della richiesta ARP */
+#define ETHARP_ANNOUNCE_NUM   2     /* RFC 5227 ANNOUNCE_NUM */
+#define ETHARP_ANNOUNCE_MSECS 2000  /* RFC 5227 ANNOUNCE_INTERVAL */
+#define ETHARP_RESOLVE_MAX    8     /* vicini risolti insieme */
+
+typedef struct {
+    int fd;
+    int ifindex;
+    unsigned char mac[ETHARP_HWADDR_LEN]; /* MAC dell'interfaccia */
+    struct in_addr addr;                  /* IPv4 dell'interfaccia (o 0.0.0.0) */
+    char deviceName[DEVICENAME_LEN];
+} t_arp_socket;
+
+extern int ethArpOpen(const char *device, t_arp_socket *as);
+extern void ethArpClose(t_arp_socket *as);
+extern int ethArpSend(t_arp_socket *as, const char *target,
+                      const unsigned char *targetMac);
+extern int ethArpRecv(t_arp_socket *as, const char *target,
+                      unsigned char *replyMac);
+extern int ethArpProbe(const char *device, const char *target,
+                       const unsigned char *targetMac,
+                       unsigned char *replyMac, int timeoutMs);
+extern int ethArpAnnounce(const char *device, const char *address);
+extern int ethArpResolve(const char *device, const char * const *targets,
+                         int nTargets, unsigned char (*macs)[ETHARP_HWADDR_LEN],
+                         int *resolved, int timeoutMs);
+extern void ethArpMacToString(const unsigned char *mac, char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Backend del livello kernel/helper: tutto cio` che il control plane
+ * chiede al sistema (comandi, letture di stato, DHCP, NTP, verifiche di
+ * connettivita`) passa da una tabella di operazioni. Il backend reale
+ * esegue davvero; quello simulato (ethsim) risponde da uno stato finto,
+ * con latenze e guasti configurabili.
+ */
+#ifndef __ETHBACKEND_INCLUDED__
+#define __ETHBACKEND_INCLUDED__
+
+#include "ethapi.h"
+#include "ethhealth.h"
+#include "ethnic.h"
+#include "ethqueue.h"
+#include "ethmtu.h"
+#include "ethtcp.h"
+#include "ethqdisc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Attributi di un device letti da ethapi */
+typedef enum {
+    ETHATTR_MAC = 0,
+    ETHATTR_IPV4,
+    ETHATTR_IPV6,
+    ETHATTR_GATEWAY,
+    ETHATTR_NETMASK,
+    ETHATTR_NTPSERVER,
+    ETHATTR_SPEED,          /* Mb/s, "-1" se il driver non la conosce */
+} t_eth_attr;
+
+typedef struct {
+    const char *name;
+    int real;       /* 0: route netlink e file di stato non vanno toccati */
+    /* comando di configurazione, come system() */
+    int (*command)(const char *cmdline);
+    /* avvio del client DHCP sul device: il lease arriva in background */
+    int (*dhcpStart)(const char *device);
+    /* default route via gateway (configurazione statica con un gateway) */
+    int (*defaultRoute)(const char *device, const char *gateway);
+    /* attributo del device in out; ETHNOERR, o errore se assente */
+    int (*readAttr)(const char *device, t_eth_attr attr, char *out, int len);
+    /* carrier del device: ETHSTATEUP / ETHSTATEDOWN, o errore */
+    int (*linkStatus)(const char *device);
+    /* riconnessione di ethConnect con il file di configurazione gia` scritto */
+    int (*connect)(t_network_conf *conf, const char *confFile);
+    /* scrive il server NTP nella configurazione e riavvia il servizio */
+    int (*ntpConfigure)(t_network_conf *conf);
+    /* verifica a strati (ethCheckHealth) */
+    int (*health)(const char *device, const char * const *gateways,
+                  int nGateways, const t_probe *probes, int nProbes,
+                  t_health_report *report);
+    /* ARP unicast verso un gateway noto (ethArpProbe) */
+    int (*arpProbe)(const char *device, const char *target,
+                    const unsigned char *targetMac, unsigned char *replyMac,
+                    int timeoutMs);
+    /* nameserver in /etc/resolv.conf */
+    int (*writeResolver)(const char *dns1, const char *dns2);
+    /* profilo della scheda (ethNicApply) */
+    int (*nicApply)(const char *device, const t_nic_profile *want,
+                    t_nic_profile *effective);
+    /* code e interrupt sui core (ethQueueApply) */
+    int (*queueApply)(const char *device, const t_cpuset *cpus,
+                      t_queue_report *report);
+    /* MTU del device (ethMtuSet) */
+    int (*mtuSet)(const char *device, int mtu);
+    /* path MTU verso target con echo DF (ethPmtuProbe) */
+    int (*pmtuProbe)(const char *device, const char *target, int maxMtu,
+                     int timeoutMs, t_pmtu_result *result);
+    /* buffer TCP dimensionati sul BDP (ethTcpBuffers) */
+    int (*tcpBuffers)(long bdp, t_tcp_buffers *result);
+    /* qdisc di root del device (ethQdiscApply) */
+    int (*qdiscApply)(const char *device, const t_qdisc_conf *q, long rateKbit);
+    /* contatori della qdisc di root (ethQdiscStats) */
+    int (*qdiscStats)(const char *device, t_qdisc_stats *stats);
+    /* annuncio ARP gratuito dell'indirizzo (ethArpAnnounce) */
+    int (*arpAnnounce)(const char *device, const char *address);
+    /* ARP broadcast in parallelo verso i vicini (ethArpResolve) */
+    int (*neighResolve)(const char *device, const char * const *targets,
+                        int nTargets, unsigned char (*macs)[ETHARP_HWADDR_LEN],
+                        int *resolved, int timeoutMs);
+    /* voce della tabella dei vicini (ethRouteNeighSet) */
+    int (*neighSet)(const char *device, const char *address,
+                    const unsigned char *mac, int permanent);
+    /* rimozione della voce PERMANENT (ethRouteNeighUnpin), 1 se c'era */
+    int (*neighUnpin)(const char *device, const char *address);
+    /* velocita`, duplex, autonegoziazione e lane negoziati (ethNicLinkMode) */
+    int (*linkMode)(const char *device, t_link_mode *mode);
+    /* riavvio dell'autonegoziazione (ethNicRenegotiate) */
+    int (*linkRenegotiate)(const char *device);
+} t_eth_backend;
+
+extern const t_eth_backend ethBackendReal;
+extern const t_eth_backend *ethBackend(void);
+extern void ethBackendSet(const t_eth_backend *backend);
+
+/* Implementazioni reali di ethapi usate da ethBackendReal */
+extern int ethRealCommand(const char *cmdline);
+extern int ethRealReadAttr(const char *device, t_eth_attr attr, char *out,
+                           int len);
+extern int ethRealLinkStatus(const char *device);
+extern int ethRealConnect(t_network_conf *conf, const char *confFile);
+extern int ethRealNtpConfigure(t_network_conf *conf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Connessione asincrona al bus di sistema D-Bus, integrata nell'event
+ * loop: l'avvio della rete non attende dbus-daemon.
+ */
+#ifndef __ETHDBUS_INCLUDED__
+#define __ETHDBUS_INCLUDED__
+
+#include <dbus/dbus.h>
+#include "ethapi.h"
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHDBUS_MAX_WATCHES      8
+#define ETHDBUS_MAX_TIMEOUTS     8
+#define ETHDBUS_RETRY_MIN_MSECS  100   /* primo ritentativo di connessione */
+#define ETHDBUS_RETRY_MAX_MSECS  5000  /* backoff massimo */
+#define ETHDBUS_HELLO_MSECS      5000  /* attesa della risposta a Hello */
+#define ETHDBUS_STATE_LEN        32
+#define ETHDBUS_MAX_PROPS        48
+#define ETHDBUS_PROP_NAME_LEN    32
+#define ETHDBUS_PROP_STR_LEN     64
+#define ETHDBUS_SYSTEM_BUS_ADDRESS "unix:path=/var/run/dbus/system_bus_socket"
+
+typedef enum {
+    ETHDBUS_DISCONNECTED = 0,
+    ETHDBUS_CONNECTING,
+    ETHDBUS_CONNECTED,
+} t_ethdbus_state;
+
+typedef struct s_ethdbus t_ethdbus;
+typedef void (*t_ethdbus_cb)(t_ethdbus *bus, void *data);
+/* Risposta a un metodo dell'interfaccia, NULL se il metodo non esiste */
+typedef DBusMessage *(*t_ethdbus_method_cb)(t_ethdbus *bus, DBusMessage *msg,
+                                            void *data);
+
+typedef struct {
+    DBusTimeout *timeout;       /* NULL: slot libero */
+    int timerId;
+    t_ethdbus *bus;
+} t_ethdbus_timeout;
+
+/* Proprieta` in sola lettura dell'oggetto (org.freedesktop.DBus.Properties) */
+typedef struct {
+    char name[ETHDBUS_PROP_NAME_LEN];
+    int type;                   /* DBUS_TYPE_INT64, _DOUBLE o _STRING */
+    long long i;
+    double d;
+    char s[ETHDBUS_PROP_STR_LEN];
+} t_ethdbus_prop;
+
+struct s_ethdbus {
+    t_evloop *loop;
+    DBusConnection *conn;
+    DBusPendingCall *hello;
+    t_ethdbus_state state;
+    const char *objectPath;
+    const char *interfaceName;
+    DBusWatch *watch[ETHDBUS_MAX_WATCHES];
+    int nWatches;
+    t_ethdbus_timeout timeout[ETHDBUS_MAX_TIMEOUTS];
+    int retryMs;                /* backoff corrente */
+    int retryTimer;
+    int dispatchTimer;
+    /* Ultimo stato pubblicato: ripetuto a ogni (ri)connessione */
+    char device[DEVICENAME_LEN];
+    char netState[ETHDBUS_STATE_LEN];
+    t_ethdbus_prop prop[ETHDBUS_MAX_PROPS];
+    int nProps;
+    t_ethdbus_cb onConnect;     /* opzionale, a connessione stabilita */
+    t_ethdbus_cb onGetProperties;   /* opzionale, aggiorna prima di Get */
+    t_ethdbus_method_cb onMethod;   /* opzionale, metodi di interfaceName */
+    void *cbData;
+};
+
+extern void ethDbusInit(t_ethdbus *bus, const char *objectPath,
+                        const char *interfaceName);
+extern int ethDbusStart(t_ethdbus *bus, t_evloop *loop);
+extern void ethDbusStop(t_ethdbus *bus);
+extern int ethDbusIsConnected(const t_ethdbus *bus);
+extern void ethDbusPublishState(t_ethdbus *bus, const char *device,
+                                const char *state);
+extern void ethDbusEmit(t_ethdbus *bus, const char *member, const char *device,
+                        const char *detail);
+extern void ethDbusSetInt(t_ethdbus *bus, const char *name, long long value);
+extern void ethDbusSetDouble(t_ethdbus *bus, const char *name, double value);
+extern void ethDbusSetString(t_ethdbus *bus, const char *name,
+                             const char *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
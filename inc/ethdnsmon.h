@@ -0,0 +1,69 @@
+/*
+ * Salute dei nameserver: query di prova periodiche a ogni server, con
+ * latenza e tasso di errore smussati, e ordine consigliato per
+ * resolv.conf con isteresi.
+ */
+#ifndef __ETHDNSMON_INCLUDED__
+#define __ETHDNSMON_INCLUDED__
+
+#include "ethapi.h"
+#include "ethprobe.h"
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DNSMON_MAX_SERVERS     3      /* MAXNS del resolver di glibc */
+#define DNSMON_INTERVAL_MSECS  10000
+#define DNSMON_TIMEOUT_MSECS   1000   /* oltre, la query conta come persa */
+#define DNSMON_FAIL_MSECS      5000   /* attesa del resolver su un server muto */
+#define DNSMON_ALPHA           0.3    /* peso del campione nuovo nelle EWMA */
+#define DNSMON_MARGIN_PCT      20     /* vantaggio minimo per cambiare il primo */
+#define DNSMON_MARGIN_MSECS    2      /* ... e comunque almeno questi ms */
+#define DNSMON_SWITCH_COUNT    3      /* giri consecutivi con lo stesso vantaggio */
+
+typedef struct {
+    char address[IPv4ADDR_LEN];
+    t_probe probe;
+    t_probe_run run;
+    struct s_dnsmon *mon;
+    int samples;                /* query con esito, 0: ancora nessuna */
+    int replies;                /* query con risposta */
+    double latencyMs;           /* EWMA delle risposte */
+    double failRate;            /* EWMA 0..1 delle query perse */
+    t_probe_status last;
+    long lastMs;
+} t_dnsmon_server;
+
+struct s_dnsmon;
+typedef void (*t_dnsmon_cb)(struct s_dnsmon *mon, void *data);
+
+typedef struct s_dnsmon {
+    t_evloop *loop;
+    t_dnsmon_server server[DNSMON_MAX_SERVERS];
+    int nServers;
+    int order[DNSMON_MAX_SERVERS];  /* ordine corrente, indici di server */
+    int intervalMs;
+    int timeoutMs;
+    char name[PROBE_ARG_LEN];   /* nome chiesto nelle query */
+    int timerId;
+    int pending;                /* query del giro ancora aperte */
+    int candidate;              /* server che sta superando il primo, -1 nessuno */
+    int candidateCount;
+    t_dnsmon_cb onRound;        /* fine di ogni giro di query */
+    t_dnsmon_cb onReorder;      /* order cambiato */
+    void *cbData;
+} t_dnsmon;
+
+extern void ethDnsMonInit(t_dnsmon *mon);
+extern int ethDnsMonAdd(t_dnsmon *mon, const char *address);
+extern double ethDnsMonCost(const t_dnsmon *mon, int idx);
+extern int ethDnsMonStart(t_dnsmon *mon, t_evloop *loop);
+extern void ethDnsMonStop(t_dnsmon *mon);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * Default route ECMP (RTA_MULTIPATH) con sorveglianza per nexthop.
+ */
+#ifndef __ETHECMP_INCLUDED__
+#define __ETHECMP_INCLUDED__
+
+#include "ethgwmon.h"
+#include "ethroute.h"
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    t_evloop *loop;
+    t_gwmon mon;                       /* un target per nexthop */
+    int weight[GWMON_MAX_TARGETS];
+    int metric;
+    t_route_metrics metrics;           /* RTA_METRICS della route */
+    unsigned int installed;            /* maschera dei nexthop nella route */
+    unsigned int withdrawn;            /* nexthop con guasto accertato */
+    int running;
+} t_ecmp;
+
+extern void ethEcmpInit(t_ecmp *e, int metric);
+extern int ethEcmpAddGateway(t_ecmp *e, const char *device,
+                             const char *gateway, int weight);
+extern int ethEcmpStart(t_ecmp *e, t_evloop *loop);
+extern void ethEcmpStop(t_ecmp *e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
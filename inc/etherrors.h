@@ -17,6 +17,13 @@ enum {
     ETHNTPSERVERERR = -7,
     ETHLINKERR      = -8,
     ETHCONFIGBUSY   = -9,
+    ETHARPERR       = -10,
+    ETHSOCKETERR    = -11,
+    ETHNETLINKERR   = -12,
+    ETHPROBEERR     = -13,
+    ETHSTATEERR     = -14,
+    ETHNOMEMERR     = -15,
+    ETHCANCELLED    = -16,
 };
 
 #ifdef __cplusplus
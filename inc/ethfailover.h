@@ -0,0 +1,44 @@
+/*
+ * Failover della default route fra piu` uplink.
+ */
+#ifndef __ETHFAILOVER_INCLUDED__
+#define __ETHFAILOVER_INCLUDED__
+
+#include "ethapi.h"
+#include "ethgwmon.h"
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FAILOVER_MAX_UPLINKS   4
+#define FAILOVER_HOLD_MSECS    5000 /* stabilita` richiesta prima del failback */
+#define FAILOVER_ROUTE_METRIC  10   /* metrica della default route preferita */
+#define FAILOVER_BASE_METRIC   100  /* route di riserva: 100, 110, 120... */
+
+typedef t_gwmon_target t_uplink;
+
+typedef void (*t_failover_cb)(const t_uplink *from, const t_uplink *to,
+                              void *data);
+
+typedef struct {
+    t_evloop *loop;
+    t_gwmon mon;                /* un target per uplink, in ordine di priorita` */
+    int active;                 /* uplink della route preferita, -1 nessuno */
+    int holdMs;
+    t_failover_cb onSwitch;
+    void *cbData;
+} t_failover;
+
+extern void ethFailoverInit(t_failover *fo);
+extern int ethFailoverAddUplink(t_failover *fo, const char *spec);
+extern int ethFailoverCount(const t_failover *fo);
+extern int ethFailoverStart(t_failover *fo, t_evloop *loop);
+extern void ethFailoverStop(t_failover *fo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Sorveglianza continua di uno o piu` gateway via ARP, con isteresi.
+ */
+#ifndef __ETHGWMON_INCLUDED__
+#define __ETHGWMON_INCLUDED__
+
+#include "ethapi.h"
+#include "etharp.h"
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GWMON_MAX_TARGETS  8
+#define GWMON_PROBE_MSECS  100  /* intervallo fra i probe ARP */
+#define GWMON_FAIL_COUNT   3    /* probe persi prima di dichiarare il guasto */
+#define GWMON_RISE_COUNT   3    /* risposte consecutive per tornare sano */
+
+typedef struct {
+    char deviceName[DEVICENAME_LEN];
+    char gateway[GATEWAY_LEN];
+    t_arp_socket arp;
+    int healthy;
+    int okCount;
+    int failCount;
+    int pending;                /* probe inviato e non ancora risposto */
+    long long healthySince;
+    long long firstMissMs;      /* primo probe perso della serie corrente */
+    unsigned char gatewayMac[ETHARP_HWADDR_LEN];
+    int macKnown;
+} t_gwmon_target;
+
+struct s_gwmon;
+typedef void (*t_gwmon_cb)(struct s_gwmon *mon, int idx, void *data);
+typedef void (*t_gwmon_tick_cb)(struct s_gwmon *mon, void *data);
+
+typedef struct s_gwmon {
+    t_evloop *loop;
+    t_gwmon_target target[GWMON_MAX_TARGETS];
+    int nTargets;
+    int probeMs;
+    int failCount;
+    int riseCount;
+    int timerId;
+    t_gwmon_cb onChange;        /* cambio di stato di un target */
+    t_gwmon_tick_cb onTick;     /* fine di ogni giro di probe */
+    void *cbData;
+} t_gwmon;
+
+extern void ethGwMonInit(t_gwmon *mon);
+extern int ethGwMonAdd(t_gwmon *mon, const char *device, const char *gateway);
+extern int ethGwMonStart(t_gwmon *mon, t_evloop *loop);
+extern void ethGwMonStop(t_gwmon *mon);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
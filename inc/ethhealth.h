@@ -0,0 +1,54 @@
+/*
+ * Verifica a strati della connettivita`: link, gateway (ARP), upstream.
+ */
+#ifndef __ETHHEALTH_INCLUDED__
+#define __ETHHEALTH_INCLUDED__
+
+#include "ethapi.h"
+#include "etharp.h"
+#include "ethprobe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHHEALTH_ARP_MSECS  200 /* attesa massima della risposta del gateway */
+
+typedef enum {
+    HEALTH_OK            = 0,
+    HEALTH_LINK_FAIL     = 1, /* nessun carrier */
+    HEALTH_GATEWAY_FAIL  = 2, /* gateway assente o muto: problema locale */
+    HEALTH_UPSTREAM_FAIL = 3, /* gateway ok, upstream irraggiungibili */
+} t_health_layer;
+
+typedef struct {
+    t_health_layer failed;
+    char gateway[GATEWAY_LEN];
+    unsigned char gatewayMac[ETHARP_HWADDR_LEN];
+    long gatewayMs;             /* tempo di risposta ARP del gateway */
+    char upstream[PROBE_ARG_LEN + 64]; /* primo probe upstream riuscito */
+    long upstreamMs;
+    int portal;                 /* un probe HTTP ha trovato un captive portal */
+} t_health_report;
+
+/*
+ * Attesa delle risposte (ARP del gateway, probe upstream): serve l'event
+ * loop per al massimo ms. Restituisce i revents di fd appena e` leggibile
+ * (fd < 0: nessun socket), 0 se il tempo scade o *done diventa vero
+ * (done NULL: nessuna condizione), <0 per interrompere la verifica.
+ */
+typedef int (*t_health_wait_cb)(int fd, long ms, const int *done, void *data);
+
+extern int ethCheckHealth(const char *device,
+                          const char * const *gateways, int nGateways,
+                          const t_probe *probes, int nProbes,
+                          t_health_report *report);
+extern void ethHealthSetWait(t_evloop *loop, t_health_wait_cb wait,
+                             void *data);
+extern const char *ethHealthLayerName(t_health_layer layer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
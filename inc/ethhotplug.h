@@ -0,0 +1,43 @@
+/*
+ * Riconoscimento del device gestito fra le interfacce che compaiono:
+ * per nome, per MAC o per percorso fisico (ID_PATH di udev o percorso
+ * del device in sysfs), con glob.
+ */
+#ifndef __ETHHOTPLUG_INCLUDED__
+#define __ETHHOTPLUG_INCLUDED__
+
+#include "ethiftable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOTPLUG_PATTERN_LEN     256
+#define HOTPLUG_UDEV_CONTROL    "/run/udev/control"  /* c'e` se udev gira */
+#define HOTPLUG_UDEV_DATA       "/run/udev/data"     /* database: n<ifindex> */
+#define HOTPLUG_UDEV_POLL_MSECS 50     /* attesa della fine delle regole udev */
+#define HOTPLUG_UDEV_MAX_MSECS  3000   /* oltre si procede senza udev */
+
+typedef enum {
+    HOTPLUG_BY_NAME = 0,    /* nome dell'interfaccia, glob */
+    HOTPLUG_BY_MAC,         /* mac=aa:bb:cc:dd:ee:ff */
+    HOTPLUG_BY_PATH,        /* path=<glob> su ID_PATH o percorso sysfs */
+} t_hotplug_key;
+
+typedef struct {
+    t_hotplug_key key;
+    char pattern[HOTPLUG_PATTERN_LEN];
+    unsigned char mac[ETHMODEL_HWADDR_LEN];
+} t_hotplug_match;
+
+extern int ethHotplugParse(const char *spec, t_hotplug_match *m);
+extern int ethHotplugMatch(const t_hotplug_match *m, const t_iface *iface);
+extern t_iface *ethHotplugFind(const t_iftable *t, const t_hotplug_match *m);
+extern int ethHotplugUdevRunning(void);
+extern int ethHotplugUdevDone(int ifindex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Traffico delle interfacce: contatori IFLA_STATS64 di tutte le
+ * interfacce letti con un solo dump netlink per intervallo, e serie
+ * storica dei rate in un buffer circolare per interfaccia.
+ */
+#ifndef __ETHIFSTATS_INCLUDED__
+#define __ETHIFSTATS_INCLUDED__
+
+#include <linux/if_link.h>
+#include "ethapi.h"
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IFSTATS_INTERVAL_MSECS  1000
+#define IFSTATS_MAX_IFACES      128
+#define IFSTATS_HISTORY         60     /* campioni conservati per interfaccia */
+
+typedef struct {
+    long long timeMs;           /* fine del periodo (evLoopNowMs) */
+    double rxBps;               /* bit/s */
+    double txBps;
+    double rxPps;               /* pacchetti/s */
+    double txPps;
+    double rxErrPs;             /* errori/s */
+    double txErrPs;
+    double rxDropPs;            /* scarti/s */
+    double txDropPs;
+} t_ifstats_rate;
+
+typedef struct {
+    char name[DEVICENAME_LEN];
+    int ifindex;                /* 0: da risolvere dal nome */
+    int valid;                  /* last contiene un campione */
+    long long lastMs;
+    struct rtnl_link_stats64 last;
+    t_ifstats_rate hist[IFSTATS_HISTORY];
+    int head;                   /* prossima posizione da scrivere */
+    int count;
+    unsigned int gen;           /* ultimo dump in cui e` comparsa */
+} t_ifstats_entry;
+
+struct s_ifstats;
+typedef void (*t_ifstats_cb)(struct s_ifstats *s, void *data);
+
+typedef struct s_ifstats {
+    t_evloop *loop;
+    int intervalMs;
+    int all;                    /* segue ogni interfaccia del dump */
+    int fd;                     /* socket netlink, -1 se fermo */
+    int timerId;
+    unsigned int gen;
+    t_ifstats_entry entry[IFSTATS_MAX_IFACES];
+    int nEntries;
+    int cursor;                 /* ultima trovata: il dump e` per ifindex */
+    t_ifstats_cb onSample;      /* dopo ogni campione */
+    void *cbData;
+} t_ifstats;
+
+extern void ethIfStatsInit(t_ifstats *s);
+extern int ethIfStatsAdd(t_ifstats *s, const char *device);
+extern int ethIfStatsSample(t_ifstats *s);
+extern int ethIfStatsStart(t_ifstats *s, t_evloop *loop);
+extern void ethIfStatsStop(t_ifstats *s);
+extern t_ifstats_entry *ethIfStatsFind(t_ifstats *s, const char *device);
+extern const t_ifstats_rate *ethIfStatsRate(const t_ifstats_entry *e, int age);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Tabella delle interfacce indicizzata per ifindex (e per nome internato),
+ * riempita con un dump netlink unico all'avvio e aggiornata dagli eventi
+ * RTM_NEWLINK/DELLINK/NEWADDR/DELADDR. Costo per evento costante anche
+ * con centinaia di veth/macvlan.
+ */
+#ifndef __ETHIFTABLE_INCLUDED__
+#define __ETHIFTABLE_INCLUDED__
+
+#include <linux/netlink.h>
+#include "ethmodel.h"
+#include "ethnic.h"
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IFTABLE_MIN_BUCKETS  64  /* potenza di 2, raddoppia col carico */
+
+typedef enum {
+    IFTABLE_EV_NEW = 1,
+    IFTABLE_EV_CHANGE,
+    IFTABLE_EV_DEL,
+} t_iftable_event;
+
+typedef struct s_iface {
+    int ifindex;
+    unsigned int flags;         /* IFF_* dal kernel */
+    t_net_model model;          /* nome, MAC, link, primo IPv4/IPv6 */
+    t_link_mode linkMode;       /* modo negoziato, aggiornato dal chiamante */
+    void *user;                 /* dati del chiamante */
+    /* uso interno (risincronizzazione con ethIfTableLoad) */
+    t_net_model prev;
+    unsigned int gen;
+    int fresh;
+    struct s_iface *next;       /* catena del bucket per ifindex */
+    struct s_iface *nextName;   /* catena del bucket per nome */
+} t_iface;
+
+/* diff: campi cambiati (ethModelDiff), 0 per IFTABLE_EV_DEL */
+typedef void (*t_iftable_cb)(t_iface *iface, t_iftable_event event,
+                             unsigned int diff, void *data);
+/* Visita: un valore diverso da 0 ferma la scansione */
+typedef int (*t_iftable_visit_cb)(t_iface *iface, void *data);
+
+typedef struct {
+    t_iface **byIndex;
+    t_iface **byName;
+    int nBuckets;
+    int count;
+    unsigned int gen;           /* numero del dump corrente */
+    int loading;                /* dump in corso: eventi rimandati */
+    int fd;                     /* socket dei gruppi multicast, -1 se fermo */
+    t_evloop *loop;
+    t_iftable_cb onEvent;
+    void *cbData;
+} t_iftable;
+
+extern int ethIfTableInit(t_iftable *t);
+extern void ethIfTableFree(t_iftable *t);
+extern int ethIfTableLoad(t_iftable *t);
+extern int ethIfTableStart(t_iftable *t, t_evloop *loop);
+extern void ethIfTableStop(t_iftable *t);
+extern void ethIfTableHandleMsg(t_iftable *t, struct nlmsghdr *n);
+extern t_iface *ethIfTableLookup(const t_iftable *t, int ifindex);
+extern t_iface *ethIfTableLookupName(const t_iftable *t, const char *name);
+extern t_iface *ethIfTableForEach(const t_iftable *t, t_iftable_visit_cb cb,
+                                  void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
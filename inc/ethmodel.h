@@ -0,0 +1,51 @@
+/*
+ * Rappresentazione compatta e tipizzata di t_network_conf: indirizzi
+ * binari, prefissi, MAC a 6 byte e stringhe internate. Serve per tenere
+ * in memoria molte interfacce e molti snapshot e confrontarli in fretta;
+ * la conversione da/verso t_network_conf mantiene compatibili le API.
+ */
+#ifndef __ETHMODEL_INCLUDED__
+#define __ETHMODEL_INCLUDED__
+
+#include <netinet/in.h>
+#include "ethapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHMODEL_MAX_STRINGS  4096 /* stringhe distinte internabili */
+#define ETHMODEL_HWADDR_LEN   6
+#define ETHMODEL_DIFF_LINK    (1u << (T_CONNECTION + 1)) /* bit di ethModelDiff */
+#define ETHMODEL_DIFF_NAME    (1u << T_IFACENAME)
+
+typedef unsigned short t_str_id;   /* 0: stringa vuota */
+
+typedef struct {
+    struct in6_addr addressIPv6;
+    struct in_addr addressIPv4;
+    struct in_addr gateway;
+    struct in_addr dnsserver;
+    t_str_id deviceName;
+    t_str_id dnsdomain;
+    t_str_id configPath;
+    t_str_id ntpserverName;
+    unsigned char mac[ETHMODEL_HWADDR_LEN];
+    unsigned char prefixLen;        /* dalla netmask */
+    unsigned char prefixLen6;
+    unsigned char connection;       /* t_connection_type */
+    signed char linkStatus;         /* ETHSTATEUP / ETHSTATEDOWN / 0 */
+} t_net_model;
+
+extern t_str_id ethModelIntern(const char *str);
+extern t_str_id ethModelFind(const char *str);
+extern const char *ethModelString(t_str_id id);
+extern int ethModelFromConf(const t_network_conf *conf, t_net_model *model);
+extern void ethModelToConf(const t_net_model *model, t_network_conf *conf);
+extern unsigned int ethModelDiff(const t_net_model *a, const t_net_model *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
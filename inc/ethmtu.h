@@ -0,0 +1,41 @@
+/*
+ * MTU del device (via rtnetlink) e verifica attiva del path MTU con
+ * echo ICMP a bit DF di dimensione decrescente.
+ */
+#ifndef __ETHMTU_INCLUDED__
+#define __ETHMTU_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MTU_MIN              576    /* datagramma che ogni host IPv4 accetta */
+#define MTU_MAX              9216   /* jumbo frame */
+#define PMTU_TIMEOUT_MSECS   300    /* attesa della risposta per dimensione */
+#define PMTU_RETRIES         2      /* un pacchetto perso non e` un black hole */
+
+typedef struct {
+    int maxMtu;         /* dimensione di partenza (MTU del device) */
+    int mtu;            /* dimensione piu` grande passata, 0: host muto */
+    int icmpMtu;        /* MTU annunciata da un ICMP frag-needed, 0: nessuno */
+    int blackhole;      /* dimensione persa senza ICMP oltre mtu, 0: nessuna */
+    int probes;         /* echo inviati */
+} t_pmtu_result;
+
+/*
+ * Attesa della risposta a un echo: restituisce i revents di fd, 0 se il
+ * tempo scade, <0 per interrompere la misura. Senza, poll() su fd.
+ */
+typedef int (*t_pmtu_wait_cb)(int fd, long ms, void *data);
+
+extern int ethMtuGet(const char *device);
+extern int ethMtuSet(const char *device, int mtu);
+extern void ethPmtuSetWait(t_pmtu_wait_cb wait, void *data);
+extern int ethPmtuProbe(const char *device, const char *target, int maxMtu,
+                        int timeoutMs, t_pmtu_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Profilo prestazionale della scheda: dimensione delle ring, interrupt
+ * coalescing, offload e numero di canali, via ioctl SIOCETHTOOL; modo
+ * negoziato del link (velocita`, duplex, autonegoziazione, lane).
+ */
+#ifndef __ETHNIC_INCLUDED__
+#define __ETHNIC_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NIC_UNSET  (-1)   /* campo non richiesto / non supportato */
+
+typedef struct {
+    int rxRing;         /* descrittori della ring RX */
+    int txRing;
+    int rxUsecs;        /* coalescing: attesa massima prima dell'interrupt */
+    int txUsecs;
+    int channels;       /* canali combinati RX/TX */
+    int tso;            /* offload: 0 spento, 1 acceso */
+    int gso;
+    int gro;
+    int lro;
+} t_nic_profile;
+
+typedef struct {
+    int speed;          /* Mb/s negoziati */
+    int duplex;         /* 1 full, 0 half */
+    int autoneg;        /* 0 spenta, 1 accesa */
+    int lanes;          /* lane del PHY (ethtool netlink, kernel >= 5.10) */
+} t_link_mode;          /* campi ignoti: NIC_UNSET */
+
+extern void ethNicProfileInit(t_nic_profile *p);
+extern int ethNicProfileSet(t_nic_profile *p, const char *key,
+                            const char *value);
+extern int ethNicProfileEmpty(const t_nic_profile *p);
+extern int ethNicRead(const char *device, t_nic_profile *cur);
+extern int ethNicApply(const char *device, const t_nic_profile *want,
+                       t_nic_profile *effective);
+extern void ethNicFormat(const t_nic_profile *p, char *str, int len);
+extern int ethNicLinkMode(const char *device, t_link_mode *mode);
+extern int ethNicRenegotiate(const char *device);
+extern void ethNicLinkModeFormat(const t_link_mode *m, char *str, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
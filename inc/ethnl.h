@@ -0,0 +1,45 @@
+/*
+ * Helper per i socket netlink (rtnetlink e famiglie affini).
+ */
+#ifndef __ETHNL_INCLUDED__
+#define __ETHNL_INCLUDED__
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHNL_MSGLEN  4096   /* richiesta singola */
+#define ETHNL_RCVLEN  32768  /* buffer di ricezione (dump) */
+
+typedef struct {
+    struct nlmsghdr hdr;
+    char payload[ETHNL_MSGLEN - sizeof(struct nlmsghdr)];
+} t_nl_msg;
+
+typedef int (*t_nl_dump_cb)(struct nlmsghdr *n, void *data);
+
+extern int ethNlOpen(int protocol, unsigned int groups);
+extern void ethNlClose(int fd);
+extern struct nlmsghdr *ethNlMsgInit(t_nl_msg *m, int type, int flags,
+                                     const void *family, int familyLen);
+extern int ethNlAddAttr(struct nlmsghdr *n, int type, const void *data,
+                        int len);
+extern int ethNlAddAttr32(struct nlmsghdr *n, int type, unsigned int value);
+extern int ethNlAddAttrStr(struct nlmsghdr *n, int type, const char *str);
+extern void *ethNlReserve(struct nlmsghdr *n, int len);
+extern struct rtattr *ethNlNestStart(struct nlmsghdr *n, int type);
+extern void ethNlNestEnd(struct nlmsghdr *n, struct rtattr *nest);
+extern int ethNlTalk(int fd, struct nlmsghdr *n);
+extern int ethNlDump(int fd, struct nlmsghdr *n, t_nl_dump_cb cb, void *data);
+extern int ethNlRequest(struct nlmsghdr *n);
+extern void ethNlParseAttrs(struct rtattr *tb[], int max, struct rtattr *rta,
+                            int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
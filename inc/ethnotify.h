@@ -0,0 +1,39 @@
+/*
+ * Notifiche al service manager (protocollo sd_notify) senza libsystemd:
+ * READY=1, STATUS= e keepalive del watchdog.
+ */
+#ifndef __ETHNOTIFY_INCLUDED__
+#define __ETHNOTIFY_INCLUDED__
+
+#include <sys/un.h>
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHNOTIFY_MSG_LEN  256
+
+typedef struct {
+    int fd;                     /* -1: nessun NOTIFY_SOCKET */
+    struct sockaddr_un addr;
+    socklen_t addrLen;
+    long watchdogMs;            /* 0: watchdog disabilitato */
+    int watchdogTimer;
+    t_evloop *loop;
+    int ready;                  /* READY=1 gia` inviato */
+} t_notify;
+
+extern int ethNotifyInit(t_notify *n);
+extern int ethNotifySend(t_notify *n, const char *msg);
+extern void ethNotifyReady(t_notify *n, const char *status);
+extern void ethNotifyStatus(t_notify *n, const char *status);
+extern void ethNotifyKeepalive(t_notify *n);
+extern int ethNotifyWatchdogStart(t_notify *n, t_evloop *loop);
+extern void ethNotifyClose(t_notify *n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Probe di connettivita` (ICMP, TCP, DNS, HTTP 204) eseguiti in
+ * parallelo sull'event loop.
+ */
+#ifndef __ETHPROBE_INCLUDED__
+#define __ETHPROBE_INCLUDED__
+
+#include <netinet/in.h>
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROBE_MAX            8
+#define PROBE_ARG_LEN        128
+#define PROBE_RX_LEN         512
+#define PROBE_TIMEOUT_MSECS  2000
+#define PROBE_DNS_NAME       "example.com"
+#define PROBE_HTTP_URL       "connectivitycheck.gstatic.com/generate_204"
+
+typedef enum {
+    PROBE_ICMP = 0,  /* echo request */
+    PROBE_TCP,       /* connect() riuscita */
+    PROBE_DNS,       /* risposta alla query A di arg */
+    PROBE_HTTP,      /* GET di arg ("host/path") con risposta 204 */
+} t_probe_type;
+
+typedef enum {
+    PROBE_PENDING = 0,
+    PROBE_SUCCESS,
+    PROBE_TIMEOUT,
+    PROBE_REFUSED,
+    PROBE_PORTAL,    /* HTTP con risposta diversa da 204: captive portal */
+    PROBE_FAILED,
+    PROBE_CANCELLED, /* superato dal successo di un altro probe */
+} t_probe_status;
+
+typedef struct {
+    t_probe_type type;
+    struct in_addr address;
+    int port;
+    char arg[PROBE_ARG_LEN];
+    int timeoutMs;
+} t_probe;
+
+struct s_probe_run;
+
+typedef struct {
+    struct s_probe_run *run;
+    const t_probe *probe;
+    t_probe_status status;
+    int fd;
+    int timerId;
+    int stage;                  /* HTTP: 1 richiesta inviata; ICMP: 1 raw socket */
+    unsigned short id;          /* identificativo ICMP / DNS */
+    long long startMs;
+    long long usdtStartUs;      /* inizio per i tracepoint USDT, 0: non misurato */
+    long rttMs;
+    char rx[PROBE_RX_LEN];
+    int rxLen;
+} t_probe_state;
+
+typedef void (*t_probe_done_cb)(struct s_probe_run *run, void *data);
+
+typedef struct s_probe_run {
+    t_evloop *loop;
+    t_probe_state state[PROBE_MAX];
+    int n;
+    int pending;
+    int winner;                 /* indice del primo probe riuscito, -1 nessuno */
+    int finished;
+    t_probe_done_cb cb;
+    void *cbData;
+} t_probe_run;
+
+extern int ethProbeParse(const char *spec, t_probe *probe);
+extern void ethProbeName(const t_probe *probe, char *str, int len);
+extern const char *ethProbeStatusName(t_probe_status status);
+extern int ethProbeStart(t_probe_run *run, t_evloop *loop,
+                         const t_probe *probes, int n,
+                         t_probe_done_cb cb, void *data);
+extern void ethProbeCancel(t_probe_run *run);
+extern int ethProbeDnsQuery(unsigned short id, const char *name,
+                            unsigned char *buf, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Disciplina di coda (qdisc) di root del device, via RTM_NEWQDISC, e
+ * lettura delle sue statistiche.
+ */
+#ifndef __ETHQDISC_INCLUDED__
+#define __ETHQDISC_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QDISC_KIND_LEN       16
+#define QDISC_RATE_PCT       95     /* rate=auto: margine sotto il link speed */
+
+typedef enum {
+    QDISC_NONE = 0,     /* qdisc del kernel lasciata com'e` */
+    QDISC_FQ_CODEL,
+    QDISC_FQ,           /* pacing per flusso; rate: tetto per flusso */
+    QDISC_CAKE,         /* rate: shaping dell'intero device */
+} t_qdisc_kind;
+
+typedef struct {
+    t_qdisc_kind kind;
+    long rateKbit;      /* 0: nessun limite */
+    int ratePct;        /* > 0: rate come percentuale del link speed */
+    int targetUs;       /* fq_codel: ritardo di coda obiettivo, 0 default */
+    int limit;          /* pacchetti in coda, 0 default */
+} t_qdisc_conf;
+
+typedef struct {
+    char kind[QDISC_KIND_LEN];
+    unsigned long long bytes;
+    unsigned long long packets;
+    unsigned int drops;
+    unsigned int overlimits;
+    unsigned int requeues;
+    unsigned int backlog;       /* byte in coda */
+    unsigned int qlen;          /* pacchetti in coda */
+} t_qdisc_stats;
+
+extern int ethQdiscParse(const char *spec, t_qdisc_conf *q);
+extern const char *ethQdiscKindName(t_qdisc_kind kind);
+extern long ethQdiscRate(const t_qdisc_conf *q, int speedMbps);
+extern int ethQdiscApply(const char *device, const t_qdisc_conf *q,
+                         long rateKbit);
+extern int ethQdiscStats(const char *device, t_qdisc_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Distribuzione delle code della scheda sui core: affinita` degli IRQ,
+ * RPS/XPS, flow limit e tabella di indirezione RSS.
+ */
+#ifndef __ETHQUEUE_INCLUDED__
+#define __ETHQUEUE_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QUEUE_MAX_CPUS   1024
+#define QUEUE_MAX_IRQS   256
+#define QUEUE_MASK_LEN   (QUEUE_MAX_CPUS / 4 + QUEUE_MAX_CPUS / 32 + 1)
+
+typedef struct {
+    unsigned int bits[QUEUE_MAX_CPUS / 32];
+} t_cpuset;
+
+typedef struct {
+    int nRx;            /* code trovate in /sys/class/net/<dev>/queues */
+    int nTx;
+    int nIrqs;          /* IRQ della scheda a cui e` stata data l'affinita` */
+    int nCpus;          /* core usati */
+    t_cpuset cpus;
+    int numaNode;       /* nodo della scheda, -1 se non noto */
+    int rps;            /* RPS attivato (meno code RX che core) */
+    int rssEntries;     /* voci RSS riscritte, 0 se non supportato */
+    int errors;         /* scritture rifiutate */
+} t_queue_report;
+
+extern int ethQueueParseCpus(const char *list, t_cpuset *set);
+extern int ethQueueCpuCount(const t_cpuset *set);
+extern void ethQueueFormatCpus(const t_cpuset *set, char *str, int len);
+extern int ethQueueApply(const char *device, const t_cpuset *cpus,
+                         t_queue_report *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
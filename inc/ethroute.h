@@ -0,0 +1,64 @@
+/*
+ * Gestione delle route IPv4 via rtnetlink.
+ */
+#ifndef __ETHROUTE_INCLUDED__
+#define __ETHROUTE_INCLUDED__
+
+#include <netinet/in.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHROUTE_MAX_NEXTHOPS 8
+
+typedef struct {
+    int ifindex;
+    struct in_addr gateway;
+    int weight;               /* 1..256, usato solo con piu` nexthop */
+} t_route_nexthop;
+
+#define ROUTE_CC_LEN          16   /* TCP_CA_NAME_MAX */
+
+/* Metriche RTA_METRICS di una route; 0 / "": default del kernel */
+typedef struct {
+    int mtu;                  /* RTAX_MTU bloccata (lock) */
+    int initcwnd;             /* finestra iniziale di congestione, segmenti */
+    int initrwnd;             /* finestra iniziale annunciata, segmenti */
+    int quickack;             /* 1: ACK immediati, niente delayed ACK */
+    char ccAlgo[ROUTE_CC_LEN];/* controllo di congestione ("bbr", "cubic") */
+} t_route_metrics;
+
+typedef struct {
+    struct in_addr dst;
+    int prefixLen;            /* 0: default route */
+    int metric;               /* RTA_PRIORITY */
+    int table;                /* 0: RT_TABLE_MAIN */
+    t_route_metrics metrics;
+    int nNexthops;
+    t_route_nexthop nexthop[ETHROUTE_MAX_NEXTHOPS];
+} t_route;
+
+extern int ethRouteDefaultInit(t_route *r, const char *gateway,
+                               const char *device, int metric);
+extern int ethRouteHostInit(t_route *r, const char *dst, const char *gateway,
+                            const char *device, int metric);
+extern int ethRouteAddNexthop(t_route *r, const char *gateway,
+                              const char *device, int weight);
+extern int ethRouteAdd(const t_route *r, int replace);
+extern int ethRouteDel(const t_route *r);
+extern int ethRouteMetricsSet(t_route_metrics *m, const char *key,
+                              const char *value);
+extern int ethRouteMetricsEmpty(const t_route_metrics *m);
+extern void ethRouteMetricsFormat(const t_route_metrics *m, char *str,
+                                  int len);
+extern int ethRouteTune(const char *device, const t_route_metrics *m);
+extern int ethRouteNeighSet(const char *device, const char *address,
+                            const unsigned char *mac, int permanent);
+extern int ethRouteNeighUnpin(const char *device, const char *address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
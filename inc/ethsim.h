@@ -0,0 +1,67 @@
+/*
+ * Backend simulato: un device finto con link, lease DHCP e gateway, con
+ * latenze e percentuali di guasto configurabili, e un generatore di
+ * eventi di link (RTM_NEWLINK) a frequenza data. Permette di provare il
+ * control plane senza root e senza hardware.
+ */
+#ifndef __ETHSIM_INCLUDED__
+#define __ETHSIM_INCLUDED__
+
+#include "ethbackend.h"
+#include "ethnl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHSIM_GATEWAY  "165.22.88.44"
+
+typedef struct {
+    /* parametri ("chiave=valore,..." per ethSimParse) */
+    long events;        /* eventi di link da generare */
+    long rate;          /* eventi al secondo (media, con jitter) */
+    int cmdMs;          /* latenza di un comando */
+    int dhcpMs;         /* latenza della riconnessione (lease) */
+    int arpMs;          /* risposta ARP del gateway */
+    int healthMs;       /* durata della verifica upstream */
+    int cmdFailPct;     /* percentuali di guasto */
+    int dhcpFailPct;
+    int gwFailPct;
+    int upFailPct;
+    unsigned int seed;
+    int l2Mtu;          /* frame piu` grande che lo switch inoltra */
+    int pathMtu;        /* path MTU oltre il gateway (ICMP frag-needed) */
+    int linkSpeed;      /* Mb/s negoziati a link su */
+    /* stato del device finto */
+    unsigned int rng;
+    int linkUp;
+    int ifindex;
+    char deviceName[DEVICENAME_LEN];
+    int lease;          /* ultimo ottetto del lease DHCP, 0: nessuno */
+    char ntpServer[NTPSERVERNAME_LEN];
+    int mtu;            /* MTU del device */
+    char gateway[IPv4ADDR_LEN]; /* default route statica, "": quella del lease */
+    t_qdisc_kind qdisc; /* qdisc di root impostata */
+    int neighPinned;    /* voce PERMANENT del gateway */
+    long generated;
+    long long nextUs;   /* istante del prossimo evento, -1: finiti */
+    /* statistiche */
+    long commands;
+    long failures;      /* guasti iniettati */
+    long healthChecks;
+    long connects;
+} t_sim;
+
+extern t_sim *ethSim(void);
+extern int ethSimParse(t_sim *sim, const char *spec);
+extern void ethSimStart(t_sim *sim, const char *device, int ifindex,
+                        long long startUs);
+extern const t_eth_backend *ethSimBackend(void);
+extern struct nlmsghdr *ethSimLinkMsg(const t_sim *sim, t_nl_msg *m);
+extern struct nlmsghdr *ethSimNextEvent(t_sim *sim, t_nl_msg *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Stato persistente del device gestito e lettura dello stato del kernel,
+ * per riprendere una configurazione esistente al riavvio del demone
+ * senza toccare indirizzi e route.
+ */
+#ifndef __ETHSTATE_INCLUDED__
+#define __ETHSTATE_INCLUDED__
+
+#include <netinet/in.h>
+#include "ethapi.h"
+#include "etharp.h"
+#include "ethroute.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHSTATE_DIR        "/run/networkManager"
+#define ETHSTATE_MAX_ADDRS  16
+
+/* Ultima configurazione verificata, salvata in ETHSTATE_DIR/<device>.state */
+typedef struct {
+    char deviceName[DEVICENAME_LEN];
+    int dhcp;                   /* 0 statica, 1 dhclient */
+    char address[IPv4ADDR_LEN];
+    int prefixLen;
+    int nGateways;
+    char gateway[ETHROUTE_MAX_NEXTHOPS][GATEWAY_LEN];
+    unsigned char gatewayMac[ETHARP_HWADDR_LEN];
+    int macKnown;
+    int neighPinned;            /* gateway fissati come voci permanenti */
+    char dns1[IPv4ADDR_LEN];
+    char dns2[IPv4ADDR_LEN];
+} t_persist_state;
+
+/* Indirizzi IPv4 e nexthop della default route (tabella main) del device */
+typedef struct {
+    int ifindex;
+    int nAddrs;
+    struct in_addr addr[ETHSTATE_MAX_ADDRS];
+    int prefixLen[ETHSTATE_MAX_ADDRS];
+    int nGateways;
+    struct in_addr gateway[ETHROUTE_MAX_NEXTHOPS];
+} t_kernel_state;
+
+extern int ethStateSave(const t_persist_state *st);
+extern int ethStateLoad(const char *device, t_persist_state *st);
+extern void ethStateRemove(const char *device);
+extern int ethStateReadKernel(const char *device, t_kernel_state *ks);
+extern int ethStateHasAddress(const t_kernel_state *ks, const char *address,
+                              int prefixLen);
+extern int ethStateHasGateway(const t_kernel_state *ks, const char *gateway);
+extern int ethStateDhcpClientRunning(const char *device);
+extern int ethStateNetmaskToPrefix(const char *netmask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * Dimensionamento dei buffer dei socket TCP sul prodotto banda x ritardo
+ * (BDP) del collegamento.
+ */
+#ifndef __ETHTCP_INCLUDED__
+#define __ETHTCP_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TCP_BUF_FLOOR  (4L * 1024 * 1024)     /* mai sotto il default tipico */
+#define TCP_BUF_CEIL   (256L * 1024 * 1024)   /* memoria per socket */
+
+typedef struct {
+    long bdp;           /* byte in volo a piena velocita`: banda x RTT */
+    long target;        /* massimo dei buffer richiesto, 2 x BDP */
+    long rmemMax;       /* massimi effettivi di tcp_rmem / tcp_wmem */
+    long wmemMax;
+    int changed;        /* sysctl riscritti */
+} t_tcp_buffers;
+
+extern long ethTcpBdp(int speedMbps, long rttMs);
+extern int ethTcpBuffers(long bdp, t_tcp_buffers *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Qualita` passiva delle connessioni TCP che escono dal device: tcp_info
+ * dei socket letto con un dump NETLINK_INET_DIAG, senza traffico di probe.
+ */
+#ifndef __ETHTCPMON_INCLUDED__
+#define __ETHTCPMON_INCLUDED__
+
+#include "ethapi.h"
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TCPMON_INTERVAL_MSECS  5000
+#define TCPMON_MIN_SLOTS       256    /* tabella dei socket, cresce col carico */
+#define TCPMON_MIN_SEGS        100    /* segmenti nel periodo per giudicare */
+#define TCPMON_BAD_COUNT       3      /* campioni cattivi prima del degrado */
+#define TCPMON_GOOD_COUNT      3      /* campioni buoni per tornare normale */
+
+typedef struct {
+    int sockets;
+    double srttMs;                  /* media pesata sui segmenti, EWMA fra i campioni */
+    double retransPct;              /* ritrasmessi / inviati nel periodo */
+    unsigned long long deliveryRate;    /* byte/s, somma sui socket */
+    unsigned long long segsOut;     /* segmenti inviati nel periodo */
+} t_tcp_quality;
+
+typedef struct {
+    unsigned long long cookie;      /* identita` del socket nel kernel */
+    unsigned int retrans;
+    unsigned int segsOut;
+} t_tcpmon_sock;
+
+/* Socket di un campione: hash aperto sul cookie, 0 e` uno slot libero */
+typedef struct {
+    t_tcpmon_sock *slot;
+    int nSlots;                     /* potenza di 2 */
+    int n;
+} t_tcpmon_socks;
+
+struct s_tcpmon;
+typedef void (*t_tcpmon_cb)(struct s_tcpmon *mon, void *data);
+
+typedef struct s_tcpmon {
+    t_evloop *loop;
+    char deviceName[DEVICENAME_LEN];
+    char gateway[GATEWAY_LEN];      /* solo etichetta degli aggregati */
+    int intervalMs;
+    double maxRttMs;                /* soglie di degrado, 0: nessuna */
+    double maxRetransPct;
+    int timerId;
+    t_tcp_quality device;           /* tutti i socket con indirizzo del device */
+    t_tcp_quality viaGateway;       /* quelli verso destinazioni fuori subnet */
+    int degraded;
+    int badCount;
+    int goodCount;
+    t_tcpmon_socks prev;            /* campione precedente */
+    t_tcpmon_socks cur;             /* campione in corso */
+    t_tcpmon_cb onSample;           /* dopo ogni campione */
+    t_tcpmon_cb onChange;           /* cambio di degraded */
+    void *cbData;
+} t_tcpmon;
+
+extern void ethTcpMonInit(t_tcpmon *mon, const char *device);
+extern int ethTcpMonSample(t_tcpmon *mon);
+extern int ethTcpMonStart(t_tcpmon *mon, t_evloop *loop);
+extern void ethTcpMonStop(t_tcpmon *mon);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Traccia binaria degli eventi in ingresso (messaggi netlink, esiti
+ * delle verifiche, timer) per riprodurre un incidente in laboratorio.
+ *
+ * Oltre agli ingressi si registrano le decisioni (azioni servite, stati
+ * pubblicati): il replay le confronta con le proprie.
+ *
+ * Formato: header di file t_trace_file_hdr, poi record t_trace_rec
+ * seguiti da len byte di payload, completati a multipli di 8 byte cosi`
+ * header e payload restano allineati. Interi nell'ordine della macchina
+ * che ha registrato.
+ */
+#ifndef __ETHTRACE_INCLUDED__
+#define __ETHTRACE_INCLUDED__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHTRACE_MAGIC    "NMTR"
+#define ETHTRACE_VERSION  1
+#define ETHTRACE_MAX_LEN  65536   /* payload massimo di un record */
+#define ETHTRACE_ALIGN(len)  (((len) + 7) & ~7)
+
+typedef enum {
+    ETHTRACE_NETLINK = 1,       /* nlmsghdr completo (dump iniziale ed eventi) */
+    ETHTRACE_START,             /* fine dell'avvio: nome del device gestito */
+    ETHTRACE_HEALTH,            /* t_health_report di ethCheckHealth */
+    ETHTRACE_TIMER,             /* id del timer scaduto (int) */
+    ETHTRACE_ARP,               /* esito dell'ARP unicast del fast path DNA */
+    ETHTRACE_ACTION,            /* decisione: stato del link servito (int) */
+    ETHTRACE_STATE,             /* decisione: stato pubblicato (stringa) */
+} t_trace_type;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+} t_trace_file_hdr;
+
+typedef struct {
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t len;
+    int64_t usec;               /* dall'apertura della traccia */
+} t_trace_rec;
+
+/* Traccia in lettura, caricata tutta in memoria */
+typedef struct {
+    unsigned char *data;
+    long size;
+    long pos;                   /* prossimo record di ethTraceNext */
+    int nRecords;
+} t_trace_reader;
+
+extern int ethTraceOpen(const char *path);
+extern void ethTraceClose(void);
+extern int ethTraceActive(void);
+extern void ethTraceRecord(t_trace_type type, const void *data, int len);
+
+extern int ethTraceLoad(t_trace_reader *r, const char *path);
+extern void ethTraceFree(t_trace_reader *r);
+extern const t_trace_rec *ethTracePeek(const t_trace_reader *r);
+extern const t_trace_rec *ethTraceNext(t_trace_reader *r);
+extern const t_trace_rec *ethTraceNextOfType(const t_trace_reader *r,
+                                             long *pos, t_trace_type type);
+extern const void *ethTracePayload(const t_trace_rec *rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Tracepoint statici USDT, provider "networkmanager".
+ *
+ * Con <sys/sdt.h> (pacchetto systemtap-sdt-dev) ogni probe diventa un
+ * nop piu` una nota ELF che bpftrace e perf possono agganciare sul
+ * processo in esecuzione; senza, o compilando con -DETHUSDT_DISABLE, le
+ * macro non generano codice. Ogni probe ha il suo semaforo, che il
+ * tracer incrementa quando lo aggancia: finche` e` a zero il probe non
+ * scatta e i suoi argomenti non vengono calcolati. I probe *__done portano la durata in
+ * microsecondi: ETHUSDT_NOW(done) e ETHUSDT_SINCE(done, start) leggono
+ * l'orologio solo se quel probe e` agganciato (se lo diventa a misura
+ * iniziata la durata vale 0).
+ */
+#ifndef __ETHUSDT_INCLUDED__
+#define __ETHUSDT_INCLUDED__
+
+#if !defined(ETHUSDT_DISABLE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define ETHUSDT_COMPILED 1
+#endif
+#endif
+
+/* Tutti i probe del provider: i semafori sono definiti in ethusdt.c */
+#define ETHUSDT_PROBES(X) \
+    X(spawn__start) X(spawn__done) \
+    X(eth__connect__start) X(eth__connect__done) \
+    X(eth__getinfo__start) X(eth__getinfo__done) \
+    X(probe__start) X(probe__done) \
+    X(link__change__start) X(link__change__done) \
+    X(config__apply__start) X(config__apply__done)
+
+#ifdef ETHUSDT_COMPILED
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHUSDT_SEMAPHORE(name) networkmanager_##name##_semaphore
+#define ETHUSDT_DECLARE(name) \
+    extern unsigned short ETHUSDT_SEMAPHORE(name) \
+        __attribute__((unused)) __attribute__((section(".probes")));
+ETHUSDT_PROBES(ETHUSDT_DECLARE)
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline long long ethUsdtNowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+#define ETHUSDT_ENABLED(name)   __builtin_expect(ETHUSDT_SEMAPHORE(name), 0)
+#define ETHUSDT_NOW(name)       (ETHUSDT_ENABLED(name) ? ethUsdtNowUs() : 0LL)
+#define ETHUSDT_SINCE(name, start) \
+    (ETHUSDT_ENABLED(name) && (start) != 0 ? ethUsdtNowUs() - (start) : 0LL)
+#define ETHUSDT1(name, a) \
+    do { if (ETHUSDT_ENABLED(name)) \
+        DTRACE_PROBE1(networkmanager, name, a); } while (0)
+#define ETHUSDT2(name, a, b) \
+    do { if (ETHUSDT_ENABLED(name)) \
+        DTRACE_PROBE2(networkmanager, name, a, b); } while (0)
+#define ETHUSDT3(name, a, b, c) \
+    do { if (ETHUSDT_ENABLED(name)) \
+        DTRACE_PROBE3(networkmanager, name, a, b, c); } while (0)
+#define ETHUSDT4(name, a, b, c, d) \
+    do { if (ETHUSDT_ENABLED(name)) \
+        DTRACE_PROBE4(networkmanager, name, a, b, c, d); } while (0)
+#define ETHUSDT5(name, a, b, c, d, e) \
+    do { if (ETHUSDT_ENABLED(name)) \
+        DTRACE_PROBE5(networkmanager, name, a, b, c, d, e); } while (0)
+
+#else
+
+/* Gli argomenti restano citati (niente warning) ma non vengono calcolati */
+#define ETHUSDT_ENABLED(name)   0
+#define ETHUSDT_NOW(name)       0LL
+#define ETHUSDT_SINCE(name, start) ((start) - (start))
+#define ETHUSDT1(name, a)       do { (void)sizeof(a); } while (0)
+#define ETHUSDT2(name, a, b)    do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define ETHUSDT3(name, a, b, c) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#define ETHUSDT4(name, a, b, c, d) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); \
+         (void)sizeof(d); } while (0)
+#define ETHUSDT5(name, a, b, c, d, e) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); \
+         (void)sizeof(d); (void)sizeof(e); } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Event loop a singolo thread basato su poll(): descrittori e timer.
+ */
+#ifndef __EVLOOP_INCLUDED__
+#define __EVLOOP_INCLUDED__
+
+#include <poll.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVLOOP_MAX_FDS     256
+#define EVLOOP_MAX_TIMERS  4096
+
+typedef void (*t_ev_fd_cb)(int fd, short revents, void *data);
+typedef void (*t_ev_timer_cb)(void *data);
+struct s_evloop;
+/* Clock virtuale: consegna gli eventi fino a untilMs (-1: il prossimo) */
+typedef void (*t_ev_advance_cb)(struct s_evloop *loop, long long untilMs,
+                                void *data);
+
+typedef struct {
+    int fd;
+    short events;
+    t_ev_fd_cb cb;
+    void *data;
+} t_ev_fd;
+
+typedef struct {
+    long long due;  /* scadenza in ms (CLOCK_MONOTONIC) */
+    int id;
+    t_ev_timer_cb cb;
+    void *data;
+} t_ev_timer;
+
+typedef struct s_evloop {
+    t_ev_fd fds[EVLOOP_MAX_FDS];
+    int nFds;
+    t_ev_timer timers[EVLOOP_MAX_TIMERS]; /* min-heap sulla scadenza */
+    int nTimers;
+    int nextTimerId;
+    int running;
+    t_ev_advance_cb advance;    /* NULL: tempo reale */
+    void *advanceData;
+} t_evloop;
+
+extern void evLoopInit(t_evloop *loop);
+extern int evLoopAddFd(t_evloop *loop, int fd, short events,
+                       t_ev_fd_cb cb, void *data);
+extern int evLoopModFd(t_evloop *loop, int fd, short events);
+extern void evLoopDelFd(t_evloop *loop, int fd);
+extern int evLoopAddTimer(t_evloop *loop, long ms, t_ev_timer_cb cb,
+                          void *data);
+extern void evLoopDelTimer(t_evloop *loop, int id);
+extern int evLoopRunOnce(t_evloop *loop, long maxWaitMs);
+extern int evLoopRun(t_evloop *loop);
+extern void evLoopStop(t_evloop *loop);
+extern long long evLoopNowMs(void);
+extern void evLoopSetVirtual(t_evloop *loop, long long startMs,
+                             t_ev_advance_cb cb, void *data);
+extern void evLoopSetTime(long long ms);
+extern int evLoopIsVirtual(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * Coda delle azioni per interfaccia.
+ *
+ * Non e` una vera coda: le richieste intermedie di un flap (up, down,
+ * up...) non servono a niente, quindi si conserva solo l'ultimo stato
+ * richiesto e un numero di generazione. L'azione parte da un timer a
+ * 0 ms, cioe` dal livello piu` esterno dell'event loop e mai dentro il
+ * callback che ha ricevuto l'evento. Durante le attese l'azione fa
+ * girare l'event loop: gli eventi arrivano, le richieste nuove alzano la
+ * generazione e l'attesa termina subito.
+ */
+#include <string.h>
+#include "debug.h"
+#include "ethaction.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ethActionInit(t_action_queue *q, t_evloop *loop, t_action_cb run,
+                   void *data)
+{
+    memset(q, 0, sizeof(t_action_queue));
+    q->loop = loop;
+    q->run = run;
+    q->cbData = data;
+}
+
+static void ethActionRun(void *data)
+{
+    t_action_queue *q = (t_action_queue *)data;
+
+    q->timerId = 0;
+    /* Si ripete finche` l'azione eseguita non e` quella piu` recente */
+    while (q->runGen != q->gen)
+    {
+        q->runGen = q->gen;
+        q->busy = 1;
+        q->run(q, q->target, q->cbData);
+        q->busy = 0;
+        if (q->runGen != q->gen)
+        {
+            q->superseded++;
+            DBG_V("Action superseded (gen %u -> %u)\n", q->runGen, q->gen);
+        }
+    }
+}
+
+/*
+ * Nuovo stato desiderato: sostituisce quello in attesa e rende obsoleta
+ * l'azione in corso.
+ */
+void ethActionSubmit(t_action_queue *q, int target)
+{
+    q->target = target;
+    q->gen++;
+    if (q->busy || q->timerId > 0)
+        return;
+    q->timerId = evLoopAddTimer(q->loop, 0, ethActionRun, q);
+    if (q->timerId < 0)
+        q->timerId = 0;
+}
+
+int ethActionSuperseded(const t_action_queue *q)
+{
+    return q->busy && q->runGen != q->gen;
+}
+
+/*
+ * Attende ms millisecondi servendo l'event loop. Restituisce 1 (e
+ * l'azione deve interrompersi) appena arriva una richiesta nuova o
+ * l'event loop viene fermato.
+ */
+int ethActionWait(t_action_queue *q, long ms)
+{
+    long long until = evLoopNowMs() + ms;
+    long long now;
+
+    while (!ethActionSuperseded(q) && q->loop->running &&
+           (now = evLoopNowMs()) < until)
+    {
+        if (evLoopRunOnce(q->loop, (long)(until - now)) != ETHNOERR)
+            break;
+    }
+    return ethActionSuperseded(q) || !q->loop->running;
+}
+
+void ethActionCancel(t_action_queue *q)
+{
+    if (q->timerId > 0)
+        evLoopDelTimer(q->loop, q->timerId);
+    q->timerId = 0;
+    q->runGen = q->gen;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,6 +15,8 @@
 #include <sys/time.h>
 #include "debug.h"
 #include "ethapi.h"
+#include "ethbackend.h"
+#include "ethusdt.h"
 #include "etherrors.h"
 
 #define BUFLEN 128
@@ -30,7 +32,6 @@ extern "C" {
 
 static int ethGetMac(t_network_conf *conf);
 static char *ethGetIPAddr(char *device, int useIPv6);
-static int ethGetDefaultGateway(t_network_conf *conf);
 
 /*
  * Questa funzione restituisce:
@@ -44,8 +45,10 @@ static char *systemcall(const char *command)
     char syscall[512];
     FILE *stream;
     int rval;
+    int status;
     int i;
     char lbuff[BUFLEN];
+    long long start = ETHUSDT_NOW(spawn__done);
 
     etherror = ETHNOERR;
 
@@ -65,6 +68,7 @@ static char *systemcall(const char *command)
 
     sprintf(syscall, "%s", command);
 
+    ETHUSDT1(spawn__start, command);
     stream = popen(syscall, "r"); /* Leggiamo lo stdout della chiamata */
     if (!stream)
     {
@@ -77,11 +81,12 @@ static char *systemcall(const char *command)
     memset(lbuff, 0, sizeof(lbuff));
     rval = fread(lbuff, 1, sizeof(lbuff), stream);
     DBG_V("fread() returns: %d\n", rval);
+    status = pclose(stream);
+    ETHUSDT3(spawn__done, command, status, ETHUSDT_SINCE(spawn__done, start));
     if (rval < 0)
     {
         DBG_E("Error on reading stream\n");
         etherror = ETHFREADERR;
-        pclose(stream);
         return NULL;
     }
     else
@@ -89,7 +94,6 @@ static char *systemcall(const char *command)
     {
         DBG_V("Nothing to read\n");
         etherror = ETHNOERR;
-        pclose(stream);
         return NULL;
      }
 
@@ -104,25 +108,100 @@ static char *systemcall(const char *command)
     /* Eliminiamo il carattere di EOL */
     memcpy(buffer, lbuff, (rval - 1));
     DBG_N("Exit\n");
-    pclose(stream);
     return buffer;
 }
 
+/*
+ * Attributo del device chiesto al backend (reale o simulato). Come
+ * systemcall restituisce NULL se non c'e` niente da leggere, con
+ * l'eventuale errore in etherror.
+ */
+static char *ethReadAttr(const char *device, t_eth_attr attr)
+{
+    static char attrBuffer[BUFLEN];
+
+    memset(attrBuffer, 0, sizeof(attrBuffer));
+    etherror = ethBackend()->readAttr(device, attr, attrBuffer,
+                                      sizeof(attrBuffer));
+    if (etherror != ETHNOERR || attrBuffer[0] == '\0')
+        return NULL;
+    return attrBuffer;
+}
+
+/*
+ * Lettura reale degli attributi: le stesse pipeline di comandi di sempre.
+ */
+int ethRealReadAttr(const char *device, t_eth_attr attr, char *out, int len)
+{
+    char cmdline[1024];
+    char *retval;
+    FILE *ntpConf;
+
+    switch (attr)
+    {
+        case ETHATTR_MAC:
+            sprintf(cmdline, "/sbin/ip link show %s | grep ether | "
+                    "awk '{print $2}'", device);
+            break;
+        case ETHATTR_IPV4:
+            sprintf(cmdline, "/sbin/ip addr show dev %s | grep inet | "
+                    "grep global | awk '{print $2}' | cut -f1 -d '/'", device);
+            break;
+        case ETHATTR_IPV6:
+            sprintf(cmdline, "/sbin/ip addr show dev %s | grep inet | "
+                    "grep inet6 | awk '{print $2}' | cut -f1 -d '/'", device);
+            break;
+        case ETHATTR_GATEWAY:
+            sprintf(cmdline, "/sbin/ip route show dev %s | grep default | "
+                    "awk '{print $3}'", device);
+            break;
+        case ETHATTR_NETMASK:
+            sprintf(cmdline, "/sbin/ifconfig %s | awk '/Mask:/{ print $4;} ' | "
+                    "cut -f2 -d ':'", device);
+            break;
+        case ETHATTR_NTPSERVER:
+            /*
+             * Partiamo dal presupposto che nel sistema reale
+             * l'ultima riga di /etc/ntp.conf e` il server ntp configurato
+             * dall'utente: vale solo se esiste il backup dell'originale
+             */
+            ntpConf = fopen("/etc/ntp.conf.orig", "r");
+            if (ntpConf == NULL)
+            {
+                DBG_E("No NTP Configured\n");
+                return ETHBADCONFERR;
+            }
+            fclose(ntpConf);
+            sprintf(cmdline, "tail -n 1 /etc/ntp.conf | awk '{print $2}'");
+            break;
+        case ETHATTR_SPEED:
+            sprintf(cmdline, "cat /sys/class/net/%s/speed 2>/dev/null", device);
+            break;
+        default:
+            return ETHBADCONFERR;
+    }
+    retval = systemcall(cmdline);
+    out[0] = '\0';
+    if (retval != NULL)
+    {
+        strncpy(out, retval, len - 1);
+        out[len - 1] = '\0';
+    }
+    return etherror;
+}
+
 /*
  * Returns the mac address of the device asked
  */
 static int ethGetMac(t_network_conf *conf)
 {
-    char cmdline[1024];
     char *retval;
     DBG_N("Enter\n");
     if (conf == NULL)
         return ETHBADCONFERR;
     if (conf->deviceName == NULL)
         return ETHDEVICEERR;
-    sprintf(cmdline, "/sbin/ip link show %s | grep ether | "
-            "awk '{print $2}'", conf->deviceName);
-    retval = systemcall(cmdline);
+    retval = ethReadAttr(conf->deviceName, ETHATTR_MAC);
     if (retval != NULL)
     {
         int slen = strlen(retval) > sizeof(conf->macaddress)
@@ -147,9 +226,6 @@ static int ethGetMac(t_network_conf *conf)
  */
 int ethGetLinkStatus(t_network_conf *conf)
 {
-    FILE *linkStat = NULL;
-    char fileName[512];
-    char linkStr[1];
     int link;
 
     DBG_N("Enter %p\n", (void *)conf);
@@ -164,43 +240,56 @@ int ethGetLinkStatus(t_network_conf *conf)
         return ETHDEVICEERR;
     }
 
-    sprintf(fileName, "/sys/class/net/%s/carrier", conf->deviceName);
+    link = ethBackend()->linkStatus(conf->deviceName);
+    if (link != ETHSTATEUP && link != ETHSTATEDOWN)
+    {
+        conf->linkStatus = ETHSTATEDOWN;
+        return link;
+    }
+    conf->linkStatus = link;
+
+    DBG_N("Link Status: %d\n", conf->linkStatus);
+    DBG_N("Exit\n");
+    return ETHNOERR;
+}
+
+/*
+ * Carrier reale da sysfs: ETHSTATEUP, ETHSTATEDOWN o ETHDEVICEERR se il
+ * device non esiste.
+ */
+int ethRealLinkStatus(const char *device)
+{
+    FILE *linkStat = NULL;
+    char fileName[512];
+    char linkStr[16];
+    int link;
+
+    snprintf(fileName, sizeof(fileName), "/sys/class/net/%s/carrier", device);
     linkStat = fopen(fileName, "r");
     if (!linkStat)
     {
         DBG_E("No %s file present!\n", fileName);
-        conf->linkStatus = ETHSTATEDOWN;
         return ETHDEVICEERR;
     }
 
-    fscanf(linkStat, "%s", linkStr);
+    linkStr[0] = '\0';
+    fscanf(linkStat, "%15s", linkStr);
     fclose(linkStat);
 
     link = strtoul(linkStr, NULL, 10);
     DBG_N("Link from SYSFS is %s == %d\n", fileName, link);
-    conf->linkStatus = link == 1 ? ETHSTATEUP : ETHSTATEDOWN;
-
-    DBG_N("Link Status: %d\n", conf->linkStatus);
-    DBG_N("Exit\n");
-    return ETHNOERR;
+    return link == 1 ? ETHSTATEUP : ETHSTATEDOWN;
 }
 
 
 
 static char *ethGetIPAddr(char *device, int useIPv6)
 {
-    char cmdline[1024];
     char *retval;
     DBG_N("Enter\n");
     if (device == NULL)
         return NULL;
-    if (useIPv6)
-        sprintf(cmdline, "/sbin/ip addr show dev %s | grep inet | "
-                "grep inet6 | awk '{print $2}' | cut -f1 -d '/'", device);
-    else
-        sprintf(cmdline, "/sbin/ip addr show dev %s | grep inet | "
-                "grep global | awk '{print $2}' | cut -f1 -d '/'", device);
-    retval = systemcall(cmdline);
+    retval = ethReadAttr(device, useIPv6 ? ETHATTR_IPV6 : ETHATTR_IPV4);
     DBG_N("Exit with: %s\n", retval);
     return retval;
 }
@@ -251,17 +340,14 @@ static int ethGetAddr(t_network_conf *conf)
     return ETHNOERR;
 }
 
-static int ethGetDefaultGateway(t_network_conf *conf)
+int ethGetDefaultGateway(t_network_conf *conf)
 {
-    char cmdline[1024];
     char *retval;
     if (conf == NULL)
         return ETHBADCONFERR;
     if (conf->deviceName == NULL)
         return ETHDEVICEERR;
-    sprintf(cmdline, "/sbin/ip route show dev %s | grep default | "
-            "awk '{print $3}'", conf->deviceName);
-    retval = systemcall(cmdline);
+    retval = ethReadAttr(conf->deviceName, ETHATTR_GATEWAY);
     if (retval != NULL)
     {
         strncpy(conf->gateway, retval,
@@ -279,15 +365,12 @@ static int ethGetDefaultGateway(t_network_conf *conf)
 
 static int ethGetNetMask(t_network_conf *conf)
 {
-    char cmdline[1024];
     char *retval;
     if (conf == NULL)
         return ETHBADCONFERR;
     if (conf->deviceName == NULL)
         return ETHDEVICEERR;
-    sprintf(cmdline, "/sbin/ifconfig %s | awk '/Mask:/{ print $4;} ' | "
-            "cut -f2 -d ':'", conf->deviceName);
-    retval = systemcall(cmdline);
+    retval = ethReadAttr(conf->deviceName, ETHATTR_NETMASK);
     if (retval != NULL)
     {
         strncpy(conf->netmask, retval,
@@ -323,50 +406,20 @@ static void ethMacConvert(char *dest, char *source)
 static int ethGetNTPServer(t_network_conf *conf)
 {
     int rval = ETHNOERR;
+    char *retval;
     DBG_N("Enter\n");
-#ifndef ETHAPI_DEBUG
-    FILE *ntpConf;
-    /*
-     * Partiamo dal presupposto che nel sistema reale
-     * l'ultima riga di /etc/ntp.conf e` il server ntp configurato
-     * dall'utente
-     */
-    ntpConf = fopen("/etc/ntp.conf.orig", "r");
-    if (ntpConf == NULL)
+    retval = ethReadAttr(conf->deviceName, ETHATTR_NTPSERVER);
+    if (retval != NULL)
     {
-        DBG_E("No NTP Configured\n");
-        sprintf(conf->ntpserverName, "--");
-        rval = ETHBADCONFERR;
+        strncpy(conf->ntpserverName, retval, sizeof(conf->ntpserverName) - 1);
+        rval = ETHNOERR;
     }
     else
     {
-        /*
-         * Se abbiamo il backup, allora possiamo ragionevolmente pensare
-         * che abbiamo il server ntp in fondo al file e che quindi la
-         * nostra configurazione sia corretta
-         */
-        char *retval;
-        char cmd[512];
-        fclose(ntpConf);
-        sprintf(cmd, "tail -n 1 /etc/ntp.conf | awk '{print $2}'");
-        retval = systemcall(cmd);
-        if (retval != NULL)
-        {
-            strncpy(conf->ntpserverName, retval, strlen(retval));
-            rval = ETHNOERR;
-        }
-        else
-        {
-            DBG_E("Error on getting ntp.conf data\n");
-            sprintf(conf->ntpserverName, "--");
-            rval = ETHBADCONFERR;
-        }
+        DBG_E("Error on getting ntp.conf data\n");
+        sprintf(conf->ntpserverName, "--");
+        rval = ETHBADCONFERR;
     }
-#else
-    conf = conf; // avoid gcc warning
-    rval = ETHNOERR;
-    DBG_V("Simulazione: Nessun errore\n");
-#endif
     DBG_N("Exit with: %d\n", rval);
     return rval;
 }
@@ -676,12 +729,13 @@ static int ethCreateConfigFile(t_network_conf *conf)
  */
 int ethConnect(t_network_conf *conf)
 {
-    char cli[256];
     int rval = 0;
     char ethConfFile[512];
-    static int addr = 1;
+    long long start = ETHUSDT_NOW(eth__connect__done);
 
     DBG_N("Enter\n");
+    ETHUSDT2(eth__connect__start, conf != NULL ? conf->deviceName : "",
+             conf != NULL ? (int)conf->connection : -1);
 
     if (conf == NULL)
     {
@@ -785,7 +839,7 @@ int ethConnect(t_network_conf *conf)
                     ethConfigFileName(conf->deviceName, conf->configPath, ethConfFile);
                     DBG_N("Erasing %s Configuration...\n", ethConfFile);
                     snprintf(cmdline, sizeof(cmdline), "rm %s", ethConfFile);
-                    rval = system(cmdline);
+                    rval = ethBackend()->command(cmdline);
                     if (rval != 0)
                     {
                         DBG_E("Error: %d while executing %s\n",
@@ -821,101 +875,75 @@ int ethConnect(t_network_conf *conf)
                  * corretto (nuovo o vecchio che sia)
                  */
                 ethConfigFileName(conf->deviceName, conf->configPath, ethConfFile);
-#ifndef __arm__
-    /*
-     * Su PC simulo la connessione ethernet completa (disconnessione,
-     * riconnessione con tempistiche fittizie).
-     */
-    #ifdef ETHAPI_DEBUG
-                /*
-                 * Simuliamo la risposta arriva dopo n secondi
-                 */
-                {   int count = 0;
-                    while (count++ < NETWORK_SIMULATION_DELAY_SECS)
-                    {
-                        DBG_N("Waiting Configuring...\n");
-                        usleep(1000 * 1000L * 1);
-                    };
-                };
-                DBG_N("Exiting...\n");
-
-                if (conf->connection == IPDHCP)
-                {
-                    sprintf(conf->addressIPv4, "171.64.88.%d", addr++);
-                    if (addr > 255)
-                        addr = 0;
-                    sprintf(conf->addressIPv6, "fe80::a6ba:dbff:fe02:38e1");
-                    sprintf(conf->dnsdomain,   "eurek.it");
-                    sprintf(conf->dnsserver,   "1.2.3.4 253.1.2.3");
-                    sprintf(conf->netmask,	 "255.255.0.0");
-                    sprintf(conf->gateway,	 "165.22.88.44");
-                }
-                else
-                {
-                    sprintf(conf->addressIPv6, "fe80::a6ba:dbff:fe02:38e1");
-                }
-                rval = ETHNOERR;
-                goto outNet;
-    #endif
-#endif
-                /* E` da fare??? */
-                if (conf->connection == IPDHCP)
-                {
-                    DBG_V("Leasing any dhcp address...\n");
-                    sprintf(cli, "/sbin/dhclient -r %s 1>/dev/null "
-                            "2>/dev/null", conf->deviceName);
-                    /*
-                     * Non controlliamo il valore di ritorno del lease del
-                     * dhcp in quanto se non fossimo mai stati connessi
-                     * sarebbe come avere un errore...
-                     */
-                    rval = system(cli);
-                    /*
-                     * ...allo stesso modo anche il dhclient precedente...
-                     */
-                    DBG_V("Killing dhclient...\n");
-                    sprintf(cli, "killall dhclient 1>/dev/null "
-                            "2>/dev/null");
-                    rval = system(cli);
-
-                    DBG_V("(Re)Starting dhclient...\n");
-                    sprintf(cli, "/sbin/dhclient -nw %s "
-                            "1>/dev/null 2>/dev/null", conf->deviceName);
-                    rval = system(cli);
-                }
-                /* Disattiviamo l'interfaccia e la riattiviamo */
-                sprintf(cli, "/sbin/ifdown %s", conf->deviceName);
-                DBG_N("CMDLINE: %s\n", cli);
-                rval = system(cli);
-                /*
-                 * Non verifichiamo il valore di ritorno, poiche` potevamo
-                 * non esserci mai connessi, ed il ifdown provoca un errore
-                 * o warning...
-                 */
-                sprintf(cli, "/sbin/ifup %s -i %s "
-                        "1>/dev/null 2>/dev/null",
-                        conf->deviceName, ethConfFile);
-                DBG_N("CMDLINE: %s\n", cli);
-                rval = system(cli);
-
-                if (rval == 0)
-                    rval = ETHNOERR;
-                else
-                    rval = ETHDEVICEERR;
+                rval = ethBackend()->connect(conf, ethConfFile);
             }
         }
     }
-outNet:
     DBG_N("exit with %d\n", rval);
+    ETHUSDT3(eth__connect__done, conf != NULL ? conf->deviceName : "", rval,
+             ETHUSDT_SINCE(eth__connect__done, start));
+    return rval;
+}
+
+/*
+ * Riconnessione reale: rilascio e nuovo lease DHCP, poi ifdown/ifup con
+ * il file di configurazione appena scritto.
+ */
+int ethRealConnect(t_network_conf *conf, const char *confFile)
+{
+    char cli[256];
+    int rval;
+
+    if (conf->connection == IPDHCP)
+    {
+        DBG_V("Leasing any dhcp address...\n");
+        sprintf(cli, "/sbin/dhclient -r %s 1>/dev/null "
+                "2>/dev/null", conf->deviceName);
+        /*
+         * Non controlliamo il valore di ritorno del lease del
+         * dhcp in quanto se non fossimo mai stati connessi
+         * sarebbe come avere un errore...
+         */
+        rval = ethRealCommand(cli);
+        /*
+         * ...allo stesso modo anche il dhclient precedente...
+         */
+        DBG_V("Killing dhclient...\n");
+        sprintf(cli, "killall dhclient 1>/dev/null "
+                "2>/dev/null");
+        rval = ethRealCommand(cli);
+
+        DBG_V("(Re)Starting dhclient...\n");
+        sprintf(cli, "/sbin/dhclient -nw %s "
+                "1>/dev/null 2>/dev/null", conf->deviceName);
+        rval = ethRealCommand(cli);
+    }
+    /* Disattiviamo l'interfaccia e la riattiviamo */
+    sprintf(cli, "/sbin/ifdown %s", conf->deviceName);
+    DBG_N("CMDLINE: %s\n", cli);
+    rval = ethRealCommand(cli);
+    /*
+     * Non verifichiamo il valore di ritorno, poiche` potevamo
+     * non esserci mai connessi, ed il ifdown provoca un errore
+     * o warning...
+     */
+    sprintf(cli, "/sbin/ifup %s -i %s "
+            "1>/dev/null 2>/dev/null",
+            conf->deviceName, confFile);
+    DBG_N("CMDLINE: %s\n", cli);
+    rval = ethRealCommand(cli);
+
+    if (rval == 0)
+        rval = ETHNOERR;
+    else
+        rval = ETHDEVICEERR;
     /*
      * La connessione che passa da uno stato ON-OFF-ON puo` impiegare
      * diversi secondi per essere correttamente impostata.
      * Occorre attendere, per cui NON PUO` ESSERE CHIAMATA DAL THREAD
      * PRINCIPALE altrimenti risulta bloccante!
      */
-#ifndef ETHAPI_DEBUG
     usleep(ETHSAFEDELAY * 1000L * 1000);
-#endif
     return rval;
 }
 
@@ -936,7 +964,7 @@ static int ethGetValidNTPServer(const char *server)
         DBG_V("LOOKING for %s\n", server);
         sprintf(syscall, "/bin/ping %s -c %d 1>/dev/null", server, ntpdelay);
         DBG_N("Calling %s\n", syscall);
-        s = system(syscall);
+        s = ethBackend()->command(syscall);
         if (s != 0)
         {
             DBG_E("Unable to reach NTP server %s\n", server);
@@ -966,7 +994,7 @@ int ethPingServer(const char *server)
         int s;
         DBG_N("LOOKING for %s\n", server);
         sprintf(syscall, "/bin/ping %s -c 1 1>/dev/null", server);
-        s = system(syscall);
+        s = ethBackend()->command(syscall);
         if (s != 0)
         {
             DBG_E("Unable to reach server %s\n", server);
@@ -996,7 +1024,9 @@ int ethPingServer(const char *server)
 int ethGetInfo(t_network_conf *conf)
 {
     int rval = ETHNOERR;
+    long long start = ETHUSDT_NOW(eth__getinfo__done);
     DBG_N("Enter\n");
+    ETHUSDT1(eth__getinfo__start, conf != NULL ? conf->deviceName : "");
     if (conf == NULL)
     {
         DBG_E("No valid configuration\n");
@@ -1029,6 +1059,8 @@ int ethGetInfo(t_network_conf *conf)
         DBG_N("ethGetDNSServers returns: %d\n", rval);
     }
     DBG_N("Exit with: %d\n", rval);
+    ETHUSDT3(eth__getinfo__done, conf != NULL ? conf->deviceName : "", rval,
+             ETHUSDT_SINCE(eth__getinfo__done, start));
     return rval;
 }
 
@@ -1064,118 +1096,100 @@ int ethNTPConnect(t_network_conf *conf)
             rval = ethGetValidNTPServer(conf->ntpserverName);
             if (rval == ETHNOERR)
             {
-                /*
-                 * Verifichiamo se avessimo gia` fatto una copia del
-                 * file di configurazione originale
-                 */
-                char syscall[512];
-    #ifndef __arm__
+                rval = ethBackend()->ntpConfigure(conf);
+            }
+        }
+    }
+    DBG_N("Exit with %d\n", rval);
+    return rval;
+}
+
+/*
+ * Configurazione NTP reale: backup di /etc/ntp.conf, aggiunta del server
+ * in fondo e riavvio del servizio.
+ */
+int ethRealNtpConfigure(t_network_conf *conf)
+{
+    char syscall[NTPSERVERNAME_LEN + 64];
+    int rval = ETHNOERR;
+    FILE *ntpConf;
+    ntpConf = fopen("/etc/ntp.conf.orig", "r");
+    if (ntpConf == NULL)
+    {
+        DBG_I("Backup /etc/ntp.conf into /etc/ntp.conf.orig\n");
+        sprintf(syscall, "cp /etc/ntp.conf /etc/ntp.conf.orig");
+        rval = ethRealCommand(syscall);
+        if (rval != 0)
+        {
+            DBG_E("Error on creating backup of /etc/ntp.conf "
+                  "ERR: %d\n", rval);
+            rval = ETHNTPSERVERERR;
+        }
+    }
+    else
+    {
+        fclose(ntpConf);
+    }
+    DBG_N("Now modifying the original file...\n");
+    sprintf(syscall, "cp /etc/ntp.conf.orig /etc/ntp.conf");
+    rval = ethRealCommand(syscall);
+    if (rval != 0)
+    {
+        DBG_E("Error on creating configuration file from backup "
+              "ERR: %d\n", rval);
+        rval = ETHNTPSERVERERR;
+    }
+    else
+    {
         /*
-         * Su PC simuliamo le chiamate della connessione NTP ma in realta` non
-         * le facciamo veramente...
+         * Ho il file da modificare aggiungendo la riga in fondo
+         * con il server desiderato...
          */
-        #ifdef ETHAPI_DEBUG
-                /*
-                 * Simuliamo la risposta arriva dopo n/2 secondi
-                 */
-                {
-                    int count = 0;
-                    while (count++ < (NETWORK_SIMULATION_DELAY_SECS / 2))
-                    {
-                        DBG_N("Waiting Configuring...\n");
-                        usleep(1000 * 1000L * 1);
-                    }
-                }
-                DBG_N("Exiting...\n");
+        snprintf(syscall, sizeof(syscall), "echo 'server %s' >> /etc/ntp.conf",
+                 conf->ntpserverName);
+        rval = ethRealCommand(syscall);
+        if (rval != 0)
+        {
+            DBG_E("Error adding the server %s to /etc/ntp.conf."
+                  " Aborting\n", conf->ntpserverName);
+            rval = ETHNTPSERVERERR;
+        }
+        else
+        {
+            /*
+             * Adesso fermiamo e facciamo ripartire il
+             * servizio ntp con il nuovo server!
+             */
+            sprintf(syscall, "service ntp stop 2>/dev/null");
+            rval = ethRealCommand(syscall);
+            /*
+             * Non controllo il valore di ritorno. Potrebbe
+             * essere non essere mai stato attivato...
+             */
+            sprintf(syscall, "service ntp start "
+                    "1>/dev/null 2>/dev/null");
+            rval = ethRealCommand(syscall);
+            if (rval != 0)
+            {
+                DBG_E("Something went wrong activating NTP Client"
+                      "\nERR: %d -- CMDLINE: %s\n", rval, syscall);
+                rval = ETHNTPSERVERERR;
+            }
+            else
+            {
+                DBG_N("Service Correctly running at %s\n",
+                      conf->ntpserverName);
                 rval = ETHNOERR;
-                goto outNTP;
-        #endif
-    #endif
-                FILE *ntpConf;
-                ntpConf = fopen("/etc/ntp.conf.orig", "r");
-                if (ntpConf == NULL)
-                {
-                    DBG_I("Backup /etc/ntp.conf into /etc/ntp.conf.orig\n");
-                    sprintf(syscall, "cp /etc/ntp.conf /etc/ntp.conf.orig");
-                    rval = system(syscall);
-                    if (rval != 0)
-                    {
-                        DBG_E("Error on creating backup of /etc/ntp.conf "
-                              "ERR: %d\n", rval);
-                        rval = ETHNTPSERVERERR;
-                    }
-                }
-                else
-                {
-                    fclose(ntpConf);
-                }
-                DBG_N("Now modifying the original file...\n");
-                sprintf(syscall, "cp /etc/ntp.conf.orig /etc/ntp.conf");
-                rval = system(syscall);
-                if (rval != 0)
-                {
-                    DBG_E("Error on creating configuration file from backup "
-                          "ERR: %d\n", rval);
-                    rval = ETHNTPSERVERERR;
-                }
-                else
-                {
-                    /*
-                     * Ho il file da modificare aggiungendo la riga in fondo
-                     * con il server desiderato...
-                     */
-                    sprintf(syscall, "echo 'server %s' >> /etc/ntp.conf",
-                            conf->ntpserverName);
-                    rval = system(syscall);
-                    if (rval != 0)
-                    {
-                        DBG_E("Error adding the server %s to /etc/ntp.conf."
-                              " Aborting\n", conf->ntpserverName);
-                        rval = ETHNTPSERVERERR;
-                    }
-                    else
-                    {
-                        /*
-                         * Adesso fermiamo e facciamo ripartire il
-                         * servizio ntp con il nuovo server!
-                         */
-                        sprintf(syscall, "service ntp stop 2>/dev/null");
-                        rval = system(syscall);
-                        /*
-                         * Non controllo il valore di ritorno. Potrebbe
-                         * essere non essere mai stato attivato...
-                         */
-                        sprintf(syscall, "service ntp start "
-                                "1>/dev/null 2>/dev/null");
-                        rval = system(syscall);
-                        if (rval != 0)
-                        {
-                            DBG_E("Something went wrong activating NTP Client"
-                                  "\nERR: %d -- CMDLINE: %s\n", rval, syscall);
-                            rval = ETHNTPSERVERERR;
-                        }
-                        else
-                        {
-                            DBG_N("Service Correctly running at %s\n",
-                                  conf->ntpserverName);
-                            rval = ETHNOERR;
-                        }
-                    }
-                }
             }
         }
     }
-outNTP:
-    DBG_N("Exit with %d\n", rval);
     /*
      * La connessione al server NTP che passa da uno stato ON-OFF-ON
      * puo` impiegare diversi secondi per essere correttamente impostata.
      * Occorre attendere, per cui NON PUO` ESSERE CHIAMATA DAL THREAD
      * PRINCIPALE altrimenti risulta bloccante!
      */
-#ifndef ETHAPI_DEBUG
     usleep(ETHSAFEDELAY * 1000L * 1000);
-#endif
     return rval;
 }
 
@@ -0,0 +1,389 @@
+/*
+ * Libreria ARP su packet socket.
+ *
+ * Permette di interrogare un vicino (tipicamente il gateway) direttamente
+ * a livello 2, senza passare da ping o dalla tabella dei vicini del kernel.
+ * Le richieste possono essere unicast (MAC gia` noto, RFC 4436) o
+ * broadcast (MAC sconosciuto). Dopo l'assegnazione di un indirizzo si
+ * annuncia con ARP gratuiti (RFC 5227) e si risolvono in anticipo i
+ * vicini che servono subito (gateway, DNS).
+ */
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/if_ether.h>
+#include <netpacket/packet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include "debug.h"
+#include "etharp.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static const unsigned char ethArpBroadcast[ETHARP_HWADDR_LEN] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static long ethArpNowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/*
+ * Apre il packet socket sul device e ne legge MAC, indice ed indirizzo
+ * IPv4 (se presente: in assenza di indirizzo si usa 0.0.0.0 come
+ * mittente, come per i probe RFC 5227).
+ */
+int ethArpOpen(const char *device, t_arp_socket *as)
+{
+    struct ifreq ifr;
+    struct sockaddr_ll sll;
+
+    DBG_N("Enter %s\n", device != NULL ? device : "--NO-DEVICE--");
+    if (as == NULL)
+        return ETHBADCONFERR;
+    memset(as, 0, sizeof(t_arp_socket));
+    as->fd = -1;
+    if (device == NULL || strlen(device) >= IFNAMSIZ)
+        return ETHDEVICEERR;
+    strncpy(as->deviceName, device, sizeof(as->deviceName) - 1);
+
+    as->fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    htons(ETH_P_ARP));
+    if (as->fd < 0)
+    {
+        DBG_E("Error on socket(AF_PACKET): %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+    if (ioctl(as->fd, SIOCGIFINDEX, &ifr) < 0)
+    {
+        DBG_E("No device %s: %s\n", device, strerror(errno));
+        ethArpClose(as);
+        return ETHDEVICEERR;
+    }
+    as->ifindex = ifr.ifr_ifindex;
+
+    if (ioctl(as->fd, SIOCGIFHWADDR, &ifr) < 0)
+    {
+        DBG_E("No hw address for %s: %s\n", device, strerror(errno));
+        ethArpClose(as);
+        return ETHDEVICEERR;
+    }
+    memcpy(as->mac, ifr.ifr_hwaddr.sa_data, ETHARP_HWADDR_LEN);
+
+    if (ioctl(as->fd, SIOCGIFADDR, &ifr) == 0)
+        as->addr = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr;
+    else
+        as->addr.s_addr = INADDR_ANY;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ARP);
+    sll.sll_ifindex = as->ifindex;
+    if (bind(as->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+    {
+        DBG_E("Error on bind(%s): %s\n", device, strerror(errno));
+        ethArpClose(as);
+        return ETHSOCKETERR;
+    }
+    DBG_N("Exit\n");
+    return ETHNOERR;
+}
+
+void ethArpClose(t_arp_socket *as)
+{
+    if (as != NULL && as->fd >= 0)
+    {
+        close(as->fd);
+        as->fd = -1;
+    }
+}
+
+/* ARP request da spa per tip, broadcast se targetMac e` NULL */
+static int ethArpSendRequest(t_arp_socket *as, const struct in_addr *spa,
+                             const struct in_addr *tip,
+                             const unsigned char *targetMac)
+{
+    struct ether_arp req;
+    struct sockaddr_ll sll;
+
+    memset(&req, 0, sizeof(req));
+    req.arp_hrd = htons(ARPHRD_ETHER);
+    req.arp_pro = htons(ETH_P_IP);
+    req.arp_hln = ETHARP_HWADDR_LEN;
+    req.arp_pln = sizeof(struct in_addr);
+    req.arp_op  = htons(ARPOP_REQUEST);
+    memcpy(req.arp_sha, as->mac, ETHARP_HWADDR_LEN);
+    memcpy(req.arp_spa, spa, sizeof(struct in_addr));
+    memcpy(req.arp_tpa, tip, sizeof(struct in_addr));
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ARP);
+    sll.sll_ifindex = as->ifindex;
+    sll.sll_halen = ETHARP_HWADDR_LEN;
+    memcpy(sll.sll_addr, targetMac != NULL ? targetMac : ethArpBroadcast,
+           ETHARP_HWADDR_LEN);
+
+    if (sendto(as->fd, &req, sizeof(req), 0,
+               (struct sockaddr *)&sll, sizeof(sll)) < 0)
+    {
+        DBG_E("Error on sendto(%s): %s\n", as->deviceName, strerror(errno));
+        return ETHSOCKETERR;
+    }
+    return ETHNOERR;
+}
+
+/*
+ * Invia una ARP request verso target. Se targetMac e` NULL la richiesta
+ * e` broadcast, altrimenti e` unicast verso il MAC indicato.
+ */
+int ethArpSend(t_arp_socket *as, const char *target,
+               const unsigned char *targetMac)
+{
+    struct in_addr tip;
+    int rval;
+
+    if (as == NULL || as->fd < 0)
+        return ETHBADCONFERR;
+    if (target == NULL || inet_pton(AF_INET, target, &tip) != 1)
+    {
+        DBG_E("Bad ARP target %s\n", target != NULL ? target : "--");
+        return ETHBADCONFERR;
+    }
+    rval = ethArpSendRequest(as, &as->addr, &tip, targetMac);
+    if (rval == ETHNOERR)
+        DBG_N("ARP who-has %s on %s (%s)\n", target, as->deviceName,
+              targetMac != NULL ? "unicast" : "broadcast");
+    return rval;
+}
+
+/*
+ * Prossima ARP reply in coda (senza bloccare): mittente in spa e
+ * replyMac. ETHARPERR se la coda e` vuota.
+ */
+static int ethArpRecvReply(t_arp_socket *as, struct in_addr *spa,
+                           unsigned char *replyMac)
+{
+    struct ether_arp rep;
+    ssize_t len;
+
+    for (;;)
+    {
+        len = recv(as->fd, &rep, sizeof(rep), 0);
+        if (len < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return ETHARPERR;
+            if (errno == EINTR)
+                continue;
+            DBG_E("Error on recv(%s): %s\n", as->deviceName, strerror(errno));
+            return ETHSOCKETERR;
+        }
+        if (len < (ssize_t)sizeof(rep))
+            continue;
+        if (ntohs(rep.arp_op) != ARPOP_REPLY ||
+            ntohs(rep.arp_pro) != ETH_P_IP)
+            continue;
+        memcpy(spa, rep.arp_spa, sizeof(struct in_addr));
+        memcpy(replyMac, rep.arp_sha, ETHARP_HWADDR_LEN);
+        return ETHNOERR;
+    }
+}
+
+/*
+ * Legge (senza bloccare) le risposte ARP in coda. Restituisce ETHNOERR
+ * e il MAC del mittente se fra queste c'e` la risposta di target,
+ * ETHARPERR se non e` (ancora) arrivata.
+ */
+int ethArpRecv(t_arp_socket *as, const char *target, unsigned char *replyMac)
+{
+    struct in_addr tip, spa;
+    unsigned char mac[ETHARP_HWADDR_LEN];
+    int rval;
+
+    if (as == NULL || as->fd < 0)
+        return ETHBADCONFERR;
+    if (target == NULL || inet_pton(AF_INET, target, &tip) != 1)
+        return ETHBADCONFERR;
+
+    while ((rval = ethArpRecvReply(as, &spa, mac)) == ETHNOERR)
+    {
+        if (spa.s_addr != tip.s_addr)
+            continue;
+        if (replyMac != NULL)
+            memcpy(replyMac, mac, ETHARP_HWADDR_LEN);
+        return ETHNOERR;
+    }
+    return rval;
+}
+
+/*
+ * Probe bloccante: invia la richiesta (ritrasmessa ogni
+ * ETHARP_RETRANS_MSECS) e attende la risposta di target per al massimo
+ * timeoutMs millisecondi.
+ */
+int ethArpProbe(const char *device, const char *target,
+                const unsigned char *targetMac,
+                unsigned char *replyMac, int timeoutMs)
+{
+    t_arp_socket as;
+    struct pollfd pfd;
+    long start, next, now;
+    int rval;
+
+    DBG_N("Enter %s -> %s\n", device != NULL ? device : "--",
+          target != NULL ? target : "--");
+    rval = ethArpOpen(device, &as);
+    if (rval != ETHNOERR)
+        return rval;
+
+    start = ethArpNowMs();
+    next = start;
+    rval = ETHARPERR;
+    pfd.fd = as.fd;
+    pfd.events = POLLIN;
+    for (now = start; now - start < timeoutMs; now = ethArpNowMs())
+    {
+        int wait;
+        if (now >= next)
+        {
+            rval = ethArpSend(&as, target, targetMac);
+            if (rval != ETHNOERR)
+                break;
+            rval = ETHARPERR;
+            next = now + ETHARP_RETRANS_MSECS;
+        }
+        wait = (int)((next < start + timeoutMs ? next : start + timeoutMs) - now);
+        if (poll(&pfd, 1, wait > 0 ? wait : 0) > 0)
+        {
+            rval = ethArpRecv(&as, target, replyMac);
+            if (rval != ETHARPERR)
+                break;
+        }
+    }
+    ethArpClose(&as);
+    DBG_N("Exit with %d after %ld ms\n", rval, ethArpNowMs() - start);
+    return rval;
+}
+
+/*
+ * Annuncio ARP (RFC 5227, 2.3): request broadcast con mittente e
+ * destinatario uguali all'indirizzo appena assegnato. I vicini che
+ * hanno gia` una voce per l'indirizzo la aggiornano col nostro MAC
+ * (sostituzione della macchina). Un annuncio per chiamata: il secondo,
+ * dopo ETHARP_ANNOUNCE_MSECS, lo pianifica il chiamante.
+ */
+int ethArpAnnounce(const char *device, const char *address)
+{
+    t_arp_socket as;
+    struct in_addr ip;
+    int rval;
+
+    if (address == NULL || inet_pton(AF_INET, address, &ip) != 1)
+    {
+        DBG_E("Bad ARP announce address %s\n", address != NULL ? address : "--");
+        return ETHBADCONFERR;
+    }
+    rval = ethArpOpen(device, &as);
+    if (rval != ETHNOERR)
+        return rval;
+    rval = ethArpSendRequest(&as, &ip, &ip, NULL);
+    if (rval == ETHNOERR)
+        DBG_N("ARP announce %s on %s\n", address, device);
+    ethArpClose(&as);
+    return rval;
+}
+
+/*
+ * Risolve insieme fino a ETHARP_RESOLVE_MAX vicini: richieste broadcast
+ * ritrasmesse ogni ETHARP_RETRANS_MSECS ai soli vicini che non hanno
+ * ancora risposto, per al massimo timeoutMs. resolved[i] indica se
+ * macs[i] e` valido. Restituisce il numero di vicini risolti, o errore.
+ */
+int ethArpResolve(const char *device, const char * const *targets,
+                  int nTargets, unsigned char (*macs)[ETHARP_HWADDR_LEN],
+                  int *resolved, int timeoutMs)
+{
+    t_arp_socket as;
+    struct pollfd pfd;
+    struct in_addr tip[ETHARP_RESOLVE_MAX], spa;
+    unsigned char mac[ETHARP_HWADDR_LEN];
+    long start, next, now;
+    int i, count = 0;
+    int rval;
+
+    if (nTargets > ETHARP_RESOLVE_MAX)
+        nTargets = ETHARP_RESOLVE_MAX;
+    for (i = 0; i < nTargets; i++)
+    {
+        resolved[i] = 0;
+        if (inet_pton(AF_INET, targets[i], &tip[i]) != 1)
+            return ETHBADCONFERR;
+    }
+    rval = ethArpOpen(device, &as);
+    if (rval != ETHNOERR)
+        return rval;
+
+    start = ethArpNowMs();
+    next = start;
+    pfd.fd = as.fd;
+    pfd.events = POLLIN;
+    for (now = start; count < nTargets && now - start < timeoutMs;
+         now = ethArpNowMs())
+    {
+        int wait;
+        if (now >= next)
+        {
+            for (i = 0; i < nTargets; i++)
+            {
+                if (!resolved[i])
+                    ethArpSendRequest(&as, &as.addr, &tip[i], NULL);
+            }
+            next = now + ETHARP_RETRANS_MSECS;
+        }
+        wait = (int)((next < start + timeoutMs ? next : start + timeoutMs) - now);
+        if (poll(&pfd, 1, wait > 0 ? wait : 0) <= 0)
+            continue;
+        while (ethArpRecvReply(&as, &spa, mac) == ETHNOERR)
+        {
+            for (i = 0; i < nTargets; i++)
+            {
+                if (!resolved[i] && spa.s_addr == tip[i].s_addr)
+                {
+                    memcpy(macs[i], mac, ETHARP_HWADDR_LEN);
+                    resolved[i] = 1;
+                    count++;
+                }
+            }
+        }
+    }
+    ethArpClose(&as);
+    DBG_N("Resolved %d/%d neighbors on %s in %ld ms\n", count, nTargets,
+          device, ethArpNowMs() - start);
+    return count;
+}
+
+void ethArpMacToString(const unsigned char *mac, char *str)
+{
+    sprintf(str, "%02x:%02x:%02x:%02x:%02x:%02x",
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+#ifdef __cplusplus
+}
+#endif
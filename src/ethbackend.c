@@ -0,0 +1,118 @@
+/*
+ * Selezione del backend e operazioni reali che non appartengono a
+ * ethapi. Compilando con -DETHAPI_DEBUG il backend di default e` il
+ * simulatore, come faceva la vecchia simulazione di ethConnect; a
+ * runtime lo si sceglie con ethBackendSet.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "ethbackend.h"
+#include "ethsim.h"
+#include "ethroute.h"
+#include "ethusdt.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ethRealCommand(const char *cmdline)
+{
+    long long start = ETHUSDT_NOW(spawn__done);
+    int rval;
+
+    DBG_V("Command: %s\n", cmdline);
+    ETHUSDT1(spawn__start, cmdline);
+    rval = system(cmdline);
+    ETHUSDT3(spawn__done, cmdline, rval, ETHUSDT_SINCE(spawn__done, start));
+    return rval;
+}
+
+static int ethRealDhcpStart(const char *device)
+{
+    char cmdline[64];
+
+    /* -nw: in background subito, il lease lo attende il chiamante */
+    snprintf(cmdline, sizeof(cmdline), "dhclient -nw %s", device);
+    return ethRealCommand(cmdline);
+}
+
+static int ethRealDefaultRoute(const char *device, const char *gateway)
+{
+    char cmdline[128];
+
+    snprintf(cmdline, sizeof(cmdline), "ip route add default via %s", gateway);
+    return ethRealCommand(cmdline);
+}
+
+static int ethRealWriteResolver(const char *dns1, const char *dns2)
+{
+    FILE *resolv = fopen("/etc/resolv.conf", "w");
+
+    if (resolv == NULL)
+    {
+        DBG_E("Unable to write /etc/resolv.conf: %s\n", strerror(errno));
+        return ETHFREADERR;
+    }
+    fprintf(resolv, "nameserver %s\n", dns1);
+    if (dns2 != NULL && dns2[0] != '\0')
+        fprintf(resolv, "nameserver %s\n", dns2);
+    fclose(resolv);
+    return ETHNOERR;
+}
+
+const t_eth_backend ethBackendReal = {
+    "real",
+    1,
+    ethRealCommand,
+    ethRealDhcpStart,
+    ethRealDefaultRoute,
+    ethRealReadAttr,
+    ethRealLinkStatus,
+    ethRealConnect,
+    ethRealNtpConfigure,
+    ethCheckHealth,
+    ethArpProbe,
+    ethRealWriteResolver,
+    ethNicApply,
+    ethQueueApply,
+    ethMtuSet,
+    ethPmtuProbe,
+    ethTcpBuffers,
+    ethQdiscApply,
+    ethQdiscStats,
+    ethArpAnnounce,
+    ethArpResolve,
+    ethRouteNeighSet,
+    ethRouteNeighUnpin,
+    ethNicLinkMode,
+    ethNicRenegotiate,
+};
+
+static const t_eth_backend *ethBackendCurrent = NULL;
+
+const t_eth_backend *ethBackend(void)
+{
+    if (ethBackendCurrent == NULL)
+    {
+#ifdef ETHAPI_DEBUG
+        ethBackendCurrent = ethSimBackend();
+#else
+        ethBackendCurrent = &ethBackendReal;
+#endif
+    }
+    return ethBackendCurrent;
+}
+
+void ethBackendSet(const t_eth_backend *backend)
+{
+    ethBackendCurrent = backend;
+    DBG_V("Backend: %s\n", backend->name);
+}
+
+#ifdef __cplusplus
+}
+#endif
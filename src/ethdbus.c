@@ -0,0 +1,679 @@
+/*
+ * Connessione asincrona al bus di sistema.
+ *
+ * La connessione viene aperta da un timer dell'event loop e non blocca
+ * mai: socket, autenticazione e Hello procedono tramite le watch e i
+ * timeout di libdbus registrati sull'event loop. Se il bus non c'e`
+ * ancora (avvio) o cade (riavvio di dbus-daemon) si ritenta con backoff
+ * esponenziale fino a ETHDBUS_RETRY_MAX_MSECS. A connessione stabilita
+ * viene ripubblicato l'ultimo stato di rete noto.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "ethdbus.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static t_ethdbus_prop *ethDbusFindProp(t_ethdbus *bus, const char *name)
+{
+    int i;
+
+    for (i = 0; i < bus->nProps; i++)
+    {
+        if (strcmp(bus->prop[i].name, name) == 0)
+            return &bus->prop[i];
+    }
+    return NULL;
+}
+
+/* Crea la proprieta` se manca; NULL se la tabella e` piena */
+static t_ethdbus_prop *ethDbusProp(t_ethdbus *bus, const char *name, int type)
+{
+    t_ethdbus_prop *p = ethDbusFindProp(bus, name);
+
+    if (p == NULL)
+    {
+        if (bus->nProps >= ETHDBUS_MAX_PROPS)
+        {
+            DBG_E("Too many D-Bus properties, %s dropped\n", name);
+            return NULL;
+        }
+        p = &bus->prop[bus->nProps++];
+        memset(p, 0, sizeof(t_ethdbus_prop));
+        strncpy(p->name, name, sizeof(p->name) - 1);
+    }
+    p->type = type;
+    return p;
+}
+
+static int ethDbusAppendVariant(DBusMessageIter *iter, const t_ethdbus_prop *p)
+{
+    DBusMessageIter var;
+    char sig[2] = { (char)p->type, '\0' };
+    const char *s = p->s;
+    dbus_int64_t i = p->i;
+    double d = p->d;
+    const void *value = &i;
+
+    if (p->type == DBUS_TYPE_STRING)
+        value = &s;
+    else if (p->type == DBUS_TYPE_DOUBLE)
+        value = &d;
+    return dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, sig,
+                                            &var) &&
+           dbus_message_iter_append_basic(&var, p->type, value) &&
+           dbus_message_iter_close_container(iter, &var);
+}
+
+/*
+ * org.freedesktop.DBus.Properties: Get(s,s) -> v e GetAll(s) -> a{sv}.
+ * I valori sono quelli memorizzati con ethDbusSet*; onGetProperties puo`
+ * rinfrescarli (contatori) appena prima della risposta.
+ */
+static DBusMessage *ethDbusProperties(t_ethdbus *bus, DBusMessage *msg)
+{
+    const char *iface = NULL;
+    const char *name = NULL;
+    DBusMessage *reply;
+    DBusMessageIter iter, dict, entry;
+    t_ethdbus_prop *p;
+    int ok = 1;
+    int i;
+
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_PROPERTIES, "Get"))
+    {
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &iface,
+                                   DBUS_TYPE_STRING, &name,
+                                   DBUS_TYPE_INVALID))
+            return dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
+                                          "Expected (ss)");
+    }
+    else if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &iface,
+                                    DBUS_TYPE_INVALID))
+        return dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
+                                      "Expected (s)");
+    if (strlen(iface) > 0 && strcmp(iface, bus->interfaceName) != 0)
+        return dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_INTERFACE, iface);
+    if (bus->onGetProperties != NULL)
+        bus->onGetProperties(bus, bus->cbData);
+
+    if (name != NULL)
+    {
+        p = ethDbusFindProp(bus, name);
+        if (p == NULL)
+            return dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_PROPERTY,
+                                          name);
+        reply = dbus_message_new_method_return(msg);
+        if (reply == NULL)
+            return NULL;
+        dbus_message_iter_init_append(reply, &iter);
+        ok = ethDbusAppendVariant(&iter, p);
+    }
+    else
+    {
+        reply = dbus_message_new_method_return(msg);
+        if (reply == NULL)
+            return NULL;
+        dbus_message_iter_init_append(reply, &iter);
+        ok = dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{sv}",
+                                              &dict);
+        for (i = 0; ok && i < bus->nProps; i++)
+        {
+            const char *key = bus->prop[i].name;
+
+            ok = dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY,
+                                                  NULL, &entry) &&
+                 dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+                                                &key) &&
+                 ethDbusAppendVariant(&entry, &bus->prop[i]) &&
+                 dbus_message_iter_close_container(&dict, &entry);
+        }
+        ok = ok && dbus_message_iter_close_container(&iter, &dict);
+    }
+    if (!ok)
+    {
+        dbus_message_unref(reply);
+        return NULL;
+    }
+    return reply;
+}
+
+static DBusHandlerResult ethDbusObjectMessage(DBusConnection *conn,
+                                              DBusMessage *msg, void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+    DBusMessage *reply;
+
+    if (dbus_message_is_method_call(msg, DBUS_INTERFACE_PROPERTIES, "Get") ||
+        dbus_message_is_method_call(msg, DBUS_INTERFACE_PROPERTIES, "GetAll"))
+        reply = ethDbusProperties(bus, msg);
+    else if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_METHOD_CALL &&
+             dbus_message_has_interface(msg, bus->interfaceName) &&
+             bus->onMethod != NULL)
+    {
+        reply = bus->onMethod(bus, msg, bus->cbData);
+        if (reply == NULL)
+            reply = dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_METHOD,
+                                           dbus_message_get_member(msg));
+    }
+    else
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    if (reply == NULL)
+        return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static const DBusObjectPathVTable ethDbusVTable = {
+    .message_function = ethDbusObjectMessage,
+};
+
+static void ethDbusConnect(void *data);
+static void ethDbusFdEvent(int fd, short revents, void *data);
+
+/* --- Watch: un solo fd registrato per socket, con l'unione dei flag --- */
+
+static void ethDbusUpdateFd(t_ethdbus *bus, int fd)
+{
+    short events = 0;
+    int i;
+
+    for (i = 0; i < bus->nWatches; i++)
+    {
+        DBusWatch *w = bus->watch[i];
+        unsigned int flags;
+
+        if (dbus_watch_get_unix_fd(w) != fd || !dbus_watch_get_enabled(w))
+            continue;
+        flags = dbus_watch_get_flags(w);
+        if (flags & DBUS_WATCH_READABLE)
+            events |= POLLIN;
+        if (flags & DBUS_WATCH_WRITABLE)
+            events |= POLLOUT;
+    }
+    if (events == 0)
+        evLoopDelFd(bus->loop, fd);
+    else if (evLoopModFd(bus->loop, fd, events) != ETHNOERR)
+        evLoopAddFd(bus->loop, fd, events, ethDbusFdEvent, bus);
+}
+
+static int ethDbusHasWatch(const t_ethdbus *bus, const DBusWatch *w)
+{
+    int i;
+    for (i = 0; i < bus->nWatches; i++)
+    {
+        if (bus->watch[i] == w)
+            return 1;
+    }
+    return 0;
+}
+
+static void ethDbusFdEvent(int fd, short revents, void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+    DBusWatch *ready[ETHDBUS_MAX_WATCHES];
+    int n = 0;
+    int i;
+
+    for (i = 0; i < bus->nWatches; i++)
+    {
+        if (dbus_watch_get_unix_fd(bus->watch[i]) == fd &&
+            dbus_watch_get_enabled(bus->watch[i]))
+            ready[n++] = bus->watch[i];
+    }
+    for (i = 0; i < n; i++)
+    {
+        unsigned int flags, cond = 0;
+
+        /* Gestire una watch puo` rimuoverne altre */
+        if (!ethDbusHasWatch(bus, ready[i]))
+            continue;
+        flags = dbus_watch_get_flags(ready[i]);
+        if ((revents & POLLIN) && (flags & DBUS_WATCH_READABLE))
+            cond |= DBUS_WATCH_READABLE;
+        if ((revents & POLLOUT) && (flags & DBUS_WATCH_WRITABLE))
+            cond |= DBUS_WATCH_WRITABLE;
+        if (revents & POLLERR)
+            cond |= DBUS_WATCH_ERROR;
+        if (revents & POLLHUP)
+            cond |= DBUS_WATCH_HANGUP;
+        if (cond != 0)
+            dbus_watch_handle(ready[i], cond);
+    }
+}
+
+static dbus_bool_t ethDbusAddWatch(DBusWatch *w, void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+
+    if (bus->nWatches >= ETHDBUS_MAX_WATCHES)
+        return FALSE;
+    bus->watch[bus->nWatches++] = w;
+    ethDbusUpdateFd(bus, dbus_watch_get_unix_fd(w));
+    return TRUE;
+}
+
+static void ethDbusRemoveWatch(DBusWatch *w, void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+    int i;
+
+    for (i = 0; i < bus->nWatches; i++)
+    {
+        if (bus->watch[i] == w)
+        {
+            bus->watch[i] = bus->watch[--bus->nWatches];
+            ethDbusUpdateFd(bus, dbus_watch_get_unix_fd(w));
+            return;
+        }
+    }
+}
+
+static void ethDbusToggleWatch(DBusWatch *w, void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+    if (ethDbusHasWatch(bus, w))
+        ethDbusUpdateFd(bus, dbus_watch_get_unix_fd(w));
+}
+
+/* --- Timeout: periodici per libdbus, riarmati a ogni scadenza --- */
+
+static void ethDbusTimeoutEvent(void *data);
+
+static void ethDbusArmTimeout(t_ethdbus_timeout *slot)
+{
+    slot->timerId = 0;
+    if (dbus_timeout_get_enabled(slot->timeout))
+        slot->timerId = evLoopAddTimer(slot->bus->loop,
+                                       dbus_timeout_get_interval(slot->timeout),
+                                       ethDbusTimeoutEvent, slot);
+}
+
+static void ethDbusTimeoutEvent(void *data)
+{
+    t_ethdbus_timeout *slot = (t_ethdbus_timeout *)data;
+    DBusTimeout *t = slot->timeout;
+
+    slot->timerId = 0;
+    dbus_timeout_handle(t);
+    if (slot->timeout == t && slot->timerId == 0)
+        ethDbusArmTimeout(slot);
+}
+
+static dbus_bool_t ethDbusAddTimeout(DBusTimeout *t, void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+    int i;
+
+    for (i = 0; i < ETHDBUS_MAX_TIMEOUTS; i++)
+    {
+        t_ethdbus_timeout *slot = &bus->timeout[i];
+        if (slot->timeout == NULL)
+        {
+            slot->timeout = t;
+            slot->bus = bus;
+            dbus_timeout_set_data(t, slot, NULL);
+            ethDbusArmTimeout(slot);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void ethDbusRemoveTimeout(DBusTimeout *t, void *data)
+{
+    t_ethdbus_timeout *slot = (t_ethdbus_timeout *)dbus_timeout_get_data(t);
+    if (slot == NULL || slot->timeout != t)
+        return;
+    evLoopDelTimer(slot->bus->loop, slot->timerId);
+    slot->timerId = 0;
+    slot->timeout = NULL;
+}
+
+static void ethDbusToggleTimeout(DBusTimeout *t, void *data)
+{
+    t_ethdbus_timeout *slot = (t_ethdbus_timeout *)dbus_timeout_get_data(t);
+    if (slot == NULL || slot->timeout != t)
+        return;
+    evLoopDelTimer(slot->bus->loop, slot->timerId);
+    ethDbusArmTimeout(slot);
+}
+
+/* --- Dispatch dei messaggi in coda, fuori dai callback di libdbus --- */
+
+static void ethDbusDispatch(void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+
+    bus->dispatchTimer = 0;
+    while (bus->conn != NULL &&
+           dbus_connection_dispatch(bus->conn) == DBUS_DISPATCH_DATA_REMAINS)
+        ;
+}
+
+static void ethDbusDispatchStatus(DBusConnection *conn,
+                                  DBusDispatchStatus status, void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+    if (status == DBUS_DISPATCH_DATA_REMAINS && bus->dispatchTimer == 0)
+        bus->dispatchTimer = evLoopAddTimer(bus->loop, 0, ethDbusDispatch, bus);
+}
+
+/* --- Ciclo di vita della connessione --- */
+
+/*
+ * Toglie dall'event loop fd e timer della connessione corrente. La
+ * connessione viene chiusa solo al prossimo tentativo (o allo stop):
+ * chiuderla qui, dentro un callback di libdbus, non e` sicuro.
+ */
+static void ethDbusDetach(t_ethdbus *bus)
+{
+    int i;
+
+    for (i = 0; i < bus->nWatches; i++)
+        evLoopDelFd(bus->loop, dbus_watch_get_unix_fd(bus->watch[i]));
+    bus->nWatches = 0;
+    for (i = 0; i < ETHDBUS_MAX_TIMEOUTS; i++)
+    {
+        evLoopDelTimer(bus->loop, bus->timeout[i].timerId);
+        bus->timeout[i].timerId = 0;
+        bus->timeout[i].timeout = NULL;
+    }
+    evLoopDelTimer(bus->loop, bus->dispatchTimer);
+    bus->dispatchTimer = 0;
+}
+
+static void ethDbusClose(t_ethdbus *bus)
+{
+    ethDbusDetach(bus);
+    if (bus->hello != NULL)
+    {
+        dbus_pending_call_cancel(bus->hello);
+        dbus_pending_call_unref(bus->hello);
+        bus->hello = NULL;
+    }
+    if (bus->conn != NULL)
+    {
+        /* Niente piu` callback verso strutture gia` rilasciate */
+        dbus_connection_set_watch_functions(bus->conn, NULL, NULL, NULL,
+                                            NULL, NULL);
+        dbus_connection_set_timeout_functions(bus->conn, NULL, NULL, NULL,
+                                              NULL, NULL);
+        dbus_connection_set_dispatch_status_function(bus->conn, NULL, NULL,
+                                                     NULL);
+        dbus_connection_close(bus->conn);
+        dbus_connection_unref(bus->conn);
+        bus->conn = NULL;
+    }
+}
+
+static void ethDbusRetry(t_ethdbus *bus)
+{
+    ethDbusDetach(bus);
+    bus->state = ETHDBUS_DISCONNECTED;
+    if (bus->retryTimer == 0)
+    {
+        DBG_V("D-Bus retry in %d ms\n", bus->retryMs);
+        bus->retryTimer = evLoopAddTimer(bus->loop, bus->retryMs,
+                                         ethDbusConnect, bus);
+        bus->retryMs *= 2;
+        if (bus->retryMs > ETHDBUS_RETRY_MAX_MSECS)
+            bus->retryMs = ETHDBUS_RETRY_MAX_MSECS;
+    }
+}
+
+static DBusHandlerResult ethDbusFilter(DBusConnection *conn, DBusMessage *msg,
+                                       void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+
+    if (dbus_message_is_signal(msg, DBUS_INTERFACE_LOCAL, "Disconnected"))
+    {
+        DBG_E("Lost connection to D-Bus system bus\n");
+        bus->retryMs = ETHDBUS_RETRY_MIN_MSECS;
+        ethDbusRetry(bus);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void ethDbusSendState(t_ethdbus *bus)
+{
+    const char *device = bus->device;
+    const char *state = bus->netState;
+    DBusMessage *msg;
+
+    if (bus->state != ETHDBUS_CONNECTED || strlen(bus->netState) == 0)
+        return;
+    msg = dbus_message_new_signal(bus->objectPath, bus->interfaceName,
+                                  "StateChanged");
+    if (msg == NULL)
+        return;
+    if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &device,
+                                  DBUS_TYPE_STRING, &state,
+                                  DBUS_TYPE_INVALID) ||
+        !dbus_connection_send(bus->conn, msg, NULL))
+    {
+        DBG_E("Unable to send StateChanged(%s, %s)\n", device, state);
+    }
+    else
+    {
+        DBG_N("StateChanged(%s, %s)\n", device, state);
+    }
+    dbus_message_unref(msg);
+}
+
+static void ethDbusHelloReply(DBusPendingCall *pending, void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+    DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+    const char *name = NULL;
+    DBusError error;
+
+    dbus_pending_call_unref(bus->hello);
+    bus->hello = NULL;
+    dbus_error_init(&error);
+    if (reply == NULL || dbus_set_error_from_message(&error, reply) ||
+        !dbus_message_get_args(reply, &error, DBUS_TYPE_STRING, &name,
+                               DBUS_TYPE_INVALID))
+    {
+        DBG_E("D-Bus Hello failed: %s\n",
+              dbus_error_is_set(&error) ? error.message : "no reply");
+        dbus_error_free(&error);
+        if (reply != NULL)
+            dbus_message_unref(reply);
+        ethDbusRetry(bus);
+        return;
+    }
+    dbus_bus_set_unique_name(bus->conn, name);
+    dbus_message_unref(reply);
+
+    if (!dbus_connection_register_object_path(bus->conn, bus->objectPath,
+                                              &ethDbusVTable, bus))
+    {
+        DBG_E("Unable to register D-Bus object path %s\n", bus->objectPath);
+        ethDbusRetry(bus);
+        return;
+    }
+    bus->state = ETHDBUS_CONNECTED;
+    bus->retryMs = ETHDBUS_RETRY_MIN_MSECS;
+    DBG_I("Connected to D-Bus system bus as %s\n", name);
+    ethDbusSendState(bus);
+    if (bus->onConnect != NULL)
+        bus->onConnect(bus, bus->cbData);
+}
+
+/*
+ * Apre il socket e invia Hello senza attendere: la risposta arriva in
+ * ethDbusHelloReply tramite l'event loop.
+ */
+static void ethDbusConnect(void *data)
+{
+    t_ethdbus *bus = (t_ethdbus *)data;
+    const char *address = getenv("DBUS_SYSTEM_BUS_ADDRESS");
+    DBusMessage *hello;
+    DBusError error;
+
+    bus->retryTimer = 0;
+    ethDbusClose(bus);
+    if (address == NULL)
+        address = ETHDBUS_SYSTEM_BUS_ADDRESS;
+
+    dbus_error_init(&error);
+    bus->conn = dbus_connection_open_private(address, &error);
+    if (bus->conn == NULL)
+    {
+        DBG_V("D-Bus system bus not available: %s\n",
+              dbus_error_is_set(&error) ? error.message : address);
+        dbus_error_free(&error);
+        ethDbusRetry(bus);
+        return;
+    }
+    bus->state = ETHDBUS_CONNECTING;
+    dbus_connection_set_exit_on_disconnect(bus->conn, FALSE);
+    dbus_connection_set_dispatch_status_function(bus->conn,
+                                                 ethDbusDispatchStatus,
+                                                 bus, NULL);
+    hello = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                         DBUS_INTERFACE_DBUS, "Hello");
+    if (!dbus_connection_set_watch_functions(bus->conn, ethDbusAddWatch,
+                                             ethDbusRemoveWatch,
+                                             ethDbusToggleWatch, bus, NULL) ||
+        !dbus_connection_set_timeout_functions(bus->conn, ethDbusAddTimeout,
+                                               ethDbusRemoveTimeout,
+                                               ethDbusToggleTimeout,
+                                               bus, NULL) ||
+        !dbus_connection_add_filter(bus->conn, ethDbusFilter, bus, NULL) ||
+        hello == NULL ||
+        !dbus_connection_send_with_reply(bus->conn, hello, &bus->hello,
+                                         ETHDBUS_HELLO_MSECS) ||
+        bus->hello == NULL ||
+        !dbus_pending_call_set_notify(bus->hello, ethDbusHelloReply,
+                                      bus, NULL))
+    {
+        DBG_E("Unable to set up D-Bus connection\n");
+        if (hello != NULL)
+            dbus_message_unref(hello);
+        ethDbusRetry(bus);
+        return;
+    }
+    dbus_message_unref(hello);
+    DBG_N("D-Bus Hello sent on %s\n", address);
+}
+
+void ethDbusInit(t_ethdbus *bus, const char *objectPath,
+                 const char *interfaceName)
+{
+    memset(bus, 0, sizeof(t_ethdbus));
+    bus->objectPath = objectPath;
+    bus->interfaceName = interfaceName;
+    bus->retryMs = ETHDBUS_RETRY_MIN_MSECS;
+}
+
+/*
+ * Pianifica il primo tentativo e ritorna subito.
+ */
+int ethDbusStart(t_ethdbus *bus, t_evloop *loop)
+{
+    bus->loop = loop;
+    bus->retryTimer = evLoopAddTimer(loop, 0, ethDbusConnect, bus);
+    return bus->retryTimer > 0 ? ETHNOERR : ETHCONFIGBUSY;
+}
+
+void ethDbusStop(t_ethdbus *bus)
+{
+    if (bus->loop == NULL)
+        return;
+    evLoopDelTimer(bus->loop, bus->retryTimer);
+    bus->retryTimer = 0;
+    if (bus->state == ETHDBUS_CONNECTED)
+        dbus_connection_flush(bus->conn);
+    ethDbusClose(bus);
+    bus->state = ETHDBUS_DISCONNECTED;
+}
+
+int ethDbusIsConnected(const t_ethdbus *bus)
+{
+    return bus->state == ETHDBUS_CONNECTED;
+}
+
+/*
+ * Memorizza lo stato e lo pubblica come segnale StateChanged(device,
+ * state). Da disconnessi il segnale parte alla connessione.
+ */
+void ethDbusPublishState(t_ethdbus *bus, const char *device, const char *state)
+{
+    memset(bus->device, 0, sizeof(bus->device));
+    memset(bus->netState, 0, sizeof(bus->netState));
+    strncpy(bus->device, device, sizeof(bus->device) - 1);
+    strncpy(bus->netState, state, sizeof(bus->netState) - 1);
+    ethDbusSendState(bus);
+}
+
+/*
+ * Segnale di evento member(device, detail): a differenza di StateChanged
+ * non viene ripetuto alla connessione, da disconnessi si perde.
+ */
+void ethDbusEmit(t_ethdbus *bus, const char *member, const char *device,
+                 const char *detail)
+{
+    DBusMessage *msg;
+
+    if (bus->state != ETHDBUS_CONNECTED)
+        return;
+    msg = dbus_message_new_signal(bus->objectPath, bus->interfaceName, member);
+    if (msg == NULL)
+        return;
+    if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &device,
+                                  DBUS_TYPE_STRING, &detail,
+                                  DBUS_TYPE_INVALID) ||
+        !dbus_connection_send(bus->conn, msg, NULL))
+    {
+        DBG_E("Unable to send %s(%s, %s)\n", member, device, detail);
+    }
+    else
+    {
+        DBG_N("%s(%s, %s)\n", member, device, detail);
+    }
+    dbus_message_unref(msg);
+}
+
+/*
+ * Valori delle proprieta` esposte con Get/GetAll: nessun segnale
+ * PropertiesChanged, i client le leggono quando servono.
+ */
+void ethDbusSetInt(t_ethdbus *bus, const char *name, long long value)
+{
+    t_ethdbus_prop *p = ethDbusProp(bus, name, DBUS_TYPE_INT64);
+
+    if (p != NULL)
+        p->i = value;
+}
+
+void ethDbusSetDouble(t_ethdbus *bus, const char *name, double value)
+{
+    t_ethdbus_prop *p = ethDbusProp(bus, name, DBUS_TYPE_DOUBLE);
+
+    if (p != NULL)
+        p->d = value;
+}
+
+void ethDbusSetString(t_ethdbus *bus, const char *name, const char *value)
+{
+    t_ethdbus_prop *p = ethDbusProp(bus, name, DBUS_TYPE_STRING);
+
+    if (p != NULL)
+    {
+        memset(p->s, 0, sizeof(p->s));
+        strncpy(p->s, value, sizeof(p->s) - 1);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,198 @@
+/*
+ * Classifica dei nameserver.
+ *
+ * Il resolver di glibc interroga i server nell'ordine di resolv.conf e
+ * passa al successivo solo dopo il timeout (5 s): conta quindi soprattutto
+ * chi e` primo. A ogni giro parte una query A verso ogni server, in
+ * parallelo con i probe DNS dell'event loop. Il costo di un server e` il
+ * tempo atteso della risposta quando e` primo: la latenza smussata se
+ * risponde, l'attesa del resolver se la query si perde, pesate con il
+ * tasso di errore smussato. Il primo cambia solo se un altro server costa
+ * sensibilmente meno (DNSMON_MARGIN_*) per DNSMON_SWITCH_COUNT giri di
+ * fila: due server quasi equivalenti non si scambiano a ogni giro.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "debug.h"
+#include "ethdnsmon.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static void ethDnsMonRound(void *data);
+
+void ethDnsMonInit(t_dnsmon *mon)
+{
+    memset(mon, 0, sizeof(t_dnsmon));
+    mon->intervalMs = DNSMON_INTERVAL_MSECS;
+    mon->timeoutMs = DNSMON_TIMEOUT_MSECS;
+    mon->candidate = -1;
+    strncpy(mon->name, PROBE_DNS_NAME, sizeof(mon->name) - 1);
+}
+
+/* I server entrano nell'ordine di configurazione, che e` quello iniziale */
+int ethDnsMonAdd(t_dnsmon *mon, const char *address)
+{
+    t_dnsmon_server *s;
+    char spec[IPv4ADDR_LEN + PROBE_ARG_LEN + 8];
+    int i;
+
+    if (address == NULL || address[0] == '\0')
+        return ETHBADCONFERR;
+    for (i = 0; i < mon->nServers; i++)
+    {
+        if (strcmp(mon->server[i].address, address) == 0)
+            return ETHNOERR;
+    }
+    if (mon->nServers >= DNSMON_MAX_SERVERS)
+        return ETHCONFIGBUSY;
+    s = &mon->server[mon->nServers];
+    memset(s, 0, sizeof(t_dnsmon_server));
+    snprintf(spec, sizeof(spec), "dns %s %s", address, mon->name);
+    if (ethProbeParse(spec, &s->probe) != ETHNOERR)
+        return ETHBADCONFERR;
+    strncpy(s->address, address, sizeof(s->address) - 1);
+    s->mon = mon;
+    mon->order[mon->nServers] = mon->nServers;
+    mon->nServers++;
+    return ETHNOERR;
+}
+
+/* Tempo atteso (ms) di una query con il server al primo posto */
+double ethDnsMonCost(const t_dnsmon *mon, int idx)
+{
+    const t_dnsmon_server *s = &mon->server[idx];
+
+    return (1.0 - s->failRate) * s->latencyMs + s->failRate * DNSMON_FAIL_MSECS;
+}
+
+/* Ordine per costo crescente; a parita` resta quello corrente */
+static void ethDnsMonSort(t_dnsmon *mon)
+{
+    int i, j, k;
+
+    for (i = 1; i < mon->nServers; i++)
+    {
+        k = mon->order[i];
+        for (j = i; j > 0 && ethDnsMonCost(mon, mon->order[j - 1]) >
+                              ethDnsMonCost(mon, k); j--)
+            mon->order[j] = mon->order[j - 1];
+        mon->order[j] = k;
+    }
+}
+
+static void ethDnsMonJudge(t_dnsmon *mon)
+{
+    int leader = mon->order[0];
+    int best = leader;
+    double lead, cost;
+    int i;
+
+    for (i = 0; i < mon->nServers; i++)
+    {
+        if (mon->server[i].samples > 0 &&
+            ethDnsMonCost(mon, i) < ethDnsMonCost(mon, best))
+            best = i;
+    }
+    lead = ethDnsMonCost(mon, leader);
+    cost = ethDnsMonCost(mon, best);
+    if (best == leader || cost > lead * (100 - DNSMON_MARGIN_PCT) / 100.0 ||
+        lead - cost < DNSMON_MARGIN_MSECS)
+    {
+        mon->candidate = -1;
+        mon->candidateCount = 0;
+        return;
+    }
+    if (best != mon->candidate)
+    {
+        mon->candidate = best;
+        mon->candidateCount = 0;
+    }
+    if (++mon->candidateCount < DNSMON_SWITCH_COUNT)
+        return;
+
+    ethDnsMonSort(mon);
+    mon->candidate = -1;
+    mon->candidateCount = 0;
+    DBG_V("Nameserver %s (%.1f ms) ahead of %s (%.1f ms)\n",
+          mon->server[best].address, cost, mon->server[leader].address, lead);
+    if (mon->onReorder != NULL)
+        mon->onReorder(mon, mon->cbData);
+}
+
+static void ethDnsMonDone(t_probe_run *run, void *data)
+{
+    t_dnsmon_server *s = (t_dnsmon_server *)data;
+    t_dnsmon *mon = s->mon;
+    int ok = run->winner >= 0;
+
+    s->last = run->state[0].status;
+    s->lastMs = run->state[0].rttMs;
+    if (ok)
+        s->latencyMs = s->replies++ > 0
+                       ? (1 - DNSMON_ALPHA) * s->latencyMs + DNSMON_ALPHA * s->lastMs
+                       : s->lastMs;
+    s->failRate = s->samples > 0
+                  ? (1 - DNSMON_ALPHA) * s->failRate + DNSMON_ALPHA * !ok
+                  : !ok;
+    s->samples++;
+    DBG_N("Nameserver %s: %s in %ld ms, latency %.1f ms, failures %.0f%%\n",
+          s->address, ethProbeStatusName(s->last), s->lastMs, s->latencyMs,
+          s->failRate * 100);
+
+    if (--mon->pending > 0)
+        return;
+    ethDnsMonJudge(mon);
+    if (mon->onRound != NULL)
+        mon->onRound(mon, mon->cbData);
+    mon->timerId = evLoopAddTimer(mon->loop, mon->intervalMs, ethDnsMonRound,
+                                  mon);
+}
+
+static void ethDnsMonRound(void *data)
+{
+    t_dnsmon *mon = (t_dnsmon *)data;
+    int i;
+
+    mon->timerId = 0;
+    mon->pending = mon->nServers;
+    for (i = 0; i < mon->nServers; i++)
+    {
+        mon->server[i].probe.timeoutMs = mon->timeoutMs;
+        ethProbeStart(&mon->server[i].run, mon->loop, &mon->server[i].probe, 1,
+                      ethDnsMonDone, &mon->server[i]);
+    }
+}
+
+/* Il primo giro parte subito */
+int ethDnsMonStart(t_dnsmon *mon, t_evloop *loop)
+{
+    if (mon->nServers == 0 || mon->intervalMs <= 0)
+        return ETHBADCONFERR;
+    mon->loop = loop;
+    mon->timerId = evLoopAddTimer(loop, 0, ethDnsMonRound, mon);
+    return mon->timerId > 0 ? ETHNOERR : ETHCONFIGBUSY;
+}
+
+void ethDnsMonStop(t_dnsmon *mon)
+{
+    int i;
+
+    if (mon->loop == NULL)
+        return;
+    evLoopDelTimer(mon->loop, mon->timerId);
+    mon->timerId = 0;
+    if (mon->pending > 0)
+    {
+        for (i = 0; i < mon->nServers; i++)
+            ethProbeCancel(&mon->server[i].run);
+    }
+    mon->pending = 0;
+    mon->loop = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
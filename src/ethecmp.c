@@ -0,0 +1,137 @@
+/*
+ * Default route ECMP.
+ *
+ * Tutti i gateway configurati finiscono in un'unica route multipath
+ * (RTA_MULTIPATH, un rtnexthop per gateway con il suo peso), cosi` il
+ * kernel distribuisce i flussi su tutti gli uplink. Ogni nexthop e`
+ * sorvegliato via ARP (ethgwmon): quando uno smette di rispondere la
+ * route viene sostituita atomicamente con i soli nexthop sani, e quando
+ * torna sano viene reinserito.
+ */
+#include <string.h>
+#include "debug.h"
+#include "ethecmp.h"
+#include "ethroute.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ethEcmpInit(t_ecmp *e, int metric)
+{
+    memset(e, 0, sizeof(t_ecmp));
+    ethGwMonInit(&e->mon);
+    e->metric = metric;
+}
+
+int ethEcmpAddGateway(t_ecmp *e, const char *device, const char *gateway,
+                      int weight)
+{
+    int idx = ethGwMonAdd(&e->mon, device, gateway);
+    if (idx < 0)
+        return idx;
+    e->weight[idx] = weight;
+    return ETHNOERR;
+}
+
+static unsigned int ethEcmpAll(const t_ecmp *e)
+{
+    return (1U << e->mon.nTargets) - 1;
+}
+
+static int ethEcmpInstall(t_ecmp *e, unsigned int mask)
+{
+    t_route r;
+    int i, rval;
+
+    memset(&r, 0, sizeof(t_route));
+    r.metric = e->metric;
+    r.metrics = e->metrics;
+    for (i = 0; i < e->mon.nTargets; i++)
+    {
+        if (mask & (1U << i))
+        {
+            rval = ethRouteAddNexthop(&r, e->mon.target[i].gateway,
+                                      e->mon.target[i].deviceName,
+                                      e->weight[i]);
+            if (rval != ETHNOERR)
+                return rval;
+        }
+    }
+    rval = ethRouteAdd(&r, 1);
+    if (rval == ETHNOERR)
+    {
+        e->installed = mask;
+        DBG_I("ECMP default route: %d/%d nexthops\n", r.nNexthops,
+              e->mon.nTargets);
+    }
+    return rval;
+}
+
+/*
+ * Si tolgono solo i nexthop con un guasto accertato (quelli in attesa di
+ * verdetto, es. appena avviato, restano nella route) e si reinseriscono
+ * solo quando tornano sani, non alla prima risposta.
+ */
+static void ethEcmpEvaluate(t_gwmon *mon, void *data)
+{
+    t_ecmp *e = (t_ecmp *)data;
+    unsigned int mask;
+    int i;
+
+    for (i = 0; i < mon->nTargets; i++)
+    {
+        const t_gwmon_target *t = &mon->target[i];
+        if (t->healthy)
+            e->withdrawn &= ~(1U << i);
+        else if (t->failCount >= mon->failCount)
+            e->withdrawn |= 1U << i;
+    }
+    mask = ethEcmpAll(e) & ~e->withdrawn;
+    if (mask == 0)
+    {
+        /* Nessun nexthop sano: meglio lasciarli tutti che nessuno */
+        mask = ethEcmpAll(e);
+    }
+    if (mask != e->installed)
+        ethEcmpInstall(e, mask);
+}
+
+static void ethEcmpChange(t_gwmon *mon, int idx, void *data)
+{
+    DBG_I("ECMP nexthop %s %s\n", mon->target[idx].gateway,
+          mon->target[idx].healthy ? "healthy" : "withdrawn");
+    ethEcmpEvaluate(mon, data);
+}
+
+int ethEcmpStart(t_ecmp *e, t_evloop *loop)
+{
+    int rval;
+
+    if (e->running)
+        ethEcmpStop(e);
+    e->loop = loop;
+    e->withdrawn = 0;
+    rval = ethEcmpInstall(e, ethEcmpAll(e));
+    if (rval != ETHNOERR)
+        return rval;
+    e->mon.onChange = ethEcmpChange;
+    e->mon.onTick = ethEcmpEvaluate;
+    e->mon.cbData = e;
+    rval = ethGwMonStart(&e->mon, loop);
+    e->running = rval == ETHNOERR;
+    return rval;
+}
+
+void ethEcmpStop(t_ecmp *e)
+{
+    if (!e->running)
+        return;
+    ethGwMonStop(&e->mon);
+    e->running = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,177 @@
+/*
+ * Failover della default route fra piu` uplink.
+ *
+ * Ogni uplink ha una propria default route di riserva (metrica
+ * FAILOVER_BASE_METRIC + 10 * priorita`) e il suo gateway viene sondato
+ * di continuo (ethgwmon). La default route preferita (metrica
+ * FAILOVER_ROUTE_METRIC) punta all'uplink sano di priorita` piu` alta e
+ * viene spostata con un'unica RTM_NEWROUTE/NLM_F_REPLACE, quindi senza
+ * buchi di instradamento. Il ritorno sul primario (failback) avviene
+ * solo dopo FAILOVER_HOLD_MSECS di stabilita`.
+ */
+#include <string.h>
+#include "debug.h"
+#include "ethfailover.h"
+#include "ethroute.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ethFailoverInit(t_failover *fo)
+{
+    memset(fo, 0, sizeof(t_failover));
+    ethGwMonInit(&fo->mon);
+    fo->active = -1;
+    fo->holdMs = FAILOVER_HOLD_MSECS;
+}
+
+/*
+ * spec: "device[:gateway]". Senza gateway si usa quello della default
+ * route presente sul device all'avvio.
+ */
+int ethFailoverAddUplink(t_failover *fo, const char *spec)
+{
+    char device[DEVICENAME_LEN];
+    const char *sep;
+    size_t len;
+
+    if (fo->mon.nTargets >= FAILOVER_MAX_UPLINKS)
+    {
+        DBG_E("Too many uplinks (max %d)\n", FAILOVER_MAX_UPLINKS);
+        return ETHCONFIGBUSY;
+    }
+    sep = strchr(spec, ':');
+    len = sep != NULL ? (size_t)(sep - spec) : strlen(spec);
+    if (len == 0 || len >= sizeof(device))
+        return ETHDEVICEERR;
+    memset(device, 0, sizeof(device));
+    memcpy(device, spec, len);
+    if (ethGwMonAdd(&fo->mon, device, sep != NULL ? sep + 1 : NULL) < 0)
+        return ETHBADCONFERR;
+    return ETHNOERR;
+}
+
+int ethFailoverCount(const t_failover *fo)
+{
+    return fo->mon.nTargets;
+}
+
+static void ethFailoverSwitch(t_failover *fo, int to)
+{
+    t_uplink *from = fo->active >= 0 ? &fo->mon.target[fo->active] : NULL;
+    t_uplink *up = &fo->mon.target[to];
+    t_route r;
+
+    if (ethRouteDefaultInit(&r, up->gateway, up->deviceName,
+                            FAILOVER_ROUTE_METRIC) != ETHNOERR ||
+        ethRouteAdd(&r, 1) != ETHNOERR)
+    {
+        DBG_E("Unable to move default route to %s via %s\n",
+              up->deviceName, up->gateway);
+        return;
+    }
+    if (from != NULL && !from->healthy)
+    {
+        DBG_I("Failover %s -> %s (via %s) in %lld ms\n", from->deviceName,
+              up->deviceName, up->gateway, evLoopNowMs() - from->firstMissMs);
+    }
+    else
+    {
+        DBG_I("Default route on %s via %s\n", up->deviceName, up->gateway);
+    }
+    fo->active = to;
+    if (fo->onSwitch != NULL)
+        fo->onSwitch(from, up, fo->cbData);
+}
+
+/*
+ * Sceglie l'uplink sano di priorita` piu` alta. Se l'uplink attivo e`
+ * sano si torna su uno migliore solo dopo holdMs di stabilita`.
+ */
+static void ethFailoverEvaluate(t_gwmon *mon, void *data)
+{
+    t_failover *fo = (t_failover *)data;
+    int best = -1;
+    int i;
+
+    for (i = 0; i < mon->nTargets; i++)
+    {
+        if (mon->target[i].healthy)
+        {
+            best = i;
+            break;
+        }
+    }
+    if (best == fo->active)
+        return;
+    if (best < 0)
+    {
+        if (fo->active >= 0)
+            DBG_E("No healthy uplink: default route left on %s\n",
+                  mon->target[fo->active].deviceName);
+        return;
+    }
+    if (fo->active >= 0 && mon->target[fo->active].healthy &&
+        evLoopNowMs() - mon->target[best].healthySince < fo->holdMs)
+        return;
+    ethFailoverSwitch(fo, best);
+}
+
+static void ethFailoverChange(t_gwmon *mon, int idx, void *data)
+{
+    (void)idx;
+    ethFailoverEvaluate(mon, data);
+}
+
+int ethFailoverStart(t_failover *fo, t_evloop *loop)
+{
+    int i;
+
+    fo->loop = loop;
+    for (i = 0; i < fo->mon.nTargets; i++)
+    {
+        t_uplink *up = &fo->mon.target[i];
+        t_route r;
+
+        if (strlen(up->gateway) == 0)
+        {
+            t_network_conf conf;
+            memset(&conf, 0, sizeof(t_network_conf));
+            strncpy(conf.deviceName, up->deviceName,
+                    sizeof(conf.deviceName) - 1);
+            ethGetDefaultGateway(&conf);
+            if (strlen(conf.gateway) == 0 || strcmp(conf.gateway, "--") == 0)
+            {
+                DBG_E("Uplink %s: no gateway given or found\n",
+                      up->deviceName);
+                return ETHBADCONFERR;
+            }
+            strncpy(up->gateway, conf.gateway, sizeof(up->gateway) - 1);
+        }
+
+        /* Route di riserva: resta valida anche se il demone si ferma */
+        if (ethRouteDefaultInit(&r, up->gateway, up->deviceName,
+                                FAILOVER_BASE_METRIC + 10 * i) != ETHNOERR ||
+            ethRouteAdd(&r, 1) != ETHNOERR)
+        {
+            DBG_E("Uplink %s: unable to install backup route\n",
+                  up->deviceName);
+        }
+        DBG_I("Uplink %d: %s via %s\n", i, up->deviceName, up->gateway);
+    }
+    fo->mon.onChange = ethFailoverChange;
+    fo->mon.onTick = ethFailoverEvaluate; /* scadenza del tempo di failback */
+    fo->mon.cbData = fo;
+    return ethGwMonStart(&fo->mon, loop);
+}
+
+void ethFailoverStop(t_failover *fo)
+{
+    ethGwMonStop(&fo->mon);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,191 @@
+/*
+ * Sorveglianza dei gateway.
+ *
+ * A ogni giro (probeMs) si controlla il carrier e si invia una ARP
+ * request a ogni gateway: unicast finche` risponde, broadcast dopo un
+ * probe perso. Un target diventa guasto dopo failCount probe persi (o
+ * subito senza carrier) e torna sano dopo riseCount risposte
+ * consecutive. Il chiamante viene avvisato solo ai cambi di stato.
+ */
+#include <string.h>
+#include <poll.h>
+#include "debug.h"
+#include "ethgwmon.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ethGwMonInit(t_gwmon *mon)
+{
+    memset(mon, 0, sizeof(t_gwmon));
+    mon->probeMs = GWMON_PROBE_MSECS;
+    mon->failCount = GWMON_FAIL_COUNT;
+    mon->riseCount = GWMON_RISE_COUNT;
+}
+
+int ethGwMonAdd(t_gwmon *mon, const char *device, const char *gateway)
+{
+    t_gwmon_target *t;
+
+    if (mon->nTargets >= GWMON_MAX_TARGETS)
+    {
+        DBG_E("Too many gateways (max %d)\n", GWMON_MAX_TARGETS);
+        return ETHCONFIGBUSY;
+    }
+    if (device == NULL || strlen(device) >= DEVICENAME_LEN)
+        return ETHDEVICEERR;
+    t = &mon->target[mon->nTargets];
+    memset(t, 0, sizeof(t_gwmon_target));
+    t->arp.fd = -1;
+    strncpy(t->deviceName, device, sizeof(t->deviceName) - 1);
+    if (gateway != NULL)
+        strncpy(t->gateway, gateway, sizeof(t->gateway) - 1);
+    return mon->nTargets++;
+}
+
+static void ethGwMonArpEvent(int fd, short revents, void *data);
+
+static void ethGwMonCloseArp(t_gwmon *mon, t_gwmon_target *t)
+{
+    if (t->arp.fd >= 0)
+    {
+        evLoopDelFd(mon->loop, t->arp.fd);
+        ethArpClose(&t->arp);
+    }
+}
+
+/*
+ * Il socket si riapre a ogni guasto: l'indirizzo usato come mittente
+ * potrebbe essere cambiato (es. rinnovo DHCP).
+ */
+static int ethGwMonOpenArp(t_gwmon *mon, t_gwmon_target *t)
+{
+    if (t->arp.fd >= 0)
+        return ETHNOERR;
+    if (ethArpOpen(t->deviceName, &t->arp) != ETHNOERR)
+        return ETHDEVICEERR;
+    return evLoopAddFd(mon->loop, t->arp.fd, POLLIN, ethGwMonArpEvent, mon);
+}
+
+static void ethGwMonUp(t_gwmon *mon, t_gwmon_target *t)
+{
+    t->pending = 0;
+    t->failCount = 0;
+    t->okCount++;
+    if (!t->healthy && t->okCount >= mon->riseCount)
+    {
+        t->healthy = 1;
+        t->healthySince = evLoopNowMs();
+        DBG_I("%s: gateway %s reachable\n", t->deviceName, t->gateway);
+        if (mon->onChange != NULL)
+            mon->onChange(mon, (int)(t - mon->target), mon->cbData);
+    }
+}
+
+/*
+ * Con immediate != 0 (es. carrier perso) il guasto e` dichiarato subito,
+ * senza attendere failCount probe persi.
+ */
+static void ethGwMonDown(t_gwmon *mon, t_gwmon_target *t, int immediate,
+                         const char *why)
+{
+    if (t->failCount == 0)
+        t->firstMissMs = evLoopNowMs();
+    t->okCount = 0;
+    t->pending = 0;
+    if (immediate && t->failCount < mon->failCount)
+        t->failCount = mon->failCount;
+    else
+        t->failCount++;
+    if (t->healthy && t->failCount >= mon->failCount)
+    {
+        t->healthy = 0;
+        DBG_E("%s: gateway %s: %s\n", t->deviceName, t->gateway, why);
+        ethGwMonCloseArp(mon, t);
+        if (mon->onChange != NULL)
+            mon->onChange(mon, (int)(t - mon->target), mon->cbData);
+    }
+}
+
+static void ethGwMonArpEvent(int fd, short revents, void *data)
+{
+    t_gwmon *mon = (t_gwmon *)data;
+    int i;
+
+    for (i = 0; i < mon->nTargets; i++)
+    {
+        t_gwmon_target *t = &mon->target[i];
+        if (t->arp.fd != fd)
+            continue;
+        if (ethArpRecv(&t->arp, t->gateway, t->gatewayMac) == ETHNOERR)
+        {
+            t->macKnown = 1;
+            ethGwMonUp(mon, t);
+        }
+        return;
+    }
+    (void)revents;
+}
+
+static void ethGwMonTick(void *data)
+{
+    t_gwmon *mon = (t_gwmon *)data;
+    int i;
+
+    for (i = 0; i < mon->nTargets; i++)
+    {
+        t_gwmon_target *t = &mon->target[i];
+        t_network_conf conf;
+
+        memset(&conf, 0, sizeof(t_network_conf));
+        strncpy(conf.deviceName, t->deviceName, sizeof(conf.deviceName) - 1);
+        if (ethGetLinkStatus(&conf) != ETHNOERR ||
+            conf.linkStatus != ETHSTATEUP)
+        {
+            /* Senza carrier non serve aspettare i probe persi */
+            ethGwMonDown(mon, t, 1, "no carrier");
+            continue;
+        }
+        if (t->pending)
+            ethGwMonDown(mon, t, 0, "does not answer");
+        if (ethGwMonOpenArp(mon, t) != ETHNOERR)
+            continue;
+        if (ethArpSend(&t->arp, t->gateway,
+                       t->macKnown && t->failCount == 0
+                       ? t->gatewayMac : NULL) == ETHNOERR)
+            t->pending = 1;
+    }
+    if (mon->onTick != NULL)
+        mon->onTick(mon, mon->cbData);
+    mon->timerId = evLoopAddTimer(mon->loop, mon->probeMs, ethGwMonTick, mon);
+}
+
+int ethGwMonStart(t_gwmon *mon, t_evloop *loop)
+{
+    mon->loop = loop;
+    mon->timerId = evLoopAddTimer(loop, 0, ethGwMonTick, mon);
+    return mon->timerId > 0 ? ETHNOERR : ETHCONFIGBUSY;
+}
+
+void ethGwMonStop(t_gwmon *mon)
+{
+    int i;
+    if (mon->loop == NULL)
+        return;
+    evLoopDelTimer(mon->loop, mon->timerId);
+    mon->timerId = 0;
+    for (i = 0; i < mon->nTargets; i++)
+    {
+        ethGwMonCloseArp(mon, &mon->target[i]);
+        mon->target[i].healthy = 0;
+        mon->target[i].okCount = 0;
+        mon->target[i].failCount = 0;
+        mon->target[i].pending = 0;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
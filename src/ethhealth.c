@@ -0,0 +1,217 @@
+/*
+ * Verifica a strati della connettivita`.
+ *
+ * Si parte dal basso: carrier, poi il gateway interrogato via ARP sul
+ * packet socket, infine i probe upstream (ethprobe). Il report dice quale strato
+ * ha fallito, cosi` il chiamante puo` distinguere un problema locale
+ * (da correggere subito) da un disservizio della WAN (su cui
+ * riconfigurare l'interfaccia non serve a nulla).
+ *
+ * Le attese (ARP e probe) non bloccano: passano dall'event loop del
+ * chiamante (ethHealthSetWait), cosi` watchdog, D-Bus ed eventi netlink
+ * vengono serviti e un cambio del link interrompe la verifica.
+ */
+#include <string.h>
+#include <time.h>
+#include "debug.h"
+#include "ethhealth.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static t_evloop *ethHealthLoop;
+static t_health_wait_cb ethHealthWait;
+static void *ethHealthWaitData;
+
+static long ethHealthNowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/*
+ * Event loop su cui partono i probe e attesa delle risposte: senza,
+ * ethCheckHealth non puo` essere eseguita.
+ */
+void ethHealthSetWait(t_evloop *loop, t_health_wait_cb wait, void *data)
+{
+    ethHealthLoop = loop;
+    ethHealthWait = wait;
+    ethHealthWaitData = data;
+}
+
+/*
+ * Come ethArpProbe, ma le risposte si attendono con ethHealthWait.
+ * ETHCANCELLED se l'attesa ha interrotto la verifica.
+ */
+static int ethHealthArp(const char *device, const char *target,
+                        unsigned char *replyMac)
+{
+    t_arp_socket as;
+    long start, next, end, now;
+    int rval, n;
+
+    rval = ethArpOpen(device, &as);
+    if (rval != ETHNOERR)
+        return rval;
+
+    start = ethHealthNowMs();
+    end = start + ETHHEALTH_ARP_MSECS;
+    next = start;
+    rval = ETHARPERR;
+    for (now = start; now < end; now = ethHealthNowMs())
+    {
+        if (now >= next)
+        {
+            rval = ethArpSend(&as, target, NULL);
+            if (rval != ETHNOERR)
+                break;
+            rval = ETHARPERR;
+            next = now + ETHARP_RETRANS_MSECS;
+        }
+        n = ethHealthWait(as.fd, (next < end ? next : end) - now, NULL,
+                          ethHealthWaitData);
+        if (n < 0)
+        {
+            rval = ETHCANCELLED;
+            break;
+        }
+        if (n > 0)
+        {
+            rval = ethArpRecv(&as, target, replyMac);
+            if (rval != ETHARPERR)
+                break;
+        }
+    }
+    ethArpClose(&as);
+    return rval;
+}
+
+const char *ethHealthLayerName(t_health_layer layer)
+{
+    switch (layer)
+    {
+        case HEALTH_OK:            return "ok";
+        case HEALTH_LINK_FAIL:     return "link";
+        case HEALTH_GATEWAY_FAIL:  return "gateway";
+        case HEALTH_UPSTREAM_FAIL: return "upstream";
+    }
+    return "?";
+}
+
+/*
+ * Lo strato gateway e` sano se almeno uno dei gateway risponde (con piu`
+ * gateway ECMP basta un nexthop vivo). Senza gateway (nGateways == 0) si
+ * usa quello della default route del device (es. appreso via DHCP).
+ * Restituisce ETHNOERR se la verifica e` stata eseguita (l'esito e` in
+ * report->failed), altrimenti un codice di errore. Interrotta
+ * dall'attesa: ETHCANCELLED, con esito HEALTH_LINK_FAIL (il chiamante
+ * riparte dal nuovo stato del link).
+ */
+int ethCheckHealth(const char *device,
+                   const char * const *gateways, int nGateways,
+                   const t_probe *probes, int nProbes,
+                   t_health_report *report)
+{
+    t_network_conf conf;
+    t_probe_run run;
+    long start;
+    int i, rval;
+
+    DBG_N("Enter %s\n", device != NULL ? device : "--NO-DEVICE--");
+    if (report == NULL)
+        return ETHBADCONFERR;
+    memset(report, 0, sizeof(t_health_report));
+    if (device == NULL)
+        return ETHDEVICEERR;
+    if (ethHealthLoop == NULL || ethHealthWait == NULL)
+    {
+        DBG_E("No event loop for the health check of %s\n", device);
+        return ETHBADCONFERR;
+    }
+
+    memset(&conf, 0, sizeof(t_network_conf));
+    strncpy(conf.deviceName, device, sizeof(conf.deviceName) - 1);
+
+    /* 1. Link */
+    if (ethGetLinkStatus(&conf) != ETHNOERR || conf.linkStatus != ETHSTATEUP)
+    {
+        report->failed = HEALTH_LINK_FAIL;
+        DBG_V("%s: no carrier\n", device);
+        return ETHNOERR;
+    }
+
+    /* 2. Gateway configurati o appreso */
+    if (nGateways == 0)
+    {
+        ethGetDefaultGateway(&conf);
+        if (strlen(conf.gateway) == 0 || strcmp(conf.gateway, "--") == 0)
+        {
+            report->failed = HEALTH_GATEWAY_FAIL;
+            DBG_V("%s: no gateway\n", device);
+            return ETHNOERR;
+        }
+    }
+    report->failed = HEALTH_GATEWAY_FAIL;
+    for (i = 0; i < (nGateways > 0 ? nGateways : 1); i++)
+    {
+        const char *gw = nGateways > 0 ? gateways[i] : conf.gateway;
+        strncpy(report->gateway, gw, sizeof(report->gateway) - 1);
+        start = ethHealthNowMs();
+        rval = ethHealthArp(device, gw, report->gatewayMac);
+        if (rval == ETHCANCELLED)
+        {
+            report->failed = HEALTH_LINK_FAIL;
+            return ETHCANCELLED;
+        }
+        if (rval == ETHNOERR)
+        {
+            report->gatewayMs = ethHealthNowMs() - start;
+            report->failed = HEALTH_OK;
+            break;
+        }
+        DBG_V("%s: gateway %s does not answer ARP\n", device, gw);
+    }
+    if (report->failed == HEALTH_GATEWAY_FAIL)
+        return ETHNOERR;
+
+    /* 3. Upstream: probe in parallelo, basta il primo che riesce */
+    if (nProbes > 0)
+    {
+        ethProbeStart(&run, ethHealthLoop, probes, nProbes, NULL, NULL);
+        while (!run.finished)
+        {
+            if (ethHealthWait(-1, PROBE_TIMEOUT_MSECS, &run.finished,
+                              ethHealthWaitData) < 0)
+            {
+                ethProbeCancel(&run);
+                report->failed = HEALTH_LINK_FAIL;
+                return ETHCANCELLED;
+            }
+        }
+        if (run.winner >= 0)
+        {
+            ethProbeName(&probes[run.winner], report->upstream,
+                         sizeof(report->upstream));
+            report->upstreamMs = run.state[run.winner].rttMs;
+        }
+        else
+        {
+            report->failed = HEALTH_UPSTREAM_FAIL;
+        }
+        for (i = 0; i < run.n; i++)
+        {
+            if (run.state[i].status == PROBE_PORTAL)
+                report->portal = 1;
+        }
+    }
+    DBG_N("Exit: %s layer %s\n", device, ethHealthLayerName(report->failed));
+    return ETHNOERR;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Riconoscimento del device gestito.
+ *
+ * Il nome di un'interfaccia USB o PCI non e` stabile: dipende
+ * dall'ordine di enumerazione, e udev lo cambia appena dopo la
+ * comparsa (eth1 -> enx001122334455). Il MAC e il percorso fisico
+ * (porta USB, slot PCI) invece restano. ID_PATH si legge dal database
+ * di udev senza libudev; il percorso del device in sysfs e` disponibile
+ * subito, anche senza udev.
+ */
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "debug.h"
+#include "ethhotplug.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* "mac=aa:bb:cc:dd:ee:ff", "path=pci-0000:00:14.0-usb-0:2*", o un nome */
+int ethHotplugParse(const char *spec, t_hotplug_match *m)
+{
+    unsigned int b[ETHMODEL_HWADDR_LEN];
+    char end;
+    int i;
+
+    memset(m, 0, sizeof(t_hotplug_match));
+    if (spec == NULL || spec[0] == '\0')
+        return ETHBADCONFERR;
+    if (strncmp(spec, "mac=", 4) == 0)
+    {
+        if (sscanf(spec + 4, "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2],
+                   &b[3], &b[4], &b[5], &end) != ETHMODEL_HWADDR_LEN)
+            return ETHBADCONFERR;
+        for (i = 0; i < ETHMODEL_HWADDR_LEN; i++)
+        {
+            if (b[i] > 0xff)
+                return ETHBADCONFERR;
+            m->mac[i] = (unsigned char)b[i];
+        }
+        m->key = HOTPLUG_BY_MAC;
+        spec += 4;
+    }
+    else if (strncmp(spec, "path=", 5) == 0 && spec[5] != '\0')
+    {
+        m->key = HOTPLUG_BY_PATH;
+        spec += 5;
+    }
+    strncpy(m->pattern, spec, sizeof(m->pattern) - 1);
+    return ETHNOERR;
+}
+
+/* ID_PATH dal database di udev, se l'ha gia` scritto */
+static int ethHotplugUdevPath(int ifindex, char *path, int len)
+{
+    char file[64], line[HOTPLUG_PATTERN_LEN + 16];
+    FILE *fp;
+    int rval = ETHDEVICEERR;
+
+    snprintf(file, sizeof(file), HOTPLUG_UDEV_DATA "/n%d", ifindex);
+    fp = fopen(file, "r");
+    if (fp == NULL)
+        return ETHDEVICEERR;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (strncmp(line, "E:ID_PATH=", 10) == 0)
+        {
+            line[strcspn(line, "\n")] = '\0';
+            strncpy(path, line + 10, len - 1);
+            path[len - 1] = '\0';
+            rval = ETHNOERR;
+            break;
+        }
+    }
+    fclose(fp);
+    return rval;
+}
+
+static int ethHotplugMatchPath(const t_hotplug_match *m, const t_iface *iface)
+{
+    char link[64], path[PATH_MAX];
+
+    if (ethHotplugUdevPath(iface->ifindex, path, sizeof(path)) == ETHNOERR &&
+        fnmatch(m->pattern, path, 0) == 0)
+        return 1;
+    /* Le interfacce virtuali non hanno device */
+    snprintf(link, sizeof(link), "/sys/class/net/%s/device",
+             ethModelString(iface->model.deviceName));
+    return realpath(link, path) != NULL && fnmatch(m->pattern, path, 0) == 0;
+}
+
+int ethHotplugMatch(const t_hotplug_match *m, const t_iface *iface)
+{
+    switch (m->key)
+    {
+        case HOTPLUG_BY_MAC:
+            return memcmp(iface->model.mac, m->mac, ETHMODEL_HWADDR_LEN) == 0;
+        case HOTPLUG_BY_PATH:
+            return ethHotplugMatchPath(m, iface);
+        default:
+            return fnmatch(m->pattern, ethModelString(iface->model.deviceName),
+                           0) == 0;
+    }
+}
+
+static int ethHotplugVisit(t_iface *iface, void *data)
+{
+    return ethHotplugMatch((const t_hotplug_match *)data, iface);
+}
+
+/* Scheda vera (PCI, USB, virtio): in sysfs ha il device */
+static int ethHotplugPhysical(const t_iface *iface)
+{
+    char link[64];
+
+    snprintf(link, sizeof(link), "/sys/class/net/%s/device",
+             ethModelString(iface->model.deviceName));
+    return access(link, F_OK) == 0;
+}
+
+typedef struct {
+    const t_hotplug_match *m;
+    t_iface *physical;
+    int nPhysical;
+    t_iface *virtual;
+    int nVirtual;
+} t_hotplug_find;
+
+static int ethHotplugCount(t_iface *iface, void *data)
+{
+    t_hotplug_find *f = (t_hotplug_find *)data;
+
+    if (!ethHotplugMatch(f->m, iface))
+        return 0;
+    if (ethHotplugPhysical(iface))
+    {
+        f->physical = iface;
+        f->nPhysical++;
+    }
+    else
+    {
+        f->virtual = iface;
+        f->nVirtual++;
+    }
+    return 0;
+}
+
+/*
+ * VLAN, bridge, bond e macvlan ereditano il MAC della scheda, e il
+ * percorso di udev puo` comparire su piu` interfacce: per MAC e percorso
+ * vale la scheda vera, un'interfaccia virtuale solo se e` l'unica.
+ * Con piu` candidati alla pari non si sceglie a caso.
+ */
+t_iface *ethHotplugFind(const t_iftable *t, const t_hotplug_match *m)
+{
+    t_hotplug_find f;
+
+    /* Nome esatto: basta la lookup */
+    if (m->key == HOTPLUG_BY_NAME && strpbrk(m->pattern, "*?[") == NULL)
+        return ethIfTableLookupName(t, m->pattern);
+    if (m->key == HOTPLUG_BY_NAME)
+        return ethIfTableForEach(t, ethHotplugVisit, (void *)m);
+
+    memset(&f, 0, sizeof(f));
+    f.m = m;
+    ethIfTableForEach(t, ethHotplugCount, &f);
+    if (f.nPhysical == 1)
+        return f.physical;
+    if (f.nPhysical == 0 && f.nVirtual == 1)
+        return f.virtual;
+    if (f.nPhysical > 1 || f.nVirtual > 1)
+        DBG_E("Hotplug: '%s' matches %d interfaces (%d physical): none taken\n",
+              m->pattern, f.nPhysical + f.nVirtual, f.nPhysical);
+    return NULL;
+}
+
+/*
+ * udev ha finito con l'interfaccia (regole, rinomina) quando ne scrive
+ * il database; senza udev non c'e` niente da attendere. Finche` udev
+ * lavora il device non va portato su: la rinomina di un'interfaccia
+ * attiva fallisce.
+ */
+int ethHotplugUdevRunning(void)
+{
+    return access(HOTPLUG_UDEV_CONTROL, F_OK) == 0;
+}
+
+int ethHotplugUdevDone(int ifindex)
+{
+    char file[64];
+
+    if (!ethHotplugUdevRunning())
+        return 1;
+    snprintf(file, sizeof(file), HOTPLUG_UDEV_DATA "/n%d", ifindex);
+    return access(file, F_OK) == 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,259 @@
+/*
+ * Campionatore del traffico delle interfacce.
+ *
+ * A ogni intervallo una sola richiesta RTM_GETSTATS in dump, filtrata
+ * su IFLA_STATS_LINK_64, restituisce la struct rtnl_link_stats64 (la
+ * stessa di IFLA_STATS64) di tutte le interfacce: niente attributi del
+ * link da scartare e nessun file di sysfs da aprire. Il socket resta
+ * aperto fra i campioni. I rate sono la differenza con il campione
+ * precedente divisa per il tempo trascorso; un contatore che torna
+ * indietro (device ricreato, driver ricaricato) fa ripartire la serie.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <net/if.h>
+#include "debug.h"
+#include "ethnl.h"
+#include "ethifstats.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    t_ifstats *s;
+    long long nowMs;
+} t_ifstats_dump;
+
+void ethIfStatsInit(t_ifstats *s)
+{
+    memset(s, 0, sizeof(t_ifstats));
+    s->intervalMs = IFSTATS_INTERVAL_MSECS;
+    s->fd = -1;
+}
+
+/* Interfaccia da seguire per nome: puo` non esistere ancora */
+int ethIfStatsAdd(t_ifstats *s, const char *device)
+{
+    t_ifstats_entry *e;
+
+    if (device == NULL || device[0] == '\0')
+        return ETHBADCONFERR;
+    if (ethIfStatsFind(s, device) != NULL)
+        return ETHNOERR;
+    if (s->nEntries >= IFSTATS_MAX_IFACES)
+        return ETHCONFIGBUSY;
+    e = &s->entry[s->nEntries++];
+    memset(e, 0, sizeof(t_ifstats_entry));
+    strncpy(e->name, device, sizeof(e->name) - 1);
+    return ETHNOERR;
+}
+
+t_ifstats_entry *ethIfStatsFind(t_ifstats *s, const char *device)
+{
+    int i;
+
+    for (i = 0; i < s->nEntries; i++)
+    {
+        if (strcmp(s->entry[i].name, device) == 0)
+            return &s->entry[i];
+    }
+    return NULL;
+}
+
+/* Campione di age periodi fa (0: l'ultimo), NULL se non c'e` */
+const t_ifstats_rate *ethIfStatsRate(const t_ifstats_entry *e, int age)
+{
+    if (e == NULL || age < 0 || age >= e->count)
+        return NULL;
+    return &e->hist[(e->head - 1 - age + IFSTATS_HISTORY) % IFSTATS_HISTORY];
+}
+
+static t_ifstats_entry *ethIfStatsLookup(t_ifstats *s, int ifindex)
+{
+    t_ifstats_entry *e;
+    char name[IF_NAMESIZE];
+    int i, k;
+
+    for (i = 0; i < s->nEntries; i++)
+    {
+        k = (s->cursor + i) % s->nEntries;
+        if (s->entry[k].ifindex == ifindex)
+        {
+            s->cursor = (k + 1) % s->nEntries;
+            return &s->entry[k];
+        }
+    }
+    if (!s->all || s->nEntries >= IFSTATS_MAX_IFACES ||
+        if_indextoname(ifindex, name) == NULL)
+        return NULL;
+    e = &s->entry[s->nEntries++];
+    memset(e, 0, sizeof(t_ifstats_entry));
+    strncpy(e->name, name, sizeof(e->name) - 1);
+    e->ifindex = ifindex;
+    s->cursor = 0;
+    return e;
+}
+
+/* (cur - prev) al secondo */
+#define IFSTATS_RATE(cur, prev, f, secs)  ((double)((cur)->f - (prev)->f) / (secs))
+
+static void ethIfStatsUpdate(t_ifstats_entry *e,
+                             const struct rtnl_link_stats64 *st,
+                             long long nowMs)
+{
+    const struct rtnl_link_stats64 *p = &e->last;
+    t_ifstats_rate *r;
+    double secs = (nowMs - e->lastMs) / 1000.0;
+
+    if (e->valid && secs > 0 &&
+        st->rx_bytes >= p->rx_bytes && st->tx_bytes >= p->tx_bytes &&
+        st->rx_packets >= p->rx_packets && st->tx_packets >= p->tx_packets &&
+        st->rx_errors >= p->rx_errors && st->tx_errors >= p->tx_errors &&
+        st->rx_dropped >= p->rx_dropped && st->tx_dropped >= p->tx_dropped)
+    {
+        r = &e->hist[e->head];
+        r->timeMs = nowMs;
+        r->rxBps = IFSTATS_RATE(st, p, rx_bytes, secs) * 8;
+        r->txBps = IFSTATS_RATE(st, p, tx_bytes, secs) * 8;
+        r->rxPps = IFSTATS_RATE(st, p, rx_packets, secs);
+        r->txPps = IFSTATS_RATE(st, p, tx_packets, secs);
+        r->rxErrPs = IFSTATS_RATE(st, p, rx_errors, secs);
+        r->txErrPs = IFSTATS_RATE(st, p, tx_errors, secs);
+        r->rxDropPs = IFSTATS_RATE(st, p, rx_dropped, secs);
+        r->txDropPs = IFSTATS_RATE(st, p, tx_dropped, secs);
+        e->head = (e->head + 1) % IFSTATS_HISTORY;
+        if (e->count < IFSTATS_HISTORY)
+            e->count++;
+    }
+    else if (e->valid)
+    {
+        DBG_V("%s: counters went back, series restarted\n", e->name);
+    }
+    e->last = *st;
+    e->lastMs = nowMs;
+    e->valid = 1;
+}
+
+static int ethIfStatsCollect(struct nlmsghdr *h, void *data)
+{
+    t_ifstats_dump *d = (t_ifstats_dump *)data;
+    struct if_stats_msg *ifsm = (struct if_stats_msg *)NLMSG_DATA(h);
+    struct rtattr *tb[IFLA_STATS_MAX + 1];
+    struct rtnl_link_stats64 st;
+    t_ifstats_entry *e;
+
+    if (h->nlmsg_type != RTM_NEWSTATS)
+        return 0;
+    e = ethIfStatsLookup(d->s, ifsm->ifindex);
+    if (e == NULL)
+        return 0;
+    ethNlParseAttrs(tb, IFLA_STATS_MAX,
+                    (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm))),
+                    h->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm)));
+    if (tb[IFLA_STATS_LINK_64] == NULL)
+        return 0;
+    memset(&st, 0, sizeof(st));
+    memcpy(&st, RTA_DATA(tb[IFLA_STATS_LINK_64]),
+           RTA_PAYLOAD(tb[IFLA_STATS_LINK_64]) < sizeof(st)
+           ? RTA_PAYLOAD(tb[IFLA_STATS_LINK_64]) : sizeof(st));
+    ethIfStatsUpdate(e, &st, d->nowMs);
+    e->gen = d->s->gen;
+    return 0;
+}
+
+/*
+ * Un campione. Le interfacce assenti dal dump perdono la serie: quelle
+ * seguite per nome vengono cercate di nuovo (ifindex nuovo dopo un
+ * hotplug), quelle scoperte dal dump escono dalla tabella.
+ */
+int ethIfStatsSample(t_ifstats *s)
+{
+    t_nl_msg m;
+    struct if_stats_msg ifsm;
+    struct nlmsghdr *n;
+    t_ifstats_dump d;
+    t_ifstats_entry *e;
+    int i, j, rval;
+
+    if (s->fd < 0)
+        return ETHSOCKETERR;
+    for (i = 0; i < s->nEntries; i++)
+    {
+        e = &s->entry[i];
+        if (e->ifindex == 0)
+            e->ifindex = if_nametoindex(e->name);
+    }
+    s->gen++;
+    d.s = s;
+    d.nowMs = evLoopNowMs();
+    memset(&ifsm, 0, sizeof(ifsm));
+    ifsm.family = AF_UNSPEC;
+    ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+    n = ethNlMsgInit(&m, RTM_GETSTATS, 0, &ifsm, sizeof(ifsm));
+    rval = ethNlDump(s->fd, n, ethIfStatsCollect, &d);
+    if (rval != ETHNOERR)
+        return rval;
+
+    for (i = j = 0; i < s->nEntries; i++)
+    {
+        e = &s->entry[i];
+        if (e->gen != s->gen)
+        {
+            if (s->all)
+                continue;
+            e->ifindex = 0;
+            e->valid = 0;
+            e->count = e->head = 0;
+        }
+        if (i != j)
+            s->entry[j] = *e;
+        j++;
+    }
+    if (j != s->nEntries)
+        s->cursor = 0;
+    s->nEntries = j;
+    return ETHNOERR;
+}
+
+static void ethIfStatsTick(void *data)
+{
+    t_ifstats *s = (t_ifstats *)data;
+
+    ethIfStatsSample(s);
+    if (s->onSample != NULL)
+        s->onSample(s, s->cbData);
+    s->timerId = evLoopAddTimer(s->loop, s->intervalMs, ethIfStatsTick, s);
+}
+
+/* Primo campione subito (riferimento dei rate), poi ogni intervalMs */
+int ethIfStatsStart(t_ifstats *s, t_evloop *loop)
+{
+    if (s->intervalMs <= 0)
+        return ETHBADCONFERR;
+    s->fd = ethNlOpen(NETLINK_ROUTE, 0);
+    if (s->fd < 0)
+        return s->fd;
+    s->loop = loop;
+    if (ethIfStatsSample(s) != ETHNOERR)
+        DBG_E("Interface statistics not available\n");
+    s->timerId = evLoopAddTimer(loop, s->intervalMs, ethIfStatsTick, s);
+    return s->timerId > 0 ? ETHNOERR : ETHCONFIGBUSY;
+}
+
+void ethIfStatsStop(t_ifstats *s)
+{
+    if (s->loop == NULL)
+        return;
+    evLoopDelTimer(s->loop, s->timerId);
+    s->timerId = 0;
+    ethNlClose(s->fd);
+    s->fd = -1;
+    s->loop = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,544 @@
+/*
+ * Tabella delle interfacce.
+ *
+ * Due tabelle hash a catena sugli stessi record: per ifindex (chiave
+ * degli eventi netlink) e per id del nome internato (chiave usata da chi
+ * conosce solo "eth0"). All'avvio bastano due dump netlink (link e
+ * indirizzi) per tutte le interfacce, invece di una lettura di /sys per
+ * ciascuna; poi ogni evento costa una ricerca O(1) e un ethModelDiff.
+ *
+ * Se il socket degli eventi perde messaggi (ENOBUFS) la tabella viene
+ * ricaricata con un nuovo dump e le differenze vengono notificate come
+ * se fossero arrivati gli eventi persi.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/if.h>
+#include <linux/if_arp.h>
+#include "debug.h"
+#include "ethiftable.h"
+#include "ethnl.h"
+#include "ethtrace.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static unsigned int ethIfTableHashIndex(const t_iftable *t, int ifindex)
+{
+    return ((unsigned int)ifindex * 2654435761u) & (t->nBuckets - 1);
+}
+
+static unsigned int ethIfTableHashName(const t_iftable *t, t_str_id id)
+{
+    return ((unsigned int)id * 2654435761u) & (t->nBuckets - 1);
+}
+
+int ethIfTableInit(t_iftable *t)
+{
+    memset(t, 0, sizeof(t_iftable));
+    t->fd = -1;
+    t->nBuckets = IFTABLE_MIN_BUCKETS;
+    t->byIndex = (t_iface **)calloc(t->nBuckets, sizeof(t_iface *));
+    t->byName = (t_iface **)calloc(t->nBuckets, sizeof(t_iface *));
+    if (t->byIndex == NULL || t->byName == NULL)
+    {
+        free(t->byIndex);
+        free(t->byName);
+        t->byIndex = t->byName = NULL;
+        return ETHNOMEMERR;
+    }
+    return ETHNOERR;
+}
+
+void ethIfTableFree(t_iftable *t)
+{
+    int i;
+
+    ethIfTableStop(t);
+    for (i = 0; t->byIndex != NULL && i < t->nBuckets; i++)
+    {
+        while (t->byIndex[i] != NULL)
+        {
+            t_iface *iface = t->byIndex[i];
+            t->byIndex[i] = iface->next;
+            free(iface);
+        }
+    }
+    free(t->byIndex);
+    free(t->byName);
+    t->byIndex = t->byName = NULL;
+    t->count = 0;
+}
+
+t_iface *ethIfTableLookup(const t_iftable *t, int ifindex)
+{
+    t_iface *iface;
+
+    if (t->byIndex == NULL)
+        return NULL;
+    iface = t->byIndex[ethIfTableHashIndex(t, ifindex)];
+    while (iface != NULL && iface->ifindex != ifindex)
+        iface = iface->next;
+    return iface;
+}
+
+t_iface *ethIfTableLookupName(const t_iftable *t, const char *name)
+{
+    t_str_id id = ethModelFind(name);
+    t_iface *iface;
+
+    if (id == 0 || t->byName == NULL)
+        return NULL;
+    iface = t->byName[ethIfTableHashName(t, id)];
+    while (iface != NULL && iface->model.deviceName != id)
+        iface = iface->nextName;
+    return iface;
+}
+
+/* Interfacce in ordine di bucket; restituisce quella che ha fermato cb */
+t_iface *ethIfTableForEach(const t_iftable *t, t_iftable_visit_cb cb,
+                           void *data)
+{
+    t_iface *iface;
+    int i;
+
+    for (i = 0; t->byIndex != NULL && i < t->nBuckets; i++)
+    {
+        for (iface = t->byIndex[i]; iface != NULL; iface = iface->next)
+        {
+            if (cb(iface, data))
+                return iface;
+        }
+    }
+    return NULL;
+}
+
+static void ethIfTableUnlinkName(t_iftable *t, t_iface *iface)
+{
+    t_iface **p = &t->byName[ethIfTableHashName(t, iface->model.deviceName)];
+
+    while (*p != NULL && *p != iface)
+        p = &(*p)->nextName;
+    if (*p != NULL)
+        *p = iface->nextName;
+    iface->nextName = NULL;
+}
+
+static void ethIfTableLinkName(t_iftable *t, t_iface *iface)
+{
+    unsigned int b = ethIfTableHashName(t, iface->model.deviceName);
+
+    iface->nextName = t->byName[b];
+    t->byName[b] = iface;
+}
+
+/* Raddoppia i bucket quando il carico supera 1 */
+static void ethIfTableGrow(t_iftable *t)
+{
+    int oldBuckets = t->nBuckets;
+    t_iface **oldIndex = t->byIndex;
+    t_iface **byIndex, **byName;
+    int i;
+
+    byIndex = (t_iface **)calloc(oldBuckets * 2, sizeof(t_iface *));
+    byName = (t_iface **)calloc(oldBuckets * 2, sizeof(t_iface *));
+    if (byIndex == NULL || byName == NULL)
+    {
+        /* Si continua con le catene piu` lunghe */
+        free(byIndex);
+        free(byName);
+        return;
+    }
+    free(t->byName);
+    t->byIndex = byIndex;
+    t->byName = byName;
+    t->nBuckets = oldBuckets * 2;
+    for (i = 0; i < oldBuckets; i++)
+    {
+        while (oldIndex[i] != NULL)
+        {
+            t_iface *iface = oldIndex[i];
+            unsigned int b = ethIfTableHashIndex(t, iface->ifindex);
+            oldIndex[i] = iface->next;
+            iface->next = t->byIndex[b];
+            t->byIndex[b] = iface;
+            ethIfTableLinkName(t, iface);
+        }
+    }
+    free(oldIndex);
+}
+
+static t_iface *ethIfTableAdd(t_iftable *t, int ifindex)
+{
+    t_iface *iface;
+    unsigned int b;
+
+    if (t->count >= t->nBuckets)
+        ethIfTableGrow(t);
+    iface = (t_iface *)calloc(1, sizeof(t_iface));
+    if (iface == NULL)
+        return NULL;
+    iface->ifindex = ifindex;
+    iface->fresh = 1;
+    b = ethIfTableHashIndex(t, ifindex);
+    iface->next = t->byIndex[b];
+    t->byIndex[b] = iface;
+    ethIfTableLinkName(t, iface);
+    t->count++;
+    return iface;
+}
+
+static void ethIfTableRemove(t_iftable *t, t_iface *iface)
+{
+    t_iface **p = &t->byIndex[ethIfTableHashIndex(t, iface->ifindex)];
+
+    while (*p != NULL && *p != iface)
+        p = &(*p)->next;
+    if (*p != NULL)
+        *p = iface->next;
+    ethIfTableUnlinkName(t, iface);
+    free(iface);
+    t->count--;
+}
+
+/* Durante un dump le notifiche sono rimandate a ethIfTableSweep */
+static void ethIfTableNotify(t_iftable *t, t_iface *iface)
+{
+    unsigned int diff;
+
+    if (t->loading || t->onEvent == NULL)
+    {
+        if (!t->loading)
+            iface->fresh = 0;
+        return;
+    }
+    if (iface->fresh)
+    {
+        iface->fresh = 0;
+        t->onEvent(iface, IFTABLE_EV_NEW, ethModelDiff(&iface->prev,
+                                                       &iface->model),
+                   t->cbData);
+        return;
+    }
+    diff = ethModelDiff(&iface->prev, &iface->model);
+    if (diff != 0)
+        t->onEvent(iface, IFTABLE_EV_CHANGE, diff, t->cbData);
+}
+
+static void ethIfTableLinkMsg(t_iftable *t, struct nlmsghdr *n)
+{
+    struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(n);
+    struct rtattr *tb[IFLA_MAX + 1];
+    t_iface *iface;
+    t_str_id name;
+
+    if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+        return;
+    iface = ethIfTableLookup(t, ifi->ifi_index);
+    if (n->nlmsg_type == RTM_DELLINK)
+    {
+        /* Durante il dump la rimozione avviene nello sweep */
+        if (iface != NULL && !t->loading)
+        {
+            if (t->onEvent != NULL)
+                t->onEvent(iface, IFTABLE_EV_DEL, 0, t->cbData);
+            ethIfTableRemove(t, iface);
+        }
+        return;
+    }
+    if (iface == NULL && (iface = ethIfTableAdd(t, ifi->ifi_index)) == NULL)
+    {
+        DBG_E("Out of memory adding ifindex %d\n", ifi->ifi_index);
+        return;
+    }
+    if (!t->loading)
+        iface->prev = iface->model;
+    iface->gen = t->gen;
+
+    ethNlParseAttrs(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(n));
+    if (tb[IFLA_IFNAME] != NULL)
+    {
+        name = ethModelIntern((const char *)RTA_DATA(tb[IFLA_IFNAME]));
+        if (name != iface->model.deviceName)
+        {
+            ethIfTableUnlinkName(t, iface);
+            iface->model.deviceName = name;
+            ethIfTableLinkName(t, iface);
+        }
+    }
+    if (tb[IFLA_ADDRESS] != NULL && ifi->ifi_type == ARPHRD_ETHER &&
+        RTA_PAYLOAD(tb[IFLA_ADDRESS]) == ETHMODEL_HWADDR_LEN)
+        memcpy(iface->model.mac, RTA_DATA(tb[IFLA_ADDRESS]),
+               ETHMODEL_HWADDR_LEN);
+    iface->flags = ifi->ifi_flags;
+    iface->model.linkStatus = (ifi->ifi_flags & IFF_LOWER_UP) ?
+                              ETHSTATEUP : ETHSTATEDOWN;
+    ethIfTableNotify(t, iface);
+}
+
+static void ethIfTableAddrMsg(t_iftable *t, struct nlmsghdr *n)
+{
+    struct ifaddrmsg *ifa = (struct ifaddrmsg *)NLMSG_DATA(n);
+    struct rtattr *tb[IFA_MAX + 1];
+    t_net_model *m;
+    t_iface *iface;
+    int add = n->nlmsg_type == RTM_NEWADDR;
+
+    if (n->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg)))
+        return;
+    iface = ethIfTableLookup(t, ifa->ifa_index);
+    if (iface == NULL)
+        return;
+    ethNlParseAttrs(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(n));
+    if (tb[IFA_LOCAL] == NULL)
+        tb[IFA_LOCAL] = tb[IFA_ADDRESS];
+    if (tb[IFA_LOCAL] == NULL)
+        return;
+    if (!t->loading)
+        iface->prev = iface->model;
+    m = &iface->model;
+
+    if (ifa->ifa_family == AF_INET)
+    {
+        struct in_addr a;
+        /* Solo l'indirizzo primario; i secondari non cambiano il modello */
+        if (ifa->ifa_flags & IFA_F_SECONDARY)
+            return;
+        memcpy(&a, RTA_DATA(tb[IFA_LOCAL]), sizeof(a));
+        if (add)
+        {
+            m->addressIPv4 = a;
+            m->prefixLen = ifa->ifa_prefixlen;
+        }
+        else if (m->addressIPv4.s_addr == a.s_addr)
+        {
+            m->addressIPv4.s_addr = INADDR_ANY;
+            m->prefixLen = 0;
+        }
+    }
+    else if (ifa->ifa_family == AF_INET6)
+    {
+        struct in6_addr a;
+        memcpy(&a, RTA_DATA(tb[IFA_LOCAL]), sizeof(a));
+        if (add)
+        {
+            /* Un indirizzo globale prende il posto del link-local */
+            if (IN6_IS_ADDR_UNSPECIFIED(&m->addressIPv6) ||
+                (IN6_IS_ADDR_LINKLOCAL(&m->addressIPv6) &&
+                 ifa->ifa_scope == RT_SCOPE_UNIVERSE))
+            {
+                m->addressIPv6 = a;
+                m->prefixLen6 = ifa->ifa_prefixlen;
+            }
+        }
+        else if (memcmp(&m->addressIPv6, &a, sizeof(a)) == 0)
+        {
+            memset(&m->addressIPv6, 0, sizeof(a));
+            m->prefixLen6 = 0;
+        }
+    }
+    else
+    {
+        return;
+    }
+    ethIfTableNotify(t, iface);
+}
+
+/*
+ * Applica un messaggio rtnetlink (evento o risposta di dump). Esportata
+ * anche per alimentare la tabella da una sorgente diversa dal socket.
+ */
+void ethIfTableHandleMsg(t_iftable *t, struct nlmsghdr *n)
+{
+    switch (n->nlmsg_type)
+    {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            ethIfTableLinkMsg(t, n);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            ethIfTableAddrMsg(t, n);
+            break;
+        default:
+            break;
+    }
+}
+
+static int ethIfTableDumpCb(struct nlmsghdr *n, void *data)
+{
+    ethTraceRecord(ETHTRACE_NETLINK, n, n->nlmsg_len);
+    ethIfTableHandleMsg((t_iftable *)data, n);
+    return 0;
+}
+
+/*
+ * Fine dump: notifica nuove interfacce, cambiamenti e rimozioni rispetto
+ * al contenuto precedente della tabella.
+ */
+static void ethIfTableSweep(t_iftable *t)
+{
+    int i;
+
+    for (i = 0; i < t->nBuckets; i++)
+    {
+        t_iface *iface = t->byIndex[i];
+        while (iface != NULL)
+        {
+            t_iface *next = iface->next;
+            if (iface->gen != t->gen)
+            {
+                if (t->onEvent != NULL)
+                    t->onEvent(iface, IFTABLE_EV_DEL, 0, t->cbData);
+                ethIfTableRemove(t, iface);
+            }
+            else
+            {
+                ethIfTableNotify(t, iface);
+            }
+            iface = next;
+        }
+    }
+}
+
+/*
+ * Carica (o ricarica) la tabella con un dump dei link e uno degli
+ * indirizzi su un socket dedicato.
+ */
+int ethIfTableLoad(t_iftable *t)
+{
+    struct ifinfomsg ifi;
+    struct ifaddrmsg ifa;
+    t_nl_msg m;
+    int fd, i, rval;
+
+    fd = ethNlOpen(NETLINK_ROUTE, 0);
+    if (fd < 0)
+        return fd;
+
+    t->gen++;
+    t->loading = 1;
+    for (i = 0; i < t->nBuckets; i++)
+    {
+        t_iface *iface;
+        for (iface = t->byIndex[i]; iface != NULL; iface = iface->next)
+        {
+            iface->prev = iface->model;
+            /* Gli indirizzi vengono ricostruiti dal dump */
+            memset(&iface->model.addressIPv4, 0, sizeof(struct in_addr));
+            memset(&iface->model.addressIPv6, 0, sizeof(struct in6_addr));
+            iface->model.prefixLen = iface->model.prefixLen6 = 0;
+        }
+    }
+
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    rval = ethNlDump(fd, ethNlMsgInit(&m, RTM_GETLINK, 0, &ifi, sizeof(ifi)),
+                     ethIfTableDumpCb, t);
+    if (rval == ETHNOERR)
+    {
+        memset(&ifa, 0, sizeof(ifa));
+        ifa.ifa_family = AF_UNSPEC;
+        rval = ethNlDump(fd, ethNlMsgInit(&m, RTM_GETADDR, 0, &ifa,
+                                          sizeof(ifa)),
+                         ethIfTableDumpCb, t);
+    }
+    ethNlClose(fd);
+    t->loading = 0;
+    if (rval != ETHNOERR)
+    {
+        /* Dump incompleto: niente rimozioni, solo le differenze viste */
+        for (i = 0; i < t->nBuckets; i++)
+        {
+            t_iface *iface;
+            for (iface = t->byIndex[i]; iface != NULL; iface = iface->next)
+                iface->gen = t->gen;
+        }
+    }
+    ethIfTableSweep(t);
+    DBG_V("Interface table: %d interfaces, %d buckets\n", t->count,
+          t->nBuckets);
+    return rval;
+}
+
+static void ethIfTableEvent(int fd, short revents, void *data)
+{
+    t_iftable *t = (t_iftable *)data;
+    static char buf[ETHNL_RCVLEN];
+    ssize_t len;
+
+    for (;;)
+    {
+        struct nlmsghdr *h;
+        len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS)
+            {
+                DBG_I("Netlink event queue overrun, reloading interfaces\n");
+                ethIfTableLoad(t);
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                DBG_E("Error on netlink recv: %s\n", strerror(errno));
+            return;
+        }
+        for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, (unsigned int)len);
+             h = NLMSG_NEXT(h, len))
+        {
+            ethTraceRecord(ETHTRACE_NETLINK, h, h->nlmsg_len);
+            ethIfTableHandleMsg(t, h);
+        }
+    }
+    (void)revents;
+}
+
+/*
+ * Si iscrive agli eventi di link e indirizzi e carica la tabella. Il
+ * socket viene aperto prima del dump, cosi` nessun evento va perso fra
+ * le due operazioni.
+ */
+int ethIfTableStart(t_iftable *t, t_evloop *loop)
+{
+    int rval;
+
+    t->fd = ethNlOpen(NETLINK_ROUTE, RTMGRP_LINK | RTMGRP_IPV4_IFADDR |
+                                     RTMGRP_IPV6_IFADDR);
+    if (t->fd < 0)
+        return t->fd;
+    rval = ethIfTableLoad(t);
+    if (rval != ETHNOERR)
+    {
+        ethIfTableStop(t);
+        return rval;
+    }
+    t->loop = loop;
+    if (evLoopAddFd(loop, t->fd, POLLIN, ethIfTableEvent, t) < 0)
+    {
+        t->loop = NULL;
+        ethIfTableStop(t);
+        return ETHSOCKETERR;
+    }
+    return ETHNOERR;
+}
+
+void ethIfTableStop(t_iftable *t)
+{
+    if (t->fd < 0)
+        return;
+    if (t->loop != NULL)
+        evLoopDelFd(t->loop, t->fd);
+    ethNlClose(t->fd);
+    t->fd = -1;
+    t->loop = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
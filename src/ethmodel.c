@@ -0,0 +1,253 @@
+/*
+ * Modello compatto della configurazione di rete.
+ *
+ * t_network_conf occupa circa 1.9 KB di array di caratteri ed e` copiato
+ * per intero a ogni chiamata; t_net_model ne contiene le stesse
+ * informazioni in 48 byte. Le stringhe libere (device, dominio, path,
+ * server NTP) vengono internate una volta sola: due modelli con la
+ * stessa stringa hanno lo stesso id, quindi il confronto e` fra interi.
+ * Le stringhe internate restano allocate per tutta la vita del processo.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "debug.h"
+#include "ethmodel.h"
+#include "ethstate.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHMODEL_HASH_SIZE  (ETHMODEL_MAX_STRINGS * 2) /* potenza di 2 */
+
+static char *ethModelStrings[ETHMODEL_MAX_STRINGS]; /* [0] = "" */
+static int ethModelNStrings = 1;
+static t_str_id ethModelHash[ETHMODEL_HASH_SIZE];   /* 0: slot libero */
+
+static unsigned int ethModelHashStr(const char *str)
+{
+    unsigned int h = 2166136261u; /* FNV-1a */
+    for (; *str; str++)
+        h = (h ^ (unsigned char)*str) * 16777619u;
+    return h;
+}
+
+/* Slot della tabella hash che contiene str, o il primo slot libero */
+static unsigned int ethModelSlot(const char *str)
+{
+    unsigned int slot = ethModelHashStr(str) & (ETHMODEL_HASH_SIZE - 1);
+
+    while (ethModelHash[slot] != 0 &&
+           strcmp(ethModelStrings[ethModelHash[slot]], str) != 0)
+        slot = (slot + 1) & (ETHMODEL_HASH_SIZE - 1);
+    return slot;
+}
+
+static int ethModelIsEmpty(const char *str)
+{
+    return str == NULL || str[0] == '\0' || strcmp(str, "--") == 0;
+}
+
+/*
+ * Restituisce l'id della stringa, internandola se nuova. NULL, "" e
+ * "--" (valore "assente" di ethapi) valgono 0. Se la tabella e` piena
+ * restituisce 0.
+ */
+t_str_id ethModelIntern(const char *str)
+{
+    unsigned int slot;
+
+    if (ethModelIsEmpty(str))
+        return 0;
+    slot = ethModelSlot(str);
+    if (ethModelHash[slot] != 0)
+        return ethModelHash[slot];
+    if (ethModelNStrings >= ETHMODEL_MAX_STRINGS)
+    {
+        DBG_E("String table full, '%s' not interned\n", str);
+        return 0;
+    }
+    ethModelStrings[ethModelNStrings] = strdup(str);
+    if (ethModelStrings[ethModelNStrings] == NULL)
+        return 0;
+    ethModelHash[slot] = (t_str_id)ethModelNStrings;
+    return (t_str_id)ethModelNStrings++;
+}
+
+/*
+ * Come ethModelIntern ma senza inserire: 0 se la stringa non e` mai
+ * stata internata (nessun modello puo` contenerla).
+ */
+t_str_id ethModelFind(const char *str)
+{
+    if (ethModelIsEmpty(str))
+        return 0;
+    return ethModelHash[ethModelSlot(str)];
+}
+
+const char *ethModelString(t_str_id id)
+{
+    if (id == 0 || id >= ethModelNStrings)
+        return "";
+    return ethModelStrings[id];
+}
+
+static int ethModelParseIPv4(const char *str, struct in_addr *addr)
+{
+    addr->s_addr = INADDR_ANY;
+    if (str[0] == '\0' || strcmp(str, "--") == 0 || strcmp(str, "-") == 0)
+        return ETHNOERR;
+    return inet_pton(AF_INET, str, addr) == 1 ? ETHNOERR : ETHBADCONFERR;
+}
+
+static void ethModelFormatIPv4(const struct in_addr *addr, char *str, int len)
+{
+    if (addr->s_addr == INADDR_ANY)
+        str[0] = '\0';
+    else
+        inet_ntop(AF_INET, addr, str, len);
+}
+
+/*
+ * Converte dal formato legacy. I valori "assenti" di ethapi ("--", "-",
+ * stringa vuota) diventano indirizzi nulli. Restituisce ETHBADCONFERR se
+ * un campo non e` interpretabile (il resto del modello e` comunque
+ * compilato).
+ */
+int ethModelFromConf(const t_network_conf *conf, t_net_model *model)
+{
+    char addr6[IPv6ADDR_LEN];
+    char *slash;
+    unsigned int mac[ETHMODEL_HWADDR_LEN];
+    int prefix, i;
+    int rval = ETHNOERR;
+
+    memset(model, 0, sizeof(t_net_model));
+    if (ethModelParseIPv4(conf->addressIPv4, &model->addressIPv4) != ETHNOERR ||
+        ethModelParseIPv4(conf->gateway, &model->gateway) != ETHNOERR ||
+        ethModelParseIPv4(conf->dnsserver, &model->dnsserver) != ETHNOERR)
+        rval = ETHBADCONFERR;
+
+    prefix = 0;
+    if (conf->netmask[0] != '\0' && strcmp(conf->netmask, "-") != 0)
+        prefix = ethStateNetmaskToPrefix(conf->netmask);
+    if (prefix < 0)
+        rval = ETHBADCONFERR;
+    else
+        model->prefixLen = (unsigned char)prefix;
+
+    /* IPv6 eventualmente con "/prefisso" */
+    strncpy(addr6, conf->addressIPv6, sizeof(addr6) - 1);
+    addr6[sizeof(addr6) - 1] = '\0';
+    slash = strchr(addr6, '/');
+    if (slash != NULL)
+    {
+        *slash++ = '\0';
+        model->prefixLen6 = (unsigned char)atoi(slash);
+    }
+    if (addr6[0] != '\0' && strcmp(addr6, "--") != 0 &&
+        inet_pton(AF_INET6, addr6, &model->addressIPv6) != 1)
+        rval = ETHBADCONFERR;
+
+    if (sscanf(conf->macaddress, "%x:%x:%x:%x:%x:%x", &mac[0], &mac[1],
+               &mac[2], &mac[3], &mac[4], &mac[5]) == ETHMODEL_HWADDR_LEN)
+    {
+        for (i = 0; i < ETHMODEL_HWADDR_LEN; i++)
+            model->mac[i] = (unsigned char)mac[i];
+    }
+
+    model->deviceName = ethModelIntern(conf->deviceName);
+    model->dnsdomain = ethModelIntern(conf->dnsdomain);
+    model->configPath = ethModelIntern(conf->configPath);
+    model->ntpserverName = ethModelIntern(conf->ntpserverName);
+    model->connection = (unsigned char)conf->connection;
+    model->linkStatus = (signed char)conf->linkStatus;
+    return rval;
+}
+
+void ethModelToConf(const t_net_model *model, t_network_conf *conf)
+{
+    static const unsigned char noMac[ETHMODEL_HWADDR_LEN] = { 0 };
+    char addr6[INET6_ADDRSTRLEN];
+
+    memset(conf, 0, sizeof(t_network_conf));
+    ethModelFormatIPv4(&model->addressIPv4, conf->addressIPv4,
+                       sizeof(conf->addressIPv4));
+    ethModelFormatIPv4(&model->gateway, conf->gateway, sizeof(conf->gateway));
+    ethModelFormatIPv4(&model->dnsserver, conf->dnsserver,
+                       sizeof(conf->dnsserver));
+    if (model->prefixLen > 0)
+    {
+        struct in_addr m;
+        m.s_addr = htonl(0xffffffffu << (32 - model->prefixLen));
+        inet_ntop(AF_INET, &m, conf->netmask, sizeof(conf->netmask));
+    }
+    if (!IN6_IS_ADDR_UNSPECIFIED(&model->addressIPv6))
+    {
+        inet_ntop(AF_INET6, &model->addressIPv6, addr6, sizeof(addr6));
+        if (model->prefixLen6 > 0)
+            snprintf(conf->addressIPv6, sizeof(conf->addressIPv6), "%s/%d",
+                     addr6, model->prefixLen6);
+        else
+            snprintf(conf->addressIPv6, sizeof(conf->addressIPv6), "%s",
+                     addr6);
+    }
+    if (memcmp(model->mac, noMac, ETHMODEL_HWADDR_LEN) != 0)
+        snprintf(conf->macaddress, sizeof(conf->macaddress),
+                 "%02x:%02x:%02x:%02x:%02x:%02x", model->mac[0],
+                 model->mac[1], model->mac[2], model->mac[3], model->mac[4],
+                 model->mac[5]);
+    strncpy(conf->deviceName, ethModelString(model->deviceName),
+            sizeof(conf->deviceName) - 1);
+    strncpy(conf->dnsdomain, ethModelString(model->dnsdomain),
+            sizeof(conf->dnsdomain) - 1);
+    strncpy(conf->configPath, ethModelString(model->configPath),
+            sizeof(conf->configPath) - 1);
+    strncpy(conf->ntpserverName, ethModelString(model->ntpserverName),
+            sizeof(conf->ntpserverName) - 1);
+    conf->connection = (t_connection_type)model->connection;
+    conf->linkStatus = model->linkStatus;
+}
+
+/*
+ * Campi diversi fra due modelli, come maschera di bit (1 << T_xxx, vedi
+ * t_network_conf_idx); lo stato del link e` ETHMODEL_DIFF_LINK.
+ */
+unsigned int ethModelDiff(const t_net_model *a, const t_net_model *b)
+{
+    unsigned int diff = 0;
+
+    if (a->addressIPv4.s_addr != b->addressIPv4.s_addr)
+        diff |= 1u << T_IPV4ADDR;
+    if (memcmp(&a->addressIPv6, &b->addressIPv6, sizeof(struct in6_addr)) != 0 ||
+        a->prefixLen6 != b->prefixLen6)
+        diff |= 1u << T_IPV6ADDR;
+    if (a->prefixLen != b->prefixLen)
+        diff |= 1u << T_NETMASK;
+    if (a->gateway.s_addr != b->gateway.s_addr)
+        diff |= 1u << T_GATEWAY;
+    if (a->dnsserver.s_addr != b->dnsserver.s_addr)
+        diff |= 1u << T_DNSSERVER;
+    if (a->dnsdomain != b->dnsdomain)
+        diff |= 1u << T_DNSDOMAIN;
+    if (a->deviceName != b->deviceName)
+        diff |= 1u << T_IFACENAME;
+    if (a->configPath != b->configPath)
+        diff |= 1u << T_CONFIG;
+    if (memcmp(a->mac, b->mac, ETHMODEL_HWADDR_LEN) != 0)
+        diff |= 1u << T_MACADDR;
+    if (a->ntpserverName != b->ntpserverName)
+        diff |= 1u << T_NTPSERVER;
+    if (a->connection != b->connection)
+        diff |= 1u << T_CONNECTION;
+    if (a->linkStatus != b->linkStatus)
+        diff |= ETHMODEL_DIFF_LINK;
+    return diff;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,422 @@
+/*
+ * MTU del device e verifica attiva del path MTU.
+ *
+ * L'MTU del device si imposta con RTM_NEWLINK/IFLA_MTU. Il path MTU si
+ * misura con echo ICMP a bit DF (IP_PMTUDISC_PROBE: il kernel non
+ * frammenta e ignora il PMTU gia` in cache), partendo dalla dimensione
+ * massima e scendendo per i valori tipici (jumbo, Ethernet, PPPoE,
+ * tunnel), poi con una ricerca binaria tra l'ultima dimensione passata
+ * e la prima rifiutata. Un ICMP frag-needed (IP_RECVERR) indica subito
+ * la dimensione giusta; un echo perso senza ICMP ad una dimensione
+ * maggiore di quella passata e` un black hole: router o switch che
+ * scartano in silenzio, la configurazione da segnalare.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include "debug.h"
+#include "ethnl.h"
+#include "ethmtu.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PMTU_IP_HDR_LEN  20   /* il kernel aggiunge l'header IP all'echo */
+
+typedef enum {
+    PMTU_OK = 0,
+    PMTU_TOOBIG,    /* ICMP frag-needed da un router del percorso */
+    PMTU_LOCAL,     /* piu` grande dell'MTU del device o della route */
+    PMTU_LOST,
+    PMTU_CANCELLED, /* l'attesa e` stata interrotta */
+} t_pmtu_status;
+
+typedef struct {
+    int fd;
+    int raw;                /* 1: raw socket (root), 0: ping socket */
+    unsigned short id;
+    unsigned short seq;
+    unsigned char buf[MTU_MAX];
+} t_pmtu_socket;
+
+/* Dimensioni tipiche, in ordine decrescente */
+static const int ethPmtuPlateaus[] = {
+    9000, 8192, 4352, 4000, 1500, 1492, 1480, 1460, 1450, 1400, 1280, 1006,
+};
+
+static t_pmtu_wait_cb ethPmtuWait;
+static void *ethPmtuWaitData;
+
+static long ethMtuNowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static unsigned short ethMtuChecksum(const void *data, int len)
+{
+    const unsigned short *p = (const unsigned short *)data;
+    unsigned int sum = 0;
+
+    for (; len > 1; len -= 2)
+        sum += *p++;
+    if (len == 1)
+        sum += *(const unsigned char *)p;
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += sum >> 16;
+    return (unsigned short)~sum;
+}
+
+int ethMtuGet(const char *device)
+{
+    struct ifreq ifr;
+    int fd, rval;
+
+    if (device == NULL || strlen(device) >= IFNAMSIZ)
+        return ETHDEVICEERR;
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return ETHSOCKETERR;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+    rval = ioctl(fd, SIOCGIFMTU, &ifr) == 0 ? ifr.ifr_mtu : ETHDEVICEERR;
+    close(fd);
+    return rval;
+}
+
+int ethMtuSet(const char *device, int mtu)
+{
+    t_nl_msg m;
+    struct ifinfomsg ifi;
+    struct nlmsghdr *n;
+    int rval;
+
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index = device != NULL ? if_nametoindex(device) : 0;
+    if (ifi.ifi_index == 0)
+    {
+        DBG_E("No device %s\n", device != NULL ? device : "--");
+        return ETHDEVICEERR;
+    }
+    if (mtu < 68 || mtu > 65535)
+        return ETHBADCONFERR;
+    n = ethNlMsgInit(&m, RTM_NEWLINK, 0, &ifi, sizeof(ifi));
+    ethNlAddAttr32(n, IFLA_MTU, mtu);
+    rval = ethNlRequest(n);
+    if (rval != ETHNOERR)
+        DBG_E("%s: cannot set MTU %d: %s\n", device, mtu, strerror(errno));
+    return rval;
+}
+
+static int ethPmtuOpen(t_pmtu_socket *ps, const char *device,
+                       const char *target)
+{
+    struct sockaddr_in sin;
+    int val;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    if (target == NULL || inet_pton(AF_INET, target, &sin.sin_addr) != 1)
+        return ETHBADCONFERR;
+
+    /* Raw socket se root, altrimenti ping socket (ping_group_range) */
+    ps->raw = 1;
+    ps->fd = socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC, IPPROTO_ICMP);
+    if (ps->fd < 0)
+    {
+        ps->raw = 0;
+        ps->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_ICMP);
+    }
+    if (ps->fd < 0)
+    {
+        DBG_E("Error on ICMP socket: %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+    /* Solo root: senza, decide la route (che porta comunque al device) */
+    if (device != NULL)
+        setsockopt(ps->fd, SOL_SOCKET, SO_BINDTODEVICE, device,
+                   strlen(device) + 1);
+    val = IP_PMTUDISC_PROBE;
+    if (setsockopt(ps->fd, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val)) < 0)
+    {
+        close(ps->fd);
+        return ETHSOCKETERR;
+    }
+    val = 1;
+    setsockopt(ps->fd, IPPROTO_IP, IP_RECVERR, &val, sizeof(val));
+    if (connect(ps->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+    {
+        close(ps->fd);
+        return ETHSOCKETERR;
+    }
+    ps->id = (unsigned short)(getpid() ^ 0x4d54);
+    ps->seq = 0;
+    return ETHNOERR;
+}
+
+/*
+ * Le attese degli echo (fino a PMTU_TIMEOUT_MSECS per dimensione) passano
+ * da wait: il chiamante puo` servire il proprio event loop e fermare la
+ * misura. NULL torna a poll().
+ */
+void ethPmtuSetWait(t_pmtu_wait_cb wait, void *data)
+{
+    ethPmtuWait = wait;
+    ethPmtuWaitData = data;
+}
+
+/* Errore in coda al socket: ICMP frag-needed o limite locale */
+static int ethPmtuError(t_pmtu_socket *ps, int *info)
+{
+    char control[256];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct sock_extended_err *ee;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = ps->buf;
+    iov.iov_len = sizeof(ps->buf);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(ps->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        return PMTU_LOST;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != IPPROTO_IP || cmsg->cmsg_type != IP_RECVERR)
+            continue;
+        ee = (struct sock_extended_err *)CMSG_DATA(cmsg);
+        *info = (int)ee->ee_info;
+        if (ee->ee_origin == SO_EE_ORIGIN_ICMP &&
+            ee->ee_type == ICMP_DEST_UNREACH && ee->ee_code == ICMP_FRAG_NEEDED)
+            return PMTU_TOOBIG;
+        if (ee->ee_origin == SO_EE_ORIGIN_LOCAL && ee->ee_errno == EMSGSIZE)
+            return PMTU_LOCAL;
+    }
+    return PMTU_LOST;
+}
+
+/* Echo di size byte (datagramma IP intero) e attesa della risposta */
+static int ethPmtuSend(t_pmtu_socket *ps, int size, int timeoutMs, int *info)
+{
+    struct icmphdr *icmp = (struct icmphdr *)ps->buf;
+    struct pollfd pfd;
+    long start, now;
+    ssize_t len;
+    int off, n;
+
+    *info = 0;
+    memset(ps->buf, 0xa5, size - PMTU_IP_HDR_LEN);
+    memset(icmp, 0, sizeof(struct icmphdr));
+    icmp->type = ICMP_ECHO;
+    icmp->un.echo.id = htons(ps->id);
+    icmp->un.echo.sequence = htons(++ps->seq);
+    icmp->checksum = ethMtuChecksum(ps->buf, size - PMTU_IP_HDR_LEN);
+    if (send(ps->fd, ps->buf, size - PMTU_IP_HDR_LEN, 0) < 0)
+    {
+        if (errno != EMSGSIZE)
+            return PMTU_LOST;
+        ethPmtuError(ps, info);
+        return PMTU_LOCAL;
+    }
+
+    pfd.fd = ps->fd;
+    pfd.events = POLLIN;
+    start = ethMtuNowMs();
+    for (now = start; now - start < timeoutMs; now = ethMtuNowMs())
+    {
+        pfd.revents = 0;
+        if (ethPmtuWait != NULL)
+        {
+            n = ethPmtuWait(ps->fd, start + timeoutMs - now, ethPmtuWaitData);
+            if (n < 0)
+                return PMTU_CANCELLED;
+            pfd.revents = (short)n;
+        }
+        else
+            poll(&pfd, 1, (int)(start + timeoutMs - now));
+        if (pfd.revents == 0)
+            continue;
+        if (pfd.revents & POLLERR)
+        {
+            int rval = ethPmtuError(ps, info);
+            if (rval != PMTU_LOST)
+                return rval;
+            continue;
+        }
+        while ((len = recv(ps->fd, ps->buf, sizeof(ps->buf), MSG_DONTWAIT)) > 0)
+        {
+            /* Il raw socket consegna anche l'header IP */
+            off = ps->raw ? (ps->buf[0] & 0x0f) * 4 : 0;
+            if (len < off + (ssize_t)sizeof(struct icmphdr))
+                continue;
+            icmp = (struct icmphdr *)(ps->buf + off);
+            if (icmp->type != ICMP_ECHOREPLY ||
+                ntohs(icmp->un.echo.sequence) != ps->seq)
+                continue;
+            /* Con il ping socket l'id lo assegna il kernel */
+            if (ps->raw && ntohs(icmp->un.echo.id) != ps->id)
+                continue;
+            return PMTU_OK;
+        }
+    }
+    return PMTU_LOST;
+}
+
+/* Prova la dimensione fino a PMTU_RETRIES volte se l'echo va perso */
+static int ethPmtuTry(t_pmtu_socket *ps, int size, int timeoutMs, int *info,
+                      t_pmtu_result *result)
+{
+    int i, rval = PMTU_LOST;
+
+    for (i = 0; i < PMTU_RETRIES && rval == PMTU_LOST; i++)
+    {
+        result->probes++;
+        rval = ethPmtuSend(ps, size, timeoutMs, info);
+    }
+    DBG_V("PMTU probe %d: %s\n", size,
+          rval == PMTU_OK ? "ok" : rval == PMTU_TOOBIG ? "frag needed" :
+          rval == PMTU_LOCAL ? "local limit" :
+          rval == PMTU_CANCELLED ? "cancelled" : "lost");
+    return rval;
+}
+
+/*
+ * Misura il path MTU verso target, fino a maxMtu (MTU del device se 0).
+ * ETHPROBEERR se target non risponde neanche a MTU_MIN: il percorso non
+ * e` verificabile via ICMP, result->mtu resta 0. ETHCANCELLED se
+ * l'attesa (ethPmtuSetWait) ha interrotto la misura.
+ */
+int ethPmtuProbe(const char *device, const char *target, int maxMtu,
+                 int timeoutMs, t_pmtu_result *result)
+{
+    t_pmtu_socket *ps;
+    int lo, hi, size, info, hint, rval, silent, i;
+
+    memset(result, 0, sizeof(t_pmtu_result));
+    if (maxMtu <= 0)
+        maxMtu = ethMtuGet(device);
+    if (maxMtu <= 0)
+        return ETHDEVICEERR;
+    if (maxMtu > MTU_MAX)
+        maxMtu = MTU_MAX;
+    result->maxMtu = maxMtu;
+    if (timeoutMs <= 0)
+        timeoutMs = PMTU_TIMEOUT_MSECS;
+    ps = malloc(sizeof(t_pmtu_socket));
+    if (ps == NULL)
+        return ETHNOMEMERR;
+    rval = ethPmtuOpen(ps, device, target);
+    if (rval != ETHNOERR)
+    {
+        free(ps);
+        return rval;
+    }
+
+    /* lo: piu` grande dimensione passata; hi: piu` piccola rifiutata */
+    lo = maxMtu < MTU_MIN ? maxMtu : MTU_MIN;
+    hi = maxMtu + 1;
+    rval = ethPmtuTry(ps, lo, timeoutMs, &info, result);
+    if (rval != PMTU_OK)
+    {
+        close(ps->fd);
+        free(ps);
+        return rval == PMTU_CANCELLED ? ETHCANCELLED : ETHPROBEERR;
+    }
+
+    /* Discesa per i valori tipici, a partire dal massimo */
+    size = maxMtu;
+    silent = 0;
+    i = 0;
+    while (size > lo)
+    {
+        rval = ethPmtuTry(ps, size, timeoutMs, &info, result);
+        if (rval == PMTU_CANCELLED)
+            break;
+        if (rval == PMTU_OK)
+        {
+            lo = size;
+            break;
+        }
+        hi = size;
+        silent = rval == PMTU_LOST;
+        if (rval == PMTU_TOOBIG || rval == PMTU_LOCAL)
+        {
+            if (rval == PMTU_TOOBIG)
+                result->icmpMtu = info;
+            if (info > lo && info < hi)
+            {
+                size = info;
+                continue;
+            }
+        }
+        else if (result->blackhole == 0 || size < result->blackhole)
+            result->blackhole = size;
+        while (i < (int)(sizeof(ethPmtuPlateaus) / sizeof(ethPmtuPlateaus[0])) &&
+               ethPmtuPlateaus[i] >= size)
+            i++;
+        if (i == (int)(sizeof(ethPmtuPlateaus) / sizeof(ethPmtuPlateaus[0])))
+            break;
+        size = ethPmtuPlateaus[i];
+    }
+
+    /*
+     * Raffinamento tra lo (passata) e hi (rifiutata), solo se il rifiuto
+     * e` esplicito: sotto un black hole ogni passo costa un timeout, e
+     * il valore tipico appena passato e` la scelta prudente.
+     */
+    hint = 0;
+    while (hi - lo > 1 && !silent && rval != PMTU_CANCELLED)
+    {
+        size = hint > lo && hint < hi ? hint : lo + (hi - lo) / 2;
+        hint = 0;
+        rval = ethPmtuTry(ps, size, timeoutMs, &info, result);
+        if (rval == PMTU_CANCELLED)
+            break;
+        if (rval == PMTU_OK)
+        {
+            lo = size;
+            continue;
+        }
+        hi = size;
+        if (rval == PMTU_TOOBIG)
+            result->icmpMtu = info;
+        silent = rval == PMTU_LOST;
+        if (!silent)
+            hint = info;
+        else if (result->blackhole == 0 || size < result->blackhole)
+            result->blackhole = size;
+    }
+    close(ps->fd);
+    free(ps);
+    if (rval == PMTU_CANCELLED)
+        return ETHCANCELLED;
+    result->mtu = lo;
+    if (result->blackhole <= lo)
+        result->blackhole = 0;
+    DBG_N("PMTU %s: %d (icmp %d, blackhole %d, %d probes)\n", target,
+          result->mtu, result->icmpMtu, result->blackhole, result->probes);
+    return ETHNOERR;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,507 @@
+/*
+ * Profilo prestazionale della scheda di rete.
+ *
+ * Usa i comandi SIOCETHTOOL "storici" (ring, coalescing, canali,
+ * TSO/GSO/GRO, LRO nei flag): esistono su tutti i kernel e i driver li
+ * traducono nelle stesse operazioni di ethtool netlink. Si scrive solo
+ * cio` che differisce dal valore corrente, perche` molti driver cambiando
+ * ring o canali resettano la scheda (e il link): riapplicare lo stesso
+ * profilo a ogni link-up non ha effetti.
+ *
+ * Il modo del link si legge con ETHTOOL_GLINKSETTINGS (ETHTOOL_GSET sui
+ * driver vecchi); il numero di lane esiste solo in ethtool netlink e si
+ * chiede alla famiglia generic netlink "ethtool" quando c'e`.
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/ethtool.h>
+#include <linux/ethtool_netlink.h>
+#include <linux/genetlink.h>
+#include <linux/sockios.h>
+#include "debug.h"
+#include "ethnic.h"
+#include "ethnl.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *key;        /* chiave del file di configurazione, senza NIC_ */
+    const char *name;       /* nome come in ethtool */
+    size_t offset;
+    int onOff;
+} t_nic_field;
+
+static const t_nic_field ethNicFields[] = {
+    { "RX_RING",  "rx",       offsetof(t_nic_profile, rxRing),   0 },
+    { "TX_RING",  "tx",       offsetof(t_nic_profile, txRing),   0 },
+    { "RX_USECS", "rx-usecs", offsetof(t_nic_profile, rxUsecs),  0 },
+    { "TX_USECS", "tx-usecs", offsetof(t_nic_profile, txUsecs),  0 },
+    { "CHANNELS", "combined", offsetof(t_nic_profile, channels), 0 },
+    { "TSO",      "tso",      offsetof(t_nic_profile, tso),      1 },
+    { "GSO",      "gso",      offsetof(t_nic_profile, gso),      1 },
+    { "GRO",      "gro",      offsetof(t_nic_profile, gro),      1 },
+    { "LRO",      "lro",      offsetof(t_nic_profile, lro),      1 },
+};
+#define NIC_NFIELDS  (int)(sizeof(ethNicFields) / sizeof(ethNicFields[0]))
+
+/* Offload con comando ethtool_value dedicato */
+static const struct {
+    int get, set;
+    size_t offset;
+} ethNicOffloads[] = {
+    { ETHTOOL_GTSO, ETHTOOL_STSO, offsetof(t_nic_profile, tso) },
+    { ETHTOOL_GGSO, ETHTOOL_SGSO, offsetof(t_nic_profile, gso) },
+    { ETHTOOL_GGRO, ETHTOOL_SGRO, offsetof(t_nic_profile, gro) },
+};
+
+#define NIC_FIELD(p, off)  (*(int *)((char *)(p) + (off)))
+#define NIC_CFIELD(p, off) (*(const int *)((const char *)(p) + (off)))
+
+void ethNicProfileInit(t_nic_profile *p)
+{
+    int i;
+    for (i = 0; i < NIC_NFIELDS; i++)
+        NIC_FIELD(p, ethNicFields[i].offset) = NIC_UNSET;
+}
+
+/*
+ * Imposta un campo dalla chiave del file di configurazione (RX_RING,
+ * GRO...). I valori on/off accettano anche 1/0.
+ */
+int ethNicProfileSet(t_nic_profile *p, const char *key, const char *value)
+{
+    char *end;
+    long v;
+    int i;
+
+    for (i = 0; i < NIC_NFIELDS; i++)
+    {
+        if (strcmp(key, ethNicFields[i].key) != 0)
+            continue;
+        if (ethNicFields[i].onOff)
+        {
+            if (strcmp(value, "on") == 0 || strcmp(value, "1") == 0)
+                v = 1;
+            else if (strcmp(value, "off") == 0 || strcmp(value, "0") == 0)
+                v = 0;
+            else
+                return ETHBADCONFERR;
+        }
+        else
+        {
+            v = strtol(value, &end, 10);
+            if (end == value || *end != '\0' || v < 0 || v > 1000000)
+                return ETHBADCONFERR;
+        }
+        NIC_FIELD(p, ethNicFields[i].offset) = (int)v;
+        return ETHNOERR;
+    }
+    return ETHBADCONFERR;
+}
+
+int ethNicProfileEmpty(const t_nic_profile *p)
+{
+    int i;
+    for (i = 0; i < NIC_NFIELDS; i++)
+    {
+        if (NIC_CFIELD(p, ethNicFields[i].offset) != NIC_UNSET)
+            return 0;
+    }
+    return 1;
+}
+
+static int ethNicIoctl(int fd, const char *device, void *cmd)
+{
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+    ifr.ifr_data = (char *)cmd;
+    return ioctl(fd, SIOCETHTOOL, &ifr);
+}
+
+/* Valori correnti; quelli che il driver non espone restano NIC_UNSET */
+static void ethNicReadFd(int fd, const char *device, t_nic_profile *cur)
+{
+    struct ethtool_ringparam ring;
+    struct ethtool_coalesce coal;
+    struct ethtool_channels chan;
+    struct ethtool_value val;
+    int i;
+
+    ethNicProfileInit(cur);
+    memset(&ring, 0, sizeof(ring));
+    ring.cmd = ETHTOOL_GRINGPARAM;
+    if (ethNicIoctl(fd, device, &ring) == 0)
+    {
+        cur->rxRing = ring.rx_pending;
+        cur->txRing = ring.tx_pending;
+    }
+    memset(&coal, 0, sizeof(coal));
+    coal.cmd = ETHTOOL_GCOALESCE;
+    if (ethNicIoctl(fd, device, &coal) == 0)
+    {
+        cur->rxUsecs = coal.rx_coalesce_usecs;
+        cur->txUsecs = coal.tx_coalesce_usecs;
+    }
+    memset(&chan, 0, sizeof(chan));
+    chan.cmd = ETHTOOL_GCHANNELS;
+    if (ethNicIoctl(fd, device, &chan) == 0 && chan.max_combined > 0)
+        cur->channels = chan.combined_count;
+    for (i = 0; i < (int)(sizeof(ethNicOffloads) / sizeof(ethNicOffloads[0])); i++)
+    {
+        memset(&val, 0, sizeof(val));
+        val.cmd = ethNicOffloads[i].get;
+        if (ethNicIoctl(fd, device, &val) == 0)
+            NIC_FIELD(cur, ethNicOffloads[i].offset) = val.data ? 1 : 0;
+    }
+    memset(&val, 0, sizeof(val));
+    val.cmd = ETHTOOL_GFLAGS;
+    if (ethNicIoctl(fd, device, &val) == 0)
+        cur->lro = (val.data & ETH_FLAG_LRO) ? 1 : 0;
+}
+
+int ethNicRead(const char *device, t_nic_profile *cur)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+    {
+        DBG_E("socket: %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+    ethNicReadFd(fd, device, cur);
+    close(fd);
+    return ETHNOERR;
+}
+
+/* Da scrivere: richiesto e diverso dal corrente */
+static int ethNicWants(int want, int cur)
+{
+    return want != NIC_UNSET && want != cur;
+}
+
+static int ethNicSet(int fd, const char *device, void *cmd, const char *what)
+{
+    if (ethNicIoctl(fd, device, cmd) == 0)
+        return ETHNOERR;
+    DBG_E("%s: cannot set %s: %s\n", device, what, strerror(errno));
+    return ETHDEVICEERR;
+}
+
+/*
+ * Applica i campi richiesti di want e rilegge in effective i valori
+ * risultanti. ETHDEVICEERR se qualche valore richiesto non e` quello
+ * effettivo (non supportato, fuori dai limiti del driver...).
+ */
+int ethNicApply(const char *device, const t_nic_profile *want,
+                t_nic_profile *effective)
+{
+    t_nic_profile cur;
+    struct ethtool_ringparam ring;
+    struct ethtool_coalesce coal;
+    struct ethtool_channels chan;
+    struct ethtool_value val;
+    int fd, i, want1, rval = ETHNOERR;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        DBG_E("socket: %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+    ethNicReadFd(fd, device, &cur);
+
+    if (ethNicWants(want->rxRing, cur.rxRing) ||
+        ethNicWants(want->txRing, cur.txRing))
+    {
+        memset(&ring, 0, sizeof(ring));
+        ring.cmd = ETHTOOL_GRINGPARAM;
+        if (ethNicIoctl(fd, device, &ring) == 0)
+        {
+            if (want->rxRing != NIC_UNSET)
+                ring.rx_pending = want->rxRing;
+            if (want->txRing != NIC_UNSET)
+                ring.tx_pending = want->txRing;
+            ring.cmd = ETHTOOL_SRINGPARAM;
+            ethNicSet(fd, device, &ring, "ring sizes");
+        }
+    }
+    if (ethNicWants(want->rxUsecs, cur.rxUsecs) ||
+        ethNicWants(want->txUsecs, cur.txUsecs))
+    {
+        memset(&coal, 0, sizeof(coal));
+        coal.cmd = ETHTOOL_GCOALESCE;
+        if (ethNicIoctl(fd, device, &coal) == 0)
+        {
+            if (want->rxUsecs != NIC_UNSET)
+                coal.rx_coalesce_usecs = want->rxUsecs;
+            if (want->txUsecs != NIC_UNSET)
+                coal.tx_coalesce_usecs = want->txUsecs;
+            coal.cmd = ETHTOOL_SCOALESCE;
+            ethNicSet(fd, device, &coal, "coalescing");
+        }
+    }
+    if (ethNicWants(want->channels, cur.channels))
+    {
+        memset(&chan, 0, sizeof(chan));
+        chan.cmd = ETHTOOL_GCHANNELS;
+        if (ethNicIoctl(fd, device, &chan) == 0)
+        {
+            chan.combined_count = want->channels;
+            chan.cmd = ETHTOOL_SCHANNELS;
+            ethNicSet(fd, device, &chan, "channels");
+        }
+    }
+    for (i = 0; i < (int)(sizeof(ethNicOffloads) / sizeof(ethNicOffloads[0])); i++)
+    {
+        want1 = NIC_CFIELD(want, ethNicOffloads[i].offset);
+        if (!ethNicWants(want1, NIC_FIELD(&cur, ethNicOffloads[i].offset)))
+            continue;
+        memset(&val, 0, sizeof(val));
+        val.cmd = ethNicOffloads[i].set;
+        val.data = want1;
+        ethNicSet(fd, device, &val, "offload");
+    }
+    if (ethNicWants(want->lro, cur.lro))
+    {
+        memset(&val, 0, sizeof(val));
+        val.cmd = ETHTOOL_GFLAGS;
+        if (ethNicIoctl(fd, device, &val) == 0)
+        {
+            if (want->lro)
+                val.data |= ETH_FLAG_LRO;
+            else
+                val.data &= ~ETH_FLAG_LRO;
+            val.cmd = ETHTOOL_SFLAGS;
+            ethNicSet(fd, device, &val, "lro");
+        }
+    }
+
+    /* Rilettura: il driver puo` arrotondare o rifiutare */
+    ethNicReadFd(fd, device, effective);
+    close(fd);
+    for (i = 0; i < NIC_NFIELDS; i++)
+    {
+        want1 = NIC_CFIELD(want, ethNicFields[i].offset);
+        if (want1 != NIC_UNSET &&
+            want1 != NIC_CFIELD(effective, ethNicFields[i].offset))
+        {
+            DBG_E("%s: %s requested %d, effective %d\n", device,
+                  ethNicFields[i].name, want1,
+                  NIC_CFIELD(effective, ethNicFields[i].offset));
+            rval = ETHDEVICEERR;
+        }
+    }
+    return rval;
+}
+
+/* "rx 512 tx 512 rx-usecs 50 ... gro on lro off", campi assenti omessi */
+void ethNicFormat(const t_nic_profile *p, char *str, int len)
+{
+    int i, v, n = 0;
+
+    str[0] = '\0';
+    for (i = 0; i < NIC_NFIELDS && n < len; i++)
+    {
+        v = NIC_CFIELD(p, ethNicFields[i].offset);
+        if (v == NIC_UNSET)
+            continue;
+        if (ethNicFields[i].onOff)
+            n += snprintf(str + n, len - n, "%s%s %s", n > 0 ? " " : "",
+                          ethNicFields[i].name, v ? "on" : "off");
+        else
+            n += snprintf(str + n, len - n, "%s%s %d", n > 0 ? " " : "",
+                          ethNicFields[i].name, v);
+    }
+}
+
+static int ethNicFamilyCollect(struct nlmsghdr *h, void *data)
+{
+    struct rtattr *tb[CTRL_ATTR_MAX + 1];
+    int *family = (int *)data;
+
+    ethNlParseAttrs(tb, CTRL_ATTR_MAX,
+                    (struct rtattr *)((char *)NLMSG_DATA(h) + GENL_HDRLEN),
+                    h->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+    if (tb[CTRL_ATTR_FAMILY_NAME] == NULL || tb[CTRL_ATTR_FAMILY_ID] == NULL ||
+        strcmp(RTA_DATA(tb[CTRL_ATTR_FAMILY_NAME]), ETHTOOL_GENL_NAME) != 0)
+        return 0;
+    *family = *(unsigned short *)RTA_DATA(tb[CTRL_ATTR_FAMILY_ID]);
+    return 1;
+}
+
+typedef struct {
+    int ifindex;
+    int lanes;
+} t_nic_lanes;
+
+static int ethNicLanesCollect(struct nlmsghdr *h, void *data)
+{
+    struct rtattr *tb[ETHTOOL_A_LINKMODES_MAX + 1];
+    struct rtattr *hdr[ETHTOOL_A_HEADER_MAX + 1];
+    t_nic_lanes *l = (t_nic_lanes *)data;
+
+    ethNlParseAttrs(tb, ETHTOOL_A_LINKMODES_MAX,
+                    (struct rtattr *)((char *)NLMSG_DATA(h) + GENL_HDRLEN),
+                    h->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+    if (tb[ETHTOOL_A_LINKMODES_HEADER] == NULL)
+        return 0;
+    ethNlParseAttrs(hdr, ETHTOOL_A_HEADER_MAX,
+                    RTA_DATA(tb[ETHTOOL_A_LINKMODES_HEADER]),
+                    RTA_PAYLOAD(tb[ETHTOOL_A_LINKMODES_HEADER]));
+    if (hdr[ETHTOOL_A_HEADER_DEV_INDEX] == NULL ||
+        *(int *)RTA_DATA(hdr[ETHTOOL_A_HEADER_DEV_INDEX]) != l->ifindex)
+        return 0;
+    if (tb[ETHTOOL_A_LINKMODES_LANES] != NULL)
+        l->lanes = *(int *)RTA_DATA(tb[ETHTOOL_A_LINKMODES_LANES]);
+    return 1;
+}
+
+/*
+ * Lane del link da ethtool netlink: risoluzione della famiglia e dump
+ * di LINKMODES_GET filtrato sull'ifindex. NIC_UNSET se il kernel o il
+ * driver non le riportano.
+ */
+static int ethNicLanes(const char *device)
+{
+    struct genlmsghdr genl;
+    t_nl_msg m;
+    struct nlmsghdr *n;
+    t_nic_lanes l;
+    int fd, family = 0;
+
+    l.ifindex = if_nametoindex(device);
+    l.lanes = NIC_UNSET;
+    fd = ethNlOpen(NETLINK_GENERIC, 0);
+    if (fd < 0 || l.ifindex == 0)
+    {
+        ethNlClose(fd);
+        return NIC_UNSET;
+    }
+    memset(&genl, 0, sizeof(genl));
+    genl.cmd = CTRL_CMD_GETFAMILY;
+    genl.version = 1;
+    n = ethNlMsgInit(&m, GENL_ID_CTRL, 0, &genl, sizeof(genl));
+    if (ethNlDump(fd, n, ethNicFamilyCollect, &family) == ETHNOERR &&
+        family > 0)
+    {
+        genl.cmd = ETHTOOL_MSG_LINKMODES_GET;
+        genl.version = ETHTOOL_GENL_VERSION;
+        n = ethNlMsgInit(&m, family, 0, &genl, sizeof(genl));
+        ethNlDump(fd, n, ethNicLanesCollect, &l);
+    }
+    ethNlClose(fd);
+    return l.lanes > 0 ? l.lanes : NIC_UNSET;
+}
+
+/*
+ * Modo negoziato del link. A link giu` il driver riporta velocita` e
+ * duplex ignoti (NIC_UNSET). ETHDEVICEERR se il driver non espone
+ * nessuna delle due interfacce ethtool.
+ */
+int ethNicLinkMode(const char *device, t_link_mode *mode)
+{
+    struct {
+        struct ethtool_link_settings req;
+        __u32 masks[3 * 127];   /* supported, advertising, lp_advertising */
+    } ls;
+    struct ethtool_cmd ecmd;
+    unsigned int speed;
+    int fd;
+
+    mode->speed = mode->duplex = mode->autoneg = mode->lanes = NIC_UNSET;
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        DBG_E("socket: %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+    /* Primo giro: il kernel risponde con -(parole delle maschere) */
+    memset(&ls, 0, sizeof(ls));
+    ls.req.cmd = ETHTOOL_GLINKSETTINGS;
+    if (ethNicIoctl(fd, device, &ls) == 0 && ls.req.link_mode_masks_nwords < 0)
+    {
+        ls.req.cmd = ETHTOOL_GLINKSETTINGS;
+        ls.req.link_mode_masks_nwords = -ls.req.link_mode_masks_nwords;
+        if (ethNicIoctl(fd, device, &ls) != 0)
+            ls.req.link_mode_masks_nwords = 0;
+    }
+    if (ls.req.link_mode_masks_nwords > 0)
+    {
+        speed = ls.req.speed;
+        mode->duplex = ls.req.duplex;
+        mode->autoneg = ls.req.autoneg;
+    }
+    else
+    {
+        memset(&ecmd, 0, sizeof(ecmd));
+        ecmd.cmd = ETHTOOL_GSET;
+        if (ethNicIoctl(fd, device, &ecmd) != 0)
+        {
+            DBG_V("%s: no link settings: %s\n", device, strerror(errno));
+            close(fd);
+            return ETHDEVICEERR;
+        }
+        speed = ethtool_cmd_speed(&ecmd);
+        mode->duplex = ecmd.duplex;
+        mode->autoneg = ecmd.autoneg;
+    }
+    close(fd);
+    mode->speed = speed == 0 || speed == (unsigned int)SPEED_UNKNOWN ?
+                  NIC_UNSET : (int)speed;
+    if (mode->duplex != DUPLEX_FULL && mode->duplex != DUPLEX_HALF)
+        mode->duplex = NIC_UNSET;
+    mode->lanes = ethNicLanes(device);
+    return ETHNOERR;
+}
+
+/* Riavvia l'autonegoziazione (ethtool -r): il link cade e risale */
+int ethNicRenegotiate(const char *device)
+{
+    struct ethtool_value val;
+    int fd, rval;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        DBG_E("socket: %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+    memset(&val, 0, sizeof(val));
+    val.cmd = ETHTOOL_NWAY_RST;
+    rval = ethNicSet(fd, device, &val, "autoneg restart");
+    close(fd);
+    return rval;
+}
+
+/* "1000Mb/s full autoneg on 1 lane", campi ignoti come "?" o omessi */
+void ethNicLinkModeFormat(const t_link_mode *m, char *str, int len)
+{
+    int n;
+
+    if (m->speed != NIC_UNSET)
+        n = snprintf(str, len, "%dMb/s", m->speed);
+    else
+        n = snprintf(str, len, "?Mb/s");
+    n += snprintf(str + n, len - n, " %s", m->duplex == NIC_UNSET ? "?" :
+                  (m->duplex ? "full" : "half"));
+    if (m->autoneg != NIC_UNSET && n < len)
+        n += snprintf(str + n, len - n, " autoneg %s", m->autoneg ? "on" : "off");
+    if (m->lanes != NIC_UNSET && n < len)
+        snprintf(str + n, len - n, " %d lane%s", m->lanes, m->lanes > 1 ? "s" : "");
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,266 @@
+/*
+ * Helper netlink.
+ *
+ * Costruzione dei messaggi (attributi e attributi annidati), richiesta
+ * con attesa dell'ACK e dump con callback per messaggio. Sostituisce il
+ * fork di "ip ..." dove serve un'operazione atomica o veloce.
+ */
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "debug.h"
+#include "ethnl.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static unsigned int ethNlSeq = 0;
+
+int ethNlOpen(int protocol, unsigned int groups)
+{
+    struct sockaddr_nl snl;
+    int fd;
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+    if (fd < 0)
+    {
+        DBG_E("Error on socket(AF_NETLINK, %d): %s\n", protocol,
+              strerror(errno));
+        return ETHSOCKETERR;
+    }
+    memset(&snl, 0, sizeof(snl));
+    snl.nl_family = AF_NETLINK;
+    snl.nl_groups = groups;
+    if (bind(fd, (struct sockaddr *)&snl, sizeof(snl)) < 0)
+    {
+        DBG_E("Error on bind(AF_NETLINK): %s\n", strerror(errno));
+        close(fd);
+        return ETHSOCKETERR;
+    }
+    return fd;
+}
+
+void ethNlClose(int fd)
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+/*
+ * Prepara l'header e copia l'header di famiglia (ifinfomsg, rtmsg...).
+ */
+struct nlmsghdr *ethNlMsgInit(t_nl_msg *m, int type, int flags,
+                              const void *family, int familyLen)
+{
+    memset(m, 0, sizeof(t_nl_msg));
+    m->hdr.nlmsg_len = NLMSG_LENGTH(familyLen);
+    m->hdr.nlmsg_type = type;
+    m->hdr.nlmsg_flags = NLM_F_REQUEST | flags;
+    m->hdr.nlmsg_seq = ++ethNlSeq;
+    if (family != NULL && familyLen > 0)
+        memcpy(NLMSG_DATA(&m->hdr), family, familyLen);
+    return &m->hdr;
+}
+
+int ethNlAddAttr(struct nlmsghdr *n, int type, const void *data, int len)
+{
+    int rtalen = RTA_LENGTH(len);
+    struct rtattr *rta;
+
+    if (NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rtalen) > ETHNL_MSGLEN)
+    {
+        DBG_E("Netlink message too long (attr %d)\n", type);
+        return ETHBADCONFERR;
+    }
+    rta = (struct rtattr *)(((char *)n) + NLMSG_ALIGN(n->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = rtalen;
+    if (len > 0)
+        memcpy(RTA_DATA(rta), data, len);
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rtalen);
+    return ETHNOERR;
+}
+
+int ethNlAddAttr32(struct nlmsghdr *n, int type, unsigned int value)
+{
+    return ethNlAddAttr(n, type, &value, sizeof(value));
+}
+
+int ethNlAddAttrStr(struct nlmsghdr *n, int type, const char *str)
+{
+    return ethNlAddAttr(n, type, str, strlen(str) + 1);
+}
+
+/*
+ * Riserva len byte (allineati) in coda al messaggio, es. per le
+ * struct rtnexthop di RTA_MULTIPATH.
+ */
+void *ethNlReserve(struct nlmsghdr *n, int len)
+{
+    void *p;
+
+    if (NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len) > ETHNL_MSGLEN)
+    {
+        DBG_E("Netlink message too long\n");
+        return NULL;
+    }
+    p = ((char *)n) + NLMSG_ALIGN(n->nlmsg_len);
+    memset(p, 0, RTA_ALIGN(len));
+    n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len);
+    return p;
+}
+
+struct rtattr *ethNlNestStart(struct nlmsghdr *n, int type)
+{
+    struct rtattr *nest =
+        (struct rtattr *)(((char *)n) + NLMSG_ALIGN(n->nlmsg_len));
+    if (ethNlAddAttr(n, type, NULL, 0) != ETHNOERR)
+        return NULL;
+    return nest;
+}
+
+void ethNlNestEnd(struct nlmsghdr *n, struct rtattr *nest)
+{
+    if (nest != NULL)
+        nest->rta_len = (char *)n + n->nlmsg_len - (char *)nest;
+}
+
+void ethNlParseAttrs(struct rtattr *tb[], int max, struct rtattr *rta,
+                     int len)
+{
+    memset(tb, 0, sizeof(struct rtattr *) * (max + 1));
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        unsigned short type = rta->rta_type & NLA_TYPE_MASK;
+        if (type <= max && tb[type] == NULL)
+            tb[type] = rta;
+    }
+}
+
+/*
+ * Invia la richiesta (con ACK) e ne attende l'esito. In caso di errore
+ * restituisce ETHNETLINKERR e lascia il codice del kernel in errno.
+ */
+int ethNlTalk(int fd, struct nlmsghdr *n)
+{
+    char buf[ETHNL_MSGLEN];
+    struct sockaddr_nl snl;
+    ssize_t len;
+
+    n->nlmsg_flags |= NLM_F_ACK;
+    memset(&snl, 0, sizeof(snl));
+    snl.nl_family = AF_NETLINK;
+    if (sendto(fd, n, n->nlmsg_len, 0, (struct sockaddr *)&snl,
+               sizeof(snl)) < 0)
+    {
+        DBG_E("Error on netlink sendto: %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+
+    for (;;)
+    {
+        struct nlmsghdr *h;
+        len = recv(fd, buf, sizeof(buf), 0);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            DBG_E("Error on netlink recv: %s\n", strerror(errno));
+            return ETHSOCKETERR;
+        }
+        for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, (unsigned int)len);
+             h = NLMSG_NEXT(h, len))
+        {
+            if (h->nlmsg_seq != n->nlmsg_seq)
+                continue;
+            if (h->nlmsg_type == NLMSG_ERROR)
+            {
+                struct nlmsgerr *err = (struct nlmsgerr *)NLMSG_DATA(h);
+                if (err->error == 0)
+                    return ETHNOERR;
+                errno = -err->error;
+                DBG_V("Netlink request %d failed: %s\n", n->nlmsg_type,
+                      strerror(errno));
+                return ETHNETLINKERR;
+            }
+        }
+    }
+}
+
+/*
+ * Invia una richiesta di dump e chiama cb per ogni messaggio ricevuto
+ * fino a NLMSG_DONE. Se cb restituisce un valore != 0 i messaggi
+ * successivi vengono letti ma ignorati.
+ */
+int ethNlDump(int fd, struct nlmsghdr *n, t_nl_dump_cb cb, void *data)
+{
+    static char buf[ETHNL_RCVLEN];
+    struct sockaddr_nl snl;
+    int stop = 0;
+    ssize_t len;
+
+    n->nlmsg_flags |= NLM_F_DUMP;
+    memset(&snl, 0, sizeof(snl));
+    snl.nl_family = AF_NETLINK;
+    if (sendto(fd, n, n->nlmsg_len, 0, (struct sockaddr *)&snl,
+               sizeof(snl)) < 0)
+    {
+        DBG_E("Error on netlink sendto: %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+
+    for (;;)
+    {
+        struct nlmsghdr *h;
+        len = recv(fd, buf, sizeof(buf), 0);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            DBG_E("Error on netlink recv: %s\n", strerror(errno));
+            return ETHSOCKETERR;
+        }
+        for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, (unsigned int)len);
+             h = NLMSG_NEXT(h, len))
+        {
+            if (h->nlmsg_seq != n->nlmsg_seq)
+                continue;
+            if (h->nlmsg_type == NLMSG_DONE)
+                return ETHNOERR;
+            if (h->nlmsg_type == NLMSG_ERROR)
+            {
+                struct nlmsgerr *err = (struct nlmsgerr *)NLMSG_DATA(h);
+                errno = -err->error;
+                DBG_E("Netlink dump %d failed: %s\n", n->nlmsg_type,
+                      strerror(errno));
+                return ETHNETLINKERR;
+            }
+            if (!stop)
+                stop = cb(h, data);
+        }
+    }
+}
+
+/*
+ * Richiesta singola su un socket NETLINK_ROUTE temporaneo.
+ */
+int ethNlRequest(struct nlmsghdr *n)
+{
+    int fd, rval, err;
+
+    fd = ethNlOpen(NETLINK_ROUTE, 0);
+    if (fd < 0)
+        return fd;
+    rval = ethNlTalk(fd, n);
+    err = errno;
+    ethNlClose(fd);
+    errno = err;
+    return rval;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Protocollo sd_notify scritto direttamente sul socket datagram
+ * indicato da $NOTIFY_SOCKET (percorso o socket astratto '@...').
+ *
+ * Il keepalive WATCHDOG=1 parte da un timer dell'event loop ogni
+ * WATCHDOG_USEC / 2: se il loop resta bloccato il service manager se ne
+ * accorge e riavvia il servizio. Le variabili d'ambiente vengono tolte
+ * dopo la lettura, cosi` i processi figli (es. dhclient) non le ereditano.
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "debug.h"
+#include "ethnotify.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ethNotifyInit(t_notify *n)
+{
+    const char *path = getenv("NOTIFY_SOCKET");
+    const char *usec = getenv("WATCHDOG_USEC");
+    const char *pid = getenv("WATCHDOG_PID");
+    size_t len;
+
+    memset(n, 0, sizeof(t_notify));
+    n->fd = -1;
+
+    /* Il watchdog puo` essere destinato a un altro processo */
+    if (usec != NULL && (pid == NULL || atol(pid) == (long)getpid()))
+        n->watchdogMs = atol(usec) / 1000;
+
+    if (path == NULL || (path[0] != '/' && path[0] != '@'))
+    {
+        n->watchdogMs = 0;
+        return ETHNOERR;
+    }
+    len = strlen(path);
+    if (len >= sizeof(n->addr.sun_path))
+    {
+        DBG_E("NOTIFY_SOCKET too long\n");
+        return ETHBADCONFERR;
+    }
+    n->addr.sun_family = AF_UNIX;
+    memcpy(n->addr.sun_path, path, len);
+    if (path[0] == '@')
+        n->addr.sun_path[0] = '\0';
+    n->addrLen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len);
+
+    n->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (n->fd < 0)
+    {
+        DBG_E("Error on socket(AF_UNIX): %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+    unsetenv("NOTIFY_SOCKET");
+    unsetenv("WATCHDOG_USEC");
+    unsetenv("WATCHDOG_PID");
+    DBG_V("Service manager notifications on %s (watchdog %ld ms)\n", path,
+          n->watchdogMs);
+    return ETHNOERR;
+}
+
+/*
+ * Invia msg (righe "CHIAVE=valore"). Senza NOTIFY_SOCKET non fa nulla.
+ */
+int ethNotifySend(t_notify *n, const char *msg)
+{
+    if (n->fd < 0)
+        return ETHNOERR;
+    if (sendto(n->fd, msg, strlen(msg), MSG_NOSIGNAL,
+               (struct sockaddr *)&n->addr, n->addrLen) < 0)
+    {
+        DBG_E("Error on sendto(NOTIFY_SOCKET): %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+    DBG_N("sd_notify: %s\n", msg);
+    return ETHNOERR;
+}
+
+/*
+ * READY=1 viene inviato una sola volta; le chiamate successive
+ * aggiornano solo lo STATUS.
+ */
+void ethNotifyReady(t_notify *n, const char *status)
+{
+    char msg[ETHNOTIFY_MSG_LEN];
+
+    if (n->ready)
+    {
+        ethNotifyStatus(n, status);
+        return;
+    }
+    snprintf(msg, sizeof(msg), "READY=1\nSTATUS=%s", status);
+    if (ethNotifySend(n, msg) == ETHNOERR)
+        n->ready = 1;
+}
+
+void ethNotifyStatus(t_notify *n, const char *status)
+{
+    char msg[ETHNOTIFY_MSG_LEN];
+    snprintf(msg, sizeof(msg), "STATUS=%s", status);
+    ethNotifySend(n, msg);
+}
+
+/*
+ * Keepalive esplicito, per le attese lunghe fuori dall'event loop.
+ */
+void ethNotifyKeepalive(t_notify *n)
+{
+    if (n->watchdogMs > 0)
+        ethNotifySend(n, "WATCHDOG=1");
+}
+
+static void ethNotifyWatchdog(void *data)
+{
+    t_notify *n = (t_notify *)data;
+    /* WATCHDOG_USEC sotto i 2 ms: un timer a 0 ms girerebbe a vuoto */
+    int periodMs = n->watchdogMs / 2 > 0 ? n->watchdogMs / 2 : 1;
+
+    ethNotifyKeepalive(n);
+    n->watchdogTimer = evLoopAddTimer(n->loop, periodMs, ethNotifyWatchdog, n);
+}
+
+int ethNotifyWatchdogStart(t_notify *n, t_evloop *loop)
+{
+    if (n->watchdogMs <= 0)
+        return ETHNOERR;
+    n->loop = loop;
+    ethNotifyWatchdog(n);
+    return n->watchdogTimer > 0 ? ETHNOERR : ETHCONFIGBUSY;
+}
+
+void ethNotifyClose(t_notify *n)
+{
+    if (n->fd < 0)
+        return;
+    ethNotifySend(n, "STOPPING=1");
+    if (n->loop != NULL)
+        evLoopDelTimer(n->loop, n->watchdogTimer);
+    n->watchdogTimer = 0;
+    close(n->fd);
+    n->fd = -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
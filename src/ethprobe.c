@@ -0,0 +1,491 @@
+/*
+ * Probe di connettivita`.
+ *
+ * Tutti i probe di una "run" partono insieme, ognuno con il proprio
+ * socket non bloccante registrato sull'event loop e il proprio timeout.
+ * Il primo che riesce chiude la run e cancella gli altri; se falliscono
+ * tutti la run termina con winner == -1. Oltre all'ICMP (spesso filtrato)
+ * sono disponibili connect TCP, query DNS e GET HTTP con risposta 204
+ * (una risposta diversa indica un captive portal).
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <sys/socket.h>
+#include "debug.h"
+#include "ethprobe.h"
+#include "ethusdt.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static unsigned short ethProbeNextId = 0;
+
+static const char *ethProbeTypeName[] = { "icmp", "tcp", "dns", "http" };
+static const int ethProbeDefaultPort[] = { 0, 80, 53, 80 };
+
+/*
+ * spec: "<tipo> <indirizzo>[:porta] [argomento]", es.
+ *   icmp 8.8.8.8
+ *   tcp 1.1.1.1:443
+ *   dns 8.8.8.8 example.com
+ *   http 142.250.180.14:80 connectivitycheck.gstatic.com/generate_204
+ */
+int ethProbeParse(const char *spec, t_probe *probe)
+{
+    char type[16], addr[64], arg[PROBE_ARG_LEN];
+    char *port;
+    int n, i;
+
+    memset(probe, 0, sizeof(t_probe));
+    memset(arg, 0, sizeof(arg));
+    n = sscanf(spec, "%15s %63s %127s", type, addr, arg);
+    if (n < 2)
+    {
+        DBG_E("Bad probe '%s'\n", spec);
+        return ETHBADCONFERR;
+    }
+    for (i = 0; i <= PROBE_HTTP; i++)
+    {
+        if (strcmp(type, ethProbeTypeName[i]) == 0)
+            break;
+    }
+    if (i > PROBE_HTTP)
+    {
+        DBG_E("Unknown probe type '%s'\n", type);
+        return ETHBADCONFERR;
+    }
+    probe->type = (t_probe_type)i;
+    probe->port = ethProbeDefaultPort[i];
+    probe->timeoutMs = PROBE_TIMEOUT_MSECS;
+
+    port = strchr(addr, ':');
+    if (port != NULL)
+    {
+        *port++ = '\0';
+        probe->port = atoi(port);
+    }
+    if (inet_pton(AF_INET, addr, &probe->address) != 1 ||
+        (probe->type != PROBE_ICMP && (probe->port <= 0 || probe->port > 65535)))
+    {
+        DBG_E("Bad probe address '%s'\n", spec);
+        return ETHBADCONFERR;
+    }
+
+    if (n == 3)
+        strncpy(probe->arg, arg, sizeof(probe->arg) - 1);
+    else if (probe->type == PROBE_DNS)
+        strncpy(probe->arg, PROBE_DNS_NAME, sizeof(probe->arg) - 1);
+    else if (probe->type == PROBE_HTTP)
+        strncpy(probe->arg, PROBE_HTTP_URL, sizeof(probe->arg) - 1);
+    return ETHNOERR;
+}
+
+void ethProbeName(const t_probe *probe, char *str, int len)
+{
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &probe->address, addr, sizeof(addr));
+    if (probe->type == PROBE_ICMP)
+        snprintf(str, len, "icmp %s", addr);
+    else
+        snprintf(str, len, "%s %s:%d%s%s", ethProbeTypeName[probe->type],
+                 addr, probe->port, probe->arg[0] ? " " : "", probe->arg);
+}
+
+const char *ethProbeStatusName(t_probe_status status)
+{
+    switch (status)
+    {
+        case PROBE_PENDING:   return "pending";
+        case PROBE_SUCCESS:   return "ok";
+        case PROBE_TIMEOUT:   return "timeout";
+        case PROBE_REFUSED:   return "refused";
+        case PROBE_PORTAL:    return "captive portal";
+        case PROBE_FAILED:    return "failed";
+        case PROBE_CANCELLED: return "cancelled";
+    }
+    return "?";
+}
+
+static unsigned short ethProbeChecksum(const void *data, int len)
+{
+    const unsigned short *p = (const unsigned short *)data;
+    unsigned int sum = 0;
+
+    for (; len > 1; len -= 2)
+        sum += *p++;
+    if (len == 1)
+        sum += *(const unsigned char *)p;
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += sum >> 16;
+    return (unsigned short)~sum;
+}
+
+/*
+ * Chiude il probe con l'esito dato. Il primo successo cancella gli
+ * altri probe; l'ultimo probe a chiudersi invoca il callback della run.
+ */
+static void ethProbeFinish(t_probe_state *st, t_probe_status status)
+{
+    t_probe_run *run = st->run;
+    int i;
+
+    if (st->status != PROBE_PENDING)
+        return;
+    if (st->fd >= 0)
+    {
+        evLoopDelFd(run->loop, st->fd);
+        close(st->fd);
+        st->fd = -1;
+    }
+    evLoopDelTimer(run->loop, st->timerId);
+    st->timerId = 0;
+    st->status = status;
+    st->rttMs = (long)(evLoopNowMs() - st->startMs);
+    run->pending--;
+    ETHUSDT5(probe__done, (int)st->probe->type, st->probe->address.s_addr,
+             st->probe->arg, (int)status,
+             ETHUSDT_SINCE(probe__done, st->usdtStartUs));
+
+    if (debuglevel >= DBG_VERBOSE)
+    {
+        char name[PROBE_ARG_LEN + 64];
+        ethProbeName(st->probe, name, sizeof(name));
+        DBG_V("Probe %s: %s (%ld ms)\n", name, ethProbeStatusName(status),
+              st->rttMs);
+    }
+
+    if (status == PROBE_SUCCESS && run->winner < 0)
+    {
+        run->winner = (int)(st - run->state);
+        for (i = 0; i < run->n; i++)
+            ethProbeFinish(&run->state[i], PROBE_CANCELLED);
+    }
+    if (run->pending == 0 && !run->finished)
+    {
+        run->finished = 1;
+        if (run->cb != NULL)
+            run->cb(run, run->cbData);
+    }
+}
+
+static void ethProbeTimeout(void *data)
+{
+    t_probe_state *st = (t_probe_state *)data;
+    st->timerId = 0;
+    ethProbeFinish(st, PROBE_TIMEOUT);
+}
+
+static int ethProbeSocket(t_probe_state *st, int type, int proto)
+{
+    struct sockaddr_in sin;
+
+    st->fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, proto);
+    if (st->fd < 0)
+        return ETHSOCKETERR;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr = st->probe->address;
+    sin.sin_port = htons(st->probe->port);
+    if (connect(st->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 &&
+        errno != EINPROGRESS)
+        return errno == ECONNREFUSED ? ETHPROBEERR : ETHSOCKETERR;
+    return ETHNOERR;
+}
+
+/* --- ICMP --- */
+
+static void ethProbeIcmpEvent(int fd, short revents, void *data)
+{
+    t_probe_state *st = (t_probe_state *)data;
+    unsigned char buf[1024];
+    struct icmphdr *icmp;
+    ssize_t len;
+    int raw = st->stage;
+
+    (void)revents;
+    while ((len = recv(fd, buf, sizeof(buf), 0)) > 0)
+    {
+        int off = 0;
+        if (raw)
+        {
+            /* Il raw socket consegna anche l'header IP */
+            off = (buf[0] & 0x0f) * 4;
+        }
+        if (len < off + (ssize_t)sizeof(struct icmphdr))
+            continue;
+        icmp = (struct icmphdr *)(buf + off);
+        if (icmp->type != ICMP_ECHOREPLY)
+            continue;
+        /* Con il ping socket l'id lo assegna il kernel */
+        if (raw && ntohs(icmp->un.echo.id) != st->id)
+            continue;
+        ethProbeFinish(st, PROBE_SUCCESS);
+        return;
+    }
+}
+
+static int ethProbeIcmpStart(t_probe_state *st)
+{
+    struct icmphdr icmp;
+
+    /* Raw socket se root, altrimenti ping socket (ping_group_range) */
+    st->stage = 1;
+    if (ethProbeSocket(st, SOCK_RAW, IPPROTO_ICMP) != ETHNOERR)
+    {
+        if (st->fd >= 0)
+            close(st->fd);
+        st->fd = -1;
+        st->stage = 0;
+        if (ethProbeSocket(st, SOCK_DGRAM, IPPROTO_ICMP) != ETHNOERR)
+            return ETHSOCKETERR;
+    }
+    memset(&icmp, 0, sizeof(icmp));
+    icmp.type = ICMP_ECHO;
+    icmp.un.echo.id = htons(st->id);
+    icmp.un.echo.sequence = htons(1);
+    icmp.checksum = ethProbeChecksum(&icmp, sizeof(icmp));
+    if (send(st->fd, &icmp, sizeof(icmp), 0) < 0)
+        return ETHSOCKETERR;
+    return evLoopAddFd(st->run->loop, st->fd, POLLIN, ethProbeIcmpEvent, st);
+}
+
+/* --- TCP / HTTP --- */
+
+static void ethProbeHttpRequest(t_probe_state *st)
+{
+    char host[PROBE_ARG_LEN];
+    char req[PROBE_ARG_LEN * 2 + 64];
+    const char *path;
+    int len;
+
+    strncpy(host, st->probe->arg, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    path = strchr(st->probe->arg, '/');
+    if (path != NULL)
+        host[path - st->probe->arg] = '\0';
+    else
+        path = "/";
+    len = snprintf(req, sizeof(req),
+                   "GET %s HTTP/1.1\r\nHost: %s\r\n"
+                   "Connection: close\r\n\r\n", path, host);
+    if (send(st->fd, req, len, MSG_NOSIGNAL) != len)
+    {
+        ethProbeFinish(st, PROBE_FAILED);
+        return;
+    }
+    st->stage = 1;
+    evLoopModFd(st->run->loop, st->fd, POLLIN);
+}
+
+static void ethProbeHttpResponse(t_probe_state *st)
+{
+    int major, minor, code;
+    ssize_t len;
+
+    len = recv(st->fd, st->rx + st->rxLen, sizeof(st->rx) - 1 - st->rxLen, 0);
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (len > 0)
+    {
+        st->rxLen += len;
+        st->rx[st->rxLen] = '\0';
+        if (strstr(st->rx, "\r\n") == NULL && st->rxLen < (int)sizeof(st->rx) - 1)
+            return;
+    }
+    if (sscanf(st->rx, "HTTP/%d.%d %d", &major, &minor, &code) == 3)
+        ethProbeFinish(st, code == 204 ? PROBE_SUCCESS : PROBE_PORTAL);
+    else
+        ethProbeFinish(st, PROBE_FAILED);
+}
+
+static void ethProbeTcpEvent(int fd, short revents, void *data)
+{
+    t_probe_state *st = (t_probe_state *)data;
+    int err = 0;
+    socklen_t elen = sizeof(err);
+
+    (void)revents;
+    if (st->stage == 1)
+    {
+        ethProbeHttpResponse(st);
+        return;
+    }
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &elen) < 0 || err != 0)
+    {
+        ethProbeFinish(st, err == ECONNREFUSED ? PROBE_REFUSED : PROBE_FAILED);
+        return;
+    }
+    if (st->probe->type == PROBE_HTTP)
+        ethProbeHttpRequest(st);
+    else
+        ethProbeFinish(st, PROBE_SUCCESS);
+}
+
+static int ethProbeTcpStart(t_probe_state *st)
+{
+    int rval = ethProbeSocket(st, SOCK_STREAM, 0);
+    if (rval != ETHNOERR)
+        return rval;
+    return evLoopAddFd(st->run->loop, st->fd, POLLOUT, ethProbeTcpEvent, st);
+}
+
+/* --- DNS --- */
+
+static void ethProbeDnsEvent(int fd, short revents, void *data)
+{
+    t_probe_state *st = (t_probe_state *)data;
+    unsigned char buf[512];
+    ssize_t len;
+
+    (void)revents;
+    while ((len = recv(fd, buf, sizeof(buf), 0)) != 0)
+    {
+        if (len < 0)
+        {
+            if (errno == ECONNREFUSED)
+                ethProbeFinish(st, PROBE_REFUSED);
+            return;
+        }
+        /* Basta una risposta (QR) con il nostro id, anche NXDOMAIN */
+        if (len >= 12 && ((buf[0] << 8) | buf[1]) == st->id && (buf[2] & 0x80))
+        {
+            ethProbeFinish(st, PROBE_SUCCESS);
+            return;
+        }
+    }
+}
+
+/*
+ * Costruisce una query A (RD=1) per name in buf. Restituisce la
+ * lunghezza del messaggio o -1.
+ */
+int ethProbeDnsQuery(unsigned short id, const char *name, unsigned char *buf,
+                     int size)
+{
+    int pos = 12;
+    const char *label = name;
+
+    if (size < 12 + (int)strlen(name) + 6)
+        return -1;
+    memset(buf, 0, 12);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = 0x01;   /* RD */
+    buf[5] = 1;      /* QDCOUNT */
+    while (*label)
+    {
+        const char *dot = strchr(label, '.');
+        int l = dot != NULL ? (int)(dot - label) : (int)strlen(label);
+        if (l == 0 || l > 63)
+            return -1;
+        buf[pos++] = l;
+        memcpy(buf + pos, label, l);
+        pos += l;
+        label += l + (dot != NULL ? 1 : 0);
+    }
+    buf[pos++] = 0;
+    buf[pos++] = 0; buf[pos++] = 1;  /* QTYPE A */
+    buf[pos++] = 0; buf[pos++] = 1;  /* QCLASS IN */
+    return pos;
+}
+
+static int ethProbeDnsStart(t_probe_state *st)
+{
+    unsigned char query[PROBE_ARG_LEN + 32];
+    int len, rval;
+
+    rval = ethProbeSocket(st, SOCK_DGRAM, 0);
+    if (rval != ETHNOERR)
+        return rval;
+    len = ethProbeDnsQuery(st->id, st->probe->arg, query, sizeof(query));
+    if (len < 0 || send(st->fd, query, len, 0) != len)
+        return ETHSOCKETERR;
+    return evLoopAddFd(st->run->loop, st->fd, POLLIN, ethProbeDnsEvent, st);
+}
+
+/*
+ * Avvia in parallelo gli n probe. cb viene chiamato una volta sola, al
+ * primo successo oppure quando tutti sono falliti.
+ */
+int ethProbeStart(t_probe_run *run, t_evloop *loop, const t_probe *probes,
+                  int n, t_probe_done_cb cb, void *data)
+{
+    int i;
+
+    memset(run, 0, sizeof(t_probe_run));
+    run->loop = loop;
+    run->n = n > PROBE_MAX ? PROBE_MAX : n;
+    run->winner = -1;
+    run->cb = cb;
+    run->cbData = data;
+    run->pending = run->n;
+    for (i = 0; i < run->n; i++)
+    {
+        run->state[i].run = run;
+        run->state[i].probe = &probes[i];
+        run->state[i].fd = -1;
+        run->state[i].status = PROBE_PENDING;
+    }
+    if (run->n == 0)
+    {
+        run->finished = 1;
+        if (cb != NULL)
+            cb(run, data);
+        return ETHNOERR;
+    }
+
+    for (i = 0; i < run->n && !run->finished; i++)
+    {
+        t_probe_state *st = &run->state[i];
+        int rval = ETHBADCONFERR;
+
+        if (st->status != PROBE_PENDING)
+            continue;
+        st->startMs = evLoopNowMs();
+        st->usdtStartUs = ETHUSDT_NOW(probe__done);
+        ETHUSDT4(probe__start, (int)probes[i].type, probes[i].address.s_addr,
+                 probes[i].port, probes[i].arg);
+        st->id = (unsigned short)((getpid() << 4) ^ ++ethProbeNextId);
+        st->timerId = evLoopAddTimer(loop, probes[i].timeoutMs > 0
+                                     ? probes[i].timeoutMs
+                                     : PROBE_TIMEOUT_MSECS,
+                                     ethProbeTimeout, st);
+        switch (probes[i].type)
+        {
+            case PROBE_ICMP: rval = ethProbeIcmpStart(st); break;
+            case PROBE_TCP:
+            case PROBE_HTTP: rval = ethProbeTcpStart(st); break;
+            case PROBE_DNS:  rval = ethProbeDnsStart(st); break;
+        }
+        if (rval != ETHNOERR)
+        {
+            ethProbeFinish(st, rval == ETHPROBEERR ? PROBE_REFUSED
+                                                   : PROBE_FAILED);
+        }
+    }
+    return ETHNOERR;
+}
+
+/*
+ * Interrompe la run senza invocare il callback.
+ */
+void ethProbeCancel(t_probe_run *run)
+{
+    int i;
+    run->finished = 1;
+    for (i = 0; i < run->n; i++)
+        ethProbeFinish(&run->state[i], PROBE_CANCELLED);
+}
+
+#ifdef __cplusplus
+}
+#endif
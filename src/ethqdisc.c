@@ -0,0 +1,278 @@
+/*
+ * Qdisc di root via rtnetlink.
+ *
+ * Sotto carico la coda FIFO del driver si riempie e la latenza sale di
+ * centinaia di millisecondi (bufferbloat). fq_codel e cake tengono
+ * corta la coda scartando (o marcando ECN) i flussi che la occupano;
+ * fq distribuisce l'uscita per flusso con il pacing chiesto dal TCP.
+ * Lo shaping di cake serve quando il collo di bottiglia e` a valle (il
+ * modem): il rate va tenuto un po' sotto quello reale perche' la coda
+ * resti qui. La sostituzione (NLM_F_REPLACE) e` atomica: i pacchetti
+ * gia` in coda passano alla nuova qdisc.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <net/if.h>
+#include <linux/gen_stats.h>
+#include <linux/pkt_sched.h>
+#include "debug.h"
+#include "ethnl.h"
+#include "ethqdisc.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static const char *ethQdiscNames[] = { "", "fq_codel", "fq", "cake" };
+
+const char *ethQdiscKindName(t_qdisc_kind kind)
+{
+    return ethQdiscNames[kind];
+}
+
+/* "900mbit", "50000kbit", "1gbit", "95%", "auto" */
+static int ethQdiscParseRate(const char *value, t_qdisc_conf *q)
+{
+    char *end;
+    double v;
+
+    if (strcmp(value, "auto") == 0)
+    {
+        q->ratePct = QDISC_RATE_PCT;
+        return ETHNOERR;
+    }
+    v = strtod(value, &end);
+    if (end == value || v <= 0)
+        return ETHBADCONFERR;
+    if (strcmp(end, "%") == 0 && v <= 100)
+        q->ratePct = (int)v;
+    else if (strcasecmp(end, "kbit") == 0)
+        q->rateKbit = (long)v;
+    else if (strcasecmp(end, "mbit") == 0)
+        q->rateKbit = (long)(v * 1000);
+    else if (strcasecmp(end, "gbit") == 0)
+        q->rateKbit = (long)(v * 1000000);
+    else
+        return ETHBADCONFERR;
+    return ETHNOERR;
+}
+
+/*
+ * Sintassi: tipo [opzione=valore ...]
+ *   fq_codel [target=<us>] [limit=<pacchetti>]
+ *   fq [rate=<rate>] [limit=<pacchetti>]
+ *   cake [rate=<rate>]
+ * con rate in kbit/mbit/gbit, percentuale del link speed o "auto".
+ */
+int ethQdiscParse(const char *spec, t_qdisc_conf *q)
+{
+    char buf[128];
+    char *tok, *save = NULL, *eq;
+    int i;
+
+    memset(q, 0, sizeof(t_qdisc_conf));
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    tok = strtok_r(buf, " \t", &save);
+    if (tok == NULL)
+        return ETHBADCONFERR;
+    for (i = QDISC_FQ_CODEL; i <= QDISC_CAKE; i++)
+    {
+        if (strcmp(tok, ethQdiscNames[i]) == 0)
+            q->kind = (t_qdisc_kind)i;
+    }
+    if (q->kind == QDISC_NONE)
+        return ETHBADCONFERR;
+
+    while ((tok = strtok_r(NULL, " \t", &save)) != NULL)
+    {
+        eq = strchr(tok, '=');
+        if (eq == NULL)
+            return ETHBADCONFERR;
+        *eq++ = '\0';
+        if (strcmp(tok, "rate") == 0 && q->kind != QDISC_FQ_CODEL)
+        {
+            if (ethQdiscParseRate(eq, q) != ETHNOERR)
+                return ETHBADCONFERR;
+        }
+        else if (strcmp(tok, "target") == 0 && q->kind == QDISC_FQ_CODEL &&
+                 atoi(eq) > 0)
+            q->targetUs = atoi(eq);
+        else if (strcmp(tok, "limit") == 0 && q->kind != QDISC_CAKE &&
+                 atoi(eq) > 0)
+            q->limit = atoi(eq);
+        else
+            return ETHBADCONFERR;
+    }
+    return ETHNOERR;
+}
+
+/* Rate effettivo in kbit/s: fisso, o percentuale del link speed (0 se ignoto) */
+long ethQdiscRate(const t_qdisc_conf *q, int speedMbps)
+{
+    if (q->ratePct > 0)
+        return speedMbps > 0 ? (long)speedMbps * 10L * q->ratePct : 0;
+    return q->rateKbit;
+}
+
+int ethQdiscApply(const char *device, const t_qdisc_conf *q, long rateKbit)
+{
+    t_nl_msg m;
+    struct tcmsg tcm;
+    struct nlmsghdr *n;
+    struct rtattr *opts;
+    unsigned long long bytesPerSec = (unsigned long long)rateKbit * 1000 / 8;
+    int rval;
+
+    if (q->kind == QDISC_NONE)
+        return ETHNOERR;
+    memset(&tcm, 0, sizeof(tcm));
+    tcm.tcm_family = AF_UNSPEC;
+    tcm.tcm_ifindex = device != NULL ? if_nametoindex(device) : 0;
+    tcm.tcm_parent = TC_H_ROOT;
+    if (tcm.tcm_ifindex == 0)
+    {
+        DBG_E("No device %s\n", device != NULL ? device : "--");
+        return ETHDEVICEERR;
+    }
+    n = ethNlMsgInit(&m, RTM_NEWQDISC, NLM_F_CREATE | NLM_F_REPLACE,
+                     &tcm, sizeof(tcm));
+    ethNlAddAttrStr(n, TCA_KIND, ethQdiscNames[q->kind]);
+    opts = ethNlNestStart(n, TCA_OPTIONS);
+    switch (q->kind)
+    {
+        case QDISC_FQ_CODEL:
+            if (q->targetUs > 0)
+                ethNlAddAttr32(n, TCA_FQ_CODEL_TARGET, q->targetUs);
+            if (q->limit > 0)
+                ethNlAddAttr32(n, TCA_FQ_CODEL_LIMIT, q->limit);
+            ethNlAddAttr32(n, TCA_FQ_CODEL_ECN, 1);
+            break;
+        case QDISC_FQ:
+            ethNlAddAttr32(n, TCA_FQ_RATE_ENABLE, 1);
+            /* Tetto per flusso, in byte/s a 32 bit (~34 Gbit/s) */
+            if (rateKbit > 0)
+                ethNlAddAttr32(n, TCA_FQ_FLOW_MAX_RATE,
+                               bytesPerSec > 0xffffffffULL ? 0xffffffffU
+                                                           : (unsigned int)bytesPerSec);
+            if (q->limit > 0)
+                ethNlAddAttr32(n, TCA_FQ_PLIMIT, q->limit);
+            break;
+        case QDISC_CAKE:
+            /* 0: nessuno shaping */
+            ethNlAddAttr(n, TCA_CAKE_BASE_RATE64, &bytesPerSec,
+                         sizeof(bytesPerSec));
+            break;
+        default:
+            break;
+    }
+    ethNlNestEnd(n, opts);
+    rval = ethNlRequest(n);
+    if (rval != ETHNOERR)
+        DBG_E("%s: cannot set qdisc %s: %s\n", device, ethQdiscNames[q->kind],
+              strerror(errno));
+    return rval;
+}
+
+typedef struct {
+    int ifindex;
+    int found;
+    t_qdisc_stats *stats;
+} t_qdisc_dump;
+
+static int ethQdiscStatsCollect(struct nlmsghdr *h, void *data)
+{
+    t_qdisc_dump *d = (t_qdisc_dump *)data;
+    struct tcmsg *tcm = (struct tcmsg *)NLMSG_DATA(h);
+    struct rtattr *tb[TCA_MAX + 1];
+    struct rtattr *st[TCA_STATS_MAX + 1];
+    t_qdisc_stats *s = d->stats;
+
+    if (h->nlmsg_type != RTM_NEWQDISC || tcm->tcm_ifindex != d->ifindex ||
+        tcm->tcm_parent != TC_H_ROOT)
+        return 0;
+    ethNlParseAttrs(tb, TCA_MAX, TCA_RTA(tcm), TCA_PAYLOAD(h));
+    if (tb[TCA_KIND] != NULL)
+        strncpy(s->kind, RTA_DATA(tb[TCA_KIND]), sizeof(s->kind) - 1);
+    if (tb[TCA_STATS2] != NULL)
+    {
+        ethNlParseAttrs(st, TCA_STATS_MAX, RTA_DATA(tb[TCA_STATS2]),
+                        RTA_PAYLOAD(tb[TCA_STATS2]));
+        if (st[TCA_STATS_BASIC] != NULL)
+        {
+            struct gnet_stats_basic b;
+            memset(&b, 0, sizeof(b));
+            memcpy(&b, RTA_DATA(st[TCA_STATS_BASIC]),
+                   RTA_PAYLOAD(st[TCA_STATS_BASIC]) < sizeof(b)
+                   ? RTA_PAYLOAD(st[TCA_STATS_BASIC]) : sizeof(b));
+            s->bytes = b.bytes;
+            s->packets = b.packets;
+        }
+        if (st[TCA_STATS_QUEUE] != NULL)
+        {
+            struct gnet_stats_queue sq;
+            memset(&sq, 0, sizeof(sq));
+            memcpy(&sq, RTA_DATA(st[TCA_STATS_QUEUE]),
+                   RTA_PAYLOAD(st[TCA_STATS_QUEUE]) < sizeof(sq)
+                   ? RTA_PAYLOAD(st[TCA_STATS_QUEUE]) : sizeof(sq));
+            s->qlen = sq.qlen;
+            s->backlog = sq.backlog;
+            s->drops = sq.drops;
+            s->requeues = sq.requeues;
+            s->overlimits = sq.overlimits;
+        }
+    }
+    else if (tb[TCA_STATS] != NULL)
+    {
+        struct tc_stats ts;
+        memset(&ts, 0, sizeof(ts));
+        memcpy(&ts, RTA_DATA(tb[TCA_STATS]),
+               RTA_PAYLOAD(tb[TCA_STATS]) < sizeof(ts)
+               ? RTA_PAYLOAD(tb[TCA_STATS]) : sizeof(ts));
+        s->bytes = ts.bytes;
+        s->packets = ts.packets;
+        s->drops = ts.drops;
+        s->overlimits = ts.overlimits;
+        s->backlog = ts.backlog;
+        s->qlen = ts.qlen;
+    }
+    d->found = 1;
+    return 1;
+}
+
+/* Contatori della qdisc di root (cumulativi dalla sua creazione) */
+int ethQdiscStats(const char *device, t_qdisc_stats *stats)
+{
+    t_nl_msg m;
+    struct tcmsg tcm;
+    struct nlmsghdr *n;
+    t_qdisc_dump d;
+    int fd, rval;
+
+    memset(stats, 0, sizeof(t_qdisc_stats));
+    d.ifindex = device != NULL ? if_nametoindex(device) : 0;
+    d.found = 0;
+    d.stats = stats;
+    if (d.ifindex == 0)
+        return ETHDEVICEERR;
+    fd = ethNlOpen(NETLINK_ROUTE, 0);
+    if (fd < 0)
+        return fd;
+    memset(&tcm, 0, sizeof(tcm));
+    tcm.tcm_family = AF_UNSPEC;
+    tcm.tcm_ifindex = d.ifindex;
+    n = ethNlMsgInit(&m, RTM_GETQDISC, 0, &tcm, sizeof(tcm));
+    rval = ethNlDump(fd, n, ethQdiscStatsCollect, &d);
+    ethNlClose(fd);
+    if (rval == ETHNOERR && !d.found)
+        rval = ETHDEVICEERR;
+    return rval;
+}
+
+#ifdef __cplusplus
+}
+#endif
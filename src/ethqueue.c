@@ -0,0 +1,385 @@
+/*
+ * Mappatura code -> core.
+ *
+ * Senza intervento tutti gli interrupt della scheda finiscono sul primo
+ * core. Qui si scoprono code (sysfs) e IRQ (/proc/interrupts, o
+ * msi_irqs del device PCI), si sceglie l'insieme di core (quelli
+ * indicati, ristretti al nodo NUMA della scheda se ne ha uno) e li si
+ * distribuisce a giro:
+ *  - IRQ i              -> core i mod n (smp_affinity_list)
+ *  - coda TX i          -> core i mod n (xps_cpus)
+ *  - code RX            -> tutti i core (rps_cpus) solo se le code sono
+ *                          meno dei core, altrimenti RPS spento
+ *  - tabella RSS        -> voci ripartite in modo uniforme sulle code RX
+ *  - flow_limit         -> attivo sui core usati, contro i flussi enormi
+ * Le scritture sono idempotenti: si possono ripetere a ogni link-up.
+ */
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include "debug.h"
+#include "ethqueue.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QUEUE_SET(s, c)    ((s)->bits[(c) / 32] |= 1u << ((c) % 32))
+#define QUEUE_ISSET(s, c)  (((s)->bits[(c) / 32] >> ((c) % 32)) & 1u)
+
+/* Lista di core nel formato del kernel: "0-3,8,10-11" */
+int ethQueueParseCpus(const char *list, t_cpuset *set)
+{
+    const char *p = list;
+    char *end;
+    long lo, hi, c;
+
+    memset(set, 0, sizeof(t_cpuset));
+    while (*p != '\0' && *p != '\n')
+    {
+        lo = strtol(p, &end, 10);
+        if (end == p || lo < 0 || lo >= QUEUE_MAX_CPUS)
+            return ETHBADCONFERR;
+        hi = lo;
+        p = end;
+        if (*p == '-')
+        {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo || hi >= QUEUE_MAX_CPUS)
+                return ETHBADCONFERR;
+            p = end;
+        }
+        for (c = lo; c <= hi; c++)
+            QUEUE_SET(set, c);
+        if (*p == ',')
+            p++;
+        else if (*p != '\0' && *p != '\n')
+            return ETHBADCONFERR;
+    }
+    return ETHNOERR;
+}
+
+int ethQueueCpuCount(const t_cpuset *set)
+{
+    int c, n = 0;
+    for (c = 0; c < QUEUE_MAX_CPUS; c++)
+        n += QUEUE_ISSET(set, c);
+    return n;
+}
+
+/* "0-3,8": inverso di ethQueueParseCpus */
+void ethQueueFormatCpus(const t_cpuset *set, char *str, int len)
+{
+    int c, start, n = 0;
+
+    str[0] = '\0';
+    for (c = 0; c < QUEUE_MAX_CPUS && n < len; c++)
+    {
+        if (!QUEUE_ISSET(set, c))
+            continue;
+        start = c;
+        while (c + 1 < QUEUE_MAX_CPUS && QUEUE_ISSET(set, c + 1))
+            c++;
+        if (start == c)
+            n += snprintf(str + n, len - n, "%s%d", n > 0 ? "," : "", c);
+        else
+            n += snprintf(str + n, len - n, "%s%d-%d", n > 0 ? "," : "",
+                          start, c);
+    }
+}
+
+/* Maschera esadecimale a gruppi di 32 bit, come rps_cpus: "ff,00000001" */
+static void ethQueueFormatMask(const t_cpuset *set, char *str, int len)
+{
+    int w, top = 0, n = 0;
+
+    for (w = 0; w < QUEUE_MAX_CPUS / 32; w++)
+    {
+        if (set->bits[w] != 0)
+            top = w;
+    }
+    for (w = top; w >= 0 && n < len; w--)
+        n += snprintf(str + n, len - n, w == top ? "%x" : ",%08x",
+                      set->bits[w]);
+}
+
+static int ethQueueReadFile(const char *path, char *buf, int len)
+{
+    FILE *f = fopen(path, "r");
+    int n;
+
+    if (f == NULL)
+        return ETHFREADERR;
+    n = fread(buf, 1, len - 1, f);
+    fclose(f);
+    buf[n > 0 ? n : 0] = '\0';
+    return ETHNOERR;
+}
+
+static int ethQueueWriteFile(const char *path, const char *value)
+{
+    FILE *f = fopen(path, "w");
+    int rval = ETHNOERR;
+
+    if (f == NULL)
+    {
+        DBG_V("%s: %s\n", path, strerror(errno));
+        return ETHFREADERR;
+    }
+    /* L'errore di sysfs/procfs arriva alla scrittura effettiva */
+    if (fputs(value, f) < 0 || fflush(f) != 0)
+        rval = ETHFREADERR;
+    if (fclose(f) != 0)
+        rval = ETHFREADERR;
+    if (rval != ETHNOERR)
+        DBG_V("%s <- %s: %s\n", path, value, strerror(errno));
+    return rval;
+}
+
+/* k-esimo core dell'insieme (k < numero di core) */
+static int ethQueueNthCpu(const t_cpuset *set, int k)
+{
+    int c;
+    for (c = 0; c < QUEUE_MAX_CPUS; c++)
+    {
+        if (QUEUE_ISSET(set, c) && k-- == 0)
+            return c;
+    }
+    return 0;
+}
+
+/*
+ * Core da usare: quelli richiesti (o tutti gli online), ristretti al
+ * nodo NUMA della scheda se l'intersezione non e` vuota.
+ */
+static void ethQueueChooseCpus(const char *device, const t_cpuset *want,
+                               t_cpuset *use, int *node)
+{
+    char path[256], buf[4096];
+    t_cpuset local;
+    int w, any = 0;
+
+    memset(use, 0, sizeof(t_cpuset));
+    if (want != NULL && ethQueueCpuCount(want) > 0)
+        *use = *want;
+    else if (ethQueueReadFile("/sys/devices/system/cpu/online", buf,
+                              sizeof(buf)) != ETHNOERR ||
+             ethQueueParseCpus(buf, use) != ETHNOERR)
+        QUEUE_SET(use, 0);
+
+    *node = -1;
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", device);
+    if (ethQueueReadFile(path, buf, sizeof(buf)) == ETHNOERR)
+        *node = atoi(buf);
+    if (*node < 0)
+        return;
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             *node);
+    if (ethQueueReadFile(path, buf, sizeof(buf)) != ETHNOERR ||
+        ethQueueParseCpus(buf, &local) != ETHNOERR)
+        return;
+    for (w = 0; w < QUEUE_MAX_CPUS / 32; w++)
+    {
+        local.bits[w] &= use->bits[w];
+        any |= local.bits[w] != 0;
+    }
+    if (any)
+        *use = local;
+}
+
+static void ethQueueCount(const char *device, t_queue_report *report)
+{
+    char path[256];
+    struct dirent *de;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/queues", device);
+    dir = opendir(path);
+    if (dir == NULL)
+        return;
+    while ((de = readdir(dir)) != NULL)
+    {
+        if (strncmp(de->d_name, "rx-", 3) == 0)
+            report->nRx++;
+        else if (strncmp(de->d_name, "tx-", 3) == 0)
+            report->nTx++;
+    }
+    closedir(dir);
+}
+
+/*
+ * IRQ della scheda: righe di /proc/interrupts che nominano il device
+ * ("eth0", "eth0-TxRx-3"...), in ordine; altrimenti gli MSI del device.
+ */
+static int ethQueueIrqs(const char *device, int *irqs, int max)
+{
+    char line[1024], path[256];
+    const char *p;
+    struct dirent *de;
+    size_t dlen = strlen(device);
+    int n = 0;
+    FILE *f;
+    DIR *dir;
+
+    f = fopen("/proc/interrupts", "r");
+    while (f != NULL && n < max && fgets(line, sizeof(line), f) != NULL)
+    {
+        for (p = strstr(line, device); p != NULL; p = strstr(p + 1, device))
+        {
+            if ((p == line || isspace((unsigned char)p[-1])) &&
+                !isalnum((unsigned char)p[dlen]))
+            {
+                irqs[n++] = atoi(line);
+                break;
+            }
+        }
+    }
+    if (f != NULL)
+        fclose(f);
+    if (n > 0)
+        return n;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/msi_irqs", device);
+    dir = opendir(path);
+    if (dir == NULL)
+        return 0;
+    while ((de = readdir(dir)) != NULL && n < max)
+    {
+        if (isdigit((unsigned char)de->d_name[0]))
+            irqs[n++] = atoi(de->d_name);
+    }
+    closedir(dir);
+    return n;
+}
+
+/* Indirezione RSS uniforme sulle code RX; voci scritte o 0 */
+static int ethQueueRss(const char *device, int *errors)
+{
+    struct ethtool_rxnfc rings;
+    struct ethtool_rxfh_indir head, *indir;
+    struct ifreq ifr;
+    unsigned int i;
+    int fd, rval = 0;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return 0;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+
+    memset(&rings, 0, sizeof(rings));
+    rings.cmd = ETHTOOL_GRXRINGS;
+    ifr.ifr_data = (char *)&rings;
+    memset(&head, 0, sizeof(head));
+    head.cmd = ETHTOOL_GRXFHINDIR;
+    if (ioctl(fd, SIOCETHTOOL, &ifr) != 0 || rings.data < 2 ||
+        (ifr.ifr_data = (char *)&head, ioctl(fd, SIOCETHTOOL, &ifr)) != 0 ||
+        head.size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+    indir = calloc(1, sizeof(*indir) + head.size * sizeof(indir->ring_index[0]));
+    if (indir == NULL)
+    {
+        close(fd);
+        return 0;
+    }
+    indir->cmd = ETHTOOL_SRXFHINDIR;
+    indir->size = head.size;
+    for (i = 0; i < head.size; i++)
+        indir->ring_index[i] = i % rings.data;
+    ifr.ifr_data = (char *)indir;
+    if (ioctl(fd, SIOCETHTOOL, &ifr) == 0)
+        rval = (int)head.size;
+    else
+    {
+        DBG_V("%s: RSS indirection: %s\n", device, strerror(errno));
+        (*errors)++;
+    }
+    free(indir);
+    close(fd);
+    return rval;
+}
+
+/*
+ * Distribuisce code e interrupt del device sui core di cpus (NULL o
+ * vuoto: tutti gli online). Gli errori delle singole scritture (IRQ
+ * gestiti dal kernel, driver senza RSS...) sono contati nel report ma
+ * non fermano le altre.
+ */
+int ethQueueApply(const char *device, const t_cpuset *cpus,
+                  t_queue_report *report)
+{
+    char path[256], mask[QUEUE_MASK_LEN], val[16];
+    int irqs[QUEUE_MAX_IRQS];
+    t_cpuset use, one;
+    int i, nIrqs;
+
+    memset(report, 0, sizeof(t_queue_report));
+    if (device == NULL || strlen(device) >= IFNAMSIZ)
+        return ETHDEVICEERR;
+    ethQueueCount(device, report);
+    if (report->nRx == 0 && report->nTx == 0)
+    {
+        DBG_E("%s: no queues in sysfs\n", device);
+        return ETHDEVICEERR;
+    }
+    ethQueueChooseCpus(device, cpus, &use, &report->numaNode);
+    report->cpus = use;
+    report->nCpus = ethQueueCpuCount(&use);
+
+    nIrqs = ethQueueIrqs(device, irqs, QUEUE_MAX_IRQS);
+    for (i = 0; i < nIrqs; i++)
+    {
+        snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irqs[i]);
+        snprintf(val, sizeof(val), "%d", ethQueueNthCpu(&use, i % report->nCpus));
+        if (ethQueueWriteFile(path, val) == ETHNOERR)
+            report->nIrqs++;
+        else
+            report->errors++;
+    }
+
+    /* RPS solo se l'hardware non ha abbastanza code per tutti i core */
+    report->rps = report->nRx < report->nCpus;
+    ethQueueFormatMask(&use, mask, sizeof(mask));
+    for (i = 0; i < report->nRx; i++)
+    {
+        snprintf(path, sizeof(path), "/sys/class/net/%s/queues/rx-%d/rps_cpus",
+                 device, i);
+        if (ethQueueWriteFile(path, report->rps ? mask : "0") != ETHNOERR)
+            report->errors++;
+    }
+    if (report->rps &&
+        ethQueueWriteFile("/proc/sys/net/core/flow_limit_cpu_bitmap",
+                          mask) != ETHNOERR)
+        report->errors++;
+
+    for (i = 0; i < report->nTx; i++)
+    {
+        memset(&one, 0, sizeof(one));
+        QUEUE_SET(&one, ethQueueNthCpu(&use, i % report->nCpus));
+        ethQueueFormatMask(&one, mask, sizeof(mask));
+        snprintf(path, sizeof(path), "/sys/class/net/%s/queues/tx-%d/xps_cpus",
+                 device, i);
+        if (ethQueueWriteFile(path, mask) != ETHNOERR)
+            report->errors++;
+    }
+
+    report->rssEntries = ethQueueRss(device, &report->errors);
+    return ETHNOERR;
+}
+
+#ifdef __cplusplus
+}
+#endif
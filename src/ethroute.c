@@ -0,0 +1,466 @@
+/*
+ * Route IPv4 via rtnetlink.
+ *
+ * A differenza di "ip route add/del", la sostituzione (replace) di una
+ * route e` un'unica operazione atomica nel kernel: non c'e` un istante
+ * in cui la default route manca.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include "debug.h"
+#include "ethnl.h"
+#include "ethroute.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Prepara una default route via gateway sul device con la metrica data.
+ */
+int ethRouteDefaultInit(t_route *r, const char *gateway, const char *device,
+                        int metric)
+{
+    memset(r, 0, sizeof(t_route));
+    r->metric = metric;
+    r->nNexthops = 1;
+    r->nexthop[0].weight = 1;
+    if (device != NULL)
+    {
+        r->nexthop[0].ifindex = if_nametoindex(device);
+        if (r->nexthop[0].ifindex == 0)
+        {
+            DBG_E("No device %s\n", device);
+            return ETHDEVICEERR;
+        }
+    }
+    if (gateway == NULL ||
+        inet_pton(AF_INET, gateway, &r->nexthop[0].gateway) != 1)
+    {
+        DBG_E("Bad gateway %s\n", gateway != NULL ? gateway : "--");
+        return ETHBADCONFERR;
+    }
+    return ETHNOERR;
+}
+
+/*
+ * Route verso il solo host dst (/32) via gateway sul device.
+ */
+int ethRouteHostInit(t_route *r, const char *dst, const char *gateway,
+                     const char *device, int metric)
+{
+    int rval = ethRouteDefaultInit(r, gateway, device, metric);
+
+    if (rval != ETHNOERR)
+        return rval;
+    if (dst == NULL || inet_pton(AF_INET, dst, &r->dst) != 1)
+    {
+        DBG_E("Bad destination %s\n", dst != NULL ? dst : "--");
+        return ETHBADCONFERR;
+    }
+    r->prefixLen = 32;
+    return ETHNOERR;
+}
+
+/*
+ * Aggiunge un nexthop (gateway sul device, peso 1..256) alla route.
+ */
+int ethRouteAddNexthop(t_route *r, const char *gateway, const char *device,
+                       int weight)
+{
+    t_route_nexthop *nh;
+
+    if (r->nNexthops >= ETHROUTE_MAX_NEXTHOPS)
+        return ETHCONFIGBUSY;
+    nh = &r->nexthop[r->nNexthops];
+    memset(nh, 0, sizeof(t_route_nexthop));
+    nh->ifindex = if_nametoindex(device);
+    if (nh->ifindex == 0)
+    {
+        DBG_E("No device %s\n", device);
+        return ETHDEVICEERR;
+    }
+    if (gateway == NULL || inet_pton(AF_INET, gateway, &nh->gateway) != 1)
+    {
+        DBG_E("Bad gateway %s\n", gateway != NULL ? gateway : "--");
+        return ETHBADCONFERR;
+    }
+    nh->weight = weight < 1 ? 1 : (weight > 256 ? 256 : weight);
+    r->nNexthops++;
+    return ETHNOERR;
+}
+
+/* RTA_METRICS con le sole metriche impostate */
+static void ethRouteAddMetrics(struct nlmsghdr *n, const t_route_metrics *m)
+{
+    struct rtattr *mx;
+
+    if (ethRouteMetricsEmpty(m))
+        return;
+    mx = ethNlNestStart(n, RTA_METRICS);
+    if (m->mtu > 0)
+    {
+        /* Bloccata: il PMTU discovery del kernel non la modifica piu` */
+        ethNlAddAttr32(n, RTAX_LOCK, 1u << RTAX_MTU);
+        ethNlAddAttr32(n, RTAX_MTU, m->mtu);
+    }
+    if (m->initcwnd > 0)
+        ethNlAddAttr32(n, RTAX_INITCWND, m->initcwnd);
+    if (m->initrwnd > 0)
+        ethNlAddAttr32(n, RTAX_INITRWND, m->initrwnd);
+    if (m->quickack > 0)
+        ethNlAddAttr32(n, RTAX_QUICKACK, 1);
+    if (m->ccAlgo[0] != '\0')
+        ethNlAddAttrStr(n, RTAX_CC_ALGO, m->ccAlgo);
+    ethNlNestEnd(n, mx);
+}
+
+static void ethRouteFill(struct nlmsghdr *n, const t_route *r)
+{
+    if (r->prefixLen > 0)
+        ethNlAddAttr(n, RTA_DST, &r->dst, sizeof(r->dst));
+    if (r->metric > 0)
+        ethNlAddAttr32(n, RTA_PRIORITY, r->metric);
+    if (r->table > 255)
+        ethNlAddAttr32(n, RTA_TABLE, r->table);
+    ethRouteAddMetrics(n, &r->metrics);
+    if (r->nNexthops > 1)
+    {
+        /* ECMP: un solo RTA_MULTIPATH con un rtnexthop per gateway */
+        struct rtattr *mp = ethNlNestStart(n, RTA_MULTIPATH);
+        int i;
+        for (i = 0; i < r->nNexthops; i++)
+        {
+            struct rtnexthop *rtnh = ethNlReserve(n, sizeof(struct rtnexthop));
+            if (rtnh == NULL)
+                break;
+            rtnh->rtnh_hops = r->nexthop[i].weight > 0
+                              ? r->nexthop[i].weight - 1 : 0;
+            rtnh->rtnh_ifindex = r->nexthop[i].ifindex;
+            ethNlAddAttr(n, RTA_GATEWAY, &r->nexthop[i].gateway,
+                         sizeof(struct in_addr));
+            rtnh->rtnh_len = (char *)n + n->nlmsg_len - (char *)rtnh;
+        }
+        ethNlNestEnd(n, mp);
+    }
+    else if (r->nNexthops == 1)
+    {
+        if (r->nexthop[0].gateway.s_addr != INADDR_ANY)
+            ethNlAddAttr(n, RTA_GATEWAY, &r->nexthop[0].gateway,
+                         sizeof(struct in_addr));
+        if (r->nexthop[0].ifindex > 0)
+            ethNlAddAttr32(n, RTA_OIF, r->nexthop[0].ifindex);
+    }
+}
+
+static void ethRouteHeader(struct rtmsg *rtm, const t_route *r)
+{
+    memset(rtm, 0, sizeof(struct rtmsg));
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = r->prefixLen;
+    if (r->table == 0)
+        rtm->rtm_table = RT_TABLE_MAIN;
+    else if (r->table <= 255)
+        rtm->rtm_table = r->table;
+    else
+        rtm->rtm_table = RT_TABLE_UNSPEC; /* tabella in RTA_TABLE */
+    rtm->rtm_protocol = RTPROT_STATIC;
+    rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+    rtm->rtm_type = RTN_UNICAST;
+}
+
+/*
+ * Aggiunge la route; con replace != 0 sostituisce atomicamente quella
+ * con stessa destinazione, tabella e metrica (o la crea).
+ */
+int ethRouteAdd(const t_route *r, int replace)
+{
+    t_nl_msg m;
+    struct rtmsg rtm;
+    struct nlmsghdr *n;
+    int rval;
+
+    if (r == NULL || r->nNexthops < 1)
+        return ETHBADCONFERR;
+    ethRouteHeader(&rtm, r);
+    n = ethNlMsgInit(&m, RTM_NEWROUTE,
+                     NLM_F_CREATE | (replace ? NLM_F_REPLACE : NLM_F_EXCL),
+                     &rtm, sizeof(rtm));
+    ethRouteFill(n, r);
+    rval = ethNlRequest(n);
+    if (rval != ETHNOERR)
+    {
+        char gw[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &r->nexthop[0].gateway, gw, sizeof(gw));
+        DBG_E("Unable to %s route via %s metric %d: %s\n",
+              replace ? "replace" : "add", gw, r->metric, strerror(errno));
+    }
+    return rval;
+}
+
+int ethRouteDel(const t_route *r)
+{
+    t_nl_msg m;
+    struct rtmsg rtm;
+    struct nlmsghdr *n;
+
+    if (r == NULL)
+        return ETHBADCONFERR;
+    ethRouteHeader(&rtm, r);
+    rtm.rtm_scope = RT_SCOPE_NOWHERE;
+    n = ethNlMsgInit(&m, RTM_DELROUTE, 0, &rtm, sizeof(rtm));
+    ethRouteFill(n, r);
+    return ethNlRequest(n);
+}
+
+/*
+ * Chiavi ROUTE_* del file di configurazione, senza il prefisso:
+ * INITCWND, INITRWND, CC, QUICKACK (on/off), MTU (bloccata).
+ */
+int ethRouteMetricsSet(t_route_metrics *m, const char *key, const char *value)
+{
+    int v;
+
+    if (strcmp(key, "CC") == 0)
+    {
+        if (strlen(value) == 0 || strlen(value) >= ROUTE_CC_LEN)
+            return ETHBADCONFERR;
+        strcpy(m->ccAlgo, value);
+        return ETHNOERR;
+    }
+    if (strcmp(key, "QUICKACK") == 0)
+    {
+        if (strcmp(value, "on") != 0 && strcmp(value, "off") != 0)
+            return ETHBADCONFERR;
+        m->quickack = strcmp(value, "on") == 0;
+        return ETHNOERR;
+    }
+    v = atoi(value);
+    if (strcmp(key, "INITCWND") == 0 && v > 0 && v <= 1024)
+        m->initcwnd = v;
+    else if (strcmp(key, "INITRWND") == 0 && v > 0 && v <= 1024)
+        m->initrwnd = v;
+    else if (strcmp(key, "MTU") == 0 && v >= 576 && v <= 65535)
+        m->mtu = v;
+    else
+        return ETHBADCONFERR;
+    return ETHNOERR;
+}
+
+int ethRouteMetricsEmpty(const t_route_metrics *m)
+{
+    return m->mtu <= 0 && m->initcwnd <= 0 && m->initrwnd <= 0 &&
+           m->quickack <= 0 && m->ccAlgo[0] == '\0';
+}
+
+void ethRouteMetricsFormat(const t_route_metrics *m, char *str, int len)
+{
+    int n = 0;
+
+    str[0] = '\0';
+    if (m->initcwnd > 0 && n < len)
+        n += snprintf(str + n, len - n, " initcwnd %d", m->initcwnd);
+    if (m->initrwnd > 0 && n < len)
+        n += snprintf(str + n, len - n, " initrwnd %d", m->initrwnd);
+    if (m->ccAlgo[0] != '\0' && n < len)
+        n += snprintf(str + n, len - n, " congctl %s", m->ccAlgo);
+    if (m->quickack > 0 && n < len)
+        n += snprintf(str + n, len - n, " quickack 1");
+    if (m->mtu > 0 && n < len)
+        n += snprintf(str + n, len - n, " mtu lock %d", m->mtu);
+}
+
+#define ROUTE_TUNE_MAX  16
+
+typedef struct {
+    int ifindex;
+    int n;
+    t_nl_msg msg[ROUTE_TUNE_MAX];
+} t_route_tune;
+
+/* Default route e route di subnet del device, nella tabella main */
+static int ethRouteTuneCollect(struct nlmsghdr *h, void *data)
+{
+    t_route_tune *t = (t_route_tune *)data;
+    struct rtmsg *rtm = (struct rtmsg *)NLMSG_DATA(h);
+    struct rtattr *tb[RTA_MAX + 1];
+    int table;
+
+    if (h->nlmsg_type != RTM_NEWROUTE || rtm->rtm_family != AF_INET ||
+        rtm->rtm_type != RTN_UNICAST || t->n >= ROUTE_TUNE_MAX ||
+        h->nlmsg_len > sizeof(t_nl_msg))
+        return 0;
+    ethNlParseAttrs(tb, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(h));
+    table = tb[RTA_TABLE] != NULL ? *(int *)RTA_DATA(tb[RTA_TABLE])
+                                  : rtm->rtm_table;
+    if (table != RT_TABLE_MAIN || tb[RTA_OIF] == NULL ||
+        *(int *)RTA_DATA(tb[RTA_OIF]) != t->ifindex)
+        return 0;
+    if (rtm->rtm_dst_len != 0 && rtm->rtm_scope != RT_SCOPE_LINK)
+        return 0;
+    memcpy(&t->msg[t->n++], h, h->nlmsg_len);
+    return 0;
+}
+
+/*
+ * Riscrive (NLM_F_REPLACE) la default route e le route di subnet del
+ * device con le metriche date, lasciando invariato tutto il resto
+ * (gateway, sorgente, protocollo, scope). Le route ECMP, senza RTA_OIF,
+ * le gestisce ethecmp. Restituisce il numero di route modificate.
+ */
+int ethRouteTune(const char *device, const t_route_metrics *m)
+{
+    static t_route_tune t;
+    t_nl_msg req;
+    struct rtmsg rtm;
+    struct nlmsghdr *n;
+    int fd, i, rval, tuned = 0;
+
+    memset(&t, 0, sizeof(t));
+    t.ifindex = device != NULL ? if_nametoindex(device) : 0;
+    if (t.ifindex == 0)
+        return ETHDEVICEERR;
+    fd = ethNlOpen(NETLINK_ROUTE, 0);
+    if (fd < 0)
+        return fd;
+    memset(&rtm, 0, sizeof(rtm));
+    rtm.rtm_family = AF_INET;
+    n = ethNlMsgInit(&req, RTM_GETROUTE, 0, &rtm, sizeof(rtm));
+    rval = ethNlDump(fd, n, ethRouteTuneCollect, &t);
+
+    for (i = 0; i < t.n && rval == ETHNOERR; i++)
+    {
+        struct nlmsghdr *h = &t.msg[i].hdr;
+        struct rtmsg *old = (struct rtmsg *)NLMSG_DATA(h);
+        struct rtattr *rta = RTM_RTA(old);
+        int len = RTM_PAYLOAD(h);
+
+        n = ethNlMsgInit(&req, RTM_NEWROUTE, NLM_F_REPLACE, old, sizeof(*old));
+        for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+        {
+            if (rta->rta_type == RTA_METRICS || rta->rta_type == RTA_CACHEINFO)
+                continue;
+            ethNlAddAttr(n, rta->rta_type, RTA_DATA(rta), RTA_PAYLOAD(rta));
+        }
+        ethRouteAddMetrics(n, m);
+        if (ethNlTalk(fd, n) == ETHNOERR)
+            tuned++;
+        else
+            DBG_E("%s: cannot tune route /%d: %s\n", device, old->rtm_dst_len,
+                  strerror(errno));
+    }
+    ethNlClose(fd);
+    return rval != ETHNOERR ? rval : tuned;
+}
+
+/*
+ * Voce della tabella dei vicini per address con il MAC (Ethernet) gia`
+ * risolto: REACHABLE la lascia al ciclo normale del kernel, che la
+ * riverifica quando scade; PERMANENT la fissa (nessun ARP, nessuna
+ * scadenza) finche` non viene sostituita.
+ */
+int ethRouteNeighSet(const char *device, const char *address,
+                     const unsigned char *mac, int permanent)
+{
+    t_nl_msg m;
+    struct ndmsg ndm;
+    struct nlmsghdr *n;
+    struct in_addr dst;
+    int rval;
+
+    memset(&ndm, 0, sizeof(ndm));
+    ndm.ndm_family = AF_INET;
+    ndm.ndm_ifindex = device != NULL ? if_nametoindex(device) : 0;
+    ndm.ndm_state = permanent ? NUD_PERMANENT : NUD_REACHABLE;
+    if (ndm.ndm_ifindex == 0)
+    {
+        DBG_E("No device %s\n", device != NULL ? device : "--");
+        return ETHDEVICEERR;
+    }
+    if (address == NULL || inet_pton(AF_INET, address, &dst) != 1)
+        return ETHBADCONFERR;
+    n = ethNlMsgInit(&m, RTM_NEWNEIGH, NLM_F_CREATE | NLM_F_REPLACE,
+                     &ndm, sizeof(ndm));
+    ethNlAddAttr(n, NDA_DST, &dst, sizeof(dst));
+    ethNlAddAttr(n, NDA_LLADDR, mac, 6);
+    rval = ethNlRequest(n);
+    if (rval != ETHNOERR)
+        DBG_E("%s: cannot set neighbor %s: %s\n", device, address,
+              strerror(errno));
+    return rval;
+}
+
+typedef struct {
+    int ifindex;
+    struct in_addr dst;
+    int found;
+} t_neigh_pin;
+
+/* La voce PERMANENT per dst sul device, se c'e` */
+static int ethRouteNeighPinCollect(struct nlmsghdr *h, void *data)
+{
+    t_neigh_pin *p = (t_neigh_pin *)data;
+    struct ndmsg *ndm = (struct ndmsg *)NLMSG_DATA(h);
+    struct rtattr *tb[NDA_MAX + 1];
+
+    if (h->nlmsg_type != RTM_NEWNEIGH || ndm->ndm_family != AF_INET ||
+        ndm->ndm_ifindex != p->ifindex || !(ndm->ndm_state & NUD_PERMANENT))
+        return 0;
+    ethNlParseAttrs(tb, NDA_MAX, (struct rtattr *)((char *)ndm +
+                    NLMSG_ALIGN(sizeof(*ndm))),
+                    h->nlmsg_len - NLMSG_LENGTH(sizeof(*ndm)));
+    if (tb[NDA_DST] != NULL && RTA_PAYLOAD(tb[NDA_DST]) == sizeof(p->dst) &&
+        memcmp(RTA_DATA(tb[NDA_DST]), &p->dst, sizeof(p->dst)) == 0)
+        p->found = 1;
+    return 0;
+}
+
+/*
+ * Rimuove (RTM_DELNEIGH) la voce di address fissata da ethRouteNeighSet.
+ * Solo se e` PERMANENT: una voce dinamica la gestisce il kernel e non va
+ * toccata. Restituisce 1 se la voce e` stata rimossa, 0 se non c'era.
+ */
+int ethRouteNeighUnpin(const char *device, const char *address)
+{
+    t_nl_msg req;
+    t_neigh_pin p;
+    struct ndmsg ndm;
+    struct nlmsghdr *n;
+    int fd, rval;
+
+    memset(&p, 0, sizeof(p));
+    p.ifindex = device != NULL ? if_nametoindex(device) : 0;
+    if (p.ifindex == 0)
+        return ETHDEVICEERR;
+    if (address == NULL || inet_pton(AF_INET, address, &p.dst) != 1)
+        return ETHBADCONFERR;
+    fd = ethNlOpen(NETLINK_ROUTE, 0);
+    if (fd < 0)
+        return fd;
+
+    memset(&ndm, 0, sizeof(ndm));
+    ndm.ndm_family = AF_INET;
+    n = ethNlMsgInit(&req, RTM_GETNEIGH, 0, &ndm, sizeof(ndm));
+    rval = ethNlDump(fd, n, ethRouteNeighPinCollect, &p);
+    if (rval == ETHNOERR && p.found)
+    {
+        ndm.ndm_ifindex = p.ifindex;
+        n = ethNlMsgInit(&req, RTM_DELNEIGH, 0, &ndm, sizeof(ndm));
+        ethNlAddAttr(n, NDA_DST, &p.dst, sizeof(p.dst));
+        rval = ethNlTalk(fd, n);
+        if (rval != ETHNOERR)
+            DBG_E("%s: cannot remove neighbor %s: %s\n", device, address,
+                  strerror(errno));
+    }
+    ethNlClose(fd);
+    return rval != ETHNOERR ? rval : p.found;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,607 @@
+/*
+ * Simulatore del livello kernel/helper.
+ *
+ * Generalizza la vecchia simulazione di ethConnect (ETHAPI_DEBUG): stesso
+ * lease finto 171.64.88.N, ma dietro la tabella di operazioni di
+ * ethbackend, quindi valida per tutto il control plane. Le latenze
+ * spostano il clock virtuale dell'event loop se attivo, altrimenti sono
+ * attese reali; i guasti sono estratti da un xorshift con seme fisso, per
+ * cui due esecuzioni con gli stessi parametri sono identiche.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/if.h>
+#include <arpa/inet.h>
+#include "debug.h"
+#include "ethsim.h"
+#include "evloop.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Quanto non e` elencato (guasti, lease, statistiche) parte da zero */
+static t_sim ethSimState = {
+    /* parametri */
+    .rate = 10,
+    .cmdMs = 5,
+    .dhcpMs = 200,
+    .arpMs = 2,
+    .healthMs = 30,
+    .seed = 1,
+    .l2Mtu = 9000,
+    .pathMtu = 1500,
+    .linkSpeed = 1000,
+    /* stato */
+    .rng = 1,
+    .linkUp = 1,
+    .ifindex = 2,
+    .deviceName = "eth0",
+    .mtu = 1500,
+    .nextUs = -1,
+};
+
+t_sim *ethSim(void)
+{
+    return &ethSimState;
+}
+
+static unsigned int ethSimRand(t_sim *sim)
+{
+    unsigned int x = sim->rng;  /* xorshift32 */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->rng = x;
+    return x;
+}
+
+static int ethSimFail(t_sim *sim, int pct)
+{
+    if (pct <= 0 || (int)(ethSimRand(sim) % 100) >= pct)
+        return 0;
+    sim->failures++;
+    return 1;
+}
+
+static void ethSimDelay(int ms)
+{
+    if (ms <= 0)
+        return;
+    if (evLoopIsVirtual())
+        evLoopSetTime(evLoopNowMs() + ms);
+    else
+        usleep(ms * 1000L);
+}
+
+/*
+ * "events=5000,rate=2000,dhcp=300,gwfail=10": le chiavi non indicate
+ * mantengono il valore corrente.
+ */
+int ethSimParse(t_sim *sim, const char *spec)
+{
+    char buf[512];
+    char *tok, *save = NULL, *eq, *end;
+    long v;
+
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    for (tok = strtok_r(buf, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save))
+    {
+        eq = strchr(tok, '=');
+        if (eq == NULL)
+        {
+            DBG_E("Simulator: '%s' is not key=value\n", tok);
+            return ETHBADCONFERR;
+        }
+        *eq++ = '\0';
+        v = strtol(eq, &end, 10);
+        if (end == eq || *end != '\0')
+        {
+            DBG_E("Simulator: '%s' is not a number for '%s'\n", eq, tok);
+            return ETHBADCONFERR;
+        }
+        if (v < 0)
+        {
+            DBG_E("Simulator: negative value for '%s'\n", tok);
+            return ETHBADCONFERR;
+        }
+        if (strcmp(tok, "events") == 0)        sim->events = v;
+        else if (strcmp(tok, "rate") == 0)     sim->rate = v > 0 ? v : 1;
+        else if (strcmp(tok, "cmd") == 0)      sim->cmdMs = (int)v;
+        else if (strcmp(tok, "dhcp") == 0)     sim->dhcpMs = (int)v;
+        else if (strcmp(tok, "arp") == 0)      sim->arpMs = (int)v;
+        else if (strcmp(tok, "health") == 0)   sim->healthMs = (int)v;
+        else if (strcmp(tok, "cmdfail") == 0)  sim->cmdFailPct = (int)v;
+        else if (strcmp(tok, "dhcpfail") == 0) sim->dhcpFailPct = (int)v;
+        else if (strcmp(tok, "gwfail") == 0)   sim->gwFailPct = (int)v;
+        else if (strcmp(tok, "upfail") == 0)   sim->upFailPct = (int)v;
+        else if (strcmp(tok, "seed") == 0)     sim->seed = (unsigned int)v;
+        else if (strcmp(tok, "l2mtu") == 0)    sim->l2Mtu = (int)v;
+        else if (strcmp(tok, "pmtu") == 0)     sim->pathMtu = (int)v;
+        else if (strcmp(tok, "speed") == 0)    sim->linkSpeed = (int)v;
+        else
+        {
+            DBG_E("Simulator: unknown parameter '%s'\n", tok);
+            return ETHBADCONFERR;
+        }
+    }
+    return ETHNOERR;
+}
+
+/* Azzera lo stato e programma il primo evento a startUs */
+void ethSimStart(t_sim *sim, const char *device, int ifindex,
+                 long long startUs)
+{
+    strncpy(sim->deviceName, device, sizeof(sim->deviceName) - 1);
+    sim->deviceName[sizeof(sim->deviceName) - 1] = '\0';
+    sim->ifindex = ifindex;
+    sim->rng = sim->seed != 0 ? sim->seed : 1;
+    sim->linkUp = 1;
+    sim->lease = 0;
+    sim->mtu = 1500;
+    sim->gateway[0] = '\0';
+    sim->generated = 0;
+    sim->nextUs = sim->events > 0 ? startUs : -1;
+    sim->commands = sim->failures = sim->healthChecks = sim->connects = 0;
+}
+
+/* RTM_NEWLINK con lo stato attuale del device finto */
+struct nlmsghdr *ethSimLinkMsg(const t_sim *sim, t_nl_msg *m)
+{
+    struct ifinfomsg ifi;
+    struct nlmsghdr *n;
+
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index = sim->ifindex;
+    ifi.ifi_flags = IFF_UP | (sim->linkUp ? IFF_RUNNING | IFF_LOWER_UP : 0);
+    n = ethNlMsgInit(m, RTM_NEWLINK, 0, &ifi, sizeof(ifi));
+    ethNlAddAttrStr(n, IFLA_IFNAME, sim->deviceName);
+    return n;
+}
+
+/*
+ * Prossimo evento del generatore: inverte il link e programma il
+ * successivo a 1/rate secondi in media (fra 0.5 e 1.5 volte). NULL
+ * quando gli eventi richiesti sono finiti.
+ */
+struct nlmsghdr *ethSimNextEvent(t_sim *sim, t_nl_msg *m)
+{
+    long long mean;
+
+    if (sim->nextUs < 0)
+        return NULL;
+    sim->linkUp = !sim->linkUp;
+    if (!sim->linkUp)
+        sim->lease = 0;
+    mean = 1000000LL / sim->rate;
+    sim->nextUs += mean / 2 + (long long)(ethSimRand(sim) % (mean + 1));
+    if (++sim->generated >= sim->events)
+        sim->nextUs = -1;
+    return ethSimLinkMsg(sim, m);
+}
+
+static int ethSimCommand(const char *cmdline)
+{
+    t_sim *sim = &ethSimState;
+
+    sim->commands++;
+    DBG_V("Simulated command: %s\n", cmdline);
+    ethSimDelay(sim->cmdMs);
+    return ethSimFail(sim, sim->cmdFailPct);
+}
+
+/* Il lease arriva con il link su, dopo la latenza del DHCP */
+static int ethSimDhcpStart(const char *device)
+{
+    t_sim *sim = &ethSimState;
+
+    sim->commands++;
+    DBG_V("Simulated DHCP client on %s\n", device);
+    ethSimDelay(sim->dhcpMs);
+    if (ethSimFail(sim, sim->dhcpFailPct))
+        return 1;
+    if (sim->linkUp)
+        sim->lease = sim->lease % 254 + 1;
+    return 0;
+}
+
+static int ethSimDefaultRoute(const char *device, const char *gateway)
+{
+    t_sim *sim = &ethSimState;
+
+    if (ethSimCommand("ip route add default") != 0)
+        return 1;
+    strncpy(sim->gateway, gateway, sizeof(sim->gateway) - 1);
+    sim->gateway[sizeof(sim->gateway) - 1] = '\0';
+    return 0;
+}
+
+static int ethSimReadAttr(const char *device, t_eth_attr attr, char *out,
+                          int len)
+{
+    t_sim *sim = &ethSimState;
+
+    out[0] = '\0';
+    switch (attr)
+    {
+        case ETHATTR_MAC:
+            snprintf(out, len, "02:00:00:00:%02x:%02x",
+                     (sim->ifindex >> 8) & 0xff, sim->ifindex & 0xff);
+            break;
+        case ETHATTR_IPV4:
+            if (sim->lease > 0)
+                snprintf(out, len, "171.64.88.%d", sim->lease);
+            break;
+        case ETHATTR_IPV6:
+            snprintf(out, len, "fe80::a6ba:dbff:fe02:38e1");
+            break;
+        case ETHATTR_GATEWAY:
+            if (sim->lease > 0)
+                snprintf(out, len, ETHSIM_GATEWAY);
+            break;
+        case ETHATTR_NETMASK:
+            if (sim->lease > 0)
+                snprintf(out, len, "255.255.0.0");
+            break;
+        case ETHATTR_NTPSERVER:
+            if (sim->ntpServer[0] == '\0')
+                return ETHBADCONFERR;
+            snprintf(out, len, "%s", sim->ntpServer);
+            break;
+        case ETHATTR_SPEED:
+            snprintf(out, len, "%d", sim->linkUp ? sim->linkSpeed : -1);
+            break;
+        default:
+            return ETHBADCONFERR;
+    }
+    return ETHNOERR;
+}
+
+static int ethSimLinkStatus(const char *device)
+{
+    return ethSimState.linkUp ? ETHSTATEUP : ETHSTATEDOWN;
+}
+
+static int ethSimConnect(t_network_conf *conf, const char *confFile)
+{
+    t_sim *sim = &ethSimState;
+
+    sim->connects++;
+    ethSimDelay(sim->dhcpMs);
+    if (!sim->linkUp || ethSimFail(sim, sim->dhcpFailPct))
+        return ETHDEVICEERR;
+    if (conf->connection == IPDHCP)
+    {
+        sim->lease = sim->lease % 254 + 1;
+        sprintf(conf->addressIPv4, "171.64.88.%d", sim->lease);
+        sprintf(conf->dnsdomain, "eurek.it");
+        sprintf(conf->dnsserver, "1.2.3.4 253.1.2.3");
+        sprintf(conf->netmask, "255.255.0.0");
+        sprintf(conf->gateway, ETHSIM_GATEWAY);
+    }
+    sprintf(conf->addressIPv6, "fe80::a6ba:dbff:fe02:38e1");
+    return ETHNOERR;
+}
+
+static int ethSimNtpConfigure(t_network_conf *conf)
+{
+    t_sim *sim = &ethSimState;
+
+    ethSimDelay(sim->cmdMs);
+    if (ethSimFail(sim, sim->cmdFailPct))
+        return ETHNTPSERVERERR;
+    strncpy(sim->ntpServer, conf->ntpserverName, sizeof(sim->ntpServer) - 1);
+    return ETHNOERR;
+}
+
+static int ethSimArpProbe(const char *device, const char *target,
+                          const unsigned char *targetMac,
+                          unsigned char *replyMac, int timeoutMs)
+{
+    static const unsigned char gwMac[ETHARP_HWADDR_LEN] =
+        { 0x02, 0x00, 0x5e, 0x00, 0x00, 0x01 };
+    t_sim *sim = &ethSimState;
+
+    if (!sim->linkUp || ethSimFail(sim, sim->gwFailPct))
+    {
+        ethSimDelay(timeoutMs);
+        return ETHARPERR;
+    }
+    ethSimDelay(sim->arpMs);
+    memcpy(replyMac, targetMac != NULL ? targetMac : gwMac, ETHARP_HWADDR_LEN);
+    return ETHNOERR;
+}
+
+/* Stessi strati di ethCheckHealth, con esiti estratti dal simulatore */
+static int ethSimHealth(const char *device, const char * const *gateways,
+                        int nGateways, const t_probe *probes, int nProbes,
+                        t_health_report *report)
+{
+    t_sim *sim = &ethSimState;
+
+    memset(report, 0, sizeof(t_health_report));
+    sim->healthChecks++;
+    if (!sim->linkUp)
+    {
+        report->failed = HEALTH_LINK_FAIL;
+        return ETHNOERR;
+    }
+    strncpy(report->gateway, nGateways > 0 ? gateways[0] : ETHSIM_GATEWAY,
+            sizeof(report->gateway) - 1);
+    if (ethSimArpProbe(device, report->gateway, NULL, report->gatewayMac,
+                       ETHHEALTH_ARP_MSECS) != ETHNOERR)
+    {
+        report->failed = HEALTH_GATEWAY_FAIL;
+        return ETHNOERR;
+    }
+    report->gatewayMs = sim->arpMs;
+    ethSimDelay(sim->healthMs);
+    if (nProbes > 0)
+    {
+        if (ethSimFail(sim, sim->upFailPct))
+        {
+            report->failed = HEALTH_UPSTREAM_FAIL;
+            return ETHNOERR;
+        }
+        ethProbeName(&probes[0], report->upstream, sizeof(report->upstream));
+        report->upstreamMs = sim->healthMs;
+    }
+    report->failed = HEALTH_OK;
+    return ETHNOERR;
+}
+
+static int ethSimWriteResolver(const char *dns1, const char *dns2)
+{
+    return ethSimCommand("resolv.conf");
+}
+
+/* La scheda finta accetta qualunque profilo; default da NIC generica */
+static int ethSimNicApply(const char *device, const t_nic_profile *want,
+                          t_nic_profile *effective)
+{
+    static const t_nic_profile defaults = { 256, 256, 50, 50, 1, 1, 1, 1, 0 };
+    t_sim *sim = &ethSimState;
+
+    ethSimDelay(sim->cmdMs);
+    *effective = defaults;
+    if (want->rxRing != NIC_UNSET) effective->rxRing = want->rxRing;
+    if (want->txRing != NIC_UNSET) effective->txRing = want->txRing;
+    if (want->rxUsecs != NIC_UNSET) effective->rxUsecs = want->rxUsecs;
+    if (want->txUsecs != NIC_UNSET) effective->txUsecs = want->txUsecs;
+    if (want->channels != NIC_UNSET) effective->channels = want->channels;
+    if (want->tso != NIC_UNSET) effective->tso = want->tso;
+    if (want->gso != NIC_UNSET) effective->gso = want->gso;
+    if (want->gro != NIC_UNSET) effective->gro = want->gro;
+    if (want->lro != NIC_UNSET) effective->lro = want->lro;
+    return ETHNOERR;
+}
+
+/* Scheda finta a 4 code RX/TX con un IRQ per coda, senza NUMA */
+static int ethSimQueueApply(const char *device, const t_cpuset *cpus,
+                            t_queue_report *report)
+{
+    t_sim *sim = &ethSimState;
+
+    ethSimDelay(sim->cmdMs);
+    memset(report, 0, sizeof(t_queue_report));
+    report->nRx = 4;
+    report->nTx = 4;
+    report->nIrqs = 4;
+    if (cpus != NULL && ethQueueCpuCount(cpus) > 0)
+        report->cpus = *cpus;
+    else
+        ethQueueParseCpus("0-3", &report->cpus);
+    report->nCpus = ethQueueCpuCount(&report->cpus);
+    report->numaNode = -1;
+    report->rps = report->nRx < report->nCpus;
+    report->rssEntries = 128;
+    return ETHNOERR;
+}
+
+static int ethSimMtuSet(const char *device, int mtu)
+{
+    t_sim *sim = &ethSimState;
+    int rval = ethSimCommand("mtu");
+
+    if (rval == ETHNOERR)
+        sim->mtu = mtu;
+    return rval;
+}
+
+/*
+ * Lo switch scarta in silenzio i frame oltre l2mtu (black hole); oltre
+ * il gateway un router risponde frag-needed sopra pmtu.
+ */
+static int ethSimPmtuProbe(const char *device, const char *target, int maxMtu,
+                           int timeoutMs, t_pmtu_result *result)
+{
+    t_sim *sim = &ethSimState;
+    int mtu = maxMtu > 0 && maxMtu < sim->mtu ? maxMtu : sim->mtu;
+
+    memset(result, 0, sizeof(t_pmtu_result));
+    result->maxMtu = mtu;
+    result->probes = 2;
+    if (sim->l2Mtu > 0 && sim->l2Mtu < mtu)
+    {
+        result->blackhole = mtu;
+        mtu = sim->l2Mtu;
+        result->probes += 2 * PMTU_RETRIES;
+        ethSimDelay(PMTU_RETRIES * (timeoutMs > 0 ? timeoutMs : PMTU_TIMEOUT_MSECS));
+    }
+    if (strcmp(target, ETHSIM_GATEWAY) != 0 &&
+        strcmp(target, sim->gateway) != 0 && sim->pathMtu > 0 &&
+        sim->pathMtu < mtu)
+    {
+        result->icmpMtu = sim->pathMtu;
+        mtu = sim->pathMtu;
+        result->probes++;
+    }
+    ethSimDelay(result->probes * sim->arpMs);
+    result->mtu = mtu;
+    return ETHNOERR;
+}
+
+/* sysctl di una distribuzione tipica: tcp_rmem max 6 MB, tcp_wmem 4 MB */
+static int ethSimTcpBuffers(long bdp, t_tcp_buffers *result)
+{
+    memset(result, 0, sizeof(t_tcp_buffers));
+    if (bdp <= 0)
+        return ETHBADCONFERR;
+    ethSimCommand("sysctl");
+    result->bdp = bdp;
+    result->target = 2 * bdp < TCP_BUF_FLOOR ? TCP_BUF_FLOOR :
+                     (2 * bdp > TCP_BUF_CEIL ? TCP_BUF_CEIL : 2 * bdp);
+    result->rmemMax = 6291456;
+    result->wmemMax = 4194304;
+    if (result->rmemMax < result->target)
+    {
+        result->rmemMax = result->target;
+        result->changed++;
+    }
+    if (result->wmemMax < result->target)
+    {
+        result->wmemMax = result->target;
+        result->changed++;
+    }
+    return ETHNOERR;
+}
+
+static int ethSimQdiscApply(const char *device, const t_qdisc_conf *q,
+                            long rateKbit)
+{
+    t_sim *sim = &ethSimState;
+    int rval = ethSimCommand("tc qdisc replace");
+
+    if (rval == ETHNOERR)
+        sim->qdisc = q->kind;
+    return rval;
+}
+
+/* Uno scarto ogni evento di link generato: basta a vedere i contatori */
+static int ethSimQdiscStats(const char *device, t_qdisc_stats *stats)
+{
+    t_sim *sim = &ethSimState;
+
+    memset(stats, 0, sizeof(t_qdisc_stats));
+    strncpy(stats->kind, sim->qdisc != QDISC_NONE ?
+            ethQdiscKindName(sim->qdisc) : "mq", sizeof(stats->kind) - 1);
+    stats->packets = (unsigned long long)sim->commands * 10;
+    stats->bytes = stats->packets * 1500;
+    stats->drops = (unsigned int)sim->generated;
+    return ETHNOERR;
+}
+
+static int ethSimArpAnnounce(const char *device, const char *address)
+{
+    return ethSimCommand("arping -U");
+}
+
+/* Risponde il solo gateway (quello statico o del lease) */
+static int ethSimNeighResolve(const char *device, const char * const *targets,
+                              int nTargets,
+                              unsigned char (*macs)[ETHARP_HWADDR_LEN],
+                              int *resolved, int timeoutMs)
+{
+    t_sim *sim = &ethSimState;
+    char gateway[IPv4ADDR_LEN];
+    int i, count = 0;
+
+    if (sim->gateway[0] != '\0')
+        snprintf(gateway, sizeof(gateway), "%s", sim->gateway);
+    else
+        ethSimReadAttr(device, ETHATTR_GATEWAY, gateway, sizeof(gateway));
+    for (i = 0; i < nTargets; i++)
+    {
+        resolved[i] = 0;
+        if (strcmp(targets[i], gateway) == 0 &&
+            ethSimArpProbe(device, targets[i], NULL, macs[i],
+                           timeoutMs) == ETHNOERR)
+        {
+            resolved[i] = 1;
+            count++;
+        }
+    }
+    if (count < nTargets && sim->linkUp)
+        ethSimDelay(timeoutMs);
+    return count;
+}
+
+static int ethSimNeighSet(const char *device, const char *address,
+                          const unsigned char *mac, int permanent)
+{
+    if (ethSimCommand("ip neigh replace") != 0)
+        return 1;
+    ethSimState.neighPinned = permanent;
+    return 0;
+}
+
+/* Come ethRouteNeighUnpin: nessun comando se non c'e` niente da togliere */
+static int ethSimNeighUnpin(const char *device, const char *address)
+{
+    if (!ethSimState.neighPinned)
+        return 0;
+    if (ethSimCommand("ip neigh del") != 0)
+        return ETHNETLINKERR;
+    ethSimState.neighPinned = 0;
+    return 1;
+}
+
+/* Sotto i 1000 Mb/s il simulatore negozia half duplex, come un cavo guasto */
+static int ethSimLinkMode(const char *device, t_link_mode *mode)
+{
+    t_sim *sim = &ethSimState;
+
+    mode->speed = sim->linkUp ? sim->linkSpeed : NIC_UNSET;
+    mode->duplex = sim->linkUp ? sim->linkSpeed >= 1000 : NIC_UNSET;
+    mode->autoneg = 1;
+    mode->lanes = 1;
+    return ETHNOERR;
+}
+
+static int ethSimLinkRenegotiate(const char *device)
+{
+    return ethSimCommand("ethtool -r");
+}
+
+static const t_eth_backend ethSimOps = {
+    "sim",
+    0,
+    ethSimCommand,
+    ethSimDhcpStart,
+    ethSimDefaultRoute,
+    ethSimReadAttr,
+    ethSimLinkStatus,
+    ethSimConnect,
+    ethSimNtpConfigure,
+    ethSimHealth,
+    ethSimArpProbe,
+    ethSimWriteResolver,
+    ethSimNicApply,
+    ethSimQueueApply,
+    ethSimMtuSet,
+    ethSimPmtuProbe,
+    ethSimTcpBuffers,
+    ethSimQdiscApply,
+    ethSimQdiscStats,
+    ethSimArpAnnounce,
+    ethSimNeighResolve,
+    ethSimNeighSet,
+    ethSimNeighUnpin,
+    ethSimLinkMode,
+    ethSimLinkRenegotiate,
+};
+
+const t_eth_backend *ethSimBackend(void)
+{
+    return &ethSimOps;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,346 @@
+/*
+ * Stato persistente e stato del kernel.
+ *
+ * Dopo ogni configurazione verificata il demone salva in ETHSTATE_DIR
+ * (tmpfs: lo stato non deve sopravvivere a un reboot, come quello del
+ * kernel) cosa ha configurato. Al riavvio confronta il file con la
+ * configurazione desiderata e con indirizzi e default route letti via
+ * netlink: se coincidono il demone riprende il controllo del device
+ * senza toccarlo.
+ */
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/stat.h>
+#include "debug.h"
+#include "ethnl.h"
+#include "ethstate.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static void ethStatePath(const char *device, char *path, int len)
+{
+    snprintf(path, len, "%s/%s.state", ETHSTATE_DIR, device);
+}
+
+/*
+ * Scrittura atomica (file temporaneo + rename): un crash a meta`
+ * scrittura non lascia uno stato troncato.
+ */
+int ethStateSave(const t_persist_state *st)
+{
+    char path[256], tmp[272], mac[MACADDRESS_LEN];
+    FILE *fp;
+    int i;
+
+    if (mkdir(ETHSTATE_DIR, 0755) < 0 && errno != EEXIST)
+    {
+        DBG_E("Unable to create %s: %s\n", ETHSTATE_DIR, strerror(errno));
+        return ETHSTATEERR;
+    }
+    ethStatePath(st->deviceName, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL)
+    {
+        DBG_E("Unable to write %s: %s\n", tmp, strerror(errno));
+        return ETHSTATEERR;
+    }
+    fprintf(fp, "MODE=%s\n", st->dhcp ? "dhcp" : "static");
+    fprintf(fp, "IP_ADDR=%s\n", st->address);
+    fprintf(fp, "PREFIX=%d\n", st->prefixLen);
+    for (i = 0; i < st->nGateways; i++)
+        fprintf(fp, "GATEWAY=%s\n", st->gateway[i]);
+    if (st->macKnown)
+    {
+        ethArpMacToString(st->gatewayMac, mac);
+        fprintf(fp, "GATEWAY_MAC=%s\n", mac);
+    }
+    if (st->neighPinned)
+        fprintf(fp, "NEIGH_PIN=on\n");
+    if (strlen(st->dns1) > 0)
+        fprintf(fp, "DNS1=%s\n", st->dns1);
+    if (strlen(st->dns2) > 0)
+        fprintf(fp, "DNS2=%s\n", st->dns2);
+    if (fclose(fp) != 0 || rename(tmp, path) < 0)
+    {
+        DBG_E("Unable to save %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return ETHSTATEERR;
+    }
+    DBG_V("State saved to %s\n", path);
+    return ETHNOERR;
+}
+
+int ethStateLoad(const char *device, t_persist_state *st)
+{
+    char path[256], line[256];
+    FILE *fp;
+
+    memset(st, 0, sizeof(t_persist_state));
+    strncpy(st->deviceName, device, sizeof(st->deviceName) - 1);
+    ethStatePath(device, path, sizeof(path));
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        return ETHSTATEERR;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char *value = strchr(line, '=');
+        if (value == NULL)
+            continue;
+        *value++ = '\0';
+        value[strcspn(value, "\n")] = '\0';
+
+        if (strcmp(line, "MODE") == 0)
+            st->dhcp = strcmp(value, "dhcp") == 0;
+        else if (strcmp(line, "IP_ADDR") == 0)
+            strncpy(st->address, value, sizeof(st->address) - 1);
+        else if (strcmp(line, "PREFIX") == 0)
+            st->prefixLen = atoi(value);
+        else if (strcmp(line, "GATEWAY") == 0 &&
+                 st->nGateways < ETHROUTE_MAX_NEXTHOPS)
+            strncpy(st->gateway[st->nGateways++], value, GATEWAY_LEN - 1);
+        else if (strcmp(line, "GATEWAY_MAC") == 0)
+        {
+            unsigned int m[ETHARP_HWADDR_LEN];
+            int i;
+            if (sscanf(value, "%x:%x:%x:%x:%x:%x",
+                       &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) == 6)
+            {
+                for (i = 0; i < ETHARP_HWADDR_LEN; i++)
+                    st->gatewayMac[i] = (unsigned char)m[i];
+                st->macKnown = 1;
+            }
+        }
+        else if (strcmp(line, "NEIGH_PIN") == 0)
+            st->neighPinned = strcmp(value, "on") == 0;
+        else if (strcmp(line, "DNS1") == 0)
+            strncpy(st->dns1, value, sizeof(st->dns1) - 1);
+        else if (strcmp(line, "DNS2") == 0)
+            strncpy(st->dns2, value, sizeof(st->dns2) - 1);
+    }
+    fclose(fp);
+    return strlen(st->address) > 0 ? ETHNOERR : ETHBADCONFERR;
+}
+
+void ethStateRemove(const char *device)
+{
+    char path[256];
+    ethStatePath(device, path, sizeof(path));
+    unlink(path);
+}
+
+/* --- Lettura dello stato del kernel --- */
+
+static int ethStateAddrCb(struct nlmsghdr *n, void *data)
+{
+    t_kernel_state *ks = (t_kernel_state *)data;
+    struct ifaddrmsg *ifa = (struct ifaddrmsg *)NLMSG_DATA(n);
+    struct rtattr *tb[IFA_MAX + 1];
+
+    if (n->nlmsg_type != RTM_NEWADDR || ifa->ifa_family != AF_INET ||
+        (int)ifa->ifa_index != ks->ifindex || ks->nAddrs >= ETHSTATE_MAX_ADDRS)
+        return 0;
+    ethNlParseAttrs(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(n));
+    if (tb[IFA_LOCAL] == NULL)
+        tb[IFA_LOCAL] = tb[IFA_ADDRESS];
+    if (tb[IFA_LOCAL] == NULL)
+        return 0;
+    memcpy(&ks->addr[ks->nAddrs], RTA_DATA(tb[IFA_LOCAL]),
+           sizeof(struct in_addr));
+    ks->prefixLen[ks->nAddrs] = ifa->ifa_prefixlen;
+    ks->nAddrs++;
+    return 0;
+}
+
+static void ethStateAddGateway(t_kernel_state *ks, struct rtattr *gw)
+{
+    if (gw != NULL && ks->nGateways < ETHROUTE_MAX_NEXTHOPS)
+        memcpy(&ks->gateway[ks->nGateways++], RTA_DATA(gw),
+               sizeof(struct in_addr));
+}
+
+static int ethStateRouteCb(struct nlmsghdr *n, void *data)
+{
+    t_kernel_state *ks = (t_kernel_state *)data;
+    struct rtmsg *rtm = (struct rtmsg *)NLMSG_DATA(n);
+    struct rtattr *tb[RTA_MAX + 1];
+
+    if (n->nlmsg_type != RTM_NEWROUTE || rtm->rtm_family != AF_INET ||
+        rtm->rtm_dst_len != 0 || rtm->rtm_table != RT_TABLE_MAIN)
+        return 0;
+    ethNlParseAttrs(tb, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(n));
+    if (tb[RTA_MULTIPATH] != NULL)
+    {
+        struct rtnexthop *nh = (struct rtnexthop *)RTA_DATA(tb[RTA_MULTIPATH]);
+        int len = RTA_PAYLOAD(tb[RTA_MULTIPATH]);
+
+        for (; RTNH_OK(nh, len); len -= NLMSG_ALIGN(nh->rtnh_len),
+             nh = RTNH_NEXT(nh))
+        {
+            struct rtattr *ntb[RTA_MAX + 1];
+            if (nh->rtnh_ifindex != ks->ifindex)
+                continue;
+            ethNlParseAttrs(ntb, RTA_MAX, RTNH_DATA(nh),
+                            nh->rtnh_len - sizeof(struct rtnexthop));
+            ethStateAddGateway(ks, ntb[RTA_GATEWAY]);
+        }
+    }
+    else if (tb[RTA_OIF] != NULL &&
+             *(int *)RTA_DATA(tb[RTA_OIF]) == ks->ifindex)
+    {
+        ethStateAddGateway(ks, tb[RTA_GATEWAY]);
+    }
+    return 0;
+}
+
+/*
+ * Fotografa indirizzi IPv4 e default route del device con due dump
+ * netlink, senza lanciare processi esterni.
+ */
+int ethStateReadKernel(const char *device, t_kernel_state *ks)
+{
+    t_nl_msg m;
+    struct ifaddrmsg ifa;
+    struct rtmsg rtm;
+    int fd, rval;
+
+    memset(ks, 0, sizeof(t_kernel_state));
+    ks->ifindex = (int)if_nametoindex(device);
+    if (ks->ifindex == 0)
+        return ETHDEVICEERR;
+    fd = ethNlOpen(NETLINK_ROUTE, 0);
+    if (fd < 0)
+        return fd;
+
+    memset(&ifa, 0, sizeof(ifa));
+    ifa.ifa_family = AF_INET;
+    rval = ethNlDump(fd, ethNlMsgInit(&m, RTM_GETADDR, 0, &ifa, sizeof(ifa)),
+                     ethStateAddrCb, ks);
+    if (rval == ETHNOERR)
+    {
+        memset(&rtm, 0, sizeof(rtm));
+        rtm.rtm_family = AF_INET;
+        rval = ethNlDump(fd, ethNlMsgInit(&m, RTM_GETROUTE, 0, &rtm,
+                                          sizeof(rtm)),
+                         ethStateRouteCb, ks);
+    }
+    ethNlClose(fd);
+    return rval;
+}
+
+int ethStateHasAddress(const t_kernel_state *ks, const char *address,
+                       int prefixLen)
+{
+    struct in_addr a;
+    int i;
+
+    if (inet_pton(AF_INET, address, &a) != 1)
+        return 0;
+    for (i = 0; i < ks->nAddrs; i++)
+    {
+        if (ks->addr[i].s_addr == a.s_addr &&
+            (prefixLen < 0 || ks->prefixLen[i] == prefixLen))
+            return 1;
+    }
+    return 0;
+}
+
+int ethStateHasGateway(const t_kernel_state *ks, const char *gateway)
+{
+    struct in_addr a;
+    int i;
+
+    if (inet_pton(AF_INET, gateway, &a) != 1)
+        return 0;
+    for (i = 0; i < ks->nGateways; i++)
+    {
+        if (ks->gateway[i].s_addr == a.s_addr)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Cerca in /proc un dhclient lanciato per il device: e` lui a rinnovare
+ * il lease, se c'e` ancora la configurazione DHCP si puo` riprendere.
+ */
+int ethStateDhcpClientRunning(const char *device)
+{
+    DIR *proc = opendir("/proc");
+    struct dirent *de;
+    int found = 0;
+
+    if (proc == NULL)
+        return 0;
+    while (!found && (de = readdir(proc)) != NULL)
+    {
+        char path[300], cmdline[1024];
+        const char *arg, *base;
+        ssize_t len;
+        int fd;
+
+        if (!isdigit((unsigned char)de->d_name[0]))
+            continue;
+        snprintf(path, sizeof(path), "/proc/%s/cmdline", de->d_name);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        len = read(fd, cmdline, sizeof(cmdline) - 1);
+        close(fd);
+        if (len <= 0)
+            continue;
+        cmdline[len] = '\0';
+        base = strrchr(cmdline, '/');
+        base = base != NULL ? base + 1 : cmdline;
+        if (strcmp(base, "dhclient") != 0)
+            continue;
+        /* Argomenti separati da '\0' */
+        for (arg = cmdline + strlen(cmdline) + 1; arg < cmdline + len;
+             arg += strlen(arg) + 1)
+        {
+            if (strcmp(arg, device) == 0)
+            {
+                found = 1;
+                break;
+            }
+        }
+    }
+    closedir(proc);
+    return found;
+}
+
+/*
+ * "255.255.255.0" oppure "24" -> 24; -1 se non valida.
+ */
+int ethStateNetmaskToPrefix(const char *netmask)
+{
+    struct in_addr m;
+    unsigned int bits;
+    int prefix = 0;
+
+    if (strchr(netmask, '.') == NULL)
+    {
+        prefix = atoi(netmask);
+        return prefix >= 0 && prefix <= 32 ? prefix : -1;
+    }
+    if (inet_pton(AF_INET, netmask, &m) != 1)
+        return -1;
+    for (bits = ntohl(m.s_addr); bits & 0x80000000u; bits <<= 1)
+        prefix++;
+    return bits == 0 ? prefix : -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Buffer TCP sul BDP.
+ *
+ * Con l'autotuning la finestra cresce fino al massimo di tcp_rmem /
+ * tcp_wmem: se il massimo e` sotto il BDP un solo flusso non riempie il
+ * collegamento. Il massimo si porta a 2 x BDP (meta` del buffer va in
+ * overhead con tcp_adv_win_scale=1), insieme a rmem_max / wmem_max per
+ * chi usa SO_RCVBUF. I valori si alzano soltanto: un'altra interfaccia
+ * potrebbe averne bisogno di piu` grandi.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "debug.h"
+#include "ethtcp.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+long ethTcpBdp(int speedMbps, long rttMs)
+{
+    if (speedMbps <= 0 || rttMs <= 0)
+        return 0;
+    /* Mb/s x ms = kbit: / 8 per i byte */
+    return (long)speedMbps * rttMs * 1000L / 8;
+}
+
+static int ethTcpRead(const char *path, long v[3], int n)
+{
+    FILE *f = fopen(path, "r");
+    int got;
+
+    if (f == NULL)
+        return ETHFREADERR;
+    got = n == 3 ? fscanf(f, "%ld %ld %ld", &v[0], &v[1], &v[2])
+                 : fscanf(f, "%ld", &v[0]);
+    fclose(f);
+    return got == n ? ETHNOERR : ETHFREADERR;
+}
+
+static int ethTcpWrite(const char *path, const long v[3], int n)
+{
+    FILE *f = fopen(path, "w");
+    int rval = ETHNOERR;
+
+    if (f == NULL)
+    {
+        DBG_E("%s: %s\n", path, strerror(errno));
+        return ETHFREADERR;
+    }
+    if (n == 3)
+        fprintf(f, "%ld %ld %ld\n", v[0], v[1], v[2]);
+    else
+        fprintf(f, "%ld\n", v[0]);
+    if (fclose(f) != 0)
+    {
+        DBG_E("%s: %s\n", path, strerror(errno));
+        rval = ETHFREADERR;
+    }
+    return rval;
+}
+
+/* Porta a target l'ultimo dei n valori del sysctl, se e` minore */
+static int ethTcpRaise(const char *path, int n, long target, long *effective,
+                       int *changed)
+{
+    long v[3] = { 0, 0, 0 };
+    int rval = ethTcpRead(path, v, n);
+
+    if (rval != ETHNOERR)
+        return rval;
+    *effective = v[n - 1];
+    if (v[n - 1] >= target)
+        return ETHNOERR;
+    v[n - 1] = target;
+    rval = ethTcpWrite(path, v, n);
+    if (rval == ETHNOERR)
+    {
+        *effective = target;
+        (*changed)++;
+    }
+    return rval;
+}
+
+int ethTcpBuffers(long bdp, t_tcp_buffers *result)
+{
+    long unused;
+    int rval = ETHNOERR;
+
+    memset(result, 0, sizeof(t_tcp_buffers));
+    if (bdp <= 0)
+        return ETHBADCONFERR;
+    result->bdp = bdp;
+    result->target = 2 * bdp;
+    if (result->target < TCP_BUF_FLOOR)
+        result->target = TCP_BUF_FLOOR;
+    if (result->target > TCP_BUF_CEIL)
+        result->target = TCP_BUF_CEIL;
+
+    if (ethTcpRaise("/proc/sys/net/core/rmem_max", 1, result->target,
+                    &unused, &result->changed) != ETHNOERR)
+        rval = ETHFREADERR;
+    if (ethTcpRaise("/proc/sys/net/core/wmem_max", 1, result->target,
+                    &unused, &result->changed) != ETHNOERR)
+        rval = ETHFREADERR;
+    if (ethTcpRaise("/proc/sys/net/ipv4/tcp_rmem", 3, result->target,
+                    &result->rmemMax, &result->changed) != ETHNOERR)
+        rval = ETHFREADERR;
+    if (ethTcpRaise("/proc/sys/net/ipv4/tcp_wmem", 3, result->target,
+                    &result->wmemMax, &result->changed) != ETHNOERR)
+        rval = ETHFREADERR;
+    DBG_N("BDP %ld: target %ld, rmem %ld, wmem %ld, %d changed\n", bdp,
+          result->target, result->rmemMax, result->wmemMax, result->changed);
+    return rval;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,345 @@
+/*
+ * Monitor passivo della qualita` TCP.
+ *
+ * A ogni intervallo un solo dump SOCK_DIAG_BY_FAMILY (TCP, IPv4,
+ * ESTABLISHED, estensione INET_DIAG_INFO) restituisce il tcp_info di
+ * tutti i socket: si tengono quelli con l'indirizzo locale del device.
+ * Ritrasmissioni e segmenti inviati sono cumulativi per socket, quindi
+ * il tasso si calcola sulla differenza con il campione precedente
+ * (socket riconosciuti dal cookie del kernel): un socket che non c'era,
+ * come tutti al primo campione, conta solo per l'RTT e il numero di
+ * socket, altrimenti la sua storia finirebbe nel periodo. L'RTT e` lo srtt del
+ * kernel, mediato pesando i socket con i segmenti inviati nel periodo
+ * (le connessioni ferme non contano) e poi smussato fra i campioni.
+ * Il giudizio richiede abbastanza traffico e ha isteresi: senza
+ * traffico lo stato non cambia.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/inet_diag.h>
+#include <linux/sock_diag.h>
+#include <linux/tcp.h>
+#include "debug.h"
+#include "ethnl.h"
+#include "ethtcpmon.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TCPMON_ESTABLISHED  1   /* TCP_ESTABLISHED in include/net/tcp_states.h */
+
+typedef struct {
+    int n;
+    double sumRtt;
+    double sumRttW;
+    double sumW;
+    unsigned long long retrans;
+    unsigned long long segsOut;
+    unsigned long long deliveryRate;
+} t_tcpmon_acc;
+
+typedef struct {
+    t_tcpmon *mon;
+    struct in_addr addr;
+    struct in_addr mask;
+    t_tcpmon_acc device;
+    t_tcpmon_acc viaGateway;
+} t_tcpmon_dump;
+
+void ethTcpMonInit(t_tcpmon *mon, const char *device)
+{
+    memset(mon, 0, sizeof(t_tcpmon));
+    if (device != NULL)
+        strncpy(mon->deviceName, device, sizeof(mon->deviceName) - 1);
+    mon->intervalMs = TCPMON_INTERVAL_MSECS;
+}
+
+/* Indirizzo e netmask correnti: cambiano con il lease */
+static int ethTcpMonAddress(const char *device, struct in_addr *addr,
+                            struct in_addr *mask)
+{
+    struct ifreq ifr;
+    int fd, rval = ETHDEVICEERR;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return ETHSOCKETERR;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFADDR, &ifr) == 0)
+    {
+        *addr = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr;
+        if (ioctl(fd, SIOCGIFNETMASK, &ifr) == 0)
+        {
+            *mask = ((struct sockaddr_in *)&ifr.ifr_netmask)->sin_addr;
+            rval = ETHNOERR;
+        }
+    }
+    close(fd);
+    return rval;
+}
+
+static unsigned int ethTcpMonHash(unsigned long long cookie, int nSlots)
+{
+    return (unsigned int)((cookie * 0x9e3779b97f4a7c15ull) >> 32) &
+           (nSlots - 1);
+}
+
+static t_tcpmon_sock *ethTcpMonFind(const t_tcpmon_socks *t,
+                                    unsigned long long cookie)
+{
+    unsigned int i;
+
+    if (t->n == 0)
+        return NULL;
+    for (i = ethTcpMonHash(cookie, t->nSlots); t->slot[i].cookie != 0;
+         i = (i + 1) & (t->nSlots - 1))
+    {
+        if (t->slot[i].cookie == cookie)
+            return &t->slot[i];
+    }
+    return NULL;
+}
+
+/* Raddoppia la tabella (o la crea) e vi ridistribuisce i socket */
+static int ethTcpMonGrow(t_tcpmon_socks *t)
+{
+    int nSlots = t->nSlots > 0 ? t->nSlots * 2 : TCPMON_MIN_SLOTS;
+    t_tcpmon_sock *slot;
+    unsigned int j;
+    int i;
+
+    slot = (t_tcpmon_sock *)calloc(nSlots, sizeof(t_tcpmon_sock));
+    if (slot == NULL)
+        return ETHNOMEMERR;
+    for (i = 0; i < t->nSlots; i++)
+    {
+        if (t->slot[i].cookie == 0)
+            continue;
+        for (j = ethTcpMonHash(t->slot[i].cookie, nSlots); slot[j].cookie != 0;
+             j = (j + 1) & (nSlots - 1))
+            ;
+        slot[j] = t->slot[i];
+    }
+    free(t->slot);
+    t->slot = slot;
+    t->nSlots = nSlots;
+    return ETHNOERR;
+}
+
+/* Slot per il cookie, al massimo mezza piena; NULL senza memoria */
+static t_tcpmon_sock *ethTcpMonInsert(t_tcpmon_socks *t,
+                                      unsigned long long cookie)
+{
+    unsigned int i;
+
+    if ((t->n + 1) * 2 > t->nSlots && ethTcpMonGrow(t) != ETHNOERR)
+        return NULL;
+    for (i = ethTcpMonHash(cookie, t->nSlots); t->slot[i].cookie != 0;
+         i = (i + 1) & (t->nSlots - 1))
+    {
+        if (t->slot[i].cookie == cookie)
+            return &t->slot[i];
+    }
+    t->n++;
+    t->slot[i].cookie = cookie;
+    return &t->slot[i];
+}
+
+static void ethTcpMonClear(t_tcpmon_socks *t)
+{
+    if (t->slot != NULL)
+        memset(t->slot, 0, t->nSlots * sizeof(t_tcpmon_sock));
+    t->n = 0;
+}
+
+static void ethTcpMonAdd(t_tcpmon_acc *acc, const struct tcp_info *ti,
+                         unsigned int dRetrans, unsigned int dSegs)
+{
+    acc->n++;
+    acc->sumRtt += ti->tcpi_rtt;
+    acc->sumRttW += (double)ti->tcpi_rtt * dSegs;
+    acc->sumW += dSegs;
+    acc->retrans += dRetrans;
+    acc->segsOut += dSegs;
+    acc->deliveryRate += ti->tcpi_delivery_rate;
+}
+
+static int ethTcpMonCollect(struct nlmsghdr *h, void *data)
+{
+    t_tcpmon_dump *d = (t_tcpmon_dump *)data;
+    t_tcpmon *mon = d->mon;
+    struct inet_diag_msg *msg = (struct inet_diag_msg *)NLMSG_DATA(h);
+    struct rtattr *tb[INET_DIAG_MAX + 1];
+    struct tcp_info ti;
+    t_tcpmon_sock *s;
+    unsigned long long cookie;
+    unsigned int dRetrans = 0, dSegs = 0;
+    int len;
+
+    if (h->nlmsg_type != SOCK_DIAG_BY_FAMILY ||
+        msg->id.idiag_src[0] != d->addr.s_addr)
+        return 0;
+    ethNlParseAttrs(tb, INET_DIAG_MAX, (struct rtattr *)(msg + 1),
+                    h->nlmsg_len - NLMSG_LENGTH(sizeof(*msg)));
+    if (tb[INET_DIAG_INFO] == NULL)
+        return 0;
+    /* I kernel vecchi hanno un tcp_info piu` corto: il resto vale 0 */
+    memset(&ti, 0, sizeof(ti));
+    len = RTA_PAYLOAD(tb[INET_DIAG_INFO]);
+    memcpy(&ti, RTA_DATA(tb[INET_DIAG_INFO]),
+           len < (int)sizeof(ti) ? len : (int)sizeof(ti));
+
+    cookie = (unsigned long long)msg->id.idiag_cookie[1] << 32 |
+             msg->id.idiag_cookie[0];
+    s = ethTcpMonFind(&mon->prev, cookie);
+    if (s != NULL)
+    {
+        dRetrans = ti.tcpi_total_retrans - s->retrans;
+        dSegs = ti.tcpi_segs_out - s->segsOut;
+    }
+    /* Senza memoria il socket resta nuovo anche al prossimo campione */
+    s = cookie != 0 ? ethTcpMonInsert(&mon->cur, cookie) : NULL;
+    if (s != NULL)
+    {
+        s->retrans = ti.tcpi_total_retrans;
+        s->segsOut = ti.tcpi_segs_out;
+    }
+    ethTcpMonAdd(&d->device, &ti, dRetrans, dSegs);
+    if ((msg->id.idiag_dst[0] & d->mask.s_addr) !=
+        (d->addr.s_addr & d->mask.s_addr))
+        ethTcpMonAdd(&d->viaGateway, &ti, dRetrans, dSegs);
+    return 0;
+}
+
+static void ethTcpMonUpdate(t_tcp_quality *q, const t_tcpmon_acc *acc)
+{
+    double srtt;
+
+    q->sockets = acc->n;
+    q->segsOut = acc->segsOut;
+    q->deliveryRate = acc->deliveryRate;
+    q->retransPct = acc->segsOut > 0 ? 100.0 * acc->retrans / acc->segsOut : 0;
+    if (acc->n == 0)
+    {
+        q->srttMs = 0;
+        return;
+    }
+    /* us -> ms; senza traffico nel periodo media semplice */
+    srtt = (acc->sumW > 0 ? acc->sumRttW / acc->sumW : acc->sumRtt / acc->n) / 1000.0;
+    q->srttMs = q->srttMs > 0 ? 0.75 * q->srttMs + 0.25 * srtt : srtt;
+}
+
+static void ethTcpMonJudge(t_tcpmon *mon)
+{
+    const t_tcp_quality *q = &mon->device;
+    int bad;
+
+    if (q->segsOut < TCPMON_MIN_SEGS)
+        return;
+    bad = (mon->maxRttMs > 0 && q->srttMs > mon->maxRttMs) ||
+          (mon->maxRetransPct > 0 && q->retransPct > mon->maxRetransPct);
+    mon->badCount = bad ? mon->badCount + 1 : 0;
+    mon->goodCount = bad ? 0 : mon->goodCount + 1;
+    if ((!mon->degraded && mon->badCount >= TCPMON_BAD_COUNT) ||
+        (mon->degraded && mon->goodCount >= TCPMON_GOOD_COUNT))
+    {
+        mon->degraded = !mon->degraded;
+        DBG_V("TCP quality on %s %s: srtt %.1f ms, retrans %.2f%%\n",
+              mon->deviceName, mon->degraded ? "degraded" : "restored",
+              q->srttMs, q->retransPct);
+        if (mon->onChange != NULL)
+            mon->onChange(mon, mon->cbData);
+    }
+}
+
+/*
+ * Un campione: dump dei socket, aggregati di device e gateway,
+ * giudizio. Senza indirizzo sul device gli aggregati vanno a zero.
+ */
+int ethTcpMonSample(t_tcpmon *mon)
+{
+    struct inet_diag_req_v2 req;
+    t_nl_msg m;
+    struct nlmsghdr *n;
+    t_tcpmon_dump d;
+    t_tcpmon_socks swap;
+    int fd, rval;
+
+    memset(&d, 0, sizeof(d));
+    d.mon = mon;
+    ethTcpMonClear(&mon->cur);
+    rval = ethTcpMonAddress(mon->deviceName, &d.addr, &d.mask);
+    if (rval == ETHNOERR)
+    {
+        fd = ethNlOpen(NETLINK_SOCK_DIAG, 0);
+        if (fd < 0)
+            return fd;
+        memset(&req, 0, sizeof(req));
+        req.sdiag_family = AF_INET;
+        req.sdiag_protocol = IPPROTO_TCP;
+        req.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+        req.idiag_states = 1 << TCPMON_ESTABLISHED;
+        n = ethNlMsgInit(&m, SOCK_DIAG_BY_FAMILY, 0, &req, sizeof(req));
+        rval = ethNlDump(fd, n, ethTcpMonCollect, &d);
+        ethNlClose(fd);
+    }
+    /* Il campione diventa il precedente; la vecchia tabella si riusa */
+    swap = mon->prev;
+    mon->prev = mon->cur;
+    mon->cur = swap;
+    ethTcpMonUpdate(&mon->device, &d.device);
+    ethTcpMonUpdate(&mon->viaGateway, &d.viaGateway);
+    DBG_N("%s: %d TCP sockets, srtt %.1f ms, retrans %.2f%%, %llu B/s\n",
+          mon->deviceName, mon->device.sockets, mon->device.srttMs,
+          mon->device.retransPct, mon->device.deliveryRate);
+    ethTcpMonJudge(mon);
+    return rval;
+}
+
+static void ethTcpMonTick(void *data)
+{
+    t_tcpmon *mon = (t_tcpmon *)data;
+
+    ethTcpMonSample(mon);
+    if (mon->onSample != NULL)
+        mon->onSample(mon, mon->cbData);
+    mon->timerId = evLoopAddTimer(mon->loop, mon->intervalMs, ethTcpMonTick,
+                                  mon);
+}
+
+int ethTcpMonStart(t_tcpmon *mon, t_evloop *loop)
+{
+    if (mon->intervalMs <= 0)
+        return ETHBADCONFERR;
+    mon->loop = loop;
+    mon->timerId = evLoopAddTimer(loop, mon->intervalMs, ethTcpMonTick, mon);
+    return mon->timerId > 0 ? ETHNOERR : ETHCONFIGBUSY;
+}
+
+void ethTcpMonStop(t_tcpmon *mon)
+{
+    free(mon->prev.slot);
+    free(mon->cur.slot);
+    memset(&mon->prev, 0, sizeof(mon->prev));
+    memset(&mon->cur, 0, sizeof(mon->cur));
+    if (mon->loop == NULL)
+        return;
+    evLoopDelTimer(mon->loop, mon->timerId);
+    mon->timerId = 0;
+    mon->degraded = 0;
+    mon->badCount = mon->goodCount = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Registrazione e lettura delle tracce di eventi.
+ *
+ * La registrazione e` globale (una sola traccia per processo) cosi` i
+ * moduli che ricevono input dal kernel chiamano ethTraceRecord senza
+ * doversi passare un contesto; senza traccia aperta la chiamata costa un
+ * confronto. Ogni record viene scritto subito: il demone non ha una
+ * chiusura ordinata e la traccia serve proprio quando qualcosa va male.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "debug.h"
+#include "ethtrace.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static FILE *ethTraceFile = NULL;
+static long long ethTraceStartUs;
+
+static long long ethTraceNowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000LL;
+}
+
+int ethTraceOpen(const char *path)
+{
+    t_trace_file_hdr hdr;
+
+    ethTraceClose();
+    ethTraceFile = fopen(path, "wb");
+    if (ethTraceFile == NULL)
+    {
+        DBG_E("Unable to create trace '%s': %s\n", path, strerror(errno));
+        return ETHFREADERR;
+    }
+    memcpy(hdr.magic, ETHTRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = ETHTRACE_VERSION;
+    fwrite(&hdr, sizeof(hdr), 1, ethTraceFile);
+    fflush(ethTraceFile);
+    ethTraceStartUs = ethTraceNowUs();
+    return ETHNOERR;
+}
+
+void ethTraceClose(void)
+{
+    if (ethTraceFile != NULL)
+        fclose(ethTraceFile);
+    ethTraceFile = NULL;
+}
+
+int ethTraceActive(void)
+{
+    return ethTraceFile != NULL;
+}
+
+void ethTraceRecord(t_trace_type type, const void *data, int len)
+{
+    static const char pad[8] = { 0 };
+    t_trace_rec rec;
+
+    if (ethTraceFile == NULL || len < 0 || len > ETHTRACE_MAX_LEN)
+        return;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = (uint16_t)type;
+    rec.len = (uint32_t)len;
+    rec.usec = ethTraceNowUs() - ethTraceStartUs;
+    if (fwrite(&rec, sizeof(rec), 1, ethTraceFile) != 1 ||
+        (len > 0 && fwrite(data, len, 1, ethTraceFile) != 1) ||
+        (ETHTRACE_ALIGN(len) > len &&
+         fwrite(pad, ETHTRACE_ALIGN(len) - len, 1, ethTraceFile) != 1) ||
+        fflush(ethTraceFile) != 0)
+    {
+        DBG_E("Trace write failed, recording stopped: %s\n", strerror(errno));
+        ethTraceClose();
+    }
+}
+
+/*
+ * Carica la traccia e ne controlla la struttura: un file troncato
+ * (demone ucciso durante una scrittura) viene letto fino all'ultimo
+ * record completo.
+ */
+int ethTraceLoad(t_trace_reader *r, const char *path)
+{
+    FILE *fp;
+    long pos;
+
+    memset(r, 0, sizeof(t_trace_reader));
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        DBG_E("Unable to open trace '%s': %s\n", path, strerror(errno));
+        return ETHFREADERR;
+    }
+    fseek(fp, 0, SEEK_END);
+    r->size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    r->data = (unsigned char *)malloc(r->size > 0 ? r->size : 1);
+    if (r->data == NULL || fread(r->data, 1, r->size, fp) != (size_t)r->size)
+    {
+        fclose(fp);
+        ethTraceFree(r);
+        return r->data == NULL ? ETHNOMEMERR : ETHFREADERR;
+    }
+    fclose(fp);
+
+    if (r->size < (long)sizeof(t_trace_file_hdr) ||
+        memcmp(r->data, ETHTRACE_MAGIC, 4) != 0 ||
+        ((t_trace_file_hdr *)r->data)->version != ETHTRACE_VERSION)
+    {
+        DBG_E("'%s' is not a version %d trace\n", path, ETHTRACE_VERSION);
+        ethTraceFree(r);
+        return ETHBADCONFERR;
+    }
+    pos = sizeof(t_trace_file_hdr);
+    while (pos + (long)sizeof(t_trace_rec) <= r->size)
+    {
+        const t_trace_rec *rec = (const t_trace_rec *)(r->data + pos);
+        if (rec->len > ETHTRACE_MAX_LEN ||
+            pos + (long)sizeof(t_trace_rec) + ETHTRACE_ALIGN((long)rec->len) >
+            r->size)
+            break;
+        pos += sizeof(t_trace_rec) + ETHTRACE_ALIGN(rec->len);
+        r->nRecords++;
+    }
+    if (pos != r->size)
+        DBG_I("Trace '%s' truncated after %d records\n", path, r->nRecords);
+    r->size = pos;
+    r->pos = sizeof(t_trace_file_hdr);
+    return ETHNOERR;
+}
+
+void ethTraceFree(t_trace_reader *r)
+{
+    free(r->data);
+    memset(r, 0, sizeof(t_trace_reader));
+}
+
+const void *ethTracePayload(const t_trace_rec *rec)
+{
+    return (const unsigned char *)rec + sizeof(t_trace_rec);
+}
+
+const t_trace_rec *ethTracePeek(const t_trace_reader *r)
+{
+    if (r->data == NULL || r->pos >= r->size)
+        return NULL;
+    return (const t_trace_rec *)(r->data + r->pos);
+}
+
+const t_trace_rec *ethTraceNext(t_trace_reader *r)
+{
+    const t_trace_rec *rec = ethTracePeek(r);
+
+    if (rec != NULL)
+        r->pos += sizeof(t_trace_rec) + ETHTRACE_ALIGN(rec->len);
+    return rec;
+}
+
+/*
+ * Scansione indipendente da ethTraceNext per un solo tipo di record
+ * (*pos = 0 per partire dall'inizio).
+ */
+const t_trace_rec *ethTraceNextOfType(const t_trace_reader *r, long *pos,
+                                      t_trace_type type)
+{
+    if (*pos < (long)sizeof(t_trace_file_hdr))
+        *pos = sizeof(t_trace_file_hdr);
+    while (r->data != NULL && *pos < r->size)
+    {
+        const t_trace_rec *rec = (const t_trace_rec *)(r->data + *pos);
+        *pos += sizeof(t_trace_rec) + ETHTRACE_ALIGN(rec->len);
+        if (rec->type == type)
+            return rec;
+    }
+    return NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
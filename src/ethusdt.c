@@ -0,0 +1,21 @@
+/*
+ * Semafori dei tracepoint USDT (vedi ethusdt.h): uno per probe, nella
+ * sezione .probes dove bpftrace e perf li trovano e li incrementano.
+ */
+#include "ethusdt.h"
+
+#ifdef ETHUSDT_COMPILED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETHUSDT_DEFINE(name) \
+    unsigned short ETHUSDT_SEMAPHORE(name) __attribute__((section(".probes")));
+ETHUSDT_PROBES(ETHUSDT_DEFINE)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
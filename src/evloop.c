@@ -0,0 +1,283 @@
+/*
+ * Event loop a singolo thread.
+ *
+ * Tutto il lavoro periodico (probe, timer di isteresi, eventi dal
+ * kernel) gira qui, senza sleep() bloccanti: i callback devono tornare
+ * subito e riprogrammarsi con un timer se hanno altro da fare.
+ */
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "debug.h"
+#include "evloop.h"
+#include "ethtrace.h"
+#include "etherrors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* >= 0: tempo virtuale imposto dal replay di una traccia */
+static long long evLoopVirtualMs = -1;
+
+long long evLoopNowMs(void)
+{
+    struct timespec ts;
+    if (evLoopVirtualMs >= 0)
+        return evLoopVirtualMs;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
+}
+
+/*
+ * Passa al tempo virtuale: poll() non attende piu` e, quando non c'e`
+ * niente di pronto, cb consegna gli eventi successivi e sposta il clock
+ * con evLoopSetTime. I timer scadono in ordine ma senza attese reali.
+ */
+void evLoopSetVirtual(t_evloop *loop, long long startMs, t_ev_advance_cb cb,
+                      void *data)
+{
+    evLoopVirtualMs = startMs;
+    loop->advance = cb;
+    loop->advanceData = data;
+}
+
+int evLoopIsVirtual(void)
+{
+    return evLoopVirtualMs >= 0;
+}
+
+void evLoopSetTime(long long ms)
+{
+    if (evLoopVirtualMs >= 0 && ms > evLoopVirtualMs)
+        evLoopVirtualMs = ms;
+}
+
+void evLoopInit(t_evloop *loop)
+{
+    memset(loop, 0, sizeof(t_evloop));
+    loop->nextTimerId = 1;
+}
+
+int evLoopAddFd(t_evloop *loop, int fd, short events, t_ev_fd_cb cb,
+                void *data)
+{
+    if (loop->nFds >= EVLOOP_MAX_FDS)
+    {
+        DBG_E("Too many descriptors in event loop\n");
+        return ETHCONFIGBUSY;
+    }
+    loop->fds[loop->nFds].fd = fd;
+    loop->fds[loop->nFds].events = events;
+    loop->fds[loop->nFds].cb = cb;
+    loop->fds[loop->nFds].data = data;
+    loop->nFds++;
+    return ETHNOERR;
+}
+
+int evLoopModFd(t_evloop *loop, int fd, short events)
+{
+    int i;
+    for (i = 0; i < loop->nFds; i++)
+    {
+        if (loop->fds[i].fd == fd)
+        {
+            loop->fds[i].events = events;
+            return ETHNOERR;
+        }
+    }
+    return ETHBADCONFERR;
+}
+
+void evLoopDelFd(t_evloop *loop, int fd)
+{
+    int i;
+    for (i = 0; i < loop->nFds; i++)
+    {
+        if (loop->fds[i].fd == fd)
+        {
+            loop->fds[i] = loop->fds[--loop->nFds];
+            return;
+        }
+    }
+}
+
+static void evTimerSwap(t_evloop *loop, int a, int b)
+{
+    t_ev_timer t = loop->timers[a];
+    loop->timers[a] = loop->timers[b];
+    loop->timers[b] = t;
+}
+
+static void evTimerUp(t_evloop *loop, int i)
+{
+    while (i > 0 && loop->timers[(i - 1) / 2].due > loop->timers[i].due)
+    {
+        evTimerSwap(loop, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void evTimerDown(t_evloop *loop, int i)
+{
+    for (;;)
+    {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < loop->nTimers && loop->timers[l].due < loop->timers[m].due)
+            m = l;
+        if (r < loop->nTimers && loop->timers[r].due < loop->timers[m].due)
+            m = r;
+        if (m == i)
+            return;
+        evTimerSwap(loop, i, m);
+        i = m;
+    }
+}
+
+static void evTimerRemoveAt(t_evloop *loop, int i)
+{
+    loop->timers[i] = loop->timers[--loop->nTimers];
+    if (i < loop->nTimers)
+    {
+        evTimerDown(loop, i);
+        evTimerUp(loop, i);
+    }
+}
+
+/*
+ * Programma cb fra ms millisecondi (one-shot). Restituisce l'id del
+ * timer (> 0) oppure un codice di errore.
+ */
+int evLoopAddTimer(t_evloop *loop, long ms, t_ev_timer_cb cb, void *data)
+{
+    t_ev_timer *t;
+    if (loop->nTimers >= EVLOOP_MAX_TIMERS)
+    {
+        DBG_E("Too many timers in event loop\n");
+        return ETHCONFIGBUSY;
+    }
+    t = &loop->timers[loop->nTimers];
+    t->due = evLoopNowMs() + (ms > 0 ? ms : 0);
+    t->id = loop->nextTimerId++;
+    if (loop->nextTimerId <= 0)
+        loop->nextTimerId = 1;
+    t->cb = cb;
+    t->data = data;
+    loop->nTimers++;
+    evTimerUp(loop, loop->nTimers - 1);
+    return t->id;
+}
+
+void evLoopDelTimer(t_evloop *loop, int id)
+{
+    int i;
+    if (id <= 0)
+        return;
+    for (i = 0; i < loop->nTimers; i++)
+    {
+        if (loop->timers[i].id == id)
+        {
+            evTimerRemoveAt(loop, i);
+            return;
+        }
+    }
+}
+
+/*
+ * Una iterazione: attende al massimo maxWaitMs (o fino al primo timer),
+ * serve i descrittori pronti e i timer scaduti.
+ */
+int evLoopRunOnce(t_evloop *loop, long maxWaitMs)
+{
+    struct pollfd pfd[EVLOOP_MAX_FDS];
+    t_ev_fd ready[EVLOOP_MAX_FDS];
+    long long now;
+    long wait = maxWaitMs;
+    int i, n, nfds;
+
+    if (loop->nTimers > 0)
+    {
+        long long delta = loop->timers[0].due - evLoopNowMs();
+        if (delta < 0)
+            delta = 0;
+        if (wait < 0 || delta < wait)
+            wait = (long)delta;
+    }
+
+    nfds = loop->nFds;
+    for (i = 0; i < nfds; i++)
+    {
+        pfd[i].fd = loop->fds[i].fd;
+        pfd[i].events = loop->fds[i].events;
+        pfd[i].revents = 0;
+        ready[i] = loop->fds[i];
+    }
+
+    if (loop->advance != NULL)
+    {
+        n = nfds > 0 ? poll(pfd, nfds, 0) : 0;
+        if (n == 0)
+            loop->advance(loop, wait < 0 ? -1 : evLoopNowMs() + wait,
+                          loop->advanceData);
+    }
+    else
+    {
+        n = poll(pfd, nfds, (int)wait);
+    }
+    if (n < 0 && errno != EINTR)
+    {
+        DBG_E("Error on poll(): %s\n", strerror(errno));
+        return ETHSOCKETERR;
+    }
+
+    /*
+     * I callback possono aggiungere o togliere descrittori: si lavora
+     * sulla copia e si salta chi nel frattempo e` stato rimosso.
+     */
+    for (i = 0; n > 0 && i < nfds; i++)
+    {
+        if (pfd[i].revents != 0)
+        {
+            int j, alive = 0;
+            for (j = 0; j < loop->nFds; j++)
+            {
+                if (loop->fds[j].fd == ready[i].fd &&
+                    loop->fds[j].cb == ready[i].cb)
+                {
+                    alive = 1;
+                    break;
+                }
+            }
+            if (alive)
+                ready[i].cb(ready[i].fd, pfd[i].revents, ready[i].data);
+        }
+    }
+
+    now = evLoopNowMs();
+    while (loop->nTimers > 0 && loop->timers[0].due <= now)
+    {
+        t_ev_timer t = loop->timers[0];
+        evTimerRemoveAt(loop, 0);
+        ethTraceRecord(ETHTRACE_TIMER, &t.id, sizeof(t.id));
+        t.cb(t.data);
+    }
+    return ETHNOERR;
+}
+
+int evLoopRun(t_evloop *loop)
+{
+    int rval = ETHNOERR;
+    loop->running = 1;
+    while (loop->running && rval == ETHNOERR)
+        rval = evLoopRunOnce(loop, -1);
+    return rval;
+}
+
+void evLoopStop(t_evloop *loop)
+{
+    loop->running = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,16 +4,61 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
-#include <sys/inotify.h>
 #include <limits.h>
 #include <getopt.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <time.h>
 
 #include "debug.h"
 #include "ethapi.h" // For ethapi functions
-#include <dbus/dbus.h> // For D-Bus communication
+#include "etharp.h" // For the Detecting Network Attachment probe
+#include "ethhealth.h" // For the layered connectivity check
+#include "ethfailover.h" // For multi-uplink default route failover
+#include "ethecmp.h" // For the multipath default route
+#include "ethroute.h" // For ETHROUTE_MAX_NEXTHOPS
+#include "ethprobe.h" // For the upstream probes
+#include "evloop.h" // For the poll() based event loop
+#include "ethdbus.h" // For the asynchronous D-Bus connection
+#include "ethnotify.h" // For sd_notify readiness and watchdog
+#include "ethstate.h" // For adopting the configuration at restart
+#include "ethiftable.h" // For the ifindex keyed interface table
+#include "ethaction.h" // For the per-interface action queue
+#include "ethtrace.h" // For recording and replaying event traces
+#include "ethbackend.h" // For the real or simulated system backend
+#include "ethsim.h" // For the simulated device and event generator
+#include "ethusdt.h" // For the USDT static tracepoints
+#include "ethnic.h" // For the NIC performance profile
+#include "ethqueue.h" // For the queue-to-CPU mapping
+#include "ethmtu.h" // For the device MTU and path MTU probing
+#include "ethtcp.h" // For the BDP based TCP buffer sizing
+#include "ethqdisc.h" // For the root queueing discipline
+#include "ethtcpmon.h" // For the passive TCP quality monitor
+#include "ethifstats.h" // For the interface traffic sampler
+#include "ethdnsmon.h" // For the nameserver latency ranking
+#include "ethhotplug.h" // For matching the device by name, MAC or path
 
-// Global D-Bus connection
-static DBusConnection *connection = NULL;
+// Connessione D-Bus, aperta in background dall'event loop
+static t_ethdbus dbus_if;
+
+// Qualita` TCP del device dai tcp_info dei socket (TCP_MONITOR=)
+static t_tcpmon tcp_monitor;
+
+// Rate di traffico delle interfacce da IFLA_STATS64 (STATS_INTERVAL=)
+static t_ifstats traffic_stats;
+
+// Latenza dei nameserver e loro ordine in resolv.conf (DNS_MONITOR=)
+static t_dnsmon dns_monitor;
+
+// Interfacce del sistema per ifindex, aggiornate dagli eventi netlink
+static t_iftable iface_table;
+
+// Device gestito: come riconoscerlo (-d) e nome attuale, vuoto finche` non compare
+static t_hotplug_match device_match;
+static char managed_device[DEVICENAME_LEN];
+
+// Notifiche al service manager (READY=1 a connettività verificata, watchdog)
+static t_notify service_notify;
 
 // D-Bus constants
 const char* DBUS_OBJECT_PATH = "/com/example/NetworkManager";
@@ -27,35 +72,238 @@ int debuglevel = DBG_INFO;
 typedef struct {
 	char ip_addr[MAX_LINE_LEN];
 	char netmask[MAX_LINE_LEN];
-	char gateway[MAX_LINE_LEN];
+	char gateway[MAX_LINE_LEN];  // Primo gateway
 	char dns1[MAX_LINE_LEN];
 	char dns2[MAX_LINE_LEN];
+	// Tutti i GATEWAY= del file: piu` di uno => default route ECMP
+	int num_gateways;
+	char gateways[ETHROUTE_MAX_NEXTHOPS][IPv4ADDR_LEN];
+	int gateway_weights[ETHROUTE_MAX_NEXTHOPS];
+	// Probe upstream (PROBE=), validi anche senza IP_ADDR (modalita` DHCP)
+	int num_probes;
+	t_probe probes[PROBE_MAX];
+	int probe_timeout_ms;
+	// Profilo della scheda (NIC_*=), valido anche in DHCP
+	t_nic_profile nic;
+	// Code e interrupt sui core (QUEUE_CPUS=auto o lista di core)
+	bool queue_mapping;
+	t_cpuset queue_cpus;
+	// MTU del device (MTU=, 0: quella del driver) e verifica del path MTU (PMTU_PROBE=)
+	int mtu;
+	int pmtu_probe; // 0: solo se MTU= e` impostata, 1: sempre, -1: mai
+	// Metriche TCP di default route e subnet (ROUTE_*=), buffer TCP sul BDP (TCP_BUFFERS=auto)
+	t_route_metrics route_metrics;
+	bool tcp_buffers;
+	// Qdisc di root applicata al link-up (QDISC=fq_codel|fq|cake [opzioni])
+	t_qdisc_conf qdisc;
+	// Dopo gli indirizzi: ARP gratuiti (ARP_ANNOUNCE=off), gateway e DNS risolti
+	// in anticipo (NEIGH_PRERESOLVE=off), gateway fissato nella tabella dei vicini (NEIGH_PIN_GATEWAY=on)
+	bool no_arp_announce;
+	bool no_neigh_preresolve;
+	bool neigh_pin_gateway;
+	// Velocita` minima attesa (LINK_MIN_SPEED=, Mb/s, 0: nessuna) e riavvio dell'autonegoziazione (LINK_RENEGOTIATE=on)
+	int link_min_speed;
+	bool link_renegotiate;
+	// Monitor passivo TCP: intervallo (TCP_MONITOR=, ms, 0: spento) e soglie di degrado
+	int tcp_monitor_ms;
+	double tcp_monitor_max_rtt;
+	double tcp_monitor_max_retrans;
+	// Campionamento del traffico: intervallo (STATS_INTERVAL=, ms, 0: spento) e interfacce (STATS_IFACES=, "all" o elenco)
+	int stats_interval_ms;
+	char stats_ifaces[MAX_LINE_LEN];
+	// Classifica dei DNS: intervallo delle query di prova (DNS_MONITOR=, ms, 0: ordine fisso) e nome chiesto (DNS_MONITOR_NAME=)
+	int dns_monitor_ms;
+	char dns_monitor_name[MAX_LINE_LEN];
 } StaticNetConfig;
 
+// Event loop principale e default route ECMP (configurazione statica con piu` gateway)
+static t_evloop* event_loop = NULL;
+static t_ecmp ecmp;
+
+// Eventi del socket atteso (ARP, echo del path MTU) durante un'attesa dell'azione
+static short reply_revents;
+
+// --- Stato del device gestito, passato ai callback dell'event loop ---
+typedef struct {
+	const char* device_name;
+	int ifindex;
+	bool use_static_config;
+	StaticNetConfig static_config;
+	t_evloop* loop;
+	t_action_queue actions; // Solo l'ultimo stato del link viene servito
+	int renegotiations; // Autonegoziazioni riavviate da quando il link e` degradato
+	long long wait_since; // Prima corrispondenza trovata mentre si attende il device
+	bool wait_matched; // wait_since e` valido
+	int wait_timer; // Attesa della fine delle regole udev
+	bool traced; // Evento di avvio gia` scritto nella traccia
+} LinkContext;
+
+#define LINK_RENEGOTIATE_MAX 1  // Un solo tentativo: un cavo guasto non si ripara ripetendolo
+// Azione della coda oltre a ETHSTATEUP/ETHSTATEDOWN: riprende la configurazione esistente, se no stato del link
+#define LINK_ADOPT 2
+
+// dhclient parte in background: il lease (default route sul device) si attende servendo l'event loop
+#define DHCP_LEASE_TIMEOUT_MS 60000  // Come il timeout di dhclient
+#define DHCP_LEASE_POLL_MS    250
+
+// --- Annuncio dell'indirizzo (RFC 5227): il secondo ARP gratuito parte da un timer ---
+#define NEIGH_RESOLVE_MS 200  // Attesa massima delle risposte ARP di gateway e DNS
+
+typedef struct {
+	char device_name[DEVICENAME_LEN];
+	char address[IPv4ADDR_LEN];
+	int remaining;
+	int timer;
+} ArpAnnounce;
+
+static ArpAnnounce arp_announce;
+
+// Gateway fissati come voci permanenti (NEIGH_PIN_GATEWAY=on): il kernel non li toglie da solo
+static char pinned_gateways[ETHROUTE_MAX_NEXTHOPS][GATEWAY_LEN];
+static int num_pinned = 0;
+
+// --- Detecting Network Attachment (RFC 4436) ---
+#define DNA_MAX_IFACES  8
+#define DNA_TIMEOUT_MS  150  // Attesa massima della risposta unicast del gateway
+
+typedef struct {
+	bool valid;
+	char device_name[DEVICENAME_LEN];
+	char gateway[IPv4ADDR_LEN];
+	unsigned char gateway_mac[ETHARP_HWADDR_LEN];
+} DnaEntry;
+
+// Esito dell'ARP unicast verso il gateway, registrato nella traccia
+typedef struct {
+	int rval;
+	unsigned char reply_mac[ETHARP_HWADDR_LEN];
+} DnaProbe;
+
+static DnaEntry dna_table[DNA_MAX_IFACES];
+static bool dna_enabled = true;
+
+// Al riavvio riprende la configurazione esistente invece di rifarla (-R per forzare)
+static bool adopt_enabled = true;
+
+// --- Replay di una traccia o simulazione: backend finto, tempo virtuale ---
+typedef struct {
+	long events;         // Messaggi netlink consegnati
+	long timers;         // Timer registrati nella traccia (solo conteggio)
+	long actions;        // Azioni della coda eseguite
+	long commands;       // Comandi/modifiche al kernel che sarebbero stati eseguiti
+	long publishes;      // Cambi di stato pubblicati
+	long health_missing; // Verifiche senza esito registrato
+	long divergences;    // Decisioni diverse da quelle registrate (o mancanti)
+} ReplayStats;
+
+// Simulatore con gli esiti delle verifiche presi dalla traccia
+static t_eth_backend replay_backend;
+static t_trace_reader replay_trace;
+static long replay_health_pos = 0;
+static long replay_arp_pos = 0;
+static long replay_action_pos = 0;
+static long replay_state_pos = 0;
+static bool replay_compare = false; // La traccia contiene le decisioni
+static long long replay_end_ms = 0; // Ultimo record: oltre, il demone registrato non e` arrivato
+static ReplayStats replay_stats;
+
+// Eventi del simulatore finiti: un'azione che riprova all'infinito (gateway muto) si ferma qui
+#define SIM_DRAIN_MS 600000
+static long long sim_drain_since = -1;
+
 // --- Function Prototypes ---
 bool parse_static_config(const char* filename, StaticNetConfig* config);
+void parse_gateway(StaticNetConfig* config, char* value);
+void parse_probe(StaticNetConfig* config, const char* value);
+void default_probes(StaticNetConfig* config);
+void apply_nic_profile(const char* device_name, const StaticNetConfig* config);
+void apply_queue_mapping(const char* device_name, const StaticNetConfig* config);
+void apply_qdisc(const char* device_name, const StaticNetConfig* config);
+void refresh_dbus_properties(t_ethdbus* bus, void* data);
+void apply_link_mtu(const char* device_name, const StaticNetConfig* config);
+void verify_path_mtu(const char* device_name, const char* gateway, const StaticNetConfig* config, const t_action_queue* actions);
+int probe_path_mtu(const char* device_name, const char* target, int max_mtu, const t_action_queue* actions, t_pmtu_result* result);
+int wait_pmtu_reply(int fd, long ms, void* data);
+int wait_reply(int fd, long ms, const int* done, void* data);
+void on_reply(int fd, short revents, void* data);
+void lock_route_mtu(const char* device_name, const char* destination, const char* gateway, const StaticNetConfig* config, int mtu);
+void apply_route_tuning(const char* device_name, const StaticNetConfig* config);
+void announce_address(const char* device_name, const char* address);
+void on_arp_announce(void* data);
+void warm_neighbors(const char* device_name, const StaticNetConfig* config);
+void unpin_gateways(const char* device_name, int ifindex);
+void size_tcp_buffers(const char* device_name, const t_health_report* report, const StaticNetConfig* config);
 void apply_static_config(const char* device_name, const StaticNetConfig* config);
 void apply_dhcp_config(const char* device_name);
+bool wait_dhcp_lease(const char* device_name, t_action_queue* actions);
 void remove_network_config(const char* device_name);
 bool is_link_up(const char* device_name);
-void handle_link_change(const char* device_name, bool use_static_config, const StaticNetConfig* static_config);
+void handle_link_change(const char* device_name, bool use_static_config, const StaticNetConfig* static_config, t_action_queue* actions);
+void on_link_action(t_action_queue* actions, int target, void* data);
+void on_iface_event(t_iface* iface, t_iftable_event event, unsigned int diff, void* data);
+void on_uplink_switch(const t_uplink* from, const t_uplink* to, void* data);
+void track_link_mode(LinkContext* ctx, t_iface* iface);
+void attach_device(LinkContext* ctx, t_iface* iface, bool hotplug);
+void detach_device(LinkContext* ctx, const char* why);
+void wait_for_device(LinkContext* ctx);
+void on_device_wait(void* data);
+void start_tcp_monitor(const char* device_name, const StaticNetConfig* config);
+void on_tcp_sample(t_tcpmon* mon, void* data);
+void on_tcp_quality(t_tcpmon* mon, void* data);
+void start_traffic_stats(const char* device_name, const StaticNetConfig* config);
+void on_traffic_sample(t_ifstats* stats, void* data);
+DBusMessage* handle_dbus_method(t_ethdbus* bus, DBusMessage* msg, void* data);
+void start_dns_monitor(LinkContext* ctx);
+void write_resolver(const StaticNetConfig* config);
+void on_dns_round(t_dnsmon* mon, void* data);
+void on_dns_reorder(t_dnsmon* mon, void* data);
+void publish_state(const char* device_name, const char* state);
+DnaEntry* dna_lookup(const char* device_name);
+bool dna_fast_path(const char* device_name);
+void dna_learn(const char* device_name, const t_health_report* report);
+void dna_forget(const char* device_name);
+void start_ecmp(const char* device_name, const StaticNetConfig* config);
+bool adopt_existing_state(const LinkContext* ctx);
+bool saved_state_matches(const t_persist_state* saved, const StaticNetConfig* config);
+void save_state(const char* device_name, bool use_static_config, const StaticNetConfig* config, const t_health_report* report);
+int run_command(const char* command);
+void run_health_check(const char* device_name, const char** gateways, int num_gateways, const StaticNetConfig* config, const t_action_queue* actions, t_health_report* report);
+void trace_decision(t_trace_type type, const void* data, int len);
+int replay_arp_probe(const char* device, const char* target, const unsigned char* target_mac, unsigned char* reply_mac, int timeout_ms);
+int replay_health(const char* device_name, const char* const* gateways, int num_gateways, const t_probe* probes, int num_probes, t_health_report* report);
+int run_replay(const char* device_name, const char* config_file, const char* trace_file);
+void on_replay_advance(t_evloop* loop, long long until_ms, void* data);
+int run_simulation(const char* device_name, const char* config_file, const char* spec);
+void on_sim_advance(t_evloop* loop, long long until_ms, void* data);
+void print_run_stats(const char* what, long long start_ms, const struct timespec* cpu_start, const t_action_queue* actions);
 
 // --- Main Application ---
 int main(int argc, char *argv[]) {
 	char* device_name = "eth0";
 	char* config_file = "network.conf";
+	char* trace_file = NULL;
+	char* replay_file = NULL;
+	char* sim_spec = NULL;
+	t_failover failover;
+	ethFailoverInit(&failover);
 	// --- Argomento Parsing ---
 	static struct option long_options[] = {
 		{"device", required_argument, 0, 'd'}, // Corresponds to -d
 		{"config", required_argument, 0, 'c'}, // Corresponds to -c
 		{"debug", required_argument, 0, 'D'},  // New option for debug level
+		{"no-dna", no_argument, 0, 'n'},       // Disable the link-up fast path
+		{"uplink", required_argument, 0, 'u'}, // Failover uplink, repeatable
+		{"reconfigure", no_argument, 0, 'R'},  // Ignore the saved state at startup
+		{"trace", required_argument, 0, 'T'},  // Record input events to a trace file
+		{"replay", required_argument, 0, 'P'}, // Replay a trace against a fake kernel
+		{"simulate", required_argument, 0, 'S'}, // Run against the simulated backend
 		{0, 0, 0, 0} // Terminator
 	};
 
 	int opt;
 	int long_index = 0;
 	// Use getopt_long instead of getopt
-	while ((opt = getopt_long(argc, argv, "d:c:D:", long_options, &long_index)) != -1)
+	while ((opt = getopt_long(argc, argv, "d:c:D:nu:RT:P:S:", long_options, &long_index)) != -1)
 	{
 		switch (opt)
 		{
@@ -80,346 +328,1948 @@ int main(int argc, char *argv[]) {
 				}
 				break;
 			}
+			case 'n':
+				dna_enabled = false;
+				break;
+			case 'R':
+				adopt_enabled = false;
+				break;
+			case 'T':
+				trace_file = optarg;
+				break;
+			case 'P':
+				replay_file = optarg;
+				break;
+			case 'S':
+				sim_spec = optarg;
+				break;
+			case 'u':
+				if (ethFailoverAddUplink(&failover, optarg) != ETHNOERR)
+				{
+					fprintf(stderr, "Invalid uplink '%s' (device[:gateway], max %d).\n", optarg, FAILOVER_MAX_UPLINKS);
+					return EXIT_FAILURE;
+				}
+				break;
 			case '?': // Handle unknown options
 			default:
 				// Update usage string for new --debug option
-				fprintf(stderr, "Usage: %s [-d device_name] [-c config_file] [--debug <level>]\n", argv[0]);
+				fprintf(stderr, "Usage: %s [-d name|mac=<MAC>|path=<glob>] [-c config_file] [--debug <level>] [--no-dna] [--reconfigure] [--trace file | --replay file | --simulate spec] [-u device[:gateway]]...\n", argv[0]);
 				return EXIT_FAILURE;
 		}
 	}
 
 	LOG_INFO("Device: %s, File di Configurazione: %s, Debug Level: %d", device_name, config_file, debuglevel);
 
-	// --- Initialize D-Bus connection ---
-	DBusError error;
-	dbus_error_init(&error);
-	connection = dbus_bus_get(DBUS_BUS_SYSTEM, &error);
-	if (dbus_error_is_set(&error))
+	// Replay e simulazione non toccano il sistema: niente privilegi, niente D-Bus
+	if (replay_file != NULL)
 	{
-		LOG_ERROR("Failed to connect to D-Bus system bus: %s", error.message);
-		dbus_error_free(&error);
-		return EXIT_FAILURE;
-	}
-	if (connection == NULL)
-	{
-		return EXIT_FAILURE;
+		return run_replay(device_name, config_file, replay_file);
 	}
-	// Export an object path for emitting signals
-	if (!dbus_connection_register_object_path(connection, DBUS_OBJECT_PATH, NULL, NULL))
+	if (sim_spec != NULL)
 	{
-		LOG_ERROR("Failed to register D-Bus object path %s.", DBUS_OBJECT_PATH);
-		dbus_connection_unref(connection); // Clean up connection on error
-		connection = NULL;
-		return EXIT_FAILURE;
+		return run_simulation(device_name, config_file, sim_spec);
 	}
-	// --- End D-Bus initialization ---
 
 	// Verifica dei privilegi di root
 	if (geteuid() != 0)
 	{
 		LOG_ERROR("Questo programma richiede privilegi di root. Eseguire con sudo.");
-		// D-Bus cleanup needed here if connection was successful
-		if (connection)
+		return EXIT_FAILURE;
+	}
+
+	t_evloop loop;
+	evLoopInit(&loop);
+	event_loop = &loop;
+
+	// --- D-Bus: connessione asincrona, la rete non attende dbus-daemon ---
+	ethDbusInit(&dbus_if, DBUS_OBJECT_PATH, DBUS_INTERFACE_NAME);
+	ethDbusStart(&dbus_if, &loop);
+
+	// --- sd_notify: READY=1 solo a connettività verificata, watchdog dall'event loop ---
+	ethNotifyInit(&service_notify);
+	ethNotifyWatchdogStart(&service_notify, &loop);
+
+	// --- Modalità failover: solo default route, nessuna configurazione del device ---
+	if (ethFailoverCount(&failover) > 0)
+	{
+		LOG_INFO("Modalità failover su %d uplink.", ethFailoverCount(&failover));
+		failover.onSwitch = on_uplink_switch;
+		if (ethFailoverStart(&failover, &loop) != ETHNOERR)
 		{
-			dbus_connection_unref(connection);
-			connection = NULL;
+			LOG_ERROR("Impossibile avviare il failover degli uplink.");
+			ethDbusStop(&dbus_if);
+			return EXIT_FAILURE;
 		}
-		return EXIT_FAILURE;
+		evLoopRun(&loop);
+		ethFailoverStop(&failover);
+		ethNotifyClose(&service_notify);
+		ethDbusStop(&dbus_if);
+		return EXIT_SUCCESS;
 	}
 
-	StaticNetConfig static_config = {0};
-	bool use_static_config = parse_static_config(config_file, &static_config);
+	if (ethHotplugParse(device_name, &device_match) != ETHNOERR)
+	{
+		LOG_ERROR("Device '%s' non valido: nome (anche glob), mac=<MAC> o path=<glob>.", device_name);
+		ethDbusStop(&dbus_if);
+		return EXIT_FAILURE;
+	}
+	static LinkContext link_ctx = {0};
+	link_ctx.device_name = managed_device;
+	link_ctx.loop = &loop;
+	bool config_found = parse_static_config(config_file, &link_ctx.static_config);
+	// Contatori della qdisc letti dal kernel a ogni Get/GetAll delle proprieta`
+	dbus_if.onGetProperties = refresh_dbus_properties;
+	dbus_if.onMethod = handle_dbus_method;
+	dbus_if.cbData = &link_ctx;
+	// Un file senza IP_ADDR porta solo le opzioni generali (es. PROBE=): si usa dhclient
+	link_ctx.use_static_config = config_found && link_ctx.static_config.ip_addr[0] != '\0';
+	default_probes(&link_ctx.static_config);
 
-	if (use_static_config)
+	if (link_ctx.use_static_config)
 	{
 		LOG_INFO("File di configurazione '%s' trovato. Verrà usata la configurazione statica.", config_file);
 	}
+	else if (config_found)
+	{
+		LOG_INFO("File di configurazione '%s' senza IP_ADDR. Verrà usato dhclient.", config_file);
+	}
 	else
 	{
 		LOG_INFO("File di configurazione '%s' non trovato. Verrà usato dhclient.", config_file);
 	}
 
-	// --- Setup inotify ---
-	int fd = inotify_init();
-	if (fd < 0)
+	// --- Traccia degli eventi in ingresso, aperta prima del dump iniziale ---
+	if (trace_file != NULL && ethTraceOpen(trace_file) == ETHNOERR)
 	{
-		LOG_ERROR("Errore in inotify_init: %s", strerror(errno));
-		// D-Bus cleanup needed here if connection was successful
-		if (connection)
-		{
-			dbus_connection_unref(connection);
-			connection = NULL;
-		}
-		return EXIT_FAILURE;
+		LOG_INFO("Registrazione degli eventi in '%s'.", trace_file);
 	}
 
-	char watch_path[PATH_MAX];
-	snprintf(watch_path, sizeof(watch_path), "/sys/class/net/%s/carrier", device_name);
-
-	int wd = inotify_add_watch(fd, watch_path, IN_MODIFY | IN_CREATE);
-	if (wd < 0)
+	// --- Tabella delle interfacce: un dump netlink, poi solo eventi ---
+	ethIfTableInit(&iface_table);
+	if (ethIfTableStart(&iface_table, &loop) != ETHNOERR)
 	{
-		LOG_ERROR("Errore in inotify_add_watch per '%s': %s", watch_path, strerror(errno));
-		close(fd);
-		if (errno == ENOENT)
-		{
-			 LOG_ERROR("Interfaccia '%s' non trovata. Il programma non può continuare.", device_name);
-		}
-		// D-Bus cleanup needed here if connection was successful
-		if (connection)
-		{
-			dbus_connection_unref(connection);
-			connection = NULL;
-		}
+		LOG_ERROR("Impossibile leggere le interfacce via netlink.");
+		ethIfTableFree(&iface_table);
+		ethDbusStop(&dbus_if);
 		return EXIT_FAILURE;
 	}
+	// Le interfacce del dump iniziale non sono hotplug: gli eventi contano da qui
+	iface_table.onEvent = on_iface_event;
+	iface_table.cbData = &link_ctx;
 
-	LOG_INFO("In ascolto per cambiamenti di stato su %s...", watch_path);
-	
-	// Controllo iniziale dello stato del link all'avvio
-	handle_link_change(device_name, use_static_config, &static_config);
-
-	// --- Event Loop ---
-	char buffer[sizeof(struct inotify_event) + NAME_MAX + 1];
-	while (1)
+	if (link_ctx.use_static_config)
 	{
-		ssize_t len = read(fd, buffer, sizeof(buffer));
-		if (len < 0)
-		{
-			LOG_ERROR("Errore nella lettura da inotify: %s", strerror(errno));
-			break; // Exit loop on read error
-		}
-
-		LOG_INFO("Rilevato cambiamento di stato del link per %s.", device_name);
-		handle_link_change(device_name, use_static_config, &static_config);
+		start_dns_monitor(&link_ctx);
 	}
-
-	// Cleanup
-	if (connection)
+	// Il device puo` comparire dopo (USB, driver caricato tardi): si attende senza uscire
+	ethActionInit(&link_ctx.actions, &loop, on_link_action, &link_ctx);
+	t_iface* iface = ethHotplugFind(&iface_table, &device_match);
+	if (iface != NULL)
+	{
+		attach_device(&link_ctx, iface, false);
+	}
+	else
 	{
-		dbus_connection_unref(connection);
-		connection = NULL;
+		LOG_INFO("Interfaccia '%s' non presente: attendo che compaia (%d interfacce)...", device_name, iface_table.count);
+		publish_state(device_name, "unavailable");
 	}
-	inotify_rm_watch(fd, wd);
-	close(fd);
+
+	// --- Event Loop ---
+	evLoopRun(&loop);
+
+	// Cleanup
+	ethTcpMonStop(&tcp_monitor);
+	ethIfStatsStop(&traffic_stats);
+	ethDnsMonStop(&dns_monitor);
+	ethNotifyClose(&service_notify);
+	ethDbusStop(&dbus_if);
+	ethIfTableFree(&iface_table);
+	ethTraceClose();
 	return EXIT_SUCCESS;
 }
 
 /**
- * @brief Controlla lo stato del link leggendo il file carrier di sysfs.
+ * @brief Pubblica lo stato su D-Bus e al service manager; "connected" vale come READY=1.
  */
-bool is_link_up(const char* device_name)
+void publish_state(const char* device_name, const char* state)
 {
-	char carrier_path[PATH_MAX];
-	snprintf(carrier_path, sizeof(carrier_path), "/sys/class/net/%s/carrier", device_name);
-	
-	FILE *fp = fopen(carrier_path, "r");
-	if (!fp)
+	char status[ETHNOTIFY_MSG_LEN];
+
+	trace_decision(ETHTRACE_STATE, state, strlen(state) + 1);
+	if (!ethBackend()->real)
 	{
-		return false;
+		replay_stats.publishes++;
+		LOG_INFO("%s: %s -> %s", ethBackend()->name, device_name, state);
+		return;
+	}
+	ethDbusPublishState(&dbus_if, device_name, state);
+	snprintf(status, sizeof(status), "%s: %s", device_name, state);
+	if (strcmp(state, "connected") == 0)
+	{
+		ethNotifyReady(&service_notify, status);
+	}
+	else
+	{
+		ethNotifyStatus(&service_notify, status);
 	}
-	
-	char status = fgetc(fp);
-	fclose(fp);
-	
-	return (status == '1');
 }
 
 /**
- * @brief Gestisce il cambiamento di stato del link, verifica la connettività internet con ritentativi e riconfigurazione.
+ * @brief Callback del failover: pubblica su D-Bus l'uplink che porta la default route.
  */
-void handle_link_change(const char* device_name, bool use_static_config, const StaticNetConfig* static_config)
+void on_uplink_switch(const t_uplink* from, const t_uplink* to, void* data)
 {
-	sleep(1); // Breve attesa per stabilizzazione
-
-	// --- Using ethapi for link status ---
-	t_network_conf conf;
-	memset(&conf, 0, sizeof(t_network_conf));
-	strncpy(conf.deviceName, device_name, sizeof(conf.deviceName) - 1);
+	publish_state(to->deviceName, "connected");
+}
 
-	int link_status_result = ethGetLinkStatus(&conf); // Call ethGetLinkStatus
+/**
+ * @brief Callback della tabella interfacce: un cambio di stato del link del device gestito.
+ */
+void on_iface_event(t_iface* iface, t_iftable_event event, unsigned int diff, void* data)
+{
+	LinkContext* ctx = (LinkContext*)data;
 
-	if (link_status_result == ETHNOERR && conf.linkStatus == ETHSTATEUP)
+	// In attesa del device: puo` esserlo solo un'interfaccia nuova o rinominata
+	if (ctx->ifindex == 0)
 	{
-		// Check result and status
-		LOG_INFO("Link %s: ATTIVO (via ethGetLinkStatus).", device_name);
-
-		// --- Keep existing logic for applying config for now ---
-		// NOTE: This part could ideally be refactored to use ethConnect,
-		// but that's a more complex change. For now, we keep the custom apply functions.
-		if (use_static_config)
+		if (event == IFTABLE_EV_NEW || (event == IFTABLE_EV_CHANGE && (diff & ETHMODEL_DIFF_NAME)))
 		{
-			apply_static_config(device_name, static_config);
+			wait_for_device(ctx);
 		}
-		else
+		return;
+	}
+	// Gli eventi delle altre interfacce (veth, bridge...) costano una lookup e basta
+	if (iface->ifindex != ctx->ifindex)
+	{
+		return;
+	}
+	if (event == IFTABLE_EV_DEL)
+	{
+		detach_device(ctx, "rimossa");
+		return;
+	}
+	if (diff & ETHMODEL_DIFF_NAME)
+	{
+		// Il nome e` in tutti i comandi: si smonta con il nome nuovo e si riparte come da un
+		// device appena comparso, se corrisponde ancora
+		LOG_INFO("Interfaccia %s rinominata in %s.", ctx->device_name, ethModelString(iface->model.deviceName));
+		strncpy(managed_device, ethModelString(iface->model.deviceName), sizeof(managed_device) - 1);
+		detach_device(ctx, "rinominata");
+		wait_for_device(ctx);
+		return;
+	}
+	if (event == IFTABLE_EV_CHANGE && (diff & ETHMODEL_DIFF_LINK))
+	{
+		track_link_mode(ctx, iface);
+		// Non si gestisce qui: l'azione parte dall'event loop e rende obsoleta quella in corso
+		LOG_INFO("Rilevato cambiamento di stato del link per %s.", ctx->device_name);
+		ethActionSubmit(&ctx->actions, iface->model.linkStatus);
+	}
+}
+
+/**
+ * @brief Il device e` presente: monitor, evento di avvio della traccia e stato iniziale del link.
+ *
+ * Un device appena comparso (hotplug) e` giu`: senza IFF_UP il carrier non arriva e il link-up
+ * non scatterebbe mai, quindi lo si porta su subito.
+ */
+void attach_device(LinkContext* ctx, t_iface* iface, bool hotplug)
+{
+	char command[128];
+
+	memset(managed_device, 0, sizeof(managed_device));
+	strncpy(managed_device, ethModelString(iface->model.deviceName), sizeof(managed_device) - 1);
+	ctx->ifindex = iface->ifindex;
+	ctx->renegotiations = 0;
+	track_link_mode(ctx, iface);
+	start_tcp_monitor(managed_device, &ctx->static_config);
+	start_traffic_stats(managed_device, &ctx->static_config);
+	if (!ctx->traced)
+	{
+		ethTraceRecord(ETHTRACE_START, managed_device, strlen(managed_device) + 1);
+		ctx->traced = true;
+	}
+	LOG_INFO("In ascolto per cambiamenti di stato su %s (ifindex %d, %d interfacce)...", managed_device, ctx->ifindex, iface_table.count);
+
+	if (hotplug)
+	{
+		LOG_INFO("Interfaccia %s comparsa.", managed_device);
+		if (!(iface->flags & IFF_UP))
 		{
-			apply_dhcp_config(device_name);
+			snprintf(command, sizeof(command), "ip link set %s up", managed_device);
+			LOG_INFO("CMD: %s\n", command);
+			run_command(command);
 		}
-		// --- End keeping existing logic ---
+	}
+	// Controllo iniziale: dopo un riavvio del demone il device gia` configurato viene ripreso cosi` com'e`.
+	// Anche la ripresa e` un'azione della coda: mai dentro il callback dell'evento, mai insieme a un link-up
+	ethActionSubmit(&ctx->actions, adopt_enabled ? LINK_ADOPT : is_link_up(managed_device) ? ETHSTATEUP : ETHSTATEDOWN);
+}
 
-		// --- Verification of Internet Connectivity with Retries ---
-		const char* internet_server = "8.8.8.8"; // Public DNS server
-		int ping_result;
-		int attempts = 0;
-		const int MAX_ATTEMPTS = 10;
-		const int RETRY_DELAY_SEC = 10;
+/**
+ * @brief Il device non c'e` piu` (o ha cambiato nome): ferma i monitor e smonta la configurazione.
+ *
+ * Lo smontaggio e` l'azione di link-down (dhclient, indirizzi, stato salvato): rende
+ * obsoleta un'eventuale configurazione in corso sul device sparito.
+ */
+void detach_device(LinkContext* ctx, const char* why)
+{
+	LOG_ERROR("Interfaccia %s %s: in attesa che ricompaia.", ctx->device_name, why);
+	ethTcpMonStop(&tcp_monitor);
+	ethIfStatsStop(&traffic_stats);
+	if (arp_announce.timer > 0)
+	{
+		evLoopDelTimer(event_loop, arp_announce.timer);
+		arp_announce.timer = 0;
+	}
+	dna_forget(ctx->device_name);
+	// Lo smontaggio puo` non arrivare (superato dal riaggancio dopo una rinomina): le voci fissate vanno tolte qui
+	unpin_gateways(ctx->device_name, ctx->ifindex);
+	ctx->ifindex = 0;
+	ethActionSubmit(&ctx->actions, ETHSTATEDOWN);
+}
 
-		LOG_INFO("Verifica connettività Internet verso %s...\n", internet_server);
-		do
-		{
-			ping_result = ethPingServer(internet_server);
-			if (ping_result == ETHNOERR)
-			{
-				LOG_INFO("Connettività Internet verificata: server %s raggiungibile.\n", internet_server);
-				break; // Exit loop if successful
-			}
-			else
-			{
-				attempts++;
-				if (attempts < MAX_ATTEMPTS)
-				{
-					LOG_ERROR("Tentativo %d/%d fallito: server %s NON raggiungibile (codice errore: %d). Riprovo tra %d secondi...\n", attempts, MAX_ATTEMPTS, internet_server, ping_result, RETRY_DELAY_SEC);
-					sleep(RETRY_DELAY_SEC);
-				}
-			}
-		} while (attempts < MAX_ATTEMPTS);
+/**
+ * @brief Cerca il device fra le interfacce; se udev ci sta ancora lavorando riprova a breve.
+ *
+ * Con il timer gia` armato la verifica e` solo rimandata: le interfacce che non corrispondono
+ * (veth, bridge dei container) non allungano l'attesa.
+ */
+void wait_for_device(LinkContext* ctx)
+{
+	if (ctx->wait_timer == 0)
+	{
+		on_device_wait(ctx);
+	}
+}
 
-		// --- Check if connectivity was established after retries ---
-		if (ping_result != ETHNOERR)
-		{
-			LOG_ERROR("Server %s irraggiungibile dopo %d tentativi. Riconfigurazione rete in corso...\n", internet_server, MAX_ATTEMPTS);
-			
-			// Reconfigure network from scratch (reset and try DHCP or static based on use_static_config)
-			remove_network_config(device_name); // Reset current config
-			if (use_static_config)
-			{
-				apply_static_config(device_name, static_config); // Try static config again
-			}
-			else
-			{
-				apply_dhcp_config(device_name);     // Try to reconfigure with DHCP
-			}
+/**
+ * @brief Timer dell'attesa: il device va preso solo a regole udev finite (rinomina, ID_PATH).
+ */
+void on_device_wait(void* data)
+{
+	LinkContext* ctx = (LinkContext*)data;
+	t_iface* iface;
+
+	ctx->wait_timer = 0;
+	if (ctx->ifindex != 0)
+	{
+		return;
+	}
+	iface = ethHotplugFind(&iface_table, &device_match);
+	if (iface == NULL)
+	{
+		// Niente da attendere: il prossimo evento di un'interfaccia nuova o rinominata riprova
+		ctx->wait_matched = false;
+		return;
+	}
+	// L'attesa delle regole udev conta dalla prima volta che il device corrisponde
+	if (!ctx->wait_matched)
+	{
+		ctx->wait_since = evLoopNowMs();
+		ctx->wait_matched = true;
+	}
+	// Senza udev nessuno rinomina o completa l'interfaccia: ethHotplugUdevDone e` subito vero
+	if (ethHotplugUdevDone(iface->ifindex) || evLoopNowMs() - ctx->wait_since >= HOTPLUG_UDEV_MAX_MSECS)
+	{
+		ctx->wait_matched = false;
+		attach_device(ctx, iface, true);
+		return;
+	}
+	ctx->wait_timer = evLoopAddTimer(ctx->loop, HOTPLUG_UDEV_POLL_MSECS, on_device_wait, ctx);
+}
 
-			// Perform one final ping check after reconfiguration
-			sleep(RETRY_DELAY_SEC); // Give some time for DHCP to apply or static config to take effect
-			ping_result = ethPingServer(internet_server);
+/**
+ * @brief Rilegge velocita`, duplex, autonegoziazione e lane a ogni cambio di carrier e segnala il link degradato.
+ *
+ * Degradato: sotto LINK_MIN_SPEED o in half duplex. Con LINK_RENEGOTIATE=on si riavvia
+ * l'autonegoziazione una volta; il link che ne risale ripassa di qui.
+ */
+void track_link_mode(LinkContext* ctx, t_iface* iface)
+{
+	const StaticNetConfig* config = &ctx->static_config;
+	t_link_mode* mode = &iface->linkMode;
+	char text[64];
 
-			if (ping_result != ETHNOERR)
-			{
-				LOG_ERROR("Riconfigurazione fallita: server %s ancora irraggiungibile. Termino il programma.\n", internet_server);
-				exit(EXIT_FAILURE); // Terminate the program if still unreachable
-			}
-			else
-			{
-				LOG_INFO("Riconfigurazione riuscita: server %s ora raggiungibile.\n", internet_server);
-			}
+	if (iface->model.linkStatus != ETHSTATEUP || ethBackend()->linkMode(ctx->device_name, mode) != ETHNOERR)
+	{
+		mode->speed = mode->duplex = mode->autoneg = mode->lanes = NIC_UNSET;
+	}
+	ethNicLinkModeFormat(mode, text, sizeof(text));
+	ethDbusSetInt(&dbus_if, "LinkSpeed", mode->speed);
+	ethDbusSetString(&dbus_if, "LinkDuplex", mode->duplex == NIC_UNSET ? "unknown" : (mode->duplex ? "full" : "half"));
+	ethDbusSetInt(&dbus_if, "LinkAutoneg", mode->autoneg);
+	ethDbusSetInt(&dbus_if, "LinkLanes", mode->lanes);
+	if (iface->model.linkStatus != ETHSTATEUP || mode->speed == NIC_UNSET)
+	{
+		ethDbusSetInt(&dbus_if, "LinkDegraded", 0);
+		return;
+	}
+	bool degraded = config->link_min_speed > 0 &&
+		(mode->speed < config->link_min_speed || mode->duplex == 0);
+	ethDbusSetInt(&dbus_if, "LinkDegraded", degraded);
+	if (!degraded)
+	{
+		LOG_INFO("Link %s: %s", ctx->device_name, text);
+		ctx->renegotiations = 0;
+		return;
+	}
+	LOG_ERROR("Link %s degradato: %s (attesi almeno %d Mb/s full duplex).", ctx->device_name, text, config->link_min_speed);
+	ethDbusEmit(&dbus_if, "LinkDegraded", ctx->device_name, text);
+	if (config->link_renegotiate && mode->autoneg != 0 && ctx->renegotiations < LINK_RENEGOTIATE_MAX)
+	{
+		ctx->renegotiations++;
+		LOG_INFO("Riavvio l'autonegoziazione di %s.", ctx->device_name);
+		if (ethBackend()->linkRenegotiate(ctx->device_name) != ETHNOERR)
+		{
+			LOG_ERROR("Autonegoziazione di %s non riavviata.", ctx->device_name);
 		}
-		// --- End Verification ---
+	}
+}
 
+/**
+ * @brief Avvia il campionamento passivo dei tcp_info dei socket che escono dal device.
+ */
+void start_tcp_monitor(const char* device_name, const StaticNetConfig* config)
+{
+	if (config->tcp_monitor_ms <= 0)
+	{
+		return;
 	}
-	else
+	ethTcpMonInit(&tcp_monitor, device_name);
+	tcp_monitor.intervalMs = config->tcp_monitor_ms;
+	tcp_monitor.maxRttMs = config->tcp_monitor_max_rtt;
+	tcp_monitor.maxRetransPct = config->tcp_monitor_max_retrans;
+	strncpy(tcp_monitor.gateway, config->gateway, sizeof(tcp_monitor.gateway) - 1);
+	tcp_monitor.onSample = on_tcp_sample;
+	tcp_monitor.onChange = on_tcp_quality;
+	if (ethTcpMonStart(&tcp_monitor, event_loop) != ETHNOERR)
 	{
-		LOG_INFO("Link %s: NON ATTIVO (via ethGetLinkStatus).\n", device_name);
-		remove_network_config(device_name);
+		LOG_ERROR("Impossibile avviare il monitor TCP di %s.", device_name);
+		return;
 	}
+	LOG_INFO("Monitor TCP di %s ogni %d ms.", device_name, config->tcp_monitor_ms);
 }
 
 /**
- * @brief Esegue i comandi per impostare una configurazione statica.
+ * @brief Aggregati dell'ultimo campione TCP nelle proprieta` D-Bus.
  */
-void apply_static_config(const char* device_name, const StaticNetConfig* config)
+void on_tcp_sample(t_tcpmon* mon, void* data)
 {
-	char command[1024];
+	ethDbusSetInt(&dbus_if, "TcpSockets", mon->device.sockets);
+	ethDbusSetDouble(&dbus_if, "TcpSrttMs", mon->device.srttMs);
+	ethDbusSetDouble(&dbus_if, "TcpRetransPct", mon->device.retransPct);
+	ethDbusSetInt(&dbus_if, "TcpDeliveryRate", (long long)mon->device.deliveryRate);
+	ethDbusSetString(&dbus_if, "TcpGateway", mon->gateway);
+	ethDbusSetInt(&dbus_if, "TcpGatewaySockets", mon->viaGateway.sockets);
+	ethDbusSetDouble(&dbus_if, "TcpGatewaySrttMs", mon->viaGateway.srttMs);
+	ethDbusSetDouble(&dbus_if, "TcpGatewayRetransPct", mon->viaGateway.retransPct);
+	ethDbusSetInt(&dbus_if, "TcpGatewayDeliveryRate", (long long)mon->viaGateway.deliveryRate);
+	ethDbusSetInt(&dbus_if, "TcpQualityDegraded", mon->degraded);
+}
 
-	LOG_INFO("Applico configurazione statica a %s...\n", device_name);
+/**
+ * @brief Cambio della qualita` TCP: log e segnale QualityDegraded/QualityRestored.
+ */
+void on_tcp_quality(t_tcpmon* mon, void* data)
+{
+	char detail[128];
 
-	// 1. Assicurati che l'interfaccia sia 'up'
-	snprintf(command, sizeof(command), "ip link set %s up", device_name);
-	LOG_INFO("CMD: %s\n", command);
-	system(command);
+	snprintf(detail, sizeof(detail), "srtt %.1f ms, ritrasmissioni %.2f%%, %d socket", mon->device.srttMs, mon->device.retransPct, mon->device.sockets);
+	if (mon->degraded)
+	{
+		LOG_ERROR("Qualità TCP di %s degradata: %s.", mon->deviceName, detail);
+	}
+	else
+	{
+		LOG_INFO("Qualità TCP di %s tornata normale: %s.", mon->deviceName, detail);
+	}
+	ethDbusEmit(&dbus_if, mon->degraded ? "QualityDegraded" : "QualityRestored", mon->deviceName, detail);
+	ethDbusSetInt(&dbus_if, "TcpQualityDegraded", mon->degraded);
+}
 
-	// 2. Assegna indirizzo IP e netmask
-	snprintf(command, sizeof(command), "ip addr add %s/%s dev %s", config->ip_addr, config->netmask, device_name);
-	LOG_INFO("CMD: %s\n", command);
-	system(command);
+/**
+ * @brief Avvia il campionamento del traffico del device e delle interfacce di STATS_IFACES.
+ */
+void start_traffic_stats(const char* device_name, const StaticNetConfig* config)
+{
+	char list[MAX_LINE_LEN];
+	char* save = NULL;
+	char* name;
 
-	// 3. Imposta il gateway di default
-	if (strlen(config->gateway) > 0)
+	if (config->stats_interval_ms <= 0)
 	{
-		snprintf(command, sizeof(command), "ip route add default via %s", config->gateway);
-		LOG_INFO("CMD: %s\n", command);
-		system(command);
+		return;
 	}
-
-	// 4. Imposta i DNS
-	if (strlen(config->dns1) > 0)
+	ethIfStatsInit(&traffic_stats);
+	traffic_stats.intervalMs = config->stats_interval_ms;
+	traffic_stats.onSample = on_traffic_sample;
+	traffic_stats.cbData = (void*)device_name;
+	ethIfStatsAdd(&traffic_stats, device_name);
+	strncpy(list, config->stats_ifaces, sizeof(list) - 1);
+	list[sizeof(list) - 1] = '\0';
+	for (name = strtok_r(list, " ,", &save); name != NULL; name = strtok_r(NULL, " ,", &save))
 	{
-		FILE* resolv_conf = fopen("/etc/resolv.conf", "w");
-		if (resolv_conf)
+		if (strcmp(name, "all") == 0)
 		{
-			LOG_INFO("Scrivo /etc/resolv.conf...\n");
-			fprintf(resolv_conf, "nameserver %s\n", config->dns1);
-			if (strlen(config->dns2) > 0)
-			{
-				fprintf(resolv_conf, "nameserver %s\n", config->dns2);
-			}
-			fclose(resolv_conf);
+			traffic_stats.all = 1;
 		}
-		else
+		else if (ethIfStatsAdd(&traffic_stats, name) != ETHNOERR)
 		{
-			LOG_ERROR("Impossibile aprire /etc/resolv.conf per scrivere i DNS.\n");
+			LOG_ERROR("STATS_IFACES: '%s' ignorata.", name);
 		}
 	}
+	if (ethIfStatsStart(&traffic_stats, event_loop) != ETHNOERR)
+	{
+		LOG_ERROR("Impossibile avviare il campionamento del traffico.");
+		return;
+	}
+	LOG_INFO("Traffico di %s%s ogni %d ms.", traffic_stats.all ? "tutte le interfacce" : device_name, traffic_stats.all || traffic_stats.nEntries == 1 ? "" : " e altre interfacce", config->stats_interval_ms);
 }
 
 /**
- * @brief Lancia dhclient sull'interfaccia.
+ * @brief Rate correnti del device nelle proprieta` D-Bus; la storia si legge con GetTrafficHistory.
  */
-void apply_dhcp_config(const char* device_name)
+void on_traffic_sample(t_ifstats* stats, void* data)
 {
-	char command[128];
-	LOG_INFO("Avvio dhclient su %s...\n", device_name);
-	snprintf(command, sizeof(command), "dhclient %s", device_name);
-	system(command);
-	// NOTE: Should potentially wait for DHCP to succeed or add a check.
-	// For now, assuming it will be handled by subsequent link status checks.
+	const t_ifstats_rate* r = ethIfStatsRate(ethIfStatsFind(stats, (const char*)data), 0);
+
+	if (r == NULL)
+	{
+		return;
+	}
+	ethDbusSetDouble(&dbus_if, "TrafficRxBps", r->rxBps);
+	ethDbusSetDouble(&dbus_if, "TrafficTxBps", r->txBps);
+	ethDbusSetDouble(&dbus_if, "TrafficRxPps", r->rxPps);
+	ethDbusSetDouble(&dbus_if, "TrafficTxPps", r->txPps);
+	ethDbusSetDouble(&dbus_if, "TrafficRxErrors", r->rxErrPs);
+	ethDbusSetDouble(&dbus_if, "TrafficTxErrors", r->txErrPs);
+	ethDbusSetDouble(&dbus_if, "TrafficRxDrops", r->rxDropPs);
+	ethDbusSetDouble(&dbus_if, "TrafficTxDrops", r->txDropPs);
 }
 
 /**
- * @brief Rimuove la configurazione di rete (statica o DHCP).
+ * @brief Accoda un campione di traffico come struttura (xdddddddd) o (sdddddddd).
  */
-void remove_network_config(const char* device_name)
+static bool append_traffic_rate(DBusMessageIter* array, const char* name, const t_ifstats_rate* r)
 {
-	char command[128];
-	LOG_INFO("Rimuovo configurazione di rete da %s...\n", device_name);
+	DBusMessageIter st;
+	dbus_int64_t time_ms = r->timeMs;
+	const double* values[] = { &r->rxBps, &r->txBps, &r->rxPps, &r->txPps, &r->rxErrPs, &r->txErrPs, &r->rxDropPs, &r->txDropPs };
+	bool ok;
+	int i;
 
-	// Termina eventuali processi dhclient per l'interfaccia
-	snprintf(command, sizeof(command), "killall dhclient %s", device_name);
-	system(command); // Silenzioso
-
-	// Rimuove gli indirizzi IP dall'interfaccia
-	snprintf(command, sizeof(command), "ip addr flush dev %s", device_name);
-	LOG_INFO("CMD: %s\n", command);
-	system(command);
+	ok = dbus_message_iter_open_container(array, DBUS_TYPE_STRUCT, NULL, &st);
+	if (ok && name != NULL)
+	{
+		ok = dbus_message_iter_append_basic(&st, DBUS_TYPE_STRING, &name);
+	}
+	else if (ok)
+	{
+		ok = dbus_message_iter_append_basic(&st, DBUS_TYPE_INT64, &time_ms);
+	}
+	for (i = 0; ok && i < 8; i++)
+	{
+		ok = dbus_message_iter_append_basic(&st, DBUS_TYPE_DOUBLE, values[i]);
+	}
+	return ok && dbus_message_iter_close_container(array, &st);
 }
 
-
 /**
- * @brief Esegue il parsing del file di configurazione.
+ * @brief Metodi D-Bus: GetTraffic() -> a(sdddddddd) con l'ultimo campione di ogni interfaccia,
+ * GetTrafficHistory(s device, u count) -> a(xdddddddd) dal piu` recente ("" e` il device gestito).
+ * I valori sono bit/s, pacchetti/s, errori/s e scarti/s in ricezione e trasmissione.
  */
-bool parse_static_config(const char* filename, StaticNetConfig* config)
+DBusMessage* handle_dbus_method(t_ethdbus* bus, DBusMessage* msg, void* data)
 {
-	FILE* fp = fopen(filename, "r");
-	if (!fp) return false;
+	LinkContext* ctx = (LinkContext*)data;
+	const char* device = "";
+	dbus_uint32_t count = 0;
+	DBusMessage* reply;
+	DBusMessageIter iter, array;
+	const t_ifstats_entry* entry;
+	const t_ifstats_rate* r;
+	bool history = dbus_message_is_method_call(msg, bus->interfaceName, "GetTrafficHistory");
+	bool ok;
+	int i;
 
-	char line[MAX_LINE_LEN];
-	while (fgets(line, sizeof(line), fp))
+	if (!history && !dbus_message_is_method_call(msg, bus->interfaceName, "GetTraffic"))
 	{
-		line[strcspn(line, "\n")] = 0;
-
-		char* key = strtok(line, "=");
-		char* value = strtok(NULL, "");
-
+		return NULL;
+	}
+	if (traffic_stats.loop == NULL)
+	{
+		return dbus_message_new_error(msg, DBUS_ERROR_NOT_SUPPORTED, "STATS_INTERVAL non configurato");
+	}
+	if (history)
+	{
+		if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &device, DBUS_TYPE_UINT32, &count, DBUS_TYPE_INVALID))
+		{
+			return dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS, "Expected (su)");
+		}
+		entry = ethIfStatsFind(&traffic_stats, device[0] != '\0' ? device : ctx->device_name);
+		if (entry == NULL)
+		{
+			return dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS, device);
+		}
+	}
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+	{
+		return NULL;
+	}
+	dbus_message_iter_init_append(reply, &iter);
+	ok = dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, history ? "(xdddddddd)" : "(sdddddddd)", &array);
+	if (history)
+	{
+		for (i = 0; ok && i < (int)count && (r = ethIfStatsRate(entry, i)) != NULL; i++)
+		{
+			ok = append_traffic_rate(&array, NULL, r);
+		}
+	}
+	else
+	{
+		for (i = 0; ok && i < traffic_stats.nEntries; i++)
+		{
+			entry = &traffic_stats.entry[i];
+			if ((r = ethIfStatsRate(entry, 0)) != NULL)
+			{
+				ok = append_traffic_rate(&array, entry->name, r);
+			}
+		}
+	}
+	ok = ok && dbus_message_iter_close_container(&iter, &array);
+	if (!ok)
+	{
+		dbus_message_unref(reply);
+		return NULL;
+	}
+	return reply;
+}
+
+/**
+ * @brief Avvia le query di prova periodiche verso DNS1 e DNS2 per ordinarli per latenza.
+ */
+void start_dns_monitor(LinkContext* ctx)
+{
+	const StaticNetConfig* config = &ctx->static_config;
+
+	if (config->dns_monitor_ms <= 0 || strlen(config->dns1) == 0)
+	{
+		return;
+	}
+	ethDnsMonInit(&dns_monitor);
+	dns_monitor.intervalMs = config->dns_monitor_ms;
+	if (strlen(config->dns_monitor_name) > 0)
+	{
+		strncpy(dns_monitor.name, config->dns_monitor_name, sizeof(dns_monitor.name) - 1);
+	}
+	if (ethDnsMonAdd(&dns_monitor, config->dns1) != ETHNOERR || (strlen(config->dns2) > 0 && ethDnsMonAdd(&dns_monitor, config->dns2) != ETHNOERR))
+	{
+		LOG_ERROR("DNS non validi: la classifica dei nameserver resta spenta.");
+		return;
+	}
+	dns_monitor.onRound = on_dns_round;
+	dns_monitor.onReorder = on_dns_reorder;
+	dns_monitor.cbData = ctx;
+	if (ethDnsMonStart(&dns_monitor, event_loop) != ETHNOERR)
+	{
+		LOG_ERROR("Impossibile avviare la classifica dei nameserver.");
+		return;
+	}
+	LOG_INFO("Latenza dei nameserver ogni %d ms.", config->dns_monitor_ms);
+}
+
+/**
+ * @brief Scrive resolv.conf: nell'ordine della classifica se attiva, altrimenti DNS1 e poi DNS2.
+ */
+void write_resolver(const StaticNetConfig* config)
+{
+	const char* first = config->dns1;
+	const char* second = config->dns2;
+
+	if (dns_monitor.loop != NULL)
+	{
+		first = dns_monitor.server[dns_monitor.order[0]].address;
+		second = dns_monitor.nServers > 1 ? dns_monitor.server[dns_monitor.order[1]].address : "";
+	}
+	if (ethBackend()->writeResolver(first, second) != ETHNOERR)
+	{
+		LOG_ERROR("Impossibile aprire /etc/resolv.conf per scrivere i DNS.\n");
+	}
+}
+
+/**
+ * @brief Fine di un giro di query: ordine e primo nameserver nelle proprieta` D-Bus.
+ */
+void on_dns_round(t_dnsmon* mon, void* data)
+{
+	const t_dnsmon_server* first = &mon->server[mon->order[0]];
+	char order[ETHDBUS_PROP_STR_LEN];
+	int i, len = 0;
+
+	order[0] = '\0';
+	for (i = 0; i < mon->nServers && len < (int)sizeof(order); i++)
+	{
+		len += snprintf(order + len, sizeof(order) - len, "%s%s", i > 0 ? " " : "", mon->server[mon->order[i]].address);
+	}
+	ethDbusSetString(&dbus_if, "DnsOrder", order);
+	ethDbusSetDouble(&dbus_if, "DnsLatencyMs", first->latencyMs);
+	ethDbusSetDouble(&dbus_if, "DnsFailurePct", first->failRate * 100);
+}
+
+/**
+ * @brief Un nameserver e` stabilmente piu` veloce del primo: riscrive resolv.conf e lo segnala.
+ */
+void on_dns_reorder(t_dnsmon* mon, void* data)
+{
+	LinkContext* ctx = (LinkContext*)data;
+	const t_dnsmon_server* first = &mon->server[mon->order[0]];
+	char detail[128];
+
+	snprintf(detail, sizeof(detail), "%s: %.1f ms, %.0f%% query perse", first->address, first->latencyMs, first->failRate * 100);
+	LOG_INFO("Nameserver riordinati, primo %s.", detail);
+	write_resolver(&ctx->static_config);
+	ethDbusEmit(&dbus_if, "NameserversReordered", ctx->device_name, detail);
+}
+
+/**
+ * @brief Azione della coda del device: porta il device nello stato del link richiesto per ultimo.
+ */
+void on_link_action(t_action_queue* actions, int target, void* data)
+{
+	LinkContext* ctx = (LinkContext*)data;
+	long long start = ETHUSDT_NOW(link__change__done);
+	bool adopt = target == LINK_ADOPT;
+
+	if (adopt)
+	{
+		// Nella traccia va lo stato del link: il replay non riprende configurazioni
+		target = is_link_up(ctx->device_name) ? ETHSTATEUP : ETHSTATEDOWN;
+	}
+	replay_stats.actions++;
+	trace_decision(ETHTRACE_ACTION, &target, sizeof(target));
+	LOG_INFO("Link %s: gestione dello stato %s.", ctx->device_name, target == ETHSTATEUP ? "ATTIVO" : "NON ATTIVO");
+	ETHUSDT2(link__change__start, ctx->device_name, target);
+	if (!adopt || (!adopt_existing_state(ctx) && !ethActionSuperseded(actions)))
+	{
+		handle_link_change(ctx->device_name, ctx->use_static_config, &ctx->static_config, actions);
+	}
+	ETHUSDT4(link__change__done, ctx->device_name, target, ethActionSuperseded(actions), ETHUSDT_SINCE(link__change__done, start));
+	if (ethActionSuperseded(actions))
+	{
+		LOG_INFO("Link %s cambiato di nuovo: operazione interrotta, si riparte dallo stato attuale.", ctx->device_name);
+	}
+	else if (ctx->ifindex == 0)
+	{
+		publish_state(ctx->device_name, "unavailable");
+	}
+}
+
+/**
+ * @brief Controlla lo stato del link: dalla tabella interfacce, o dal backend (carrier di sysfs) se il device non c'e`.
+ */
+bool is_link_up(const char* device_name)
+{
+	const t_iface* iface = ethIfTableLookupName(&iface_table, device_name);
+	if (iface != NULL)
+	{
+		return iface->model.linkStatus == ETHSTATEUP;
+	}
+
+	return ethBackend()->linkStatus(device_name) == ETHSTATEUP;
+}
+
+/**
+ * @brief Gestisce il cambiamento di stato del link, verifica la connettività internet con ritentativi e riconfigurazione.
+ */
+void handle_link_change(const char* device_name, bool use_static_config, const StaticNetConfig* static_config, t_action_queue* actions)
+{
+	// Rientro sulla stessa rete: il gateway noto risponde, si tiene tutto com'e`.
+	if (dna_fast_path(device_name))
+	{
+		// Forse su un'altra porta dello switch: si riannuncia l'indirizzo
+		if (use_static_config && !static_config->no_arp_announce)
+		{
+			announce_address(device_name, static_config->ip_addr);
+		}
+		publish_state(device_name, "connected");
+		return;
+	}
+
+	// Breve attesa per stabilizzazione: un nuovo evento del link la interrompe
+	if (ethActionWait(actions, 1000))
+	{
+		return;
+	}
+
+	// Stato del link dalla tabella interfacce, aggiornata dagli eventi netlink
+	if (is_link_up(device_name))
+	{
+		LOG_INFO("Link %s: ATTIVO.", device_name);
+		publish_state(device_name, "configuring");
+
+		// --- Keep existing logic for applying config for now ---
+		// NOTE: This part could ideally be refactored to use ethConnect,
+		// but that's a more complex change. For now, we keep the custom apply functions.
+		apply_link_mtu(device_name, static_config);
+		if (use_static_config)
+		{
+			apply_static_config(device_name, static_config);
+		}
+		else
+		{
+			apply_dhcp_config(device_name);
+		}
+		// --- End keeping existing logic ---
+		apply_nic_profile(device_name, static_config);
+		// Dopo il profilo: NIC_CHANNELS cambia il numero di code
+		apply_queue_mapping(device_name, static_config);
+		apply_qdisc(device_name, static_config);
+		if (ethActionSuperseded(actions))
+		{
+			return;
+		}
+		if (!use_static_config && wait_dhcp_lease(device_name, actions))
+		{
+			return;
+		}
+
+		// --- Verifica a strati: link, gateway (ARP), upstream (probe in parallelo) ---
+		const char* gateways[ETHROUTE_MAX_NEXTHOPS];
+		int num_gateways = use_static_config ? static_config->num_gateways : 0; // 0: gateway appreso
+		t_health_report report;
+		int attempts = 0;
+		int local_attempts = 0;
+		const int MAX_ATTEMPTS = 10;
+		const int RETRY_DELAY_SEC = 10;
+		const int MAX_LOCAL_ATTEMPTS = 3;
+		const int LOCAL_RETRY_MS = 500;
+		const long MAX_GATEWAY_BACKOFF_MS = 300000L;
+		long gateway_backoff_ms = 0;
+
+		for (int i = 0; i < num_gateways; i++)
+		{
+			gateways[i] = static_config->gateways[i];
+		}
+
+		LOG_INFO("Verifica connettività di %s (gateway, poi upstream)...", device_name);
+		while (1)
+		{
+			if (ethActionSuperseded(actions))
+			{
+				return;
+			}
+			run_health_check(device_name, gateways, num_gateways, static_config, actions, &report);
+			if (report.failed == HEALTH_OK)
+			{
+				LOG_INFO("Connettività verificata: gateway %s (%ld ms), probe '%s' riuscito in %ld ms.", report.gateway, report.gatewayMs, report.upstream, report.upstreamMs);
+				publish_state(device_name, "connected");
+				break;
+			}
+			if (report.failed == HEALTH_LINK_FAIL)
+			{
+				// Il link-down arrivera` come evento e verra` gestito li`
+				LOG_INFO("Link %s perso durante la verifica.", device_name);
+				return;
+			}
+			if (report.failed == HEALTH_GATEWAY_FAIL)
+			{
+				if (local_attempts >= MAX_LOCAL_ATTEMPTS)
+				{
+					// Riconfigurare non basta (gateway spento, switch giu`): si tiene la configurazione
+					// e si riverifica a intervalli crescenti, finche` il gateway torna o il link cambia
+					if (gateway_backoff_ms == 0)
+					{
+						LOG_ERROR("Gateway '%s' irraggiungibile dopo %d riconfigurazioni: configurazione mantenuta.", report.gateway, MAX_LOCAL_ATTEMPTS);
+						publish_state(device_name, "limited");
+						gateway_backoff_ms = RETRY_DELAY_SEC * 1000L;
+					}
+					LOG_ERROR("Gateway '%s' ancora irraggiungibile. Riprovo tra %ld secondi...", report.gateway, gateway_backoff_ms / 1000);
+					if (ethActionWait(actions, gateway_backoff_ms))
+					{
+						return;
+					}
+					gateway_backoff_ms = gateway_backoff_ms * 2 > MAX_GATEWAY_BACKOFF_MS ? MAX_GATEWAY_BACKOFF_MS : gateway_backoff_ms * 2;
+					continue;
+				}
+				// Guasto locale: si rimedia subito, senza attendere
+				local_attempts++;
+				LOG_ERROR("Gateway '%s' non risponde via ARP (tentativo %d/%d): riconfigurazione locale di %s.", report.gateway, local_attempts, MAX_LOCAL_ATTEMPTS, device_name);
+				remove_network_config(device_name);
+				if (use_static_config)
+				{
+					apply_static_config(device_name, static_config);
+				}
+				else
+				{
+					apply_dhcp_config(device_name);
+					if (wait_dhcp_lease(device_name, actions))
+					{
+						return;
+					}
+				}
+				if (ethActionWait(actions, LOCAL_RETRY_MS))
+				{
+					return;
+				}
+				continue;
+			}
+
+			// HEALTH_UPSTREAM_FAIL: la rete locale e` sana, resettare l'interfaccia non serve
+			if (++attempts >= MAX_ATTEMPTS)
+			{
+				LOG_ERROR("Upstream irraggiungibili dopo %d tentativi: guasto WAN, configurazione locale mantenuta.", MAX_ATTEMPTS);
+				publish_state(device_name, "limited");
+				break;
+			}
+			if (report.portal)
+			{
+				LOG_ERROR("Probe HTTP intercettato: probabile captive portal dietro %s.", report.gateway);
+			}
+			LOG_ERROR("Tentativo %d/%d: gateway %s raggiungibile, upstream NON raggiungibili. Riprovo tra %d secondi...", attempts, MAX_ATTEMPTS, report.gateway, RETRY_DELAY_SEC);
+			if (ethActionWait(actions, RETRY_DELAY_SEC * 1000L))
+			{
+				return;
+			}
+		}
+		// --- End Verification ---
+
+		// Con dhclient la default route arriva con il lease: le metriche solo ora
+		if (!use_static_config)
+		{
+			apply_route_tuning(device_name, static_config);
+		}
+		// Frame grandi: meglio scoprire ora uno switch senza jumbo che a traffico perso
+		verify_path_mtu(device_name, report.gateway, static_config, actions);
+		if (ethActionSuperseded(actions))
+		{
+			return;
+		}
+		size_tcp_buffers(device_name, &report, static_config);
+		strncpy(tcp_monitor.gateway, report.gateway, sizeof(tcp_monitor.gateway) - 1);
+
+		// Il gateway risponde: memorizzalo per il prossimo link-up e per un riavvio del demone
+		dna_learn(device_name, &report);
+		save_state(device_name, use_static_config, static_config, &report);
+
+	}
+	else
+	{
+		LOG_INFO("Link %s: NON ATTIVO.\n", device_name);
+		publish_state(device_name, "disconnected");
+		if (dna_enabled && dna_lookup(device_name) != NULL)
+		{
+			// Lease e indirizzi restano: al link-up il gateway noto dira` se valgono ancora
+			LOG_INFO("Configurazione di %s mantenuta in attesa del link-up.\n", device_name);
+		}
+		else
+		{
+			remove_network_config(device_name);
+		}
+	}
+}
+
+/**
+ * @brief Cerca il gateway memorizzato per il device (NULL se sconosciuto).
+ */
+DnaEntry* dna_lookup(const char* device_name)
+{
+	for (int i = 0; i < DNA_MAX_IFACES; i++)
+	{
+		if (dna_table[i].valid && strcmp(dna_table[i].device_name, device_name) == 0)
+		{
+			return &dna_table[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Fast path al link-up (RFC 4436): ARP unicast verso il MAC del gateway
+ * memorizzato. Se risponde lo stesso gateway la rete e` la stessa e la
+ * configurazione corrente (lease DHCP compreso) resta valida.
+ */
+bool dna_fast_path(const char* device_name)
+{
+	DnaEntry* entry;
+	DnaProbe probe;
+	char mac_str[MACADDRESS_LEN];
+
+	if (!dna_enabled || (entry = dna_lookup(device_name)) == NULL || !is_link_up(device_name))
+	{
+		return false;
+	}
+
+	ethArpMacToString(entry->gateway_mac, mac_str);
+	memset(&probe, 0, sizeof(probe));
+	probe.rval = ethBackend()->arpProbe(device_name, entry->gateway, entry->gateway_mac, probe.reply_mac, DNA_TIMEOUT_MS);
+	ethTraceRecord(ETHTRACE_ARP, &probe, sizeof(probe));
+	if (probe.rval == ETHNOERR && memcmp(probe.reply_mac, entry->gateway_mac, ETHARP_HWADDR_LEN) == 0)
+	{
+		LOG_INFO("Link %s: ATTIVO sulla stessa rete (gateway %s [%s]). Configurazione mantenuta.", device_name, entry->gateway, mac_str);
+		return true;
+	}
+
+	// Rete diversa (o gateway muto): la vecchia configurazione non vale piu`
+	LOG_INFO("Link %s: gateway %s [%s] non risponde. Riconfigurazione completa.", device_name, entry->gateway, mac_str);
+	dna_forget(device_name);
+	remove_network_config(device_name);
+	return false;
+}
+
+/**
+ * @brief Memorizza IP e MAC del gateway verificati dal controllo di connettività.
+ */
+void dna_learn(const char* device_name, const t_health_report* report)
+{
+	char mac_str[MACADDRESS_LEN];
+	DnaEntry* entry;
+
+	if (!dna_enabled)
+	{
+		return;
+	}
+
+	entry = dna_lookup(device_name);
+	for (int i = 0; entry == NULL && i < DNA_MAX_IFACES; i++)
+	{
+		if (!dna_table[i].valid)
+		{
+			entry = &dna_table[i];
+		}
+	}
+	if (entry == NULL)
+	{
+		return;
+	}
+
+	memset(entry, 0, sizeof(DnaEntry));
+	strncpy(entry->device_name, device_name, sizeof(entry->device_name) - 1);
+	strncpy(entry->gateway, report->gateway, sizeof(entry->gateway) - 1);
+	memcpy(entry->gateway_mac, report->gatewayMac, ETHARP_HWADDR_LEN);
+	entry->valid = true;
+
+	ethArpMacToString(entry->gateway_mac, mac_str);
+	LOG_INFO("Gateway di %s memorizzato: %s [%s].", device_name, entry->gateway, mac_str);
+}
+
+/**
+ * @brief Dimentica il gateway memorizzato per il device.
+ */
+void dna_forget(const char* device_name)
+{
+	DnaEntry* entry = dna_lookup(device_name);
+	if (entry != NULL)
+	{
+		entry->valid = false;
+	}
+}
+
+/**
+ * @brief Esegue i comandi per impostare una configurazione statica.
+ */
+void apply_static_config(const char* device_name, const StaticNetConfig* config)
+{
+	char command[1024];
+	long long start = ETHUSDT_NOW(config__apply__done);
+
+	LOG_INFO("Applico configurazione statica a %s...\n", device_name);
+	ETHUSDT2(config__apply__start, device_name, 1);
+
+	// 1. Assicurati che l'interfaccia sia 'up'
+	snprintf(command, sizeof(command), "ip link set %s up", device_name);
+	LOG_INFO("CMD: %s\n", command);
+	run_command(command);
+
+	// 2. Assegna indirizzo IP e netmask
+	snprintf(command, sizeof(command), "ip addr add %s/%s dev %s", config->ip_addr, config->netmask, device_name);
+	LOG_INFO("CMD: %s\n", command);
+	run_command(command);
+
+	// 3. Imposta il gateway di default
+	if (config->num_gateways > 1)
+	{
+		start_ecmp(device_name, config);
+	}
+	else if (strlen(config->gateway) > 0)
+	{
+		snprintf(command, sizeof(command), "ip route add default via %s", config->gateway);
+		LOG_INFO("CMD: %s\n", command);
+		if (!ethBackend()->real)
+		{
+			replay_stats.commands++;
+		}
+		ethBackend()->defaultRoute(device_name, config->gateway);
+	}
+	apply_route_tuning(device_name, config);
+
+	// 4. Imposta i DNS
+	if (strlen(config->dns1) > 0)
+	{
+		LOG_INFO("Scrivo /etc/resolv.conf...\n");
+		if (!ethBackend()->real)
+		{
+			replay_stats.commands++;
+		}
+		write_resolver(config);
+	}
+
+	// 5. Annuncia l'indirizzo e prepara i vicini: il primo pacchetto non attende l'ARP
+	if (!config->no_arp_announce)
+	{
+		announce_address(device_name, config->ip_addr);
+	}
+	warm_neighbors(device_name, config);
+	ETHUSDT3(config__apply__done, device_name, 1, ETHUSDT_SINCE(config__apply__done, start));
+}
+
+/**
+ * @brief Piu` gateway: un'unica route multipath, sorvegliata nexthop per nexthop.
+ */
+void start_ecmp(const char* device_name, const StaticNetConfig* config)
+{
+	if (!ethBackend()->real)
+	{
+		replay_stats.commands++;
+		return;
+	}
+	ethEcmpStop(&ecmp);
+	ethEcmpInit(&ecmp, 0);
+	ecmp.metrics = config->route_metrics;
+	for (int i = 0; i < config->num_gateways; i++)
+	{
+		ethEcmpAddGateway(&ecmp, device_name, config->gateways[i], config->gateway_weights[i]);
+		LOG_INFO("ECMP nexthop %s peso %d\n", config->gateways[i], config->gateway_weights[i]);
+	}
+	// NLM_F_REPLACE: se la route c'e` gia` identica il traffico non se ne accorge
+	if (ethEcmpStart(&ecmp, event_loop) != ETHNOERR)
+	{
+		LOG_ERROR("Impossibile installare la default route ECMP su %s.\n", device_name);
+	}
+}
+
+/**
+ * @brief Lancia dhclient sull'interfaccia.
+ */
+void apply_dhcp_config(const char* device_name)
+{
+	long long start = ETHUSDT_NOW(config__apply__done);
+	LOG_INFO("Avvio dhclient su %s...\n", device_name);
+	ETHUSDT2(config__apply__start, device_name, 0);
+	if (!ethBackend()->real)
+	{
+		replay_stats.commands++;
+	}
+	ethBackend()->dhcpStart(device_name);
+	ETHUSDT3(config__apply__done, device_name, 0, ETHUSDT_SINCE(config__apply__done, start));
+}
+
+/**
+ * @brief Attende il lease di dhclient (default route sul device) servendo l'event loop.
+ *
+ * Il backend simulato ritorna gia` con il lease. Restituisce true se l'azione va interrotta;
+ * senza lease entro DHCP_LEASE_TIMEOUT_MS decide la verifica del gateway.
+ */
+bool wait_dhcp_lease(const char* device_name, t_action_queue* actions)
+{
+	char gateway[GATEWAY_LEN];
+
+	if (!ethBackend()->real)
+	{
+		return false;
+	}
+	for (long waited = 0; waited < DHCP_LEASE_TIMEOUT_MS; waited += DHCP_LEASE_POLL_MS)
+	{
+		if (ethBackend()->readAttr(device_name, ETHATTR_GATEWAY, gateway, sizeof(gateway)) == ETHNOERR && gateway[0] != '\0')
+		{
+			LOG_INFO("Lease DHCP su %s dopo %ld ms, gateway %s.", device_name, waited, gateway);
+			return false;
+		}
+		if (ethActionWait(actions, DHCP_LEASE_POLL_MS))
+		{
+			return true;
+		}
+	}
+	LOG_ERROR("Nessun lease DHCP su %s dopo %d secondi.", device_name, DHCP_LEASE_TIMEOUT_MS / 1000);
+	return false;
+}
+
+/**
+ * @brief Porta la scheda al profilo NIC_* (ring, coalescing, offload, canali) e riporta i valori effettivi.
+ */
+void apply_nic_profile(const char* device_name, const StaticNetConfig* config)
+{
+	t_nic_profile effective;
+	char report[256];
+
+	if (ethNicProfileEmpty(&config->nic))
+	{
+		return;
+	}
+	// Si scrive solo cio` che differisce: di nuovo allo stesso link-up non cambia niente
+	int rval = ethBackend()->nicApply(device_name, &config->nic, &effective);
+	ethNicFormat(&effective, report, sizeof(report));
+	if (rval == ETHNOERR)
+	{
+		LOG_INFO("Profilo NIC di %s: %s", device_name, report);
+	}
+	else
+	{
+		LOG_ERROR("Profilo NIC di %s applicato solo in parte (valori effettivi: %s).", device_name, report);
+	}
+}
+
+/**
+ * @brief Distribuisce IRQ, RPS/XPS, flow limit e RSS della scheda sui core di QUEUE_CPUS.
+ */
+void apply_queue_mapping(const char* device_name, const StaticNetConfig* config)
+{
+	t_queue_report report;
+	char cpus[128];
+
+	if (!config->queue_mapping)
+	{
+		return;
+	}
+	// Scritture idempotenti: ad ogni link-up si ripristina la mappatura
+	int rval = ethBackend()->queueApply(device_name, &config->queue_cpus, &report);
+	if (rval != ETHNOERR)
+	{
+		LOG_ERROR("Mappatura delle code di %s non applicata (%d).", device_name, rval);
+		return;
+	}
+	ethQueueFormatCpus(&report.cpus, cpus, sizeof(cpus));
+	LOG_INFO("Code di %s: %d RX, %d TX, %d IRQ sui core %s (nodo NUMA %d), RPS %s, RSS %d voci%s",
+		device_name, report.nRx, report.nTx, report.nIrqs, cpus, report.numaNode,
+		report.rps ? "attivo" : "spento", report.rssEntries,
+		report.errors > 0 ? ", alcune scritture rifiutate" : "");
+}
+
+/**
+ * @brief Primo dei ETHARP_ANNOUNCE_NUM ARP gratuiti (RFC 5227): aggiorna le cache ARP dei vicini.
+ *
+ * I successivi partono da un timer ogni ETHARP_ANNOUNCE_MSECS, senza fermare la configurazione.
+ */
+void announce_address(const char* device_name, const char* address)
+{
+	if (event_loop != NULL && arp_announce.timer > 0)
+	{
+		evLoopDelTimer(event_loop, arp_announce.timer);
+	}
+	memset(&arp_announce, 0, sizeof(arp_announce));
+	strncpy(arp_announce.device_name, device_name, sizeof(arp_announce.device_name) - 1);
+	strncpy(arp_announce.address, address, sizeof(arp_announce.address) - 1);
+	arp_announce.remaining = ETHARP_ANNOUNCE_NUM;
+	on_arp_announce(&arp_announce);
+}
+
+void on_arp_announce(void* data)
+{
+	ArpAnnounce* a = (ArpAnnounce*)data;
+
+	a->timer = 0;
+	if (ethBackend()->arpAnnounce(a->device_name, a->address) != ETHNOERR)
+	{
+		LOG_ERROR("Annuncio ARP di %s su %s non inviato.", a->address, a->device_name);
+		return;
+	}
+	if (--a->remaining > 0 && event_loop != NULL)
+	{
+		a->timer = evLoopAddTimer(event_loop, ETHARP_ANNOUNCE_MSECS, on_arp_announce, a);
+	}
+}
+
+/**
+ * @brief Risolve in parallelo gateway e DNS sulla subnet e li scrive nella tabella dei vicini.
+ *
+ * Il gateway puo` essere fissato come voce permanente (NEIGH_PIN_GATEWAY=on), ripresa ad ogni link-up.
+ */
+void warm_neighbors(const char* device_name, const StaticNetConfig* config)
+{
+	const char* targets[ETHARP_RESOLVE_MAX];
+	unsigned char macs[ETHARP_RESOLVE_MAX][ETHARP_HWADDR_LEN];
+	int resolved[ETHARP_RESOLVE_MAX];
+	int num_gateways = 0;
+	int num_targets = 0;
+	struct in_addr local, addr;
+	char mac[18];
+
+	// Opzione tolta (anche fra un riavvio e l'altro): le voci permanenti rimaste non valgono piu`
+	if (!config->neigh_pin_gateway)
+	{
+		unpin_gateways(device_name, 0);
+	}
+	if (config->no_neigh_preresolve && !config->neigh_pin_gateway)
+	{
+		return;
+	}
+	for (int i = 0; i < config->num_gateways && num_targets < ETHARP_RESOLVE_MAX; i++)
+	{
+		targets[num_targets++] = config->gateways[i];
+	}
+	num_gateways = num_targets;
+	// I DNS fuori dalla subnet passano dal gateway: niente ARP
+	int prefix = ethStateNetmaskToPrefix(config->netmask);
+	unsigned int mask = prefix > 0 ? htonl(0xffffffffu << (32 - prefix)) : 0;
+	const char* dns[2] = { config->dns1, config->dns2 };
+	for (int i = 0; i < 2 && !config->no_neigh_preresolve && num_targets < ETHARP_RESOLVE_MAX; i++)
+	{
+		if (prefix > 0 && inet_pton(AF_INET, config->ip_addr, &local) == 1 &&
+			inet_pton(AF_INET, dns[i], &addr) == 1 &&
+			(local.s_addr & mask) == (addr.s_addr & mask) && addr.s_addr != local.s_addr)
+		{
+			bool known = false;
+			for (int j = 0; j < num_targets; j++)
+			{
+				known = known || strcmp(targets[j], dns[i]) == 0;
+			}
+			if (!known)
+			{
+				targets[num_targets++] = dns[i];
+			}
+		}
+	}
+	if (num_targets == 0)
+	{
+		return;
+	}
+	int count = ethBackend()->neighResolve(device_name, targets, num_targets, macs, resolved, NEIGH_RESOLVE_MS);
+	if (count < 0)
+	{
+		LOG_ERROR("Impossibile risolvere i vicini di %s (%d).", device_name, count);
+		return;
+	}
+	for (int i = 0; i < num_targets; i++)
+	{
+		if (!resolved[i])
+		{
+			LOG_INFO("Vicino %s di %s non risponde all'ARP.", targets[i], device_name);
+			continue;
+		}
+		bool pin = i < num_gateways && config->neigh_pin_gateway;
+		if (ethBackend()->neighSet(device_name, targets[i], macs[i], pin) != ETHNOERR)
+		{
+			LOG_ERROR("Voce ARP di %s su %s non scritta.", targets[i], device_name);
+			continue;
+		}
+		ethArpMacToString(macs[i], mac);
+		LOG_INFO("Vicino %s di %s: %s%s", targets[i], device_name, mac, pin ? " (permanente)" : "");
+		bool known = !pin;
+		for (int j = 0; j < num_pinned && !known; j++)
+		{
+			known = strcmp(pinned_gateways[j], targets[i]) == 0;
+		}
+		if (!known && num_pinned < ETHROUTE_MAX_NEXTHOPS)
+		{
+			strncpy(pinned_gateways[num_pinned++], targets[i], GATEWAY_LEN - 1);
+		}
+	}
+}
+
+/**
+ * @brief Toglie dalla tabella dei vicini le voci permanenti dei gateway (NEIGH_PIN_GATEWAY=on).
+ *
+ * Oltre a quelle fissate da questa istanza, quelle di un'istanza precedente registrate nello
+ * stato salvato. Con ifindex > 0 il device si cerca per indice: dopo una rinomina le voci
+ * restano sul device con il nome nuovo.
+ */
+void unpin_gateways(const char* device_name, int ifindex)
+{
+	char gateways[2 * ETHROUTE_MAX_NEXTHOPS][GATEWAY_LEN];
+	char current[IF_NAMESIZE];
+	t_persist_state saved;
+	const char* name = device_name;
+	int count = 0;
+
+	for (int i = 0; i < num_pinned; i++)
+	{
+		strncpy(gateways[count++], pinned_gateways[i], GATEWAY_LEN);
+	}
+	num_pinned = 0;
+	if (ethBackend()->real && ethStateLoad(device_name, &saved) == ETHNOERR && saved.neighPinned)
+	{
+		for (int i = 0; i < saved.nGateways; i++)
+		{
+			strncpy(gateways[count++], saved.gateway[i], GATEWAY_LEN);
+		}
+	}
+	if (ifindex > 0 && if_indextoname(ifindex, current) != NULL)
+	{
+		name = current;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		int rval = ethBackend()->neighUnpin(name, gateways[i]);
+		if (rval > 0)
+		{
+			LOG_INFO("Voce permanente del gateway %s rimossa da %s.", gateways[i], name);
+		}
+		else if (rval < 0 && rval != ETHDEVICEERR)
+		{
+			LOG_ERROR("Voce permanente del gateway %s su %s non rimossa (%d).", gateways[i], name, rval);
+		}
+	}
+}
+
+/**
+ * @brief Sostituisce la qdisc di root (QDISC=); rate in percentuale ricavato dalla velocita` negoziata.
+ */
+void apply_qdisc(const char* device_name, const StaticNetConfig* config)
+{
+	const t_qdisc_conf* q = &config->qdisc;
+	char speed[32];
+	int speed_mbps = 0;
+
+	if (q->kind == QDISC_NONE)
+	{
+		return;
+	}
+	if (q->ratePct > 0)
+	{
+		if (ethBackend()->readAttr(device_name, ETHATTR_SPEED, speed, sizeof(speed)) == ETHNOERR)
+		{
+			speed_mbps = atoi(speed);
+		}
+		if (speed_mbps <= 0)
+		{
+			LOG_INFO("Velocità di %s non nota: %s senza limite di rate.", device_name, ethQdiscKindName(q->kind));
+		}
+	}
+	long rate_kbit = ethQdiscRate(q, speed_mbps);
+	// RTM_NEWQDISC con REPLACE: idempotente ad ogni link-up
+	if (ethBackend()->qdiscApply(device_name, q, rate_kbit) != ETHNOERR)
+	{
+		LOG_ERROR("Qdisc %s non applicata a %s: resta quella del kernel.", ethQdiscKindName(q->kind), device_name);
+		return;
+	}
+	if (rate_kbit > 0)
+	{
+		LOG_INFO("Qdisc di %s: %s a %ld kbit/s", device_name, ethQdiscKindName(q->kind), rate_kbit);
+	}
+	else
+	{
+		LOG_INFO("Qdisc di %s: %s", device_name, ethQdiscKindName(q->kind));
+	}
+	ethDbusSetInt(&dbus_if, "QdiscRateKbit", rate_kbit);
+}
+
+/**
+ * @brief Aggiorna le proprieta` D-Bus con i contatori correnti della qdisc di root.
+ */
+void refresh_dbus_properties(t_ethdbus* bus, void* data)
+{
+	LinkContext* ctx = (LinkContext*)data;
+	t_qdisc_stats stats;
+
+	if (ethBackend()->qdiscStats(ctx->device_name, &stats) != ETHNOERR)
+	{
+		return;
+	}
+	ethDbusSetString(bus, "QdiscKind", stats.kind);
+	ethDbusSetInt(bus, "QdiscPackets", (long long)stats.packets);
+	ethDbusSetInt(bus, "QdiscDrops", stats.drops);
+	ethDbusSetInt(bus, "QdiscOverlimits", stats.overlimits);
+	ethDbusSetInt(bus, "QdiscRequeues", stats.requeues);
+	ethDbusSetInt(bus, "QdiscBacklogBytes", stats.backlog);
+	ethDbusSetInt(bus, "QdiscBacklogPackets", stats.qlen);
+}
+
+/**
+ * @brief Imposta l'MTU del device (MTU=) via netlink, prima degli indirizzi.
+ */
+void apply_link_mtu(const char* device_name, const StaticNetConfig* config)
+{
+	if (config->mtu <= 0)
+	{
+		return;
+	}
+	if (ethBackend()->mtuSet(device_name, config->mtu) != ETHNOERR)
+	{
+		LOG_ERROR("MTU %d non accettata da %s: resta quella del driver.", config->mtu, device_name);
+		return;
+	}
+	LOG_INFO("MTU di %s: %d", device_name, config->mtu);
+}
+
+/**
+ * @brief Blocca l'MTU della route verso destination via gateway (NULL: default route e subnet), con le metriche ROUTE_*.
+ */
+void lock_route_mtu(const char* device_name, const char* destination, const char* gateway, const StaticNetConfig* config, int mtu)
+{
+	t_route route;
+	int rval;
+
+	if (!ethBackend()->real)
+	{
+		replay_stats.commands++;
+		return;
+	}
+	if (destination == NULL)
+	{
+		// Le route del device restano le stesse, cambiano solo le metriche
+		route.metrics = config->route_metrics;
+		route.metrics.mtu = mtu;
+		rval = ethRouteTune(device_name, &route.metrics) > 0 ? ETHNOERR : ETHNETLINKERR;
+	}
+	else
+	{
+		rval = ethRouteHostInit(&route, destination, gateway, device_name, 0);
+		route.metrics = config->route_metrics;
+		route.metrics.mtu = mtu;
+		if (rval == ETHNOERR)
+		{
+			rval = ethRouteAdd(&route, 1);
+		}
+	}
+	if (rval != ETHNOERR)
+	{
+		LOG_ERROR("Impossibile bloccare l'MTU %d sulla route verso %s.", mtu, destination != NULL ? destination : "default");
+	}
+}
+
+/**
+ * @brief Applica le metriche ROUTE_* (initcwnd, initrwnd, congestion control, quickack, MTU) a default route e subnet del device.
+ */
+void apply_route_tuning(const char* device_name, const StaticNetConfig* config)
+{
+	char metrics[128];
+
+	if (ethRouteMetricsEmpty(&config->route_metrics))
+	{
+		return;
+	}
+	if (!ethBackend()->real)
+	{
+		replay_stats.commands++;
+		return;
+	}
+	ethRouteMetricsFormat(&config->route_metrics, metrics, sizeof(metrics));
+	int tuned = ethRouteTune(device_name, &config->route_metrics);
+	if (tuned > 0)
+	{
+		LOG_INFO("Route di %s (%d):%s", device_name, tuned, metrics);
+	}
+	else
+	{
+		// Tipicamente ROUTE_CC con un algoritmo non caricato (modprobe tcp_bbr)
+		LOG_ERROR("Metriche%s non applicate alle route di %s.", metrics, device_name);
+	}
+}
+
+/**
+ * @brief Alza i buffer TCP massimi a 2 x BDP, da velocita` del link e RTT misurato dalla verifica.
+ */
+void size_tcp_buffers(const char* device_name, const t_health_report* report, const StaticNetConfig* config)
+{
+	char speed[32];
+	t_tcp_buffers buffers;
+
+	if (!config->tcp_buffers)
+	{
+		return;
+	}
+	long rtt_ms = report->upstreamMs > 0 ? report->upstreamMs : report->gatewayMs;
+	if (ethBackend()->readAttr(device_name, ETHATTR_SPEED, speed, sizeof(speed)) != ETHNOERR || atoi(speed) <= 0)
+	{
+		LOG_INFO("Velocità di %s non nota: buffer TCP invariati.", device_name);
+		return;
+	}
+	// Sotto il millisecondo la misura non ha risoluzione
+	long bdp = ethTcpBdp(atoi(speed), rtt_ms > 0 ? rtt_ms : 1);
+	int rval = ethBackend()->tcpBuffers(bdp, &buffers);
+	if (rval == ETHBADCONFERR)
+	{
+		LOG_ERROR("Impossibile dimensionare i buffer TCP (BDP %ld byte).", bdp);
+		return;
+	}
+	// net.core.* non e` per namespace: in un container puo` non essere scrivibile
+	LOG_INFO("BDP di %s: %s Mb/s x %ld ms = %ld byte; buffer TCP massimi rmem %ld, wmem %ld%s%s", device_name, speed, rtt_ms, bdp, buffers.rmemMax, buffers.wmemMax,
+		buffers.changed > 0 ? " (alzati)" : "", rval != ETHNOERR ? ", alcuni sysctl non scrivibili" : "");
+}
+
+/**
+ * @brief Misura il path MTU verso gateway e probe upstream e blocca sulle route la dimensione piu` grande che passa.
+ */
+void verify_path_mtu(const char* device_name, const char* gateway, const StaticNetConfig* config, const t_action_queue* actions)
+{
+	t_pmtu_result result;
+	char target[INET_ADDRSTRLEN];
+	int route_mtu;
+	int rval;
+
+	if (config->pmtu_probe < 0 || (config->pmtu_probe == 0 && config->mtu <= 0) || strlen(gateway) == 0)
+	{
+		return;
+	}
+
+	// Gateway: se non passa l'MTU del device il segmento locale non porta quei frame
+	rval = probe_path_mtu(device_name, gateway, 0, actions, &result);
+	if (rval == ETHCANCELLED)
+	{
+		return;
+	}
+	if (rval != ETHNOERR)
+	{
+		LOG_INFO("Path MTU verso il gateway %s non verificabile (ICMP filtrato?).", gateway);
+		return;
+	}
+	route_mtu = result.mtu;
+	if (result.mtu < result.maxMtu)
+	{
+		LOG_ERROR("MTU di %s (%d) non supportata fino al gateway %s: passano solo %d byte%s.", device_name, result.maxMtu, gateway, result.mtu,
+			result.blackhole > 0 ? ", i frame piu` grandi vengono scartati senza ICMP (switch o gateway senza jumbo frame?)" : "");
+		if (config->num_gateways > 1)
+		{
+			LOG_ERROR("Default route ECMP: MTU non bloccata, correggere MTU= o la rete.");
+		}
+		else
+		{
+			LOG_INFO("Default route e subnet di %s bloccate a MTU %d.", device_name, result.mtu);
+			lock_route_mtu(device_name, NULL, gateway, config, result.mtu);
+		}
+	}
+	else
+	{
+		LOG_INFO("Path MTU verso il gateway %s: %d (%d probe).", gateway, result.mtu, result.probes);
+	}
+
+	// Upstream: una route host per chi ha un percorso piu` stretto del gateway
+	for (int i = 0; i < config->num_probes; i++)
+	{
+		bool seen = false;
+		for (int j = 0; j < i; j++)
+		{
+			seen = seen || config->probes[j].address.s_addr == config->probes[i].address.s_addr;
+		}
+		inet_ntop(AF_INET, &config->probes[i].address, target, sizeof(target));
+		if (seen || config->probes[i].address.s_addr == INADDR_ANY || strcmp(target, gateway) == 0)
+		{
+			continue;
+		}
+		rval = probe_path_mtu(device_name, target, route_mtu, actions, &result);
+		if (rval == ETHCANCELLED)
+		{
+			return;
+		}
+		if (rval != ETHNOERR)
+		{
+			LOG_INFO("Path MTU verso %s non verificabile (ICMP filtrato?).", target);
+			continue;
+		}
+		if (result.blackhole > 0)
+		{
+			LOG_ERROR("Black hole PMTU verso %s: datagrammi da %d byte persi senza ICMP frag-needed.", target, result.blackhole);
+		}
+		if (result.mtu < route_mtu)
+		{
+			LOG_INFO("Path MTU verso %s: %d%s, route bloccata.", target, result.mtu, result.icmpMtu > 0 ? " (ICMP frag-needed)" : "");
+			lock_route_mtu(device_name, target, gateway, config, result.mtu);
+		}
+		else
+		{
+			LOG_INFO("Path MTU verso %s: %d (%d probe).", target, result.mtu, result.probes);
+		}
+	}
+}
+
+/**
+ * @brief Una misura del path MTU; le attese degli echo servono l'event loop e si fermano a un nuovo evento del link.
+ */
+int probe_path_mtu(const char* device_name, const char* target, int max_mtu, const t_action_queue* actions, t_pmtu_result* result)
+{
+	int rval;
+
+	if (ethActionSuperseded(actions))
+	{
+		return ETHCANCELLED;
+	}
+	ethPmtuSetWait(wait_pmtu_reply, (void*)actions);
+	rval = ethBackend()->pmtuProbe(device_name, target, max_mtu, 0, result);
+	ethPmtuSetWait(NULL, NULL);
+	if (rval == ETHCANCELLED)
+	{
+		LOG_INFO("Link %s cambiato: misura del path MTU verso %s interrotta.", device_name, target);
+	}
+	return rval;
+}
+
+/**
+ * @brief Attesa della risposta a un echo del path MTU.
+ */
+int wait_pmtu_reply(int fd, long ms, void* data)
+{
+	return wait_reply(fd, ms, NULL, data);
+}
+
+/**
+ * @brief Attesa di una risposta (ARP, probe, echo) dentro l'azione: watchdog, D-Bus ed eventi netlink continuano a girare.
+ *
+ * Termina quando fd (se >= 0) e` leggibile, *done (se non NULL) diventa vero o scadono ms; -1 se l'azione e` superata.
+ */
+int wait_reply(int fd, long ms, const int* done, void* data)
+{
+	const t_action_queue* actions = (const t_action_queue*)data;
+	long long until = evLoopNowMs() + ms;
+	long long now;
+
+	reply_revents = 0;
+	if (fd >= 0 && evLoopAddFd(event_loop, fd, POLLIN, on_reply, NULL) != ETHNOERR)
+	{
+		return 0;
+	}
+	while (reply_revents == 0 && (done == NULL || !*done) && !ethActionSuperseded(actions) && event_loop->running && (now = evLoopNowMs()) < until)
+	{
+		if (evLoopRunOnce(event_loop, (long)(until - now)) != ETHNOERR)
+		{
+			break;
+		}
+	}
+	if (fd >= 0)
+	{
+		evLoopDelFd(event_loop, fd);
+	}
+	return ethActionSuperseded(actions) || !event_loop->running ? -1 : reply_revents;
+}
+
+/**
+ * @brief Il socket atteso ha una risposta (o un errore ICMP in coda).
+ */
+void on_reply(int fd, short revents, void* data)
+{
+	reply_revents = revents;
+}
+
+/**
+ * @brief Rimuove la configurazione di rete (statica o DHCP).
+ */
+void remove_network_config(const char* device_name)
+{
+	char command[128];
+	LOG_INFO("Rimuovo configurazione di rete da %s...\n", device_name);
+
+	// Fine della sorveglianza dei nexthop ECMP (la route sparisce con gli indirizzi)
+	ethEcmpStop(&ecmp);
+
+	// Le voci permanenti dei gateway sopravvivrebbero agli indirizzi (servono anche lo stato salvato)
+	unpin_gateways(device_name, 0);
+
+	// La configurazione salvata non descrive piu` il device
+	if (ethBackend()->real)
+	{
+		ethStateRemove(device_name);
+	}
+
+	// Termina eventuali processi dhclient per l'interfaccia
+	snprintf(command, sizeof(command), "killall dhclient %s", device_name);
+	run_command(command); // Silenzioso
+
+	// Rimuove gli indirizzi IP dall'interfaccia
+	snprintf(command, sizeof(command), "ip addr flush dev %s", device_name);
+	LOG_INFO("CMD: %s\n", command);
+	run_command(command);
+}
+
+
+/**
+ * @brief Riprende la configurazione lasciata da un'istanza precedente senza toccare il device.
+ *
+ * Serve che lo stato salvato corrisponda alla configurazione richiesta e a indirizzi,
+ * default route (e dhclient) presenti nel kernel, e che il gateway risponda.
+ */
+bool adopt_existing_state(const LinkContext* ctx)
+{
+	const char* device_name = ctx->device_name;
+	const StaticNetConfig* config = &ctx->static_config;
+	const char* gateways[ETHROUTE_MAX_NEXTHOPS];
+	const char* reason = NULL;
+	t_persist_state saved;
+	t_kernel_state kernel;
+	t_health_report report;
+
+	if (ethStateLoad(device_name, &saved) != ETHNOERR)
+	{
+		return false; // Primo avvio: nessuno stato
+	}
+
+	if (!is_link_up(device_name))
+	{
+		reason = "link non attivo";
+	}
+	else if ((saved.dhcp != 0) == ctx->use_static_config)
+	{
+		reason = "modalità statica/DHCP cambiata";
+	}
+	else if (ctx->use_static_config && !saved_state_matches(&saved, config))
+	{
+		reason = "configurazione cambiata";
+	}
+	else if (ethStateReadKernel(device_name, &kernel) != ETHNOERR)
+	{
+		reason = "stato del kernel non leggibile";
+	}
+	else if (!ethStateHasAddress(&kernel, saved.address, saved.prefixLen))
+	{
+		reason = "indirizzo assente";
+	}
+	else if (saved.dhcp && !ethStateDhcpClientRunning(device_name))
+	{
+		reason = "dhclient non attivo";
+	}
+	for (int i = 0; reason == NULL && i < saved.nGateways; i++)
+	{
+		if (!ethStateHasGateway(&kernel, saved.gateway[i]))
+		{
+			reason = "default route diversa";
+		}
+		gateways[i] = saved.gateway[i];
+	}
+	if (reason != NULL)
+	{
+		LOG_INFO("Stato salvato di %s non riutilizzabile (%s): configurazione completa.", device_name, reason);
+		if ((saved.dhcp != 0) == ctx->use_static_config || (ctx->use_static_config && !saved_state_matches(&saved, config)))
+		{
+			// La configurazione precedente non e` piu` quella voluta: va tolta
+			remove_network_config(device_name);
+		}
+		return false;
+	}
+
+	// Verifica non intrusiva: ARP dei gateway e probe upstream
+	run_health_check(device_name, gateways, saved.nGateways, config, &ctx->actions, &report);
+	if (report.failed == HEALTH_LINK_FAIL || report.failed == HEALTH_GATEWAY_FAIL)
+	{
+		LOG_INFO("Stato salvato di %s non riutilizzabile (gateway muto): configurazione completa.", device_name);
+		return false;
+	}
+	// Stesso IP ma un altro router (sostituito, VRRP passato al backup): cache e stato sono vecchi.
+	// Con piu` gateway il MAC salvato e` di quello che aveva risposto per primo: si confronta solo con uno
+	if (saved.macKnown && saved.nGateways == 1 && memcmp(saved.gatewayMac, report.gatewayMac, ETHARP_HWADDR_LEN) != 0)
+	{
+		LOG_INFO("Stato salvato di %s non riutilizzabile (gateway %s con un altro MAC): configurazione completa.", device_name, report.gateway);
+		return false;
+	}
+
+	if (ctx->use_static_config && config->num_gateways > 1)
+	{
+		start_ecmp(device_name, config);
+	}
+	LOG_INFO("Configurazione esistente di %s ripresa senza modifiche (%s/%d, gateway %s).", device_name, saved.address, saved.prefixLen, report.gateway);
+	// Gli altri passi del link-up sono idempotenti e non sono nello stato salvato: NIC_*, QUEUE_CPUS,
+	// MTU, ROUTE_* e QDISC possono essere cambiati durante il riavvio, e valgono da subito
+	apply_link_mtu(device_name, config);
+	apply_nic_profile(device_name, config);
+	apply_queue_mapping(device_name, config);
+	apply_qdisc(device_name, config);
+	apply_route_tuning(device_name, config);
+	if (ctx->use_static_config)
+	{
+		warm_neighbors(device_name, config);
+	}
+	verify_path_mtu(device_name, report.gateway, config, &ctx->actions);
+	if (ethActionSuperseded(&ctx->actions))
+	{
+		return true; // Il link e` cambiato: ci pensa l'azione successiva
+	}
+	size_tcp_buffers(device_name, &report, config);
+	strncpy(tcp_monitor.gateway, report.gateway, sizeof(tcp_monitor.gateway) - 1);
+	dna_learn(device_name, &report);
+	save_state(device_name, ctx->use_static_config, config, &report);
+	publish_state(device_name, report.failed == HEALTH_OK ? "connected" : "limited");
+	return true;
+}
+
+/**
+ * @brief Vero se lo stato salvato descrive la configurazione statica richiesta.
+ */
+bool saved_state_matches(const t_persist_state* saved, const StaticNetConfig* config)
+{
+	if (strcmp(saved->address, config->ip_addr) != 0 ||
+	    saved->prefixLen != ethStateNetmaskToPrefix(config->netmask) ||
+	    saved->nGateways != config->num_gateways ||
+	    strcmp(saved->dns1, config->dns1) != 0 ||
+	    strcmp(saved->dns2, config->dns2) != 0)
+	{
+		return false;
+	}
+	for (int i = 0; i < saved->nGateways; i++)
+	{
+		if (strcmp(saved->gateway[i], config->gateways[i]) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Salva la configurazione verificata (indirizzo e gateway letti dal kernel in DHCP).
+ */
+void save_state(const char* device_name, bool use_static_config, const StaticNetConfig* config, const t_health_report* report)
+{
+	t_persist_state st;
+	t_kernel_state kernel;
+
+	if (!ethBackend()->real)
+	{
+		return;
+	}
+	memset(&st, 0, sizeof(st));
+	strncpy(st.deviceName, device_name, sizeof(st.deviceName) - 1);
+	st.dhcp = !use_static_config;
+	if (use_static_config)
+	{
+		strncpy(st.address, config->ip_addr, sizeof(st.address) - 1);
+		st.prefixLen = ethStateNetmaskToPrefix(config->netmask);
+		st.nGateways = config->num_gateways;
+		for (int i = 0; i < config->num_gateways; i++)
+		{
+			strncpy(st.gateway[i], config->gateways[i], GATEWAY_LEN - 1);
+		}
+		strncpy(st.dns1, config->dns1, sizeof(st.dns1) - 1);
+		strncpy(st.dns2, config->dns2, sizeof(st.dns2) - 1);
+	}
+	else
+	{
+		if (ethStateReadKernel(device_name, &kernel) != ETHNOERR || kernel.nAddrs == 0)
+		{
+			LOG_ERROR("Impossibile leggere indirizzo e route di %s: stato non salvato.", device_name);
+			return;
+		}
+		inet_ntop(AF_INET, &kernel.addr[0], st.address, sizeof(st.address));
+		st.prefixLen = kernel.prefixLen[0];
+		st.nGateways = kernel.nGateways;
+		for (int i = 0; i < kernel.nGateways; i++)
+		{
+			inet_ntop(AF_INET, &kernel.gateway[i], st.gateway[i], GATEWAY_LEN);
+		}
+	}
+	if (report->failed != HEALTH_GATEWAY_FAIL && strlen(report->gateway) > 0)
+	{
+		memcpy(st.gatewayMac, report->gatewayMac, ETHARP_HWADDR_LEN);
+		st.macKnown = 1;
+	}
+	st.neighPinned = num_pinned > 0;
+	ethStateSave(&st);
+}
+
+/**
+ * @brief Esegue il parsing del file di configurazione.
+ */
+bool parse_static_config(const char* filename, StaticNetConfig* config)
+{
+	ethNicProfileInit(&config->nic);
+	FILE* fp = fopen(filename, "r");
+	if (!fp) return false;
+
+	char line[MAX_LINE_LEN];
+	while (fgets(line, sizeof(line), fp))
+	{
+		line[strcspn(line, "\n")] = 0;
+
+		char* key = strtok(line, "=");
+		char* value = strtok(NULL, "");
+
 		if (key && value)
 		{
 			while (*value == ' ' || *value == '\t')
@@ -429,12 +2279,490 @@ bool parse_static_config(const char* filename, StaticNetConfig* config)
 			
 			if (strcmp(key, "IP_ADDR") == 0) strncpy(config->ip_addr, value, MAX_LINE_LEN - 1);
 			else if (strcmp(key, "NETMASK") == 0) strncpy(config->netmask, value, MAX_LINE_LEN - 1);
-			else if (strcmp(key, "GATEWAY") == 0) strncpy(config->gateway, value, MAX_LINE_LEN - 1);
+			else if (strcmp(key, "GATEWAY") == 0) parse_gateway(config, value);
 			else if (strcmp(key, "DNS1") == 0) strncpy(config->dns1, value, MAX_LINE_LEN - 1);
 			else if (strcmp(key, "DNS2") == 0) strncpy(config->dns2, value, MAX_LINE_LEN - 1);
+			else if (strcmp(key, "PROBE") == 0) parse_probe(config, value);
+			else if (strcmp(key, "PROBE_TIMEOUT") == 0) config->probe_timeout_ms = atoi(value);
+			else if (strncmp(key, "NIC_", 4) == 0 && ethNicProfileSet(&config->nic, key + 4, value) != ETHNOERR)
+			{
+				LOG_ERROR("%s non valido: '%s' ignorato.", key, value);
+			}
+			else if (strncmp(key, "ROUTE_", 6) == 0 && ethRouteMetricsSet(&config->route_metrics, key + 6, value) != ETHNOERR)
+			{
+				LOG_ERROR("%s non valido: '%s' ignorato.", key, value);
+			}
+			else if (strcmp(key, "TCP_BUFFERS") == 0) config->tcp_buffers = strcmp(value, "auto") == 0;
+			else if (strcmp(key, "TCP_MONITOR") == 0) config->tcp_monitor_ms = atoi(value);
+			else if (strcmp(key, "TCP_MONITOR_MAX_RTT") == 0) config->tcp_monitor_max_rtt = atof(value);
+			else if (strcmp(key, "TCP_MONITOR_MAX_RETRANS") == 0) config->tcp_monitor_max_retrans = atof(value);
+			else if (strcmp(key, "DNS_MONITOR") == 0) config->dns_monitor_ms = atoi(value);
+			else if (strcmp(key, "DNS_MONITOR_NAME") == 0) strncpy(config->dns_monitor_name, value, sizeof(config->dns_monitor_name) - 1);
+			else if (strcmp(key, "STATS_INTERVAL") == 0) config->stats_interval_ms = atoi(value);
+			else if (strcmp(key, "STATS_IFACES") == 0) strncpy(config->stats_ifaces, value, sizeof(config->stats_ifaces) - 1);
+			else if (strcmp(key, "LINK_MIN_SPEED") == 0) config->link_min_speed = atoi(value);
+			else if (strcmp(key, "LINK_RENEGOTIATE") == 0) config->link_renegotiate = strcmp(value, "on") == 0;
+			else if (strcmp(key, "ARP_ANNOUNCE") == 0) config->no_arp_announce = strcmp(value, "off") == 0;
+			else if (strcmp(key, "NEIGH_PRERESOLVE") == 0) config->no_neigh_preresolve = strcmp(value, "off") == 0;
+			else if (strcmp(key, "NEIGH_PIN_GATEWAY") == 0) config->neigh_pin_gateway = strcmp(value, "on") == 0;
+			else if (strcmp(key, "QDISC") == 0 && ethQdiscParse(value, &config->qdisc) != ETHNOERR)
+			{
+				LOG_ERROR("QDISC non valida: '%s' ignorata.", value);
+				memset(&config->qdisc, 0, sizeof(config->qdisc));
+			}
+			else if (strcmp(key, "MTU") == 0)
+			{
+				config->mtu = atoi(value);
+				if (config->mtu < MTU_MIN || config->mtu > MTU_MAX)
+				{
+					LOG_ERROR("MTU non valida: '%s' ignorata (%d-%d).", value, MTU_MIN, MTU_MAX);
+					config->mtu = 0;
+				}
+			}
+			else if (strcmp(key, "PMTU_PROBE") == 0) config->pmtu_probe = strcmp(value, "on") == 0 ? 1 : (strcmp(value, "off") == 0 ? -1 : 0);
+			else if (strcmp(key, "QUEUE_CPUS") == 0)
+			{
+				// "auto": tutti i core online (del nodo NUMA della scheda)
+				memset(&config->queue_cpus, 0, sizeof(config->queue_cpus));
+				config->queue_mapping = strcmp(value, "auto") == 0 ||
+					ethQueueParseCpus(value, &config->queue_cpus) == ETHNOERR;
+				if (!config->queue_mapping)
+				{
+					LOG_ERROR("QUEUE_CPUS non valido: '%s' ignorato.", value);
+				}
+			}
 		}
 	}
 
 	fclose(fp);
 	return true;
 }
+
+/**
+ * @brief Aggiunge un probe upstream nel formato "tipo indirizzo[:porta] [argomento]".
+ */
+void parse_probe(StaticNetConfig* config, const char* value)
+{
+	if (config->num_probes >= PROBE_MAX)
+	{
+		LOG_ERROR("Troppi PROBE (massimo %d): '%s' ignorato.", PROBE_MAX, value);
+		return;
+	}
+	if (ethProbeParse(value, &config->probes[config->num_probes]) != ETHNOERR)
+	{
+		LOG_ERROR("PROBE non valido: '%s' ignorato.", value);
+		return;
+	}
+	config->num_probes++;
+}
+
+/**
+ * @brief Senza PROBE= si usa il ping dei DNS pubblici; applica PROBE_TIMEOUT a tutti i probe.
+ */
+void default_probes(StaticNetConfig* config)
+{
+	if (config->num_probes == 0)
+	{
+		parse_probe(config, "icmp 8.8.8.8");
+		parse_probe(config, "icmp 1.1.1.1");
+	}
+	for (int i = 0; i < config->num_probes; i++)
+	{
+		if (config->probe_timeout_ms > 0)
+		{
+			config->probes[i].timeoutMs = config->probe_timeout_ms;
+		}
+	}
+}
+
+/**
+ * @brief Aggiunge un gateway nel formato "indirizzo[,peso]" (peso 1-256, default 1).
+ */
+void parse_gateway(StaticNetConfig* config, char* value)
+{
+	int weight = 1;
+	char* sep = strchr(value, ',');
+
+	if (config->num_gateways >= ETHROUTE_MAX_NEXTHOPS)
+	{
+		LOG_ERROR("Troppi GATEWAY (massimo %d): '%s' ignorato.", ETHROUTE_MAX_NEXTHOPS, value);
+		return;
+	}
+	if (sep != NULL)
+	{
+		*sep = '\0';
+		weight = atoi(sep + 1);
+		if (weight < 1 || weight > 256)
+		{
+			LOG_ERROR("Peso non valido per il gateway %s: uso 1.", value);
+			weight = 1;
+		}
+	}
+
+	strncpy(config->gateways[config->num_gateways], value, IPv4ADDR_LEN - 1);
+	config->gateway_weights[config->num_gateways] = weight;
+	if (config->num_gateways == 0)
+	{
+		strncpy(config->gateway, value, MAX_LINE_LEN - 1);
+	}
+	config->num_gateways++;
+}
+
+/**
+ * @brief Esegue un comando di configurazione tramite il backend; con quello finto lo conta.
+ */
+int run_command(const char* command)
+{
+	if (!ethBackend()->real)
+	{
+		replay_stats.commands++;
+	}
+	return ethBackend()->command(command);
+}
+
+/**
+ * @brief Verifica a strati tramite il backend, servendo l'event loop durante le attese; l'esito va nella traccia.
+ */
+void run_health_check(const char* device_name, const char** gateways, int num_gateways, const StaticNetConfig* config, const t_action_queue* actions, t_health_report* report)
+{
+	ethHealthSetWait(event_loop, wait_reply, (void*)actions);
+	ethBackend()->health(device_name, gateways, num_gateways, config->probes, config->num_probes, report);
+	ethHealthSetWait(NULL, NULL, NULL);
+	ethTraceRecord(ETHTRACE_HEALTH, report, sizeof(t_health_report));
+}
+
+/**
+ * @brief Registra una decisione (azione servita, stato pubblicato); nel replay la confronta con quella registrata.
+ *
+ * Azioni e stati si confrontano ciascuno nel proprio ordine: si segnala solo la prima divergenza.
+ */
+void trace_decision(t_trace_type type, const void* data, int len)
+{
+	long* pos = type == ETHTRACE_ACTION ? &replay_action_pos : &replay_state_pos;
+	const t_trace_rec* rec;
+
+	ethTraceRecord(type, data, len);
+	if (!replay_compare)
+	{
+		return;
+	}
+	rec = ethTraceNextOfType(&replay_trace, pos, type);
+	if (rec != NULL && rec->len == (uint32_t)len && memcmp(ethTracePayload(rec), data, len) == 0)
+	{
+		return;
+	}
+	if (replay_stats.divergences++ > 0)
+	{
+		return;
+	}
+	if (type == ETHTRACE_ACTION)
+	{
+		LOG_ERROR("Replay divergente a %lld ms: azione %d, registrata %d.", evLoopNowMs(), *(const int*)data,
+			rec != NULL && rec->len == sizeof(int) ? *(const int*)ethTracePayload(rec) : 0);
+	}
+	else
+	{
+		LOG_ERROR("Replay divergente a %lld ms: stato '%s', registrato '%s'.", evLoopNowMs(), (const char*)data,
+			rec != NULL ? (const char*)ethTracePayload(rec) : "-");
+	}
+}
+
+/**
+ * @brief Verifica a strati del replay: l'esito viene dalla traccia.
+ */
+int replay_health(const char* device_name, const char* const* gateways, int num_gateways, const t_probe* probes, int num_probes, t_health_report* report)
+{
+	const t_trace_rec* rec = ethTraceNextOfType(&replay_trace, &replay_health_pos, ETHTRACE_HEALTH);
+	if (rec != NULL && rec->len == sizeof(t_health_report))
+	{
+		memcpy(report, ethTracePayload(rec), sizeof(t_health_report));
+		return ETHNOERR;
+	}
+	// Le decisioni hanno preso un'altra strada rispetto alla registrazione
+	memset(report, 0, sizeof(t_health_report));
+	report->failed = HEALTH_LINK_FAIL;
+	replay_stats.health_missing++;
+	return ETHNOERR;
+}
+
+/**
+ * @brief ARP unicast del fast path DNA nel replay: l'esito viene dalla traccia.
+ */
+int replay_arp_probe(const char* device, const char* target, const unsigned char* target_mac, unsigned char* reply_mac, int timeout_ms)
+{
+	const t_trace_rec* rec = ethTraceNextOfType(&replay_trace, &replay_arp_pos, ETHTRACE_ARP);
+	if (rec != NULL && rec->len == sizeof(DnaProbe))
+	{
+		const DnaProbe* probe = (const DnaProbe*)ethTracePayload(rec);
+		memcpy(reply_mac, probe->reply_mac, ETHARP_HWADDR_LEN);
+		return probe->rval;
+	}
+	replay_stats.health_missing++;
+	return ETHARPERR;
+}
+
+/**
+ * @brief Clock virtuale del replay: consegna i messaggi netlink della traccia fino a until_ms.
+ */
+void on_replay_advance(t_evloop* loop, long long until_ms, void* data)
+{
+	const t_trace_rec* rec;
+
+	// Esiti delle verifiche: li consumano le azioni; timer: rigenerati dall'event loop
+	while ((rec = ethTracePeek(&replay_trace)) != NULL && rec->type != ETHTRACE_NETLINK)
+	{
+		if (rec->type == ETHTRACE_TIMER)
+		{
+			replay_stats.timers++;
+		}
+		ethTraceNext(&replay_trace);
+	}
+	if (rec == NULL)
+	{
+		// Traccia finita: si lasciano scadere i timer fino all'ultimo record, poi ci si ferma
+		if (until_ms >= 0 && until_ms <= replay_end_ms)
+		{
+			evLoopSetTime(until_ms);
+		}
+		else
+		{
+			evLoopSetTime(replay_end_ms);
+			evLoopStop(loop);
+		}
+		return;
+	}
+
+	long long at = rec->usec / 1000;
+	if (until_ms >= 0 && at > until_ms)
+	{
+		evLoopSetTime(until_ms);
+		return;
+	}
+	evLoopSetTime(at);
+	// Tutti i messaggi dello stesso millisecondo, come in una recv() dal kernel
+	while ((rec = ethTracePeek(&replay_trace)) != NULL && rec->usec / 1000 == at)
+	{
+		if (rec->type == ETHTRACE_NETLINK)
+		{
+			ethIfTableHandleMsg(&iface_table, (struct nlmsghdr*)ethTracePayload(rec));
+			replay_stats.events++;
+		}
+		ethTraceNext(&replay_trace);
+	}
+	(void)data;
+}
+
+/**
+ * @brief Rigioca una traccia registrata con --trace contro un kernel finto, a piena velocita`.
+ */
+int run_replay(const char* device_name, const char* config_file, const char* trace_file)
+{
+	static t_evloop loop;
+	static LinkContext ctx = {0};
+	static char recorded_device[DEVICENAME_LEN];
+	const t_trace_rec* rec;
+	struct timespec cpu_start;
+
+	if (ethTraceLoad(&replay_trace, trace_file) != ETHNOERR)
+	{
+		LOG_ERROR("Impossibile leggere la traccia '%s'.", trace_file);
+		return EXIT_FAILURE;
+	}
+	// Simulatore senza latenze ne' guasti: conta i comandi, le verifiche vengono dalla traccia
+	replay_backend = *ethSimBackend();
+	replay_backend.name = "replay";
+	replay_backend.health = replay_health;
+	replay_backend.arpProbe = replay_arp_probe;
+	ethSimParse(ethSim(), "cmd=0,dhcp=0,arp=0,health=0,cmdfail=0,dhcpfail=0,gwfail=0,upfail=0");
+	ethBackendSet(&replay_backend);
+	// Fast path DNA solo se la traccia ne ha gli ARP (registrata senza -n, o piu` recente)
+	dna_enabled = ethTraceNextOfType(&replay_trace, &replay_arp_pos, ETHTRACE_ARP) != NULL;
+	replay_arp_pos = 0;
+	// Tracce registrate prima delle decisioni: solo statistiche
+	replay_compare = ethTraceNextOfType(&replay_trace, &replay_action_pos, ETHTRACE_ACTION) != NULL;
+	replay_action_pos = 0;
+	t_trace_reader end = replay_trace;
+	while ((rec = ethTraceNext(&end)) != NULL)
+	{
+		replay_end_ms = rec->usec / 1000;
+	}
+	if (!replay_compare)
+	{
+		LOG_INFO("Traccia '%s' senza decisioni registrate: nessun confronto.", trace_file);
+	}
+	evLoopInit(&loop);
+	event_loop = &loop;
+
+	ctx.loop = &loop;
+	bool config_found = parse_static_config(config_file, &ctx.static_config);
+	ctx.use_static_config = config_found && ctx.static_config.ip_addr[0] != '\0';
+	default_probes(&ctx.static_config);
+
+	// Avvio: il dump registrato riempie la tabella fino al record START
+	ethIfTableInit(&iface_table);
+	while ((rec = ethTraceNext(&replay_trace)) != NULL && rec->type != ETHTRACE_START)
+	{
+		if (rec->type == ETHTRACE_NETLINK)
+		{
+			ethIfTableHandleMsg(&iface_table, (struct nlmsghdr*)ethTracePayload(rec));
+		}
+	}
+	if (rec == NULL)
+	{
+		LOG_ERROR("Traccia '%s' senza avvio registrato.", trace_file);
+		ethIfTableFree(&iface_table);
+		ethTraceFree(&replay_trace);
+		return EXIT_FAILURE;
+	}
+	strncpy(recorded_device, (const char*)ethTracePayload(rec), sizeof(recorded_device) - 1);
+	if (strcmp(recorded_device, device_name) != 0)
+	{
+		LOG_INFO("Device registrato nella traccia: %s (ignorato '%s').", recorded_device, device_name);
+	}
+	ctx.device_name = recorded_device;
+
+	t_iface* iface = ethIfTableLookupName(&iface_table, recorded_device);
+	if (iface == NULL)
+	{
+		LOG_ERROR("Interfaccia '%s' assente dal dump registrato.", recorded_device);
+		ethIfTableFree(&iface_table);
+		ethTraceFree(&replay_trace);
+		return EXIT_FAILURE;
+	}
+	ctx.ifindex = iface->ifindex;
+	iface_table.onEvent = on_iface_event;
+	iface_table.cbData = &ctx;
+	ethActionInit(&ctx.actions, &loop, on_link_action, &ctx);
+	evLoopSetVirtual(&loop, rec->usec / 1000, on_replay_advance, &ctx);
+
+	LOG_INFO("Replay di %d record da '%s' (device %s, ifindex %d).", replay_trace.nRecords, trace_file, recorded_device, ctx.ifindex);
+	long long start_ms = evLoopNowMs();
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+	ethActionSubmit(&ctx.actions, is_link_up(recorded_device) ? ETHSTATEUP : ETHSTATEDOWN);
+	evLoopRun(&loop);
+
+	// Decisioni registrate che il replay non ha preso
+	while (replay_compare &&
+		(ethTraceNextOfType(&replay_trace, &replay_action_pos, ETHTRACE_ACTION) != NULL ||
+		 ethTraceNextOfType(&replay_trace, &replay_state_pos, ETHTRACE_STATE) != NULL))
+	{
+		replay_stats.divergences++;
+	}
+
+	print_run_stats("Replay", start_ms, &cpu_start, &ctx.actions);
+	LOG_INFO("Replay: %ld timer registrati, %ld verifiche senza esito.", replay_stats.timers, replay_stats.health_missing);
+
+	ethIfTableFree(&iface_table);
+	ethTraceFree(&replay_trace);
+	if (replay_stats.divergences > 0 || replay_stats.health_missing > 0)
+	{
+		LOG_ERROR("Replay non fedele alla traccia: %ld decisioni divergenti, %ld verifiche senza esito.", replay_stats.divergences, replay_stats.health_missing);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Riepilogo di replay e simulazione: eventi, tempo virtuale, CPU, azioni e comandi.
+ */
+void print_run_stats(const char* what, long long start_ms, const struct timespec* cpu_start, const t_action_queue* actions)
+{
+	struct timespec cpu_end;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+	double cpu_us = (cpu_end.tv_sec - cpu_start->tv_sec) * 1e6 + (cpu_end.tv_nsec - cpu_start->tv_nsec) / 1e3;
+	LOG_INFO("%s: %ld eventi netlink in %lld ms virtuali, CPU %.0f us (%.2f us/evento).", what, replay_stats.events, evLoopNowMs() - start_ms, cpu_us, replay_stats.events > 0 ? cpu_us / replay_stats.events : 0.0);
+	LOG_INFO("%s: %ld azioni (%d interrotte), %ld comandi, %ld cambi di stato.", what, replay_stats.actions, actions->superseded, replay_stats.commands, replay_stats.publishes);
+}
+
+/**
+ * @brief Clock virtuale della simulazione: consegna gli eventi di link del generatore fino a until_ms.
+ */
+void on_sim_advance(t_evloop* loop, long long until_ms, void* data)
+{
+	t_sim* sim = ethSim();
+	t_nl_msg msg;
+
+	if (sim->nextUs < 0)
+	{
+		// Eventi finiti: si lasciano scadere i timer per SIM_DRAIN_MS al massimo, poi ci si ferma
+		if (sim_drain_since < 0)
+		{
+			sim_drain_since = evLoopNowMs();
+		}
+		if (until_ms >= 0 && until_ms - sim_drain_since <= SIM_DRAIN_MS)
+		{
+			evLoopSetTime(until_ms);
+		}
+		else
+		{
+			evLoopStop(loop);
+		}
+		return;
+	}
+
+	long long at = sim->nextUs / 1000;
+	if (until_ms >= 0 && at > until_ms)
+	{
+		evLoopSetTime(until_ms);
+		return;
+	}
+	evLoopSetTime(at);
+	// Tutti gli eventi dello stesso millisecondo, come in una recv() dal kernel
+	while (sim->nextUs >= 0 && sim->nextUs / 1000 <= at)
+	{
+		ethIfTableHandleMsg(&iface_table, ethSimNextEvent(sim, &msg));
+		replay_stats.events++;
+	}
+	(void)data;
+}
+
+/**
+ * @brief Esegue il control plane contro il backend simulato (device, DHCP, gateway finti) a tempo virtuale.
+ */
+int run_simulation(const char* device_name, const char* config_file, const char* spec)
+{
+	static t_evloop loop;
+	static LinkContext ctx = {0};
+	const int SIM_IFINDEX = 2;
+	t_sim* sim = ethSim();
+	t_nl_msg msg;
+	struct timespec cpu_start;
+
+	if (ethSimParse(sim, spec) != ETHNOERR)
+	{
+		LOG_ERROR("Parametri di simulazione non validi: '%s'.", spec);
+		return EXIT_FAILURE;
+	}
+	ethBackendSet(ethSimBackend());
+	evLoopInit(&loop);
+	event_loop = &loop;
+
+	ctx.loop = &loop;
+	ctx.device_name = device_name;
+	bool config_found = parse_static_config(config_file, &ctx.static_config);
+	ctx.use_static_config = config_found && ctx.static_config.ip_addr[0] != '\0';
+	default_probes(&ctx.static_config);
+
+	// Il "dump" iniziale e` lo stato del device finto
+	ethSimStart(sim, device_name, SIM_IFINDEX, 0);
+	ethIfTableInit(&iface_table);
+	ethIfTableHandleMsg(&iface_table, ethSimLinkMsg(sim, &msg));
+	ctx.ifindex = SIM_IFINDEX;
+	iface_table.onEvent = on_iface_event;
+	iface_table.cbData = &ctx;
+	ethActionInit(&ctx.actions, &loop, on_link_action, &ctx);
+	evLoopSetVirtual(&loop, 0, on_sim_advance, &ctx);
+
+	LOG_INFO("Simulazione su %s: %ld eventi di link a %ld/s (seme %u).", device_name, sim->events, sim->rate, sim->seed);
+	long long start_ms = evLoopNowMs();
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+	ethActionSubmit(&ctx.actions, is_link_up(device_name) ? ETHSTATEUP : ETHSTATEDOWN);
+	evLoopRun(&loop);
+
+	print_run_stats("Simulazione", start_ms, &cpu_start, &ctx.actions);
+	LOG_INFO("Simulazione: %ld comandi al backend, %ld verifiche, %ld guasti iniettati.", sim->commands, sim->healthChecks, sim->failures);
+
+	ethIfTableFree(&iface_table);
+	return EXIT_SUCCESS;
+}